@@ -0,0 +1,71 @@
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include <string>
+#include <functional>
+#include <vector>
+
+namespace Bench
+{
+    struct Case
+    {
+        std::string name;
+        std::string description;
+        std::function<int()> run;
+    };
+
+    /**
+     * Opens a pseudo-terminal pair. Returns the master fd and stores the path of the slave end,
+     * which can be handed to SerialPi as if it were /dev/ttyS0.
+     */
+    int open_pty(std::string &slave_path);
+
+    // Allocations through operator new since the start of the process
+    unsigned long allocations();
+
+    // Record a result of the case running, e.g. metric("sms.pdus_per_s", 1.2e6), for the report --json writes
+    void metric(const std::string &name, double value);
+
+    // Reading modem output from a pty: one poll()+read() per byte versus the SerialPi receive ring
+    int serial_read();
+
+    // Sending AT+CMGS and its PDU: asprintf()+write() and a write() per byte versus SerialPi::writeVector
+    int serial_write();
+
+    // Splitting megabytes of modem output into lines: ostringstream per byte versus LineFramer
+    int line_framer();
+
+    // Recognising unsolicited result codes: chained find() calls versus the constexpr UrcTable
+    int urc_dispatch();
+
+    // Throughput and reply correlation of ATEngine against the simulator at several pipeline depths
+    int at_pipeline();
+
+    // Encoding and decoding 27.010 frames, and a front-end query beside a long AT+CMGL on its own DLC
+    int cmux();
+
+    // Decoding SMS-DELIVER PDUs: substr/stoi and strings per field versus PduDecoder over a string_view
+    int pdu_decode();
+
+    // Unpacking GSM 7-bit text and mapping it to UTF-8: septet by septet versus 16 at a time with SSSE3/NEON
+    int gsm7();
+
+    // UCS-2 user data to UTF-8: a push_back per byte, unit by unit, and 8 units at a time with SSSE3/NEON
+    int utf16();
+
+    // Putting concatenated messages together from parts out of order, behind one lock versus per shard
+    int reassembly();
+
+    // Journaling the parts of long messages: recovery after a crash, and a sync per part versus per drain
+    int journal();
+
+    // The PDU corpus (bench/corpus/pdus.txt): PDUs/s, ns/byte, allocations and peak RSS of SMS(pdu), reassembly
+    // and email formatting
+    int pdu_suite();
+
+    // Sending SMS-SUBMITs through AT+CMGS: messages/min one at a time versus queued under AT+CMMS, and the
+    // encoder against the decoder
+    int sms_send();
+}
+
+#endif // BENCH_HPP
@@ -0,0 +1,39 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "bench.hpp"
+
+namespace
+{
+    // Every allocation of the process, to tell how many a decode costs; an atomic add on each
+    std::atomic<unsigned long> allocated{0};
+}
+
+void *operator new(std::size_t size)
+{
+    allocated.fetch_add(1, std::memory_order_relaxed);
+    if (void *block = std::malloc(size == 0 ? 1 : size))
+    {
+        return block;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *block) noexcept
+{
+    std::free(block);
+}
+
+void operator delete(void *block, std::size_t) noexcept
+{
+    std::free(block);
+}
+
+namespace Bench
+{
+    unsigned long allocations()
+    {
+        return allocated.load(std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,224 @@
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <sys/epoll.h>
+
+#include "bench.hpp"
+#include "serial.hpp"
+#include "reactor.hpp"
+#include "at_engine.hpp"
+#include "line_framer.hpp"
+#include "modem_sim.hpp"
+#include "urc.hpp"
+
+using namespace std::literals::chrono_literals;
+
+namespace
+{
+    const std::string stored_pdu = "07911326040000F0040B911346610089F60000208062917314080CC8F71D14969741F977FD07";
+    constexpr unsigned int STORED = 10;
+    constexpr unsigned long COMMANDS = 400;
+    // One reply every few milliseconds on a 115200 baud link behind a USB bridge
+    constexpr auto LATENCY = 4ms;
+    constexpr auto URC_INTERVAL = 3ms;
+
+    struct Result
+    {
+        unsigned long completed = 0;
+        unsigned long misattributed = 0;
+        unsigned long urcs = 0;
+        double seconds = 0;
+    };
+
+    // The commands cycle through queries whose information responses name the command they answer
+    std::string command_of(unsigned long idx, std::string &expected)
+    {
+        switch (idx % 4)
+        {
+        case 0:
+            expected = "+CSQ:";
+            return "AT+CSQ";
+        case 1:
+            expected = "+CMGR:";
+            return "AT+CMGR=" + std::to_string(idx / 4 % STORED);
+        case 2:
+            expected = "+COPS:";
+            return "AT+COPS?";
+        default:
+            expected = "+CREG:";
+            return "AT+CREG?";
+        }
+    }
+
+    Result run(unsigned int depth)
+    {
+        ModemSimulator::Options options;
+        options.latency = LATENCY;
+        ModemSimulator modem(options);
+        for (unsigned int idx = 0; idx < STORED; idx++) modem.store_sms(stored_pdu);
+        std::thread modem_thread([&modem]()
+                                 { modem.run(); });
+        std::atomic<bool> raising{true};
+        std::thread urc_thread;
+
+        Result result;
+        {
+            SerialPi serial(modem.device().c_str());
+            serial.begin(115200);
+            // unsolicited results land between the replies as they would from the network, once both ends
+            // agree on the rate
+            urc_thread = std::thread([&modem, &raising]()
+                                     {
+                                         for (unsigned long idx = 0; raising; idx++)
+                                         {
+                                             if (idx % 2) modem.ring("+8613800138000");
+                                             else modem.emit("+CMTI: \"SM\",3");
+                                             std::this_thread::sleep_for(URC_INTERVAL);
+                                         } });
+            Reactor reactor;
+            ATEngine engine(serial, reactor, depth);
+            LineFramer framer;
+            reactor.add(serial.fileDescriptor(), EPOLLIN, "serial", [&](uint32_t events)
+                        {
+                            if (events & EPOLLOUT) engine.output_ready();
+                            int length;
+                            while ((length = serial.readChunk(framer.space(), framer.space_size(), 0)) > 0)
+                            {
+                                framer.commit(length);
+                                for (std::string_view line; framer.next(line);)
+                                {
+                                    if (line.rfind("+CMTI:", 0) == 0 || line == "RING" || line.rfind("+CLIP:", 0) == 0) ++result.urcs;
+                                    else engine.consume(line);
+                                }
+                            } });
+
+            // silence the per-command log lines of the engine while measuring
+            auto *log_buffer = std::cout.rdbuf(nullptr);
+            auto *error_buffer = std::cerr.rdbuf(nullptr);
+            const auto start = std::chrono::steady_clock::now();
+            for (unsigned long idx = 0; idx < COMMANDS; idx++)
+            {
+                std::string expected;
+                auto command = command_of(idx, expected);
+                engine.submit(std::move(command), 2000ms, [&result, expected](const ATEngine::Result &reply)
+                              {
+                                  ++result.completed;
+                                  if (!reply.ok() || reply.response.rfind(expected, 0) != 0) ++result.misattributed; });
+            }
+            while (result.completed < COMMANDS)
+            {
+                reactor.run_once(100);
+            }
+            result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cout.rdbuf(log_buffer);
+            std::cerr.rdbuf(error_buffer);
+            serial.end();
+        }
+        raising = false;
+        urc_thread.join();
+        modem.stop();
+        modem_thread.join();
+        return result;
+    }
+
+    constexpr auto URCS = make_urc_table<bool>(SERVICE_URCS, [](std::string_view)
+                                               { return true; });
+
+    /**
+     * A dropped call's NO CARRIER while AT+CMGL drains storage, with AT+CSQ written behind it: it is an
+     * unsolicited result, as Modem::line_handler() tells them, and both commands keep their own replies
+     */
+    int no_carrier_while_listing()
+    {
+        ModemSimulator::Options options;
+        options.latency = 1ms;
+        options.command_latency["+CMGL"] = 50ms;
+        ModemSimulator modem(options);
+        for (unsigned int idx = 0; idx < STORED; idx++) modem.store_sms(stored_pdu);
+        std::thread modem_thread([&modem]()
+                                 { modem.run(); });
+
+        unsigned long urcs = 0;
+        ATEngine::Result listed;
+        ATEngine::Result quality;
+        unsigned int completed = 0;
+        {
+            SerialPi serial(modem.device().c_str());
+            serial.begin(115200);
+            Reactor reactor;
+            ATEngine engine(serial, reactor, 2);
+            LineFramer framer;
+            reactor.add(serial.fileDescriptor(), EPOLLIN, "serial", [&](uint32_t events)
+                        {
+                            if (events & EPOLLOUT) engine.output_ready();
+                            int length;
+                            while ((length = serial.readChunk(framer.space(), framer.space_size(), 0)) > 0)
+                            {
+                                framer.commit(length);
+                                for (std::string_view line; framer.next(line);)
+                                {
+                                    if (const auto *urc = URCS.find(line); urc != nullptr && !engine.claims(urc->name)) ++urcs;
+                                    else engine.consume(line);
+                                }
+                            } });
+
+            auto *log_buffer = std::cout.rdbuf(nullptr);
+            // the call drops as the commands go out: NO CARRIER is on its way while they are in flight
+            modem.emit("NO CARRIER");
+            std::this_thread::sleep_for(20ms);
+            engine.submit("AT+CMGL=4", 2000ms, [&](const ATEngine::Result &reply)
+                          { listed = reply; ++completed; });
+            engine.submit("AT+CSQ", 2000ms, [&](const ATEngine::Result &reply)
+                          { quality = reply; ++completed; });
+            while (completed < 2)
+            {
+                reactor.run_once(100);
+            }
+            std::cout.rdbuf(log_buffer);
+            serial.end();
+        }
+        modem.stop();
+        modem_thread.join();
+
+        if (urcs != 1 || !listed.ok() || listed.response.rfind("+CMGL:", 0) != 0 || !quality.ok() ||
+            quality.response.rfind("+CSQ:", 0) != 0)
+        {
+            std::cerr << "	NO CARRIER during AT+CMGL=4: " << urcs << " URCs, AT+CMGL=4 "
+                      << (listed.ok() ? "OK" : "failed") << ", AT+CSQ answered \"" << quality.response << "\""
+                      << std::endl;
+            return 1;
+        }
+        std::cout << "	NO CARRIER during AT+CMGL=4 taken as unsolicited, both replies where they belong" << std::endl;
+        return 0;
+    }
+}
+
+namespace Bench
+{
+    int at_pipeline()
+    {
+        if (no_carrier_while_listing() != 0)
+        {
+            return 1;
+        }
+        std::cout << "\t" << COMMANDS << " queries (+CSQ, +CMGR, +COPS?, +CREG?) against the simulator, "
+                  << LATENCY.count() << " ms per reply, a URC every " << URC_INTERVAL.count() << " ms" << std::endl;
+        double serial_seconds = 0;
+        for (unsigned int depth : {1u, 2u, 4u, 8u})
+        {
+            const auto result = run(depth);
+            if (depth == 1) serial_seconds = result.seconds;
+            std::cout << "\tdepth " << depth << ": " << result.completed / result.seconds << " commands/s, "
+                      << result.misattributed << " misattributed, " << result.urcs << " URCs in between, "
+                      << serial_seconds / result.seconds << "x" << std::endl;
+            if (result.misattributed != 0)
+            {
+                return 1;
+            }
+        }
+        return 0;
+    }
+}
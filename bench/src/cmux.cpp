@@ -0,0 +1,226 @@
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <sys/epoll.h>
+
+#include "bench.hpp"
+#include "serial.hpp"
+#include "reactor.hpp"
+#include "at_engine.hpp"
+#include "line_framer.hpp"
+#include "cmux.hpp"
+#include "multiplexer.hpp"
+#include "modem_sim.hpp"
+
+using namespace std::literals::chrono_literals;
+
+namespace
+{
+    constexpr unsigned long FRAMES = 200000;
+    // one frame in this many gets its control byte flipped on the wire
+    constexpr unsigned long CORRUPT_EVERY = 1000;
+    constexpr unsigned int ROUNDS = 10;
+    constexpr auto LIST_LATENCY = 200ms;
+
+    // The FCS bit by bit, as 27.010 describes it, for comparison with the table
+    uint8_t bitwise_fcs(const uint8_t *data, std::size_t length)
+    {
+        uint8_t crc = 0xFF;
+        for (std::size_t idx = 0; idx < length; idx++)
+        {
+            crc ^= data[idx];
+            for (int bit = 0; bit < 8; bit++)
+            {
+                crc = (crc & 1) ? (crc >> 1) ^ 0xE0 : crc >> 1;
+            }
+        }
+        return 0xFF - crc;
+    }
+
+    int codec()
+    {
+        // the SABM on DLC 0 every 27.010 host starts with
+        if (Cmux::frame(0, Cmux::SABM, true, {}, true) != std::string("\xF9\x03\x3F\x01\x1C\xF9", 6))
+        {
+            std::cerr << "\tSABM on DLC 0 is not F9 03 3F 01 1C F9" << std::endl;
+            return 1;
+        }
+
+        // what a modem sends: AT replies, URCs and PDUs in UIH frames of up to 31 bytes on DLCs 1..3
+        const std::string text = "\r\n+CMGR: 0,,24\r\n07911326040000F0040B911346610089F60000208062917314080CC8F71D14969741F977FD07\r\n\r\nOK\r\n";
+        std::string stream;
+        stream.reserve(FRAMES * (31 + Cmux::OVERHEAD));
+        uint8_t frame[31 + Cmux::OVERHEAD];
+        std::size_t payload = 0;
+        unsigned long corrupted = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned long idx = 0; idx < FRAMES; idx++)
+        {
+            const auto offset = idx * 7 % (text.size() - 31);
+            const auto info = std::string_view(text).substr(offset, 1 + idx % 31);
+            const auto length = Cmux::encode(frame, 1 + idx % 3, Cmux::UIH, false, info);
+            if (idx % CORRUPT_EVERY == CORRUPT_EVERY - 1)
+            {
+                frame[2] ^= 0x04;
+                corrupted++;
+            }
+            else
+            {
+                payload += info.size();
+            }
+            stream.append(reinterpret_cast<const char *>(frame), length);
+        }
+        const double encode_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        CmuxDecoder decoder;
+        std::size_t decoded_payload = 0;
+        unsigned long decoded = 0;
+        start = std::chrono::steady_clock::now();
+        // in the chunks a UART read hands over
+        for (std::size_t at = 0; at < stream.size(); at += 64)
+        {
+            decoder.feed(stream.data() + at, std::min<std::size_t>(64, stream.size() - at));
+            for (Cmux::Frame each; decoder.next(each);)
+            {
+                decoded++;
+                decoded_payload += each.info.size();
+            }
+        }
+        const double decode_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        const auto *bytes = reinterpret_cast<const uint8_t *>(stream.data());
+        uint8_t sink = 0;
+        start = std::chrono::steady_clock::now();
+        for (std::size_t at = 0; at + 4 <= stream.size(); at += 4)
+        {
+            sink ^= bitwise_fcs(bytes + at, 3);
+        }
+        const double bitwise_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        start = std::chrono::steady_clock::now();
+        for (std::size_t at = 0; at + 4 <= stream.size(); at += 4)
+        {
+            sink ^= Cmux::fcs(bytes + at, 3);
+        }
+        const double table_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        const double megabytes = stream.size() / 1e6;
+        std::cout << "\t" << FRAMES << " UIH frames, " << megabytes << " MB, one in " << CORRUPT_EVERY << " corrupted" << std::endl;
+        std::cout << "\tencode: " << FRAMES / encode_seconds / 1e6 << " M frames/s, decode: "
+                  << FRAMES / decode_seconds / 1e6 << " M frames/s (" << megabytes / decode_seconds << " MB/s)" << std::endl;
+        std::cout << "\tdecoded " << decoded << ", " << decoder.bad_fcs() << " bad FCS, " << decoder.discarded()
+                  << " bytes skipped" << std::endl;
+        std::cout << "\tFCS of a header: bitwise " << bitwise_seconds * 1e9 / (stream.size() / 4) << " ns, table "
+                  << table_seconds * 1e9 / (stream.size() / 4) << " ns (" << static_cast<int>(sink & 1) << ")" << std::endl;
+        if (decoded != FRAMES - corrupted || decoded_payload != payload || decoder.bad_fcs() != corrupted)
+        {
+            std::cerr << "\tthe decoder lost or let through frames it should not have" << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    /**
+     * How long an AT+CSQ waits while an AT+CMGL=4 is being answered: behind it on the one AT interface,
+     * or beside it on a DLC of its own.
+     */
+    double blocked_query(bool multiplexed)
+    {
+        ModemSimulator::Options options;
+        options.latency = 2ms;
+        options.command_latency["+CMGL"] = LIST_LATENCY;
+        ModemSimulator modem(options);
+        std::thread modem_thread([&modem]()
+                                 { modem.run(); });
+
+        double total_ms = 0;
+        {
+            SerialPi serial(modem.device().c_str());
+            serial.begin(115200);
+            Reactor reactor;
+            ATEngine engine(serial, reactor);
+            LineFramer framer;
+            std::unique_ptr<Multiplexer> mux;
+            std::unique_ptr<ATEngine> list_engine;
+            std::unique_ptr<ATEngine> query_engine;
+            reactor.add(serial.fileDescriptor(), EPOLLIN, "serial", [&](uint32_t events)
+                        {
+                            if (events & EPOLLOUT) engine.output_ready();
+                            char chunk[LineFramer::CAPACITY];
+                            int length;
+                            if (mux)
+                            {
+                                while ((length = serial.readChunk(chunk, sizeof(chunk), 0)) > 0)
+                                {
+                                    mux->receive(chunk, length, [&](CmuxChannel &channel, std::string_view line)
+                                                 { (channel.dlci() == 2 ? *list_engine : channel.dlci() == 3 ? *query_engine : engine).consume(line); });
+                                }
+                                return;
+                            }
+                            while ((length = serial.readChunk(framer.space(), framer.space_size(), 0)) > 0)
+                            {
+                                framer.commit(length);
+                                for (std::string_view line; framer.next(line);) engine.consume(line);
+                            } });
+
+            auto *log_buffer = std::cout.rdbuf(nullptr);
+            auto *error_buffer = std::cerr.rdbuf(nullptr);
+            ATEngine *lists = &engine;
+            ATEngine *queries = &engine;
+            if (multiplexed && engine.execute("AT+CMUX=0", 1000ms).ok())
+            {
+                mux = std::make_unique<Multiplexer>(serial);
+                mux->open({1, 2, 3});
+                for (int wait = 0; wait < 100 && !mux->opened(); wait++)
+                {
+                    reactor.run_once(20);
+                }
+                engine.switch_port(mux->channel(1));
+                list_engine = std::make_unique<ATEngine>(mux->channel(2), reactor);
+                query_engine = std::make_unique<ATEngine>(mux->channel(3), reactor);
+                lists = list_engine.get();
+                queries = query_engine.get();
+            }
+            for (unsigned int round = 0; round < ROUNDS; round++)
+            {
+                bool listed = false;
+                lists->submit("AT+CMGL=4", 2000ms, [&listed](const ATEngine::Result &)
+                              { listed = true; });
+                const auto asked = std::chrono::steady_clock::now();
+                const auto answer = queries->execute("AT+CSQ", 2000ms);
+                total_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - asked).count();
+                while (!listed)
+                {
+                    reactor.run_once(100);
+                }
+                if (!answer.ok()) total_ms = -1e9;
+            }
+            if (mux) mux->close();
+            std::cout.rdbuf(log_buffer);
+            std::cerr.rdbuf(error_buffer);
+            serial.end();
+        }
+        modem.stop();
+        modem_thread.join();
+        return total_ms / ROUNDS;
+    }
+}
+
+namespace Bench
+{
+    int cmux()
+    {
+        if (codec() != 0)
+        {
+            return 1;
+        }
+        std::cout << "\tAT+CSQ while the simulator takes " << LIST_LATENCY.count() << " ms to answer AT+CMGL=4" << std::endl;
+        const double single = blocked_query(false);
+        const double multiplexed = blocked_query(true);
+        std::cout << "\tone AT interface: " << single << " ms, on a DLC of its own: " << multiplexed << " ms" << std::endl;
+        return single > 0 && multiplexed > 0 && multiplexed < single ? 0 : 1;
+    }
+}
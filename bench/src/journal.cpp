@@ -0,0 +1,179 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "bench.hpp"
+#include "error.hpp"
+#include "segment_journal.hpp"
+
+namespace
+{
+    constexpr unsigned int PARTS = 2000;
+
+    // Parts a drain of the backlog hands on before they are deleted
+    constexpr unsigned int PER_DRAIN = 50;
+
+    // A 3-part UCS-2 message's first part, as long as they get
+    const std::string PDU = "0791448720003023440B914477661122F30008520113123471008C050003D40301" + std::string(268, '0');
+
+    double seconds_since(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    std::vector<std::string> keys(const SegmentJournal &journal)
+    {
+        std::vector<std::string> keys;
+        for (const auto &each : journal.segments())
+        {
+            keys.push_back(each.key + (each.pdu == PDU ? "" : " with another PDU"));
+        }
+        return keys;
+    }
+
+    int fail(const char *what, const std::vector<std::string> &found)
+    {
+        std::cerr << "\t" << what << "; the journal holds";
+        for (const auto &each : found)
+        {
+            std::cerr << " \"" << each << "\"";
+        }
+        std::cerr << std::endl;
+        return 1;
+    }
+
+    // Parts come back after the journal is closed, released ones do not, and neither does a record cut
+    // short; released records make way for others
+    int agree(const std::string &path)
+    {
+        std::size_t torn_at = 0;
+        {
+            SegmentJournal journal(path);
+            journal.append("a", PDU);
+            journal.append("b", PDU);
+            journal.append("a", PDU);
+            journal.sync();
+        }
+        {
+            SegmentJournal journal(path);
+            if (keys(journal) != std::vector<std::string>{"a", "b", "a"})
+            {
+                return fail("the parts do not come back in order", keys(journal));
+            }
+            journal.release("a");
+            journal.append("c", PDU);
+            torn_at = journal.stats().size - 1;
+        }
+        {
+            // the last byte of "c" never made it to the disk
+            const int fd = open(path.c_str(), O_WRONLY);
+            const char garbled = '\x55';
+            if (fd < 0 || pwrite(fd, &garbled, 1, static_cast<off_t>(torn_at)) != 1)
+            {
+                std::cerr << "\tcannot garble " << path << std::endl;
+                return 1;
+            }
+            close(fd);
+        }
+        {
+            SegmentJournal journal(path);
+            if (keys(journal) != std::vector<std::string>{"b"})
+            {
+                return fail("a released message or a torn part comes back", keys(journal));
+            }
+            journal.release("b");
+            if (journal.stats().size != 12 || !keys(journal).empty())
+            {
+                return fail("releasing the last message does not empty the journal", keys(journal));
+            }
+
+            // one message waits throughout while thousands come and go
+            journal.append("long", PDU);
+            for (unsigned int message = 0; message < PARTS; message++)
+            {
+                journal.append(std::to_string(message), PDU);
+                journal.release(std::to_string(message));
+            }
+            const auto stats = journal.stats();
+            if (stats.compactions == 0 || stats.size > 2 * 64 * 1024 || stats.waiting != 1)
+            {
+                std::cerr << "\t" << stats.size << " bytes after " << stats.compactions << " compactions" << std::endl;
+                return fail("released records are not compacted away", keys(journal));
+            }
+        }
+        {
+            SegmentJournal journal(path);
+            if (keys(journal) != std::vector<std::string>{"long"})
+            {
+                return fail("the message waiting across compactions is lost", keys(journal));
+            }
+        }
+        {
+            const int fd = open(path.c_str(), O_WRONLY | O_TRUNC);
+            if (fd < 0 || write(fd, "not a journal", 13) != 13)
+            {
+                std::cerr << "\tcannot overwrite " << path << std::endl;
+                return 1;
+            }
+            close(fd);
+            try
+            {
+                SegmentJournal journal(path);
+                std::cerr << "\tanother file is taken for a journal" << std::endl;
+                return 1;
+            }
+            catch (const Utils::Error::ParserError &)
+            {
+            }
+        }
+        unlink(path.c_str());
+        return 0;
+    }
+
+    double run(const std::string &path, unsigned int per_sync)
+    {
+        unlink(path.c_str());
+        SegmentJournal journal(path);
+        const auto start = std::chrono::steady_clock::now();
+        for (unsigned int part = 0; part < PARTS; part++)
+        {
+            journal.append(std::to_string(part / 3), PDU);
+            if (per_sync > 0 && (part + 1) % per_sync == 0) journal.sync();
+        }
+        const double seconds = seconds_since(start);
+        std::cout << "\t\t" << (per_sync == 0 ? "never synced" : per_sync == 1 ? "a sync per part" : "a sync per drain")
+                  << ": " << PARTS / seconds << " parts/s, " << seconds * 1e6 / PARTS << " us per part" << std::endl;
+        return seconds;
+    }
+}
+
+namespace Bench
+{
+    int journal()
+    {
+        char directory[] = "/tmp/cellular_journal.XXXXXX";
+        if (mkdtemp(directory) == nullptr)
+        {
+            std::cerr << "\tno temporary directory" << std::endl;
+            return 1;
+        }
+        const std::string path = std::string(directory) + "/segments.journal";
+        const int result = agree(path);
+        if (result == 0)
+        {
+            std::cout << "\t" << PARTS << " parts of " << PDU.size() << " characters in " << directory << std::endl;
+            const double each = run(path, 1);
+            const double drained = run(path, PER_DRAIN);
+            run(path, 0);
+            std::cout << "\t" << each / drained << "x the parts/s of a sync per part" << std::endl;
+        }
+        unlink(path.c_str());
+        unlink((path + ".tmp").c_str());
+        rmdir(directory);
+        return result;
+    }
+}
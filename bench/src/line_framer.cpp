@@ -0,0 +1,163 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <algorithm>
+
+#include "bench.hpp"
+#include "line_framer.hpp"
+
+namespace
+{
+    // A session of modem output: signal queries, a stored SMS read back, an incoming call, a front-end command
+    const std::string session = "\r\n+CSQ: 21,99\r\n\r\nOK\r\n"
+                                "\r\n+CMTI: \"SM\",3\r\n"
+                                "\r\n+CMGR: 0,,159\r\n"
+                                "07911356044902004412916801861326265746660008520113"
+                                "1234718A8C050003D402013010660E65E565B9821F30110032"
+                                "003000320035611F8C225E8651785F00542FFF01000A4EBA4EE"
+                                "C65004E0A96EA5C71FF0C5411661F7A7A63A27D2230028C2262C"
+                                "9683C8FCE676565B053D89769000A5728803662C951885FB77684"
+                                "795D798F4E0BFF0C86548BDA65C54EBA518D6B2151FA53D1000A96"
+                                "505B9A5E72545851DB5FA194F67070\r\n"
+                                "\r\nOK\r\n"
+                                "\r\nOK\r\n"
+                                "\r\nRING\r\n\r\n+CLIP: \"+8613800138000\",145,,,,0\r\n"
+                                "\r\n+CREG: 0,1\r\n\r\nOK\r\n"
+                                "\r\n+COPS: 0,0,\"CHINA MOBILE\",7\r\n\r\nOK\r\n";
+    constexpr size_t CAPTURE_BYTES = 8 << 20;
+    constexpr int ROUNDS = 3;
+    // Set to a file holding raw modem output to frame that instead of the synthetic session
+    constexpr const char *CAPTURE_ENV = "CELLULAR_BENCH_CAPTURE";
+
+    struct Result
+    {
+        unsigned long lines = 0;
+        unsigned long line_bytes = 0;
+        double seconds = 0;
+    };
+
+    // Sizes of the successive read()s: what FIONREAD reports varies with how busy the loop is
+    size_t read_size(unsigned int &seed, size_t largest)
+    {
+        seed = seed * 1103515245 + 12345;
+        return 1 + (seed >> 16) % largest;
+    }
+
+    // The loop before the framer: every byte appended to an ostringstream, the line copied out at "\r\n"
+    Result ostringstream_framer(const std::string &capture, size_t largest_read)
+    {
+        Result result;
+        unsigned int seed = 1;
+        auto start = std::chrono::steady_clock::now();
+        std::ostringstream incoming;
+        char last = 0;
+        for (size_t pos = 0; pos < capture.size();)
+        {
+            const auto end = std::min(capture.size(), pos + read_size(seed, largest_read));
+            for (; pos < end; ++pos)
+            {
+                const char first = capture[pos];
+                if (first == '\n' && last == '\r')
+                {
+                    auto content = incoming.str();
+                    incoming.str("");
+                    incoming.clear();
+                    last = 0;
+                    content.pop_back(); // the '\r'
+                    if (content.empty()) continue;
+                    ++result.lines;
+                    result.line_bytes += content.size();
+                    continue;
+                }
+                incoming << first;
+                last = first;
+            }
+        }
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+    Result line_framer(const std::string &capture, size_t largest_read)
+    {
+        Result result;
+        unsigned int seed = 1;
+        auto start = std::chrono::steady_clock::now();
+        LineFramer framer;
+        for (size_t pos = 0; pos < capture.size();)
+        {
+            pos += framer.feed(capture.data() + pos, std::min(capture.size() - pos, read_size(seed, largest_read)));
+            for (std::string_view line; framer.next(line);)
+            {
+                ++result.lines;
+                result.line_bytes += line.size();
+            }
+        }
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+    template <typename Framer>
+    Result best_of(Framer framer, const std::string &capture, size_t largest_read)
+    {
+        Result best;
+        for (int round = 0; round < ROUNDS; round++)
+        {
+            auto result = framer(capture, largest_read);
+            if (round == 0 || result.seconds < best.seconds) best = result;
+        }
+        return best;
+    }
+
+    void report(const char *name, const Result &result, size_t bytes)
+    {
+        std::cout << "\t" << name << ": " << result.lines << " lines in " << result.seconds * 1000 << " ms, "
+                  << result.lines / result.seconds / 1e6 << " M lines/s, "
+                  << bytes / result.seconds / (1 << 20) << " MiB/s" << std::endl;
+    }
+}
+
+namespace Bench
+{
+    int line_framer()
+    {
+        std::string capture;
+        if (const char *path = std::getenv(CAPTURE_ENV))
+        {
+            std::ifstream file(path, std::ios::binary);
+            capture.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            if (capture.empty())
+            {
+                std::cerr << "\tcannot read capture " << path << std::endl;
+                return 1;
+            }
+            std::cout << "\tcapture " << path << ": " << capture.size() << " bytes" << std::endl;
+        }
+        else
+        {
+            while (capture.size() < CAPTURE_BYTES) capture += session;
+            std::cout << "\tsynthetic capture: " << capture.size() << " bytes of modem output"
+                      << " (set " << CAPTURE_ENV << " to frame a real one)" << std::endl;
+        }
+
+        for (size_t largest_read : {size_t(16), size_t(4096)})
+        {
+            std::cout << "\treads of 1.." << largest_read << " bytes" << std::endl;
+            const auto legacy = best_of(ostringstream_framer, capture, largest_read);
+            const auto framed = best_of(::line_framer, capture, largest_read);
+            report("ostringstream per byte", legacy, capture.size());
+            report("LineFramer            ", framed, capture.size());
+            // lines longer than LineFramer::CAPACITY come out in pieces, so only the bytes must agree
+            if (legacy.line_bytes != framed.line_bytes)
+            {
+                std::cerr << "\tthe framers disagree: " << legacy.line_bytes << " / " << framed.line_bytes
+                          << " bytes in lines" << std::endl;
+                return 1;
+            }
+            std::cout << "\tspeedup: " << legacy.seconds / framed.seconds << "x" << std::endl;
+        }
+        return 0;
+    }
+}
@@ -0,0 +1,170 @@
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstring>
+#include <iomanip>
+#include <utility>
+#include "bench.hpp"
+#include "error.hpp"
+
+namespace
+{
+    const std::vector<Bench::Case> all_cases{
+        {"serial_read", "syscalls and time to read modem output from a pty", Bench::serial_read},
+        {"serial_write", "syscalls and time to write AT+CMGS submissions to a pty", Bench::serial_write},
+        {"line_framer", "lines/sec splitting a multi-megabyte capture of modem output", Bench::line_framer},
+        {"urc_dispatch", "ns per line to recognise unsolicited result codes", Bench::urc_dispatch},
+        {"at_pipeline", "AT commands/s and misattributed replies by pipeline depth", Bench::at_pipeline},
+        {"cmux", "27.010 frames/s, FCS cost and a query held up by AT+CMGL with and without CMUX", Bench::cmux},
+        {"pdu_decode", "PDUs/s and allocations per PDU decoding SMS-DELIVERs", Bench::pdu_decode},
+        {"gsm7", "septets/s unpacked and mapped to UTF-8, scalar and vectorised", Bench::gsm7},
+        {"utf16", "UTF-16 units/s to UTF-8, surrogate pairs joined across segments", Bench::utf16},
+        {"reassembly", "parts/s put together by several modem threads, expiry and the memory limit", Bench::reassembly},
+        {"journal", "parts/s journaled with a sync per part or per drain, recovery and compaction", Bench::journal},
+        {"pdu_suite", "PDUs/s, ns/byte, allocations and peak RSS of decoding, reassembly and email over a corpus",
+         Bench::pdu_suite},
+        {"sms_send", "messages/min sent one at a time and queued under AT+CMMS; SMS-SUBMITs decoded back", Bench::sms_send},
+    };
+
+    struct Result
+    {
+        const Bench::Case *run;
+        bool passed;
+        double seconds;
+        std::vector<std::pair<std::string, double>> metrics;
+    };
+
+    // what the case running recorded with Bench::metric()
+    std::vector<std::pair<std::string, double>> recorded;
+
+    void quote(std::ostream &os, const std::string &text)
+    {
+        os << '"';
+        for (const char each : text)
+        {
+            if (each == '"' || each == '\\') os << '\\';
+            os << each;
+        }
+        os << '"';
+    }
+
+    /**
+     * {"time": <seconds since the epoch>, "optimized": <bool>, "cases": [{"name", "passed", "seconds",
+     * "metrics": {<name>: <value>, ...}}, ...]}, one file per run, to be kept and compared over time
+     */
+    bool write_json(const std::string &path, const std::vector<Result> &results)
+    {
+        std::ofstream file(path);
+        const auto now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch());
+#if defined(__OPTIMIZE__)
+        constexpr bool optimized = true;
+#else
+        constexpr bool optimized = false;
+#endif
+        file << std::setprecision(9) << "{\"time\": " << now.count() << ", \"optimized\": " << std::boolalpha << optimized
+             << ", \"cases\": [";
+        for (std::size_t idx = 0; idx < results.size(); idx++)
+        {
+            const auto &result = results[idx];
+            file << (idx == 0 ? "" : ",") << "\n  {\"name\": ";
+            quote(file, result.run->name);
+            file << ", \"passed\": " << result.passed << ", \"seconds\": " << result.seconds << ", \"metrics\": {";
+            for (std::size_t each = 0; each < result.metrics.size(); each++)
+            {
+                file << (each == 0 ? "" : ", ");
+                quote(file, result.metrics[each].first);
+                // JSON has no NaN or infinity
+                const double value = result.metrics[each].second;
+                file << ": ";
+                if (std::isfinite(value)) file << value; else file << "null";
+            }
+            file << "}}";
+        }
+        file << "\n]}" << std::endl;
+        return static_cast<bool>(file);
+    }
+
+    void usage(const char *self)
+    {
+        std::cout << "Usage: " << self << " [--json FILE] [case...]\nRuns every case when none is given, and writes "
+                  << "their results to FILE with --json. Cases:" << std::endl;
+        for (const auto &each : all_cases)
+        {
+            std::cout << "\t" << each.name << "\t" << each.description << std::endl;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::signal(SIGABRT, Utils::Error::crash_printer);
+    std::signal(SIGSEGV, Utils::Error::crash_printer);
+    std::signal(SIGFPE, Utils::Error::crash_printer);
+    std::signal(SIGILL, Utils::Error::crash_printer);
+    std::signal(SIGBUS, Utils::Error::crash_printer);
+
+    std::vector<const Bench::Case *> selected;
+    std::string json;
+    for (int idx = 1; idx < argc; idx++)
+    {
+        if (std::strcmp(argv[idx], "-h") == 0 || std::strcmp(argv[idx], "--help") == 0)
+        {
+            usage(argv[0]);
+            return 0;
+        }
+        if (std::strcmp(argv[idx], "--json") == 0 && idx + 1 < argc)
+        {
+            json = argv[++idx];
+            continue;
+        }
+        const Bench::Case *found = nullptr;
+        for (const auto &each : all_cases)
+        {
+            if (each.name == argv[idx]) found = &each;
+        }
+        if (found == nullptr)
+        {
+            std::cerr << "Unknown benchmark case " << argv[idx] << std::endl;
+            usage(argv[0]);
+            return 1;
+        }
+        selected.push_back(found);
+    }
+    if (selected.empty())
+    {
+        for (const auto &each : all_cases) selected.push_back(&each);
+    }
+
+    int failures = 0;
+    std::vector<Result> results;
+    for (const auto *each : selected)
+    {
+        std::cout << "===========\n" << each->name << ": " << each->description << std::endl;
+        recorded.clear();
+        const auto start = std::chrono::steady_clock::now();
+        const bool passed = each->run() == 0;
+        results.push_back({each, passed, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(),
+                           std::move(recorded)});
+        if (!passed)
+        {
+            std::cerr << each->name << " FAILED" << std::endl;
+            ++failures;
+        }
+    }
+    if (!json.empty() && !write_json(json, results))
+    {
+        std::cerr << "Cannot write the results to " << json << std::endl;
+        return 1;
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+namespace Bench
+{
+    void metric(const std::string &name, double value)
+    {
+        recorded.emplace_back(name, value);
+    }
+}
@@ -0,0 +1,321 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bench.hpp"
+#include "sms.hpp"
+#include "pdu_decoder.hpp"
+
+namespace
+{
+    constexpr unsigned long ROUNDS = 20000;
+
+    // SMS-DELIVERs as AT+CMGR / +CMT carry them: GSM 7-bit, UCS-2, concatenated with 8- and 16-bit references
+    const std::vector<std::string> corpus{
+        "0891683108100005F0040D91683119325476F80000421061310325404BD9775D0E1A87E56450D94D4EBBCFA0986C4603DDC373D018"
+        "1D969FCB64104DE682C140C5AA1414A683A6C827D4059296E1EC3C684A7D4241F437E80DA783DE75BA0B",
+        "0891683108100005F0040791680180F60008421061310325402A60A876849A8C8BC17801662F0020003100320033003400350036FF"
+        "0C4E945206949F5185670965483002",
+        "0891683108100005F0440D91683119325476F8000042106131032540490500032A0201A061391DF47697416F33280C82CBDFED373D"
+        "FD7683E670769A0E7ADBCB7210FDFE06B5CBF379F85C9EB340F3B29B0E12E741747419240EBBD72E",
+        "0891683108100005F0440D91683119325476F8000042106131032540190500032A0202A061391D44BFBF59203ABA0C2ABBC92E",
+        "0891683108100005F04408910196000000084210613103254019060804123402017B2C4E0090E85206FF1A4F1860E06D3B52A8",
+        "0891683108100005F04408910196000000084210613103254015060804123402027B2C4E8C90E85206FF1A7ED3675F",
+        "0791448720003023240DD0E474D81C0EBB010000111011315214000BE474D81C0EBB5DE3771B",
+        "079113560449020044129168018613262657466600085201131234718A8C050003D402013010660E65E565B9821F301100320030"
+        "00320035611F8C225E8651785F00542FFF01000A4EBA4EEC65004E0A96EA5C71FF0C5411661F7A7A63A27D2230028C2262C9683C"
+        "8FCE676565B053D89769000A5728803662C951885FB77684795D798F4E0BFF0C86548BDA65C54EBA518D6B2151FA53D1000A9650"
+        "5B9A5E72545851DB5FA194F67070",
+    };
+
+    // Lines that are no PDU the decoder should take, each with what it should say
+    const std::vector<std::pair<std::string, PduDecoder::Error>> garbled{
+        {"0791448720003023240DD0E474D81C0EBB01000011101131521400", PduDecoder::Error::TRUNCATED},
+        {"0791448720003023240DD0E474D81C0EBB0100001110113152140G0BE474D81C0EBB5DE3771B", PduDecoder::Error::NOT_HEX},
+        {"0791448720003023210DD0E474D81C0EBB010000111011315214000BE474D81C0EBB5DE3771B", PduDecoder::Error::NOT_DELIVER},
+        {"0891683108100005F0440D91683119325476F8000042106131032540190500032A0203A061391D44BFBF59203ABA0C2ABBC92E",
+         PduDecoder::Error::BAD_UDH},
+    };
+
+    // The same user data under TP-DCS of each coding group (23.038 §4): general data coding, automatic
+    // deletion, reserved, message waiting and message class; in the default alphabet or UCS-2 ("ABC")
+    const std::string GSM7_BEFORE_DCS = "0791448720003023240DD0E474D81C0EBB0100";
+    const std::string GSM7_AFTER_DCS = "111011315214000BE474D81C0EBB5DE3771B";
+    const std::string UCS2_BEFORE_DCS = "0891683108100005F0040791680180F600";
+    const std::string UCS2_AFTER_DCS = "4210613103254006004100420043";
+
+    enum class Reads
+    {
+        GSM7,
+        UCS2,
+        NOTHING, // 8-bit data, compressed text
+    };
+
+    const std::pair<const char *, Reads> codings[]{
+        {"00", Reads::GSM7}, {"0C", Reads::GSM7}, {"10", Reads::GSM7}, {"40", Reads::GSM7}, {"80", Reads::GSM7},
+        {"B4", Reads::GSM7}, {"C0", Reads::GSM7}, {"D8", Reads::GSM7}, {"F0", Reads::GSM7}, {"F8", Reads::GSM7},
+        {"08", Reads::UCS2}, {"18", Reads::UCS2}, {"48", Reads::UCS2}, {"E0", Reads::UCS2}, {"E8", Reads::UCS2},
+        {"04", Reads::NOTHING}, {"44", Reads::NOTHING}, {"F4", Reads::NOTHING}, {"20", Reads::NOTHING},
+        {"28", Reads::NOTHING}, {"6A", Reads::NOTHING},
+    };
+
+    // What the SMS constructor did before PduDecoder, kept to measure against
+    namespace legacy
+    {
+        struct Fields
+        {
+            std::string smsc;
+            std::string sender;
+            std::string timestamp;
+            std::string content;
+            bool is_segment = false;
+            unsigned short reference = 0;
+            int count = 0;
+            int index = 0;
+        };
+
+        std::vector<unsigned char> hexToBytes(const std::string &hex)
+        {
+            std::vector<unsigned char> bytes;
+            for (size_t i = 0; i < hex.size(); i += 2)
+            {
+                bytes.push_back(static_cast<unsigned char>(std::stoi(hex.substr(i, 2), nullptr, 16)));
+            }
+            return bytes;
+        }
+
+        std::string decodeSemiOctet(const std::string &hex, int digits)
+        {
+            std::string result;
+            for (size_t i = 0; i < hex.size(); i += 2)
+            {
+                result.push_back(hex[i + 1]);
+                if (hex[i] != 'F')
+                    result.push_back(hex[i]);
+            }
+            if ((int)result.size() > digits)
+                result.resize(digits);
+            return result;
+        }
+
+        std::string decodeGSM7(const std::vector<unsigned char> &data, const unsigned int skip, const unsigned int septetCount)
+        {
+            std::string out;
+            for (auto i = skip; i < septetCount; i++)
+            {
+                int byteIndex = (i * 7) / 8;
+                int bitOffset = (i * 7) % 8;
+                int val = (data[byteIndex] >> bitOffset) & 0x7F;
+                if (bitOffset > 1 && byteIndex + 1 < (int)data.size())
+                {
+                    val |= (data[byteIndex + 1] << (8 - bitOffset)) & 0x7F;
+                }
+                out.push_back((char)val);
+            }
+            return out;
+        }
+
+        std::string decodeUCS2(const std::vector<unsigned char> &data, const unsigned int skip)
+        {
+            std::string out;
+            for (auto i = skip; i + 1 < data.size(); i += 2)
+            {
+                unsigned short int ch = (data[i] << 8) | data[i + 1];
+                if (ch < 0x80)
+                {
+                    out.push_back(static_cast<char>(ch));
+                }
+                else if (ch < 0x800)
+                {
+                    out.push_back(0xC0 | (ch >> 6));
+                    out.push_back(0x80 | (ch & 0x3F));
+                }
+                else
+                {
+                    out.push_back(0xE0 | (ch >> 12));
+                    out.push_back(0x80 | ((ch >> 6) & 0x3F));
+                    out.push_back(0x80 | (ch & 0x3F));
+                }
+            }
+            return out;
+        }
+
+        std::string decodeTimestamp(const std::string &hex)
+        {
+            std::string ts;
+            for (size_t i = 0; i < hex.size(); i += 2)
+            {
+                ts += hex[i + 1];
+                ts += hex[i];
+            }
+            return ts;
+        }
+
+        // The field walk of the constructor, its checks of the concatenation IE left out
+        Fields decode(const std::string &pdu)
+        {
+            Fields fields;
+            size_t idx = 0;
+            const auto smscLen = std::stoi(pdu.substr(idx, 2), nullptr, 16);
+            if (smscLen > 0)
+            {
+                auto smscInfo = pdu.substr(idx + 2, smscLen * 2);
+                fields.smsc = decodeSemiOctet(smscInfo.substr(2), (smscLen - 1) * 2);
+            }
+            idx += 2 + smscLen * 2;
+            const auto firstOctet = std::stoi(pdu.substr(idx, 2), nullptr, 16);
+            bool udhi = (firstOctet & 0x40) != 0;
+            idx += 2;
+            const auto senderLen = std::stoi(pdu.substr(idx, 2), nullptr, 16);
+            idx += 4;
+            const auto senderBytes = (senderLen + 1) / 2 * 2;
+            fields.sender = decodeSemiOctet(pdu.substr(idx, senderBytes), senderLen);
+            idx += senderBytes + 2;
+            const auto dcs = std::stoi(pdu.substr(idx, 2), nullptr, 16);
+            idx += 2;
+            fields.timestamp = decodeTimestamp(pdu.substr(idx, 14));
+            idx += 14;
+            const auto udl = std::stoi(pdu.substr(idx, 2), nullptr, 16);
+            idx += 2;
+            std::vector<unsigned char> ud = hexToBytes(pdu.substr(idx));
+            unsigned int skip = 0;
+            if (udhi)
+            {
+                skip = static_cast<unsigned int>(ud[0]) + 1;
+                fields.is_segment = true;
+                if (ud[2] == 3)
+                {
+                    fields.reference = ud[3];
+                    fields.count = ud[4];
+                    fields.index = ud[5];
+                }
+                else
+                {
+                    fields.reference = ud[3] << 8 | ud[4];
+                    fields.count = ud[5];
+                    fields.index = ud[6];
+                }
+            }
+            fields.content = (dcs & 0x0C) == 0x08 ? decodeUCS2(ud, skip) : decodeGSM7(ud, skip, udl);
+            return fields;
+        }
+    }
+
+    double seconds_since(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void report(const char *name, double seconds, unsigned long allocated)
+    {
+        const double pdus = static_cast<double>(ROUNDS) * corpus.size();
+        std::cout << "\t" << name << ": " << pdus / seconds / 1e6 << " M PDUs/s, " << seconds * 1e9 / pdus
+                  << " ns and " << allocated / pdus << " allocations per PDU" << std::endl;
+    }
+
+    // The decoder reads every field the way the constructor always did, but the text of the default alphabet
+    // and alphanumeric senders, which it maps through 23.038 (see the gsm7 case)
+    int agree()
+    {
+        PduDecoder decoder;
+        for (const auto &pdu : corpus)
+        {
+            PduDecoder::Message message;
+            const auto error = decoder.decode(pdu, message);
+            const auto fields = legacy::decode(pdu);
+            const bool gsm7 = (message.dcs & 0x0C) == 0x00;
+            const bool alphanumeric = (message.sender_type & 0x70) == 0x50;
+            if (error != PduDecoder::Error::NONE || message.smsc != fields.smsc ||
+                (!alphanumeric && message.sender != fields.sender) || (!gsm7 && message.text != fields.content) ||
+                message.segment != fields.is_segment ||
+                message.reference != fields.reference || message.count != fields.count || message.index != fields.index)
+            {
+                std::cerr << "\tthe decoder and the constructor disagree on " << pdu << " ("
+                          << PduDecoder::to_string(error) << ")" << std::endl;
+                return 1;
+            }
+        }
+        PduDecoder::Message reference;
+        decoder.decode(GSM7_BEFORE_DCS + "00" + GSM7_AFTER_DCS, reference);
+        const std::string gsm7_text(reference.text);
+        for (const auto &[dcs, reads] : codings)
+        {
+            PduDecoder::Message message;
+            const auto error = reads == Reads::UCS2 ? decoder.decode(UCS2_BEFORE_DCS + dcs + UCS2_AFTER_DCS, message)
+                                                    : decoder.decode(GSM7_BEFORE_DCS + dcs + GSM7_AFTER_DCS, message);
+            if (reads == Reads::NOTHING ? error != PduDecoder::Error::UNSUPPORTED_DCS
+                                        : error != PduDecoder::Error::NONE ||
+                                              message.text != (reads == Reads::UCS2 ? "ABC" : gsm7_text))
+            {
+                std::cerr << "\tTP-DCS " << dcs << " decodes with \"" << PduDecoder::to_string(error) << "\" to \""
+                          << message.text << "\"" << std::endl;
+                return 1;
+            }
+        }
+        for (const auto &[pdu, expected] : garbled)
+        {
+            PduDecoder::Message message;
+            if (const auto error = decoder.decode(pdu, message); error != expected)
+            {
+                std::cerr << "\t" << pdu << " decodes with \"" << PduDecoder::to_string(error) << "\", not \""
+                          << PduDecoder::to_string(expected) << "\"" << std::endl;
+                return 1;
+            }
+        }
+        return 0;
+    }
+}
+
+namespace Bench
+{
+    int pdu_decode()
+    {
+        if (agree() != 0)
+        {
+            return 1;
+        }
+        std::cout << "\t" << corpus.size() << " PDUs, " << ROUNDS << " rounds" << std::endl;
+
+        std::size_t sink = 0;
+        auto allocated = Bench::allocations();
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned long round = 0; round < ROUNDS; round++)
+        {
+            for (const auto &pdu : corpus) sink += legacy::decode(pdu).content.size();
+        }
+        const double legacy_seconds = seconds_since(start);
+        report("substr/stoi", legacy_seconds, Bench::allocations() - allocated);
+
+        allocated = Bench::allocations();
+        start = std::chrono::steady_clock::now();
+        for (unsigned long round = 0; round < ROUNDS; round++)
+        {
+            for (const auto &pdu : corpus)
+            {
+                const SMS message(pdu);
+                sink++;
+            }
+        }
+        report("SMS(pdu), with its strings", seconds_since(start), Bench::allocations() - allocated);
+
+        PduDecoder decoder;
+        PduDecoder::Message message;
+        allocated = Bench::allocations();
+        start = std::chrono::steady_clock::now();
+        for (unsigned long round = 0; round < ROUNDS; round++)
+        {
+            for (const auto &pdu : corpus)
+            {
+                decoder.decode(pdu, message);
+                sink += message.text.size();
+            }
+        }
+        const double decoder_seconds = seconds_since(start);
+        const auto decoder_allocations = Bench::allocations() - allocated;
+        report("PduDecoder", decoder_seconds, decoder_allocations);
+        std::cout << "\t" << legacy_seconds / decoder_seconds << "x the PDUs/s of substr/stoi (" << (sink & 1) << ")" << std::endl;
+        return decoder_allocations == 0 && decoder_seconds < legacy_seconds ? 0 : 1;
+    }
+}
@@ -0,0 +1,259 @@
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <sys/resource.h>
+
+#include "bench.hpp"
+#include "pdu_decoder.hpp"
+#include "reassembler.hpp"
+#include "sms.hpp"
+
+namespace
+{
+    constexpr unsigned long ROUNDS = 5000;
+
+    struct Entry
+    {
+        std::string kind;
+        std::string expected; // "ok" or the error
+        std::string pdu;
+    };
+
+    // The error names of the corpus
+    const std::pair<const char *, PduDecoder::Error> ERRORS[] = {
+        {"ok", PduDecoder::Error::NONE},
+        {"not_hex", PduDecoder::Error::NOT_HEX},
+        {"too_long", PduDecoder::Error::TOO_LONG},
+        {"truncated", PduDecoder::Error::TRUNCATED},
+        {"not_deliver", PduDecoder::Error::NOT_DELIVER},
+        {"address_too_long", PduDecoder::Error::ADDRESS_TOO_LONG},
+        {"bad_udh", PduDecoder::Error::BAD_UDH},
+        {"unsupported_dcs", PduDecoder::Error::UNSUPPORTED_DCS},
+    };
+
+    // PDU_CORPUS in the environment, or the corpus of the source tree
+    std::string corpus_path()
+    {
+        const char *path = std::getenv("PDU_CORPUS");
+        return path != nullptr ? path : PDU_CORPUS;
+    }
+
+    bool load(const std::string &path, std::vector<Entry> &corpus)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            std::cerr << "\tcannot read the corpus " << path << std::endl;
+            return false;
+        }
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (line.empty() || line[0] == '#') continue;
+            std::istringstream fields(line);
+            Entry entry;
+            if (!(fields >> entry.kind >> entry.expected >> entry.pdu))
+            {
+                std::cerr << "\tnot a line of the corpus: " << line << std::endl;
+                return false;
+            }
+            corpus.push_back(std::move(entry));
+        }
+        return !corpus.empty();
+    }
+
+    long peak_rss_kib()
+    {
+        struct rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+
+    /**
+     * Timing and allocations of one stage over units of bytes in all per round; printed, and kept as
+     * <stage>.per_s, .ns_per_byte, .allocations (per unit) and .peak_rss_kib for --json
+     */
+    class Stage
+    {
+    public:
+        Stage(std::string name, const char *unit, std::size_t units, std::size_t bytes)
+            : m_name(std::move(name)), m_unit(unit), m_units(static_cast<double>(units) * ROUNDS),
+              m_bytes(static_cast<double>(bytes) * ROUNDS), m_allocated(Bench::allocations()),
+              m_start(std::chrono::steady_clock::now())
+        {
+        }
+
+        void done()
+        {
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+            const double allocations = static_cast<double>(Bench::allocations() - m_allocated) / m_units;
+            const long rss = peak_rss_kib();
+            std::cout << "\t" << m_name << ": " << m_units / seconds / 1e6 << " M " << m_unit << "/s, "
+                      << seconds * 1e9 / m_bytes << " ns/byte, " << allocations << " allocations per " << m_unit
+                      << ", peak RSS " << rss << " KiB" << std::endl;
+            Bench::metric(m_name + ".per_s", m_units / seconds);
+            Bench::metric(m_name + ".ns_per_byte", seconds * 1e9 / m_bytes);
+            Bench::metric(m_name + ".allocations", allocations);
+            Bench::metric(m_name + ".peak_rss_kib", static_cast<double>(rss));
+        }
+
+    private:
+        const std::string m_name;
+        const char *m_unit;
+        const double m_units;
+        const double m_bytes;
+        const unsigned long m_allocated;
+        const std::chrono::steady_clock::time_point m_start;
+    };
+}
+
+namespace Bench
+{
+    int pdu_suite()
+    {
+        const auto path = corpus_path();
+        std::vector<Entry> corpus;
+        if (!load(path, corpus))
+        {
+            return 1;
+        }
+
+        // every PDU decodes as the corpus says, and SMS(pdu) throws where the decoder fails
+        PduDecoder decoder;
+        std::vector<std::string> good;
+        std::vector<std::string> bad;
+        std::size_t good_octets = 0;
+        std::size_t bad_octets = 0;
+        for (const auto &entry : corpus)
+        {
+            PduDecoder::Message message;
+            const auto error = decoder.decode(entry.pdu, message);
+            bool known = false;
+            for (const auto &[name, value] : ERRORS)
+            {
+                known |= entry.expected == name && error == value;
+            }
+            if (!known)
+            {
+                std::cerr << "\t" << entry.kind << " " << entry.pdu << " decodes with \"" << PduDecoder::to_string(error)
+                          << "\", not " << entry.expected << std::endl;
+                return 1;
+            }
+            (error == PduDecoder::Error::NONE ? good : bad).push_back(entry.pdu);
+            (error == PduDecoder::Error::NONE ? good_octets : bad_octets) += entry.pdu.size() / 2;
+        }
+        std::cout << "\t" << corpus.size() << " PDUs from " << path << ", " << bad.size() << " of them not taken, "
+                  << ROUNDS << " rounds" << std::endl;
+
+        std::vector<SMS> singles;
+        std::vector<SMS> parts;
+        std::set<std::tuple<std::string, unsigned short, unsigned int>> keys;
+        std::size_t part_bytes = 0;
+        {
+            Stage stage("sms", "PDU", good.size(), good_octets);
+            for (unsigned long round = 0; round < ROUNDS; round++)
+            {
+                for (const auto &pdu : good)
+                {
+                    SMS message(pdu);
+                    if (round > 0) continue;
+                    if (message.is_part())
+                    {
+                        keys.emplace(message.get_sender(), message.get_reference(), message.get_count());
+                        part_bytes += message.get_content().size();
+                        parts.push_back(std::move(message));
+                    }
+                    else
+                    {
+                        singles.push_back(std::move(message));
+                    }
+                }
+            }
+            stage.done();
+        }
+        {
+            unsigned long thrown = 0;
+            Stage stage("sms_rejected", "PDU", bad.size(), bad_octets);
+            for (unsigned long round = 0; round < ROUNDS; round++)
+            {
+                for (const auto &pdu : bad)
+                {
+                    try
+                    {
+                        SMS message(pdu);
+                    }
+                    catch (const std::exception &)
+                    {
+                        thrown++;
+                    }
+                }
+            }
+            stage.done();
+            if (thrown != bad.size() * ROUNDS)
+            {
+                std::cerr << "\tSMS(pdu) takes " << bad.size() * ROUNDS - thrown << " PDUs the decoder does not" << std::endl;
+                return 1;
+            }
+        }
+
+        // the parts of every long message, then what never completed past its deadline
+        std::vector<SMS> wholes;
+        {
+            Reassembler reassembler(std::chrono::seconds(600), 1024 * 1024);
+            std::vector<SMS> ready;
+            const auto past_every_deadline = Reassembler::Clock::now() + std::chrono::hours(1);
+            Stage stage("reassembly", "part", parts.size(), part_bytes);
+            for (unsigned long round = 0; round < ROUNDS; round++)
+            {
+                ready.clear();
+                for (const auto &part : parts)
+                {
+                    reassembler.add(part, ready);
+                }
+                reassembler.expire(ready, past_every_deadline);
+                if (ready.size() != keys.size())
+                {
+                    std::cerr << "\t" << ready.size() << " long messages out of " << keys.size() << std::endl;
+                    return 1;
+                }
+            }
+            stage.done();
+            wholes = std::move(ready);
+        }
+        wholes.insert(wholes.end(), singles.begin(), singles.end());
+
+        // as send_email() formats them
+        std::size_t email_bytes = 0;
+        const std::time_t when = std::time(nullptr);
+        for (const auto &each : wholes)
+        {
+            email_bytes += SMS::format_email("to@example.com", "from@example.com", each.get_sender(), each.get_content(),
+                                             when)
+                               .size();
+        }
+        std::size_t sink = 0;
+        {
+            Stage stage("email", "email", wholes.size(), email_bytes);
+            for (unsigned long round = 0; round < ROUNDS; round++)
+            {
+                for (const auto &each : wholes)
+                {
+                    sink += SMS::format_email("to@example.com", "from@example.com", each.get_sender(),
+                                              each.get_content(), when)
+                                .size();
+                }
+            }
+            stage.done();
+        }
+        std::cout << "\t" << wholes.size() << " emails per round, formatted as send_email() does (" << (sink & 1) << ")"
+                  << std::endl;
+        return 0;
+    }
+}
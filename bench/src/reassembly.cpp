@@ -0,0 +1,220 @@
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+#include "reassembler.hpp"
+#include "sms.hpp"
+
+namespace
+{
+    using namespace std::chrono_literals;
+
+    constexpr unsigned int THREADS = 4;
+
+    // Messages of 3 parts each thread puts together
+    constexpr unsigned int MESSAGES = 20000;
+
+    constexpr unsigned int PARTS = 3;
+
+    std::string hex(unsigned int octet)
+    {
+        char out[3];
+        std::snprintf(out, sizeof(out), "%02X", octet & 0xFF);
+        return out;
+    }
+
+    /**
+     * A UCS-2 SMS-DELIVER from the international number +44 7766 11 22 3 followed by one more digit, part
+     * index (from 1) of count of the message with reference; an 8-bit reference below 256, a 16-bit one above
+     */
+    std::string part_pdu(unsigned int sender, unsigned int reference, unsigned int count, unsigned int index,
+                         const std::string &text)
+    {
+        // 13 digits, in semi-octets with a fill digit
+        const std::string digits = "447766112230" + std::to_string(sender % 10) + "F";
+        std::string number;
+        for (std::size_t idx = 0; idx < digits.size(); idx += 2)
+        {
+            number += digits[idx + 1];
+            number += digits[idx];
+        }
+
+        const std::string udh = reference < 256 ? "050003" + hex(reference) + hex(count) + hex(index)
+                                                : "060804" + hex(reference >> 8) + hex(reference) + hex(count) + hex(index);
+        std::string ud = udh;
+        for (const char each : text)
+        {
+            ud += "00" + hex(static_cast<unsigned char>(each));
+        }
+        // SMSC, TP-MTI with TP-UDHI, the sender, TP-PID, UCS-2, TP-SCTS and TP-UDL
+        return "0791448720003023" "44" "0D91" + number + "00" "08" "52011312347100" + hex(ud.size() / 2) + ud;
+    }
+
+    // The numbers part_pdu() gives sender are a digit apart; anything else is the same
+    SMS part(unsigned int sender, unsigned int reference, unsigned int count, unsigned int index, const std::string &text)
+    {
+        return SMS(part_pdu(sender, reference, count, index, text));
+    }
+
+    int fail(const char *what, const std::vector<SMS> &ready)
+    {
+        std::cerr << "\t" << what << "; " << ready.size() << " message(s) came out" << std::endl;
+        for (const auto &each : ready)
+        {
+            std::cerr << "\t\t\"" << each.get_content() << "\"" << std::endl;
+        }
+        return 1;
+    }
+
+    // Parts out of order or twice, references reused by other senders or for another count, reference 0,
+    // deadlines and the limit
+    int agree()
+    {
+        const auto now = Reassembler::Clock::now();
+        {
+            Reassembler reassembler(10s, 64 * 1024);
+            std::vector<SMS> ready;
+            reassembler.add(part(1, 7, 3, 3, "three"), ready, now);
+            reassembler.add(part(1, 7, 3, 1, "one "), ready, now);
+            reassembler.add(part(1, 7, 3, 1, "one "), ready, now);
+            if (!ready.empty()) return fail("a message came out before its parts", ready);
+            reassembler.add(part(1, 7, 3, 2, "two "), ready, now);
+            if (ready.size() != 1 || ready[0].get_content() != "one two three" || ready[0].is_part())
+            {
+                return fail("three parts out of order do not make the message", ready);
+            }
+            const auto stats = reassembler.stats();
+            if (stats.completed != 1 || stats.duplicates != 1 || stats.waiting != 0 || stats.bytes != 0)
+            {
+                return fail("the counts are off after one message", ready);
+            }
+        }
+        {
+            Reassembler reassembler(10s, 64 * 1024);
+            std::vector<SMS> ready;
+            reassembler.add(part(1, 0, 2, 1, "first "), ready, now);
+            reassembler.add(part(2, 0, 2, 2, "other's second"), ready, now);
+            reassembler.add(part(1, 0, 3, 1, "longer "), ready, now);
+            reassembler.add(part(1, 0x1234, 2, 2, "wide"), ready, now);
+            reassembler.add(part(1, 0, 2, 2, "second"), ready, now);
+            reassembler.add(part(2, 0, 2, 1, "the other's first, "), ready, now);
+            reassembler.add(part(1, 0x1234, 2, 1, "16-bit and "), ready, now);
+            if (ready.size() != 3 || ready[0].get_content() != "first second" ||
+                ready[1].get_content() != "the other's first, other's second" || ready[2].get_content() != "16-bit and wide" ||
+                ready[0].get_sender() == ready[1].get_sender())
+            {
+                return fail("reference 0 from two senders and a 16-bit reference are mixed up", ready);
+            }
+            if (reassembler.stats().waiting != 1)
+            {
+                return fail("the same reference for 3 parts is not a message of its own", ready);
+            }
+
+            ready.clear();
+            reassembler.expire(ready, now + 10s - 1ms);
+            if (!ready.empty() || reassembler.next_deadline() != now + 10s)
+            {
+                return fail("a message came out before its deadline", ready);
+            }
+            reassembler.expire(ready, now + 10s);
+            if (ready.size() != 1 || ready[0].get_content() != "longer [segment missing][segment missing]" ||
+                reassembler.next_deadline() || reassembler.stats().expired != 1)
+            {
+                return fail("the message with missing parts does not come out at its deadline", ready);
+            }
+        }
+        {
+            // each message waiting takes more than 200 bytes, so a 1 KiB limit holds fewer than 5
+            Reassembler reassembler(10s, 1024, 1);
+            std::vector<SMS> ready;
+            for (unsigned int reference = 1; reference <= 10; reference++)
+            {
+                reassembler.add(part(1, reference, 2, 2, "end"), ready, now + reference * 1ms);
+            }
+            const auto stats = reassembler.stats();
+            if (stats.evicted == 0 || stats.evicted != ready.size() || stats.bytes > 1024 ||
+                ready[0].get_content() != "[segment missing]end" || stats.waiting + ready.size() != 10)
+            {
+                return fail("the oldest messages do not make way within the limit", ready);
+            }
+            if (reassembler.next_deadline() != now + (ready.size() + 1) * 1ms + 10s)
+            {
+                return fail("the deadline left is not that of the oldest message kept", ready);
+            }
+        }
+        return 0;
+    }
+
+    double run(std::size_t shards, const std::vector<std::vector<SMS>> &parts, unsigned long &completed)
+    {
+        Reassembler reassembler(600s, 64 * 1024 * 1024, shards);
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (const auto &own : parts)
+        {
+            threads.emplace_back([&reassembler, &own]()
+                                 {
+                                     std::vector<SMS> ready;
+                                     for (const auto &each : own)
+                                     {
+                                         reassembler.add(each, ready);
+                                         ready.clear();
+                                     } });
+        }
+        for (auto &each : threads)
+        {
+            each.join();
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        completed = reassembler.stats().completed;
+        return seconds;
+    }
+}
+
+namespace Bench
+{
+    int reassembly()
+    {
+        if (agree() != 0)
+        {
+            return 1;
+        }
+
+        // the parts of every message in the order 2, 3, 1, each thread a sender of its own
+        std::vector<std::vector<SMS>> parts(THREADS);
+        for (unsigned int thread = 0; thread < THREADS; thread++)
+        {
+            for (unsigned int message = 0; message < MESSAGES; message++)
+            {
+                for (unsigned int index : {2u, 3u, 1u})
+                {
+                    parts[thread].push_back(part(thread, message % 65536, PARTS, index, "part of a long message"));
+                }
+            }
+        }
+        std::cout << "\t" << THREADS << " threads, " << MESSAGES << " messages of " << PARTS << " parts each"
+                  << std::endl;
+
+        double seconds[2];
+        const std::size_t shards[2] = {1, Reassembler::SHARDS};
+        for (std::size_t idx = 0; idx < 2; idx++)
+        {
+            unsigned long completed = 0;
+            seconds[idx] = run(shards[idx], parts, completed);
+            std::cout << "\t\t" << shards[idx] << " shard(s): " << THREADS * MESSAGES * PARTS / seconds[idx] / 1e6
+                      << " M parts/s, " << seconds[idx] * 1e9 / (THREADS * MESSAGES * PARTS) << " ns per part"
+                      << std::endl;
+            if (completed != THREADS * MESSAGES)
+            {
+                std::cerr << "\t" << completed << " messages put together instead of " << THREADS * MESSAGES << std::endl;
+                return 1;
+            }
+        }
+        std::cout << "\t" << seconds[0] / seconds[1] << "x the parts/s of a single lock" << std::endl;
+        return 0;
+    }
+}
@@ -0,0 +1,160 @@
+#include <iostream>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "bench.hpp"
+#include "serial.hpp"
+
+namespace
+{
+    // What the modem sends for one stored SMS: the +CMTI URC and the +CMGR reply with a 140-octet PDU
+    const std::string modem_block = "\r\n+CMTI: \"SM\",3\r\n"
+                                    "\r\n+CMGR: 0,,159\r\n"
+                                    "07911356044902004412916801861326265746660008520113"
+                                    "1234718A8C050003D402013010660E65E565B9821F30110032"
+                                    "003000320035611F8C225E8651785F00542FFF01000A4EBA4EE"
+                                    "C65004E0A96EA5C71FF0C5411661F7A7A63A27D2230028C2262C"
+                                    "9683C8FCE676565B053D89769000A5728803662C951885FB77684"
+                                    "795D798F4E0BFF0C86548BDA65C54EBA518D6B2151FA53D1000A96"
+                                    "505B9A5E72545851DB5FA194F67070\r\n"
+                                    "\r\nOK\r\n";
+    constexpr unsigned long LINES_PER_BLOCK = 4;
+    constexpr unsigned long BLOCKS = 500;
+    // The PL011 raises its RX interrupt at a FIFO fill level; deliver the bytes in similar bursts
+    constexpr size_t BURST = 16;
+    constexpr int IDLE_TIMEOUT_MS = 1000;
+
+    void write_modem_output(int master_fd, const std::string &payload)
+    {
+        for (size_t pos = 0; pos < payload.size();)
+        {
+            auto n = write(master_fd, payload.data() + pos, std::min(BURST, payload.size() - pos));
+            if (n <= 0) return;
+            pos += n;
+        }
+    }
+
+    struct Result
+    {
+        unsigned long syscalls = 0;
+        unsigned long lines = 0;
+        double seconds = 0;
+    };
+
+    void report(const char *name, const Result &result, size_t bytes)
+    {
+        std::cout << "\t" << name << ": " << result.lines << " lines, " << result.syscalls << " syscalls ("
+                  << static_cast<double>(result.syscalls) / std::max(result.lines, 1UL) << " per line, "
+                  << static_cast<double>(result.syscalls) / bytes << " per byte), "
+                  << result.seconds * 1000 << " ms" << std::endl;
+    }
+
+    // The pre-buffering receive(): poll() and a one-byte read() for every character
+    Result per_byte_reader(int master_fd, const std::string &slave_path, const std::string &payload)
+    {
+        Result result;
+        int fd = open(slave_path.c_str(), O_RDWR | O_NOCTTY);
+        if (fd < 0) return result;
+        struct termios options;
+        tcgetattr(fd, &options);
+        cfmakeraw(&options);
+        tcsetattr(fd, TCSANOW, &options);
+
+        auto start = std::chrono::steady_clock::now();
+        std::thread writer(write_modem_output, master_fd, std::cref(payload));
+        std::string line;
+        while (result.lines < BLOCKS * LINES_PER_BLOCK)
+        {
+            struct pollfd pfd{fd, POLLIN, 0};
+            ++result.syscalls;
+            if (poll(&pfd, 1, IDLE_TIMEOUT_MS) <= 0) break;
+            unsigned char c;
+            ++result.syscalls;
+            if (read(fd, &c, 1) != 1) break;
+            if (c == '\n')
+            {
+                if (!line.empty()) ++result.lines;
+                line.clear();
+            }
+            else if (c != '\r')
+            {
+                line.push_back(c);
+            }
+        }
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        writer.join();
+        close(fd);
+        return result;
+    }
+
+    Result ring_reader(int master_fd, const std::string &slave_path, const std::string &payload)
+    {
+        Result result;
+        SerialPi serial(slave_path.c_str());
+        serial.begin(115200);
+
+        char line[512];
+        auto start = std::chrono::steady_clock::now();
+        std::thread writer(write_modem_output, master_fd, std::cref(payload));
+        while (result.lines < BLOCKS * LINES_PER_BLOCK && serial.readLine(line, sizeof(line), IDLE_TIMEOUT_MS) > 0)
+        {
+            ++result.lines;
+        }
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.syscalls = serial.readSyscallCount();
+        writer.join();
+        serial.end();
+        return result;
+    }
+}
+
+namespace Bench
+{
+    int open_pty(std::string &slave_path)
+    {
+        int master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+        if (master_fd < 0 || grantpt(master_fd) != 0 || unlockpt(master_fd) != 0)
+        {
+            std::cerr << "cannot open a pseudo-terminal" << std::endl;
+            return -1;
+        }
+        slave_path = ptsname(master_fd);
+        return master_fd;
+    }
+
+    int serial_read()
+    {
+        std::string payload;
+        for (unsigned long idx = 0; idx < BLOCKS; idx++) payload += modem_block;
+        std::cout << "\t" << BLOCKS << " x (+CMTI, +CMGR with PDU, OK) = " << payload.size()
+                  << " bytes, written in " << BURST << "-byte bursts" << std::endl;
+
+        Result results[2];
+        const char *names[2] = {"poll+read per byte", "SerialPi::readLine "};
+        for (int idx = 0; idx < 2; idx++)
+        {
+            std::string slave_path;
+            int master_fd = open_pty(slave_path);
+            if (master_fd < 0) return 1;
+            results[idx] = idx == 0 ? per_byte_reader(master_fd, slave_path, payload)
+                                    : ring_reader(master_fd, slave_path, payload);
+            close(master_fd);
+            report(names[idx], results[idx], payload.size());
+            if (results[idx].lines != BLOCKS * LINES_PER_BLOCK)
+            {
+                std::cerr << "\texpected " << BLOCKS * LINES_PER_BLOCK << " lines" << std::endl;
+                return 1;
+            }
+        }
+        std::cout << "\tsyscall reduction: " << static_cast<double>(results[0].syscalls) / results[1].syscalls
+                  << "x" << std::endl;
+        return 0;
+    }
+}
@@ -0,0 +1,126 @@
+#include <iostream>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "bench.hpp"
+#include "serial.hpp"
+
+namespace
+{
+    // A UCS2 SMS-SUBMIT of 121 octets, as sent after the "> " prompt of AT+CMGS and terminated by ^Z
+    const std::string submit_pdu = "0011000B915121551532F40008AA8C"
+                                   "4F60597D002C8FD9662F4E00676190014F608D854E0A957F7684"
+                                   "77ED4FE1FF0C752894C14E8E6D4B8BD54E32884C51999020003F"
+                                   "004B00650065007000200069007400200069006E002000610020"
+                                   "00730069006E0067006C0065002000770072006900740065002E"
+                                   "0020";
+    constexpr unsigned long MESSAGES = 1000;
+
+    struct Result
+    {
+        unsigned long syscalls = 0;
+        double seconds = 0;
+    };
+
+    void drain(int master_fd, std::atomic<bool> &done)
+    {
+        char buffer[4096];
+        while (true)
+        {
+            if (read(master_fd, buffer, sizeof(buffer)) > 0) continue;
+            if (done) break;
+            std::this_thread::yield();
+        }
+    }
+
+    // The former println(): asprintf() then write(), and send() with one write() per byte
+    Result legacy_writer(const std::string &slave_path, const std::string &command)
+    {
+        Result result;
+        int fd = open(slave_path.c_str(), O_RDWR | O_NOCTTY);
+        struct termios options;
+        tcgetattr(fd, &options);
+        cfmakeraw(&options);
+        tcsetattr(fd, TCSANOW, &options);
+
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned long idx = 0; idx < MESSAGES; idx++)
+        {
+            char *msg = NULL;
+            asprintf(&msg, "%s%s", command.c_str(), "\r\n");
+            ++result.syscalls;
+            write(fd, msg, strlen(msg));
+            free(msg);
+            for (const auto each : submit_pdu + '\x1a')
+            {
+                ++result.syscalls;
+                write(fd, &each, 1);
+            }
+        }
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        close(fd);
+        return result;
+    }
+
+    Result vector_writer(const std::string &slave_path, const std::string &command)
+    {
+        Result result;
+        SerialPi serial(slave_path.c_str());
+        serial.begin(115200);
+        const auto pdu = submit_pdu + '\x1a';
+
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned long idx = 0; idx < MESSAGES; idx++)
+        {
+            serial.println(command.c_str());
+            serial.send(pdu.data(), pdu.size());
+        }
+        while (serial.writePending() > 0)
+        {
+            std::this_thread::yield();
+        }
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.syscalls = serial.writeSyscallCount();
+        serial.end();
+        return result;
+    }
+}
+
+namespace Bench
+{
+    int serial_write()
+    {
+        const std::string command = "AT+CMGS=" + std::to_string(submit_pdu.size() / 2 - 1);
+        std::cout << "\t" << MESSAGES << " x (" << command << ", " << submit_pdu.size() << "-digit PDU + ^Z)" << std::endl;
+
+        Result results[2];
+        const char *names[2] = {"asprintf+write, write per byte", "SerialPi writev             "};
+        for (int idx = 0; idx < 2; idx++)
+        {
+            std::string slave_path;
+            int master_fd = open_pty(slave_path);
+            if (master_fd < 0) return 1;
+            fcntl(master_fd, F_SETFL, O_NONBLOCK);
+            std::atomic<bool> done{false};
+            std::thread reader(drain, master_fd, std::ref(done));
+            results[idx] = idx == 0 ? legacy_writer(slave_path, command) : vector_writer(slave_path, command);
+            done = true;
+            reader.join();
+            close(master_fd);
+            std::cout << "\t" << names[idx] << ": " << results[idx].syscalls << " syscalls ("
+                      << static_cast<double>(results[idx].syscalls) / MESSAGES << " per message), "
+                      << results[idx].seconds * 1000 << " ms" << std::endl;
+        }
+        std::cout << "\tsyscall reduction: " << static_cast<double>(results[0].syscalls) / results[1].syscalls
+                  << "x" << std::endl;
+        return 0;
+    }
+}
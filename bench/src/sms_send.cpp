@@ -0,0 +1,323 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include <sys/epoll.h>
+
+#include "bench.hpp"
+#include "serial.hpp"
+#include "reactor.hpp"
+#include "at_engine.hpp"
+#include "line_framer.hpp"
+#include "modem_sim.hpp"
+#include "pdu_encoder.hpp"
+#include "reassembler.hpp"
+#include "sms.hpp"
+
+using namespace std::literals::chrono_literals;
+
+namespace
+{
+    // Messages sent against the simulator, every third a long one of 2 parts
+    constexpr unsigned int MESSAGES = 30;
+
+    // The network's answer to AT+CMGS once the radio link is up, and bringing the link up
+    constexpr auto SEND_LATENCY = 10ms;
+    constexpr auto LINK_SETUP = 100ms;
+
+    constexpr unsigned long ENCODED = 100000;
+
+    const std::string RECIPIENT = "+447700900123";
+
+    std::string hex(unsigned int octet)
+    {
+        char out[3];
+        std::snprintf(out, sizeof(out), "%02X", octet & 0xFF);
+        return out;
+    }
+
+    // The SMS-DELIVER the recipient would get for an SMS-SUBMIT: the same address, PID, DCS and user data
+    std::string delivered(const std::string &submit)
+    {
+        std::vector<unsigned int> octets;
+        for (std::size_t idx = 0; idx + 1 < submit.size(); idx += 2)
+        {
+            octets.push_back(std::strtoul(submit.substr(idx, 2).c_str(), nullptr, 16));
+        }
+        std::size_t at = 1 + octets[0];
+        const unsigned int first = octets[at];
+        at += 2; // first octet, TP-MR
+        const std::size_t address = 2 + (octets[at] + 1) / 2;
+        std::string pdu = "00" + hex(0x04 | (first & 0x40));
+        for (std::size_t idx = 0; idx < address + 2; idx++) pdu += hex(octets[at + idx]); // TP-DA, TP-PID, TP-DCS
+        at += address + 2;
+        if ((first & 0x18) == 0x10) at++; // a relative TP-VP
+        pdu += "52011312347100";
+        for (; at < octets.size(); at++) pdu += hex(octets[at]); // TP-UDL and TP-UD
+        return pdu;
+    }
+
+    int fail(const std::string &text, const std::string &what)
+    {
+        std::cerr << "\t\"" << (text.size() > 60 ? text.substr(0, 60) + "..." : text) << "\": " << what << std::endl;
+        return 1;
+    }
+
+    // text is sent in parts and comes back whole through SMS(pdu) and the reassembler
+    int round_trip(PduEncoder &encoder, const std::string &text, std::size_t parts, uint8_t reference)
+    {
+        std::vector<PduEncoder::Pdu> pdus;
+        if (const auto error = encoder.encode(RECIPIENT, text, reference, pdus); error != PduEncoder::Error::NONE)
+        {
+            return fail(text, PduEncoder::to_string(error));
+        }
+        if (pdus.size() != parts)
+        {
+            return fail(text, std::to_string(pdus.size()) + " parts instead of " + std::to_string(parts));
+        }
+        Reassembler reassembler(10s, 1024 * 1024);
+        std::vector<SMS> ready;
+        for (const auto &pdu : pdus)
+        {
+            if (pdu.hex.size() != 2 * (pdu.tpdu_length + 1))
+            {
+                return fail(text, "a TPDU length that is not that of " + pdu.hex);
+            }
+            SMS message(delivered(pdu.hex));
+            if (!message.is_part())
+            {
+                ready.push_back(std::move(message));
+            }
+            else
+            {
+                reassembler.add(std::move(message), ready);
+            }
+        }
+        if (ready.size() != 1 || ready[0].get_content() != text)
+        {
+            return fail(text, ready.empty() ? "never whole" : "came back as \"" + ready[0].get_content() + "\"");
+        }
+        return 0;
+    }
+
+    // Both alphabets, the limits of a single message, escapes and surrogate pairs where a part ends, and errors
+    int agree()
+    {
+        PduEncoder encoder;
+        std::string gsm7_escape_at_end(152, 'a');
+        gsm7_escape_at_end += "{" + std::string(20, 'b');
+        std::string ucs2_pair_at_end;
+        for (int idx = 0; idx < 66; idx++) ucs2_pair_at_end += "ж";
+        ucs2_pair_at_end += "😀 and the rest";
+
+        const std::pair<std::string, std::size_t> sent[] = {
+            {"Hello", 1},
+            {"Grüße, ñ and € [x] ~ {y} | \\ ^", 1},
+            {std::string(160, 'a'), 1},
+            {std::string(161, 'a'), 2},
+            {std::string(80, '{'), 1}, // 160 septets, 2 each
+            {std::string(81, '{'), 2},
+            {gsm7_escape_at_end, 2},
+            {"Привет 😀", 1},
+            {std::string(70, ' ').replace(0, 1, "ж"), 1}, // 70 UCS-2 units
+            {std::string(71, ' ').replace(0, 1, "ж"), 2},
+            {ucs2_pair_at_end, 2},
+            {std::string(153 * 255, 'z'), 255},
+        };
+        uint8_t reference = 0;
+        for (const auto &[text, parts] : sent)
+        {
+            if (round_trip(encoder, text, parts, reference++) != 0)
+            {
+                return 1;
+            }
+        }
+
+        const std::tuple<std::string, std::string, PduEncoder::Error> refused[] = {
+            {"+44abc", "hi", PduEncoder::Error::BAD_NUMBER},
+            {"+", "hi", PduEncoder::Error::BAD_NUMBER},
+            {std::string(21, '1'), "hi", PduEncoder::Error::BAD_NUMBER},
+            {RECIPIENT, "", PduEncoder::Error::EMPTY},
+            {RECIPIENT, "\xC3", PduEncoder::Error::NOT_UTF8},
+            {RECIPIENT, "\xED\xA0\x80", PduEncoder::Error::NOT_UTF8},
+            {RECIPIENT, "\xC0\x80", PduEncoder::Error::NOT_UTF8},
+            {RECIPIENT, std::string(153 * 255 + 1, 'z'), PduEncoder::Error::TOO_LONG},
+        };
+        for (const auto &[recipient, text, expected] : refused)
+        {
+            std::vector<PduEncoder::Pdu> pdus;
+            if (const auto error = encoder.encode(recipient, text, 0, pdus); error != expected || !pdus.empty())
+            {
+                return fail(recipient + " " + text, std::string("\"") + PduEncoder::to_string(error) + "\", not \"" +
+                                                        PduEncoder::to_string(expected) + "\"");
+            }
+        }
+        return 0;
+    }
+
+    struct Result
+    {
+        unsigned long sent = 0;
+        unsigned long failed = 0;
+        unsigned long link_setups = 0;
+        double seconds = 0;
+    };
+
+    /**
+     * Send messages through AT+CMGS against the simulator: one at a time as each is answered, or all queued
+     * at once behind AT+CMMS=1
+     */
+    Result run(const std::vector<std::vector<PduEncoder::Pdu>> &messages, bool queued)
+    {
+        ModemSimulator::Options options;
+        options.latency = 1ms;
+        options.command_latency["+CMGS"] = SEND_LATENCY;
+        options.link_setup = LINK_SETUP;
+        ModemSimulator modem(options);
+        std::thread modem_thread([&modem]()
+                                 { modem.run(); });
+
+        Result result;
+        {
+            SerialPi serial(modem.device().c_str());
+            serial.begin(115200);
+            Reactor reactor;
+            ATEngine engine(serial, reactor);
+            LineFramer framer;
+            reactor.add(serial.fileDescriptor(), EPOLLIN, "serial", [&](uint32_t events)
+                        {
+                            if (events & EPOLLOUT) engine.output_ready();
+                            int length;
+                            while ((length = serial.readChunk(framer.space(), framer.space_size(), 0)) > 0)
+                            {
+                                framer.commit(length);
+                                for (std::string_view line; framer.next(line);)
+                                {
+                                    engine.consume(line);
+                                }
+                            }
+                            // as Modem::offer_prompt() does
+                            if (engine.awaiting_prompt() && !framer.partial().empty() && framer.partial().front() == '>')
+                            {
+                                framer.clear();
+                                engine.prompt();
+                            } });
+
+            auto *log_buffer = std::cout.rdbuf(nullptr);
+            auto *error_buffer = std::cerr.rdbuf(nullptr);
+            const auto start = std::chrono::steady_clock::now();
+            // the parts in the order they go, each answered before the next unless queued
+            std::vector<const PduEncoder::Pdu *> order;
+            for (const auto &each : messages)
+            {
+                for (const auto &pdu : each) order.push_back(&pdu);
+            }
+            std::size_t answered = 0;
+            std::function<void(std::size_t)> send = [&](std::size_t part)
+            {
+                const auto &pdu = *order[part];
+                engine.submit_prompted("AT+CMGS=" + std::to_string(pdu.tpdu_length), pdu.hex, 5000ms,
+                                       [&, part](const ATEngine::Result &reply)
+                                       {
+                                           ++answered;
+                                           ++(reply.ok() ? result.sent : result.failed);
+                                           if (!queued && part + 1 < order.size()) send(part + 1);
+                                       });
+            };
+            if (queued)
+            {
+                engine.submit("AT+CMMS=1", 1000ms, nullptr);
+                for (std::size_t part = 0; part < order.size(); part++) send(part);
+            }
+            else
+            {
+                send(0);
+            }
+            while (answered < order.size())
+            {
+                reactor.run_once(100);
+            }
+            result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cout.rdbuf(log_buffer);
+            std::cerr.rdbuf(error_buffer);
+            serial.end();
+        }
+        result.link_setups = modem.link_setups();
+        modem.stop();
+        modem_thread.join();
+        return result;
+    }
+}
+
+namespace Bench
+{
+    int sms_send()
+    {
+        if (agree() != 0)
+        {
+            return 1;
+        }
+
+        PduEncoder encoder;
+        std::vector<std::vector<PduEncoder::Pdu>> messages(MESSAGES);
+        std::size_t parts = 0;
+        for (unsigned int idx = 0; idx < MESSAGES; idx++)
+        {
+            const std::string text = idx % 3 == 2 ? "Your statement is ready. " + std::string(150, '.') + " #" + std::to_string(idx)
+                                                  : "Your code is " + std::to_string(100000 + idx);
+            encoder.encode(RECIPIENT, text, static_cast<uint8_t>(idx), messages[idx]);
+            parts += messages[idx].size();
+        }
+        {
+            const auto allocated = Bench::allocations();
+            const auto start = std::chrono::steady_clock::now();
+            std::vector<PduEncoder::Pdu> pdus;
+            std::size_t sink = 0;
+            for (unsigned long idx = 0; idx < ENCODED; idx++)
+            {
+                encoder.encode(RECIPIENT, idx % 2 ? "Your code is 123456" : "Привет, ваш код 123456", 0, pdus);
+                sink += pdus.size();
+            }
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            const double allocations = static_cast<double>(Bench::allocations() - allocated) / ENCODED;
+            std::cout << "\tencoding: " << ENCODED / seconds / 1e6 << " M messages/s, " << allocations
+                      << " allocations per message (" << (sink & 1) << ")" << std::endl;
+            Bench::metric("encode.per_s", ENCODED / seconds);
+            Bench::metric("encode.allocations", allocations);
+        }
+
+        std::cout << "\t" << MESSAGES << " messages in " << parts << " parts against the simulator, "
+                  << SEND_LATENCY.count() << " ms per AT+CMGS, " << LINK_SETUP.count() << " ms to bring the link up"
+                  << std::endl;
+        double seconds[2];
+        for (const bool queued : {false, true})
+        {
+            const auto result = run(messages, queued);
+            seconds[queued] = result.seconds;
+            const double per_minute = MESSAGES * 60 / result.seconds;
+            std::cout << "\t\t" << (queued ? "queued, AT+CMMS=1" : "one at a time") << ": " << per_minute
+                      << " messages/min, " << result.link_setups << " link setups, " << result.failed << " failed"
+                      << std::endl;
+            Bench::metric(queued ? "queued.per_min" : "one_at_a_time.per_min", per_minute);
+            if (result.sent != parts || result.failed != 0)
+            {
+                std::cerr << "\t" << result.sent << " of " << parts << " parts sent" << std::endl;
+                return 1;
+            }
+            if (queued && result.link_setups != 1)
+            {
+                std::cerr << "\tAT+CMMS=1 does not keep the link up between messages" << std::endl;
+                return 1;
+            }
+        }
+        std::cout << "\t" << seconds[0] / seconds[1] << "x the messages/min of one at a time" << std::endl;
+        return 0;
+    }
+}
@@ -0,0 +1,122 @@
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+
+#include "bench.hpp"
+#include "urc.hpp"
+
+namespace
+{
+    // The codes the service knows, handlers replaced by their position
+    constexpr auto urc_table = make_urc_table<int>({
+        {"+CMTI", 1},
+        {"+CMT", 2, true},
+        {"+CDSI", 3},
+        {"+CDS", 4, true},
+        {"+CBM", 5, true},
+        {"RING", 6},
+        {"+CLIP", 7},
+        {"NO CARRIER", 8},
+        {"+CREG", 9},
+        {"+CGREG", 10},
+        {"+CEREG", 11},
+        {"+CPIN", 12},
+        {"RDY", 13},
+        {"SMS DONE", 14},
+        {"PB DONE", 15},
+        {"NORMAL POWER DOWN", 16},
+    });
+
+    static_assert(urc_table.find("+CMTI: \"SM\",3") != nullptr && urc_table.find("+CMTI: \"SM\",3")->handler == 1);
+    static_assert(urc_table.find("+CMT: ,24") != nullptr && urc_table.find("+CMT: ,24")->handler == 2);
+    static_assert(urc_table.find("+CMGR: 0,,24") == nullptr && urc_table.find("OK") == nullptr);
+
+    // In the order the old chain of find() calls would have to test them: +CMTI before +CMT
+    const std::vector<std::string_view> names{"+CMTI:", "+CMT:", "+CDSI:", "+CDS:", "+CBM:", "RING", "+CLIP:",
+                                              "NO CARRIER", "+CREG:", "+CGREG:", "+CEREG:", "+CPIN:", "RDY",
+                                              "SMS DONE", "PB DONE", "NORMAL POWER DOWN"};
+
+    // Lines as they come from the modem: replies, their PDUs, and unsolicited results
+    const std::vector<std::string> lines{
+        "OK",
+        "+CSQ: 21,99",
+        "+CMTI: \"SM\",3",
+        "+CMGR: 0,,159",
+        "07911356044902004412916801861326265746660008520113"
+        "1234718A8C050003D402013010660E65E565B9821F30110032"
+        "003000320035611F8C225E8651785F00542FFF01000A4EBA4EE"
+        "C65004E0A96EA5C71FF0C5411661F7A7A63A27D2230028C2262C",
+        "OK",
+        "RING",
+        "+CLIP: \"+8613800138000\",145,,,,0",
+        "+CREG: 1",
+        "+COPS: 0,0,\"CHINA MOBILE\",7",
+        "OK",
+        "+CMT: ,24",
+        "0791448720003023240DD0E474D81C0EBB010000111011315214000BE474D81C0EBB5DE3771B",
+        "NO CARRIER",
+        "+CME ERROR: 10",
+    };
+    constexpr unsigned long ROUNDS = 500000;
+
+    struct Result
+    {
+        unsigned long recognised = 0;
+        double seconds = 0;
+    };
+
+    template <typename Classifier>
+    Result measure(Classifier classify)
+    {
+        Result result;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned long round = 0; round < ROUNDS; round++)
+        {
+            for (const auto &line : lines)
+            {
+                result.recognised += classify(std::string_view(line));
+            }
+        }
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+    void report(const char *name, const Result &result)
+    {
+        std::cout << "\t" << name << ": " << result.recognised << " URCs, "
+                  << result.seconds * 1e9 / (ROUNDS * lines.size()) << " ns per line" << std::endl;
+    }
+}
+
+namespace Bench
+{
+    int urc_dispatch()
+    {
+        std::cout << "\t" << ROUNDS << " x " << lines.size() << " lines, " << names.size() << " known codes" << std::endl;
+        // What Service::loop() did: two substring searches, so it only told +CMTI and RING apart
+        const auto two_finds = measure([](std::string_view line)
+                                       { return line.find("+CMTI:") != line.npos || line.find("RING") != line.npos ? 1 : 0; });
+        // The same approach extended to every code the table knows
+        const auto all_finds = measure([](std::string_view line)
+                                       {
+                                           for (const auto name : names)
+                                           {
+                                               if (line.find(name) != line.npos) return 1;
+                                           }
+                                           return 0; });
+        const auto table = measure([](std::string_view line)
+                                   { return urc_table.find(line) != nullptr ? 1 : 0; });
+        report("find() x 2        ", two_finds);
+        report("find() x 16       ", all_finds);
+        report("UrcTable::find    ", table);
+        if (table.recognised != all_finds.recognised)
+        {
+            std::cerr << "\tthe table and the find() chain disagree" << std::endl;
+            return 1;
+        }
+        std::cout << "\tspeedup over the extended chain: " << all_finds.seconds / table.seconds << "x" << std::endl;
+        return 0;
+    }
+}
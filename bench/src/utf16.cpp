@@ -0,0 +1,278 @@
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bench.hpp"
+#include "pdu_decoder.hpp"
+#include "utf16.hpp"
+
+namespace
+{
+    constexpr unsigned long ROUNDS = 200000;
+
+    // The user data of a single UCS-2 message: 140 octets
+    constexpr std::size_t UNITS = 70;
+
+    struct Text
+    {
+        const char *name;
+        std::string_view utf8;
+    };
+
+    // Mostly Chinese, as most of what the service receives; then Latin with and without accents, and emoji
+    const std::vector<Text> texts{
+        {"Chinese", "【明日方舟】2025感谢庆典开启！人们攀上雪山，向星空探索。谢拉格迎来新变革在耶拉冈德的祝福下，虔诚旅人再次出发，"
+                    "庆典限定寻访开启"},
+        {"ASCII", "Your verification code is 482913. It expires in 10 minutes. Do not share it with anyone."},
+        {"accented", "Votre colis est arrivé au dépôt. Récupérez-le avant vendredi à 18h, merci. À bientôt !"},
+        {"emoji", "Happy birthday 🎂🎉 from all of us 😀 see you at 8, don't be late 🥳🥳 ok? 👍"},
+    };
+
+    // The two segments of a message whose surrogate pair the split falls between, and what they make
+    const char *split_pdus[] = {
+        "0791448720003023440B914477661122F30008520113123471002E0500037F02010042006F006E00200061006E006E00690076006500"
+        "7200730061006900720065002000210020D83C",
+        "0791448720003023440B914477661122F3000852011312347100120500037F0202DF820020751F65E55FEB4E50",
+    };
+    constexpr std::string_view SPLIT_TEXT = "Bon anniversaire ! 🎂 生日快乐";
+
+    // UTF-8 to UTF-16BE, as a phone would send it; the text is known to be valid
+    std::vector<uint8_t> utf16be(std::string_view utf8)
+    {
+        std::vector<uint8_t> be;
+        const auto unit = [&be](unsigned int value)
+        {
+            be.push_back(static_cast<uint8_t>(value >> 8));
+            be.push_back(static_cast<uint8_t>(value));
+        };
+        for (std::size_t idx = 0; idx < utf8.size();)
+        {
+            const auto lead = static_cast<unsigned char>(utf8[idx]);
+            const std::size_t length = lead < 0x80 ? 1 : lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : 4;
+            unsigned int code_point = length == 1 ? lead : lead & (0x7F >> length);
+            for (std::size_t each = 1; each < length; each++)
+            {
+                code_point = code_point << 6 | (static_cast<unsigned char>(utf8[idx + each]) & 0x3F);
+            }
+            idx += length;
+            if (code_point >= 0x10000)
+            {
+                unit(0xD800 | (code_point - 0x10000) >> 10);
+                unit(0xDC00 | (code_point & 0x3FF));
+                continue;
+            }
+            unit(code_point);
+        }
+        return be;
+    }
+
+    // What SMS did before Utf16: every unit a BMP code point, a push_back per byte
+    std::string push_back_per_byte(const std::vector<unsigned char> &data)
+    {
+        std::string out;
+        for (std::size_t i = 0; i + 1 < data.size(); i += 2)
+        {
+            unsigned short int ch = (data[i] << 8) | data[i + 1];
+            if (ch < 0x80)
+            {
+                out.push_back(static_cast<char>(ch));
+            }
+            else if (ch < 0x800)
+            {
+                out.push_back(0xC0 | (ch >> 6));
+                out.push_back(0x80 | (ch & 0x3F));
+            }
+            else
+            {
+                out.push_back(0xE0 | (ch >> 12));
+                out.push_back(0x80 | ((ch >> 6) & 0x3F));
+                out.push_back(0x80 | (ch & 0x3F));
+            }
+        }
+        return out;
+    }
+
+    std::string transcode(const std::vector<uint8_t> &be, bool vector)
+    {
+        std::string out(be.size() / 2 * Utf16::MAX_UTF8, '\0');
+        out.resize(vector ? Utf16::to_utf8(be.data(), be.size() / 2, out.data())
+                          : Utf16::to_utf8_scalar(be.data(), be.size() / 2, out.data()));
+        return out;
+    }
+
+    double seconds_since(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void report(const char *name, double seconds)
+    {
+        const double units = static_cast<double>(ROUNDS) * UNITS;
+        std::cout << "\t\t" << name << ": " << units / seconds / 1e6 << " M units/s, " << seconds * 1e9 / ROUNDS
+                  << " ns per message" << std::endl;
+    }
+
+    // Texts come back as they went in, split pairs are joined, what is not UTF-8 is replaced, and the
+    // vector path writes what the scalar one does for any mix of units at every length
+    int agree()
+    {
+        for (const auto &text : texts)
+        {
+            const auto be = utf16be(text.utf8);
+            if (transcode(be, true) != text.utf8 || transcode(be, false) != text.utf8)
+            {
+                std::cerr << "\tthe " << text.name << " text does not come back as it went in" << std::endl;
+                return 1;
+            }
+        }
+
+        PduDecoder decoder;
+        std::string joined;
+        for (const char *pdu : split_pdus)
+        {
+            PduDecoder::Message message;
+            if (decoder.decode(pdu, message) != PduDecoder::Error::NONE)
+            {
+                std::cerr << "\t" << pdu << " does not decode" << std::endl;
+                return 1;
+            }
+            joined += message.text;
+        }
+        if (Utf16::finish(joined) != 0 || joined != SPLIT_TEXT)
+        {
+            std::cerr << "\tthe segments join to \"" << joined << "\"" << std::endl;
+            return 1;
+        }
+
+        // a low surrogate on its own, a high one at the end, a stray continuation byte and an overlong NUL
+        std::string broken = transcode({0xDC, 0x00, 0x00, 0x41, 0xD8, 0x3D}, true) + "\x80" + "\xC0\x80" + "ok";
+        if (const auto replaced = Utf16::finish(broken);
+            replaced != 5 || broken != "\xEF\xBF\xBD" "A" "\xEF\xBF\xBD\xEF\xBF\xBD\xEF\xBF\xBD\xEF\xBF\xBD" "ok")
+        {
+            std::cerr << "\t" << replaced << " replaced, leaving \"" << broken << "\"" << std::endl;
+            return 1;
+        }
+
+        static constexpr unsigned int UNIT_KINDS[] = {0x41, 0x7F, 0xE9, 0x7FF, 0x800, 0x4E2D, 0xFF0C,
+                                                      0xD83D, 0xDE00, 0xE000, 0xFFFF};
+        std::mt19937 random(21);
+        for (std::size_t units = 0; units <= 127; units++)
+        {
+            for (unsigned int percent_other : {0u, 10u, 50u})
+            {
+                std::vector<uint8_t> be;
+                for (std::size_t idx = 0; idx < units; idx++)
+                {
+                    // runs of one kind, now and then another
+                    const unsigned int unit = random() % 100 < percent_other
+                                                  ? UNIT_KINDS[random() % std::size(UNIT_KINDS)]
+                                                  : UNIT_KINDS[units % std::size(UNIT_KINDS)] + (idx % 2);
+                    be.push_back(static_cast<uint8_t>(unit >> 8));
+                    be.push_back(static_cast<uint8_t>(unit));
+                }
+                if (transcode(be, true) != transcode(be, false))
+                {
+                    std::cerr << "\tthe " << Utf16::vector_unit() << " and scalar paths disagree on " << units
+                              << " units" << std::endl;
+                    return 1;
+                }
+            }
+            // 1- and 2-byte units in any order, as in accented Latin text
+            std::vector<uint8_t> latin;
+            for (std::size_t idx = 0; idx < units; idx++)
+            {
+                const unsigned int unit = UNIT_KINDS[random() % 4];
+                latin.push_back(static_cast<uint8_t>(unit >> 8));
+                latin.push_back(static_cast<uint8_t>(unit));
+            }
+            if (transcode(latin, true) != transcode(latin, false))
+            {
+                std::cerr << "\tthe " << Utf16::vector_unit() << " and scalar paths disagree on " << units
+                          << " units of 1 and 2 bytes" << std::endl;
+                return 1;
+            }
+        }
+        return 0;
+    }
+}
+
+namespace Bench
+{
+    int utf16()
+    {
+        if (agree() != 0)
+        {
+            return 1;
+        }
+        std::cout << "\t" << UNITS << "-unit messages, " << ROUNDS << " rounds, vector unit: " << Utf16::vector_unit()
+                  << std::endl;
+
+        char out[UNITS * Utf16::MAX_UTF8];
+        std::size_t sink = 0;
+        double scalar_total = 0;
+        double vector_total = 0;
+        const char *slower = nullptr;
+        for (const auto &text : texts)
+        {
+            auto be = utf16be(text.utf8);
+            be.resize(2 * UNITS, 0);
+            if ((be[2 * UNITS - 2] & 0xFC) == 0xD8) be[2 * UNITS - 2] = 0; // no half pair at the cut
+            const std::vector<unsigned char> data(be.begin(), be.end());
+            std::cout << "\t" << text.name << ":" << std::endl;
+
+            auto start = std::chrono::steady_clock::now();
+            for (unsigned long round = 0; round < ROUNDS; round++)
+            {
+                sink += push_back_per_byte(data).size();
+            }
+            report("push_back per byte", seconds_since(start));
+
+            start = std::chrono::steady_clock::now();
+            for (unsigned long round = 0; round < ROUNDS; round++)
+            {
+                sink += Utf16::to_utf8_scalar(be.data(), UNITS, out);
+            }
+            const double scalar_seconds = seconds_since(start);
+            report("unit by unit", scalar_seconds);
+
+            start = std::chrono::steady_clock::now();
+            for (unsigned long round = 0; round < ROUNDS; round++)
+            {
+                sink += Utf16::to_utf8(be.data(), UNITS, out);
+            }
+            const double vector_seconds = seconds_since(start);
+            report("vectorised", vector_seconds);
+            std::cout << "\t\t" << scalar_seconds / vector_seconds << "x unit by unit" << std::endl;
+            if (vector_seconds >= scalar_seconds && slower == nullptr) slower = text.name;
+
+            std::string utf8 = transcode(be, true);
+            start = std::chrono::steady_clock::now();
+            for (unsigned long round = 0; round < ROUNDS; round++)
+            {
+                sink += Utf16::finish(utf8);
+            }
+            report("finish(), valid", seconds_since(start));
+            scalar_total += scalar_seconds;
+            vector_total += vector_seconds;
+        }
+        std::cout << "\t" << scalar_total / vector_total << "x the units/s of the scalar code (" << (sink & 1) << ")"
+                  << std::endl;
+#if defined(__OPTIMIZE__)
+        // every text, not only all of them together
+        if (std::strcmp(Utf16::vector_unit(), "none") != 0 && slower != nullptr)
+        {
+            std::cerr << "\tthe " << slower << " text is no faster vectorised than unit by unit" << std::endl;
+            return 1;
+        }
+        return 0;
+#else
+        // intrinsics left as calls say nothing about the vector path
+        return 0;
+#endif
+    }
+}
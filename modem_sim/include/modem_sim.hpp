@@ -0,0 +1,265 @@
+#ifndef MODEM_SIM_HPP
+#define MODEM_SIM_HPP
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "cmux.hpp"
+
+/**
+ * A SIM7600 stand-in on a pseudo-terminal. The service opens device() as if it were /dev/ttyS0 and
+ * talks AT to it; the simulator answers the subset of the dialect the service uses (AT, E0/E1, +CPIN?,
+ * +CREG?, +COPS?, +CSQ, +CMGF, +CSMS, +CNMI, +CNMA, +CLIP, +CGATT, +CMGR, +CMGD, +CMGL, +CMGS, +CMMS, +IPR, +IFC, +CMUX)
+ * after a configurable latency, and raises +CMTI / +CMT / RING / +CLIP when told to. Like a real UART, nothing gets through
+ * while the rate the service set on the pty differs from the one the modem runs at. With a ring_indicator
+ * FIFO, RI is pulsed before RING, +CMTI and +CMT by writing the edge events a GPIO chip would queue.
+ *
+ * After AT+CMUX=0 it speaks the basic option of 27.010: DLCs are opened with SABM, each takes AT commands
+ * of its own and answers them in order, while the replies of different DLCs go out as they are due.
+ * URCs go to DLC 1.
+ *
+ * After AT+CNMI=2,2 messages are handed over with +CMT instead of being stored. Under AT+CSMS=1 each has to
+ * be acknowledged with AT+CNMA within ACK_TIMEOUT before the next one comes; one refused (AT+CNMA=2) or
+ * left unacknowledged is sent again by the "network" NETWORK_RETRY later, and a missed acknowledgement
+ * turns routing off (<mt> 0: stored without +CMTI) as 27.005 has it.
+ *
+ * AT+CMGS prompts with "> " and takes the PDU up to ^Z (ESC drops it). Sending one takes the network
+ * link_setup on top of the command's latency to bring the radio link up, unless AT+CMMS keeps it up from the
+ * message before: until LINK_HOLD passes without one, after which <n> 1 falls back to 0 as well.
+ */
+class ModemSimulator
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Options
+    {
+        // delay before every reply, and per command verb (e.g. "+CMGR", "+CMGL") if set there
+        std::chrono::milliseconds latency{5};
+        std::unordered_map<std::string, std::chrono::milliseconds> command_latency;
+        // optional symlink to the slave end, e.g. /tmp/ttySIM0, so the path is stable across runs
+        std::string link;
+        unsigned int capacity = 50; // messages the "SM" storage holds
+        int rssi = 20;
+        bool sim_ready = true;
+        int baud = 115200; // the modem's rate at power-on
+        int link_limit = 0; // fastest rate the wiring carries, e.g. a level shifter; 0 for no limit
+        std::string ring_indicator; // FIFO the service reads as the GPIO chip RI is wired to; created if missing
+        std::chrono::milliseconds link_setup{50}; // bringing the radio link up for a message sent
+    };
+
+    // How long a +CMT waits for AT+CNMA under AT+CSMS=1, and the network for sending a message again
+    static constexpr std::chrono::milliseconds ACK_TIMEOUT{5000};
+
+    static constexpr std::chrono::milliseconds NETWORK_RETRY{2000};
+
+    // How long AT+CMMS keeps the radio link up after a message was sent
+    static constexpr std::chrono::milliseconds LINK_HOLD{3000};
+
+    explicit ModemSimulator(Options options);
+
+    ~ModemSimulator();
+
+    ModemSimulator(const ModemSimulator &) = delete;
+
+    ModemSimulator &operator=(const ModemSimulator &) = delete;
+
+    // Path of the slave end of the pty
+    const std::string &device() const;
+
+    // The following may be called from any thread; they take effect on the simulator loop
+
+    // An SMS-DELIVER PDU (hex, with SMSC) arrives: stored in "SM" and announced with +CMTI, or sent with +CMT
+    void deliver_sms(std::string pdu);
+
+    // Store a PDU without announcing it, like messages received while the service was down
+    void store_sms(std::string pdu);
+
+    // RING, followed by +CLIP when the service enabled it with AT+CLIP=1
+    void ring(std::string number);
+
+    // Any other unsolicited line
+    void emit(std::string urc);
+
+    // Serve the pty for up to timeout_ms; returns false once stopped
+    bool run_once(int timeout_ms);
+
+    void run();
+
+    void stop();
+
+    size_t stored() const;
+
+    unsigned long commands() const;
+
+    // Messages sent with AT+CMGS, and how often the radio link was brought up for one
+    unsigned long submitted() const;
+
+    unsigned long link_setups() const;
+
+    int baud() const;
+
+private:
+    struct Output
+    {
+        Clock::time_point due;
+        std::string text;
+        int switch_to = 0; // instead of text: change the modem's rate once everything before is out
+        unsigned int dlci = 0; // the DLC text was framed for, which it keeps its order within
+    };
+
+    struct Message
+    {
+        int stat = 0; // 0 REC UNREAD, 1 REC READ
+        std::string pdu;
+    };
+
+    void inject(std::function<void()> action);
+
+    // Handle the commands complete in input, as if they came on DLC dlci (0 when not multiplexed)
+    void take_commands(std::string &input, unsigned int dlci);
+
+    void handle_command(const std::string &command);
+
+    // The frames the modem sends on DLC dlci to carry text, or text itself when not multiplexed
+    std::string framed(unsigned int dlci, std::string_view text) const;
+
+    // Queue bytes to go out at due or, if later, once what the same DLC queued before is out
+    void queue(unsigned int dlci, std::string bytes, Clock::time_point due);
+
+    void demultiplex(const char *data, size_t length);
+
+    void control_message(std::string_view info);
+
+    void leave_multiplexing();
+
+    void reply(const std::string &verb, const std::string &body, const std::string &final_result = "OK");
+
+    void unsolicited(const std::string &line);
+
+    // The falling edge of RI, as struct gpio_v2_line_event
+    void pulse_ring_indicator();
+
+    std::chrono::milliseconds latency_of(const std::string &verb) const;
+
+    // A hex PDU with its SMSC; logs why not otherwise
+    static bool well_formed(const std::string &pdu);
+
+    int store(std::string pdu);
+
+    // A message from the network, routed as AT+CNMI says
+    void receive(std::string pdu);
+
+    // "+CMT: ,<length>" and the PDU on the next line
+    static std::string delivery_urc(const std::string &pdu);
+
+    // +CMT of the oldest message waiting for its acknowledgement
+    void send_unacknowledged();
+
+    // The acknowledgement deadline and the network's retries
+    void network_due();
+
+    void list_messages(int stat, std::string &body);
+
+    // The PDU after the prompt of AT+CMGS on the current DLC, ended by ^Z (send) or ESC
+    void submit(std::string pdu, bool send);
+
+    void write_due();
+
+    // The service's rate on the pty matches the modem's and the wiring carries it
+    bool link_up();
+
+    Options m_options;
+
+    int m_master = -1;
+
+    int m_slave = -1; // held open so the line settings survive the service reopening the port
+
+    int m_wake = -1;
+
+    int m_ring_indicator = -1;
+
+    unsigned int m_ring_pulses = 0;
+
+    std::string m_device;
+
+    std::string m_input;
+
+    std::deque<Output> m_output;
+
+    std::atomic<int> m_baud;
+
+    int m_garbled_rate = 0; // host rate of the last garbled exchange, to log each mismatch once
+
+    bool m_echo = true;
+
+    bool m_multiplexed = false;
+
+    size_t m_frame_size = 31; // N1 of AT+CMUX
+
+    CmuxDecoder m_decoder;
+
+    // DLCs the service opened, and the command each is in the middle of
+    bool m_open[Cmux::MAX_DLCI + 1] = {};
+
+    std::string m_channel_input[Cmux::MAX_DLCI + 1];
+
+    unsigned int m_channel = 0; // the DLC of the command being handled
+
+    // the TPDU length of the AT+CMGS each DLC prompted for the PDU of, 0 while it takes commands
+    std::size_t m_pdu_length[Cmux::MAX_DLCI + 1] = {};
+
+    // <n> of AT+CMMS, whether a link was kept up under it, until when, and the TP-MR of the next message
+    int m_more_messages = 0;
+
+    bool m_link_kept = false;
+
+    Clock::time_point m_link_until;
+
+    uint8_t m_message_reference = 0;
+
+    std::atomic<unsigned long> m_submitted{0};
+
+    std::atomic<unsigned long> m_link_setups{0};
+
+    unsigned long m_garbled_frames = 0; // bad FCS count last logged
+
+    bool m_clip = false;
+
+    // <mt> of AT+CNMI: 0 store silently, 1 store and +CMTI, 2 +CMT; and whether AT+CSMS=1 asks for AT+CNMA
+    int m_routing = 1;
+
+    bool m_acknowledged_delivery = false;
+
+    // messages handed over with +CMT (the front one) or waiting behind it for its acknowledgement
+    std::deque<std::string> m_unacknowledged;
+
+    Clock::time_point m_ack_due;
+
+    // messages the network sends again, and when
+    std::deque<std::pair<Clock::time_point, std::string>> m_retries;
+
+    std::string m_flow_control = "0,0";
+
+    std::map<int, Message> m_storage;
+
+    std::atomic<bool> m_running{true};
+
+    std::atomic<unsigned long> m_commands{0};
+
+    std::atomic<size_t> m_stored{0};
+
+    mutable std::mutex m_injected_mtx;
+
+    std::vector<std::function<void()>> m_injected;
+};
+
+#endif // MODEM_SIM_HPP
@@ -0,0 +1,109 @@
+#include <iostream>
+#include <csignal>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include "modem_sim.hpp"
+#include "error.hpp"
+
+namespace
+{
+    ModemSimulator *simulator = nullptr;
+
+    void sig_int_handler(int)
+    {
+        if (simulator) simulator->stop();
+    }
+
+    void usage(const char *self)
+    {
+        std::cout << "Usage: " << self << " [--link PATH] [--latency MS] [--latency-for VERB=MS] [--rssi N]"
+                     " [--capacity N] [--no-sim] [--baud N] [--link-limit N] [--ri FIFO] [--link-setup MS]"
+                     " [--sms PDU]...\n"
+                     "Emulates a SIM7600 on a pseudo-terminal and prints the device to point the service at.\n"
+                     "Commands on stdin:\n"
+                     "\tsms <PDU>\tan SMS-DELIVER PDU arrives: stored and announced with +CMTI, or after\n"
+                     "\t\t\tAT+CNMI=2,2 sent with +CMT\n"
+                     "\tring <NUMBER>\tRING, then +CLIP if enabled\n"
+                     "\turc <LINE>\tany other unsolicited line\n"
+                     "\tquit" << std::endl;
+    }
+
+    // stdin scripting, so a shell or a test harness can drive the modem
+    void console(ModemSimulator &sim)
+    {
+        std::string line;
+        while (std::getline(std::cin, line))
+        {
+            const auto space = line.find(' ');
+            const auto command = line.substr(0, space);
+            const auto argument = space == std::string::npos ? std::string() : line.substr(space + 1);
+            if (command == "sms") sim.deliver_sms(argument);
+            else if (command == "ring") sim.ring(argument);
+            else if (command == "urc") sim.emit(argument);
+            else if (command == "quit") break;
+            else if (!command.empty()) std::cerr << "unknown command " << command << std::endl;
+        }
+        sim.stop();
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::signal(SIGABRT, Utils::Error::crash_printer);
+    std::signal(SIGSEGV, Utils::Error::crash_printer);
+    std::signal(SIGFPE, Utils::Error::crash_printer);
+    std::signal(SIGILL, Utils::Error::crash_printer);
+    std::signal(SIGBUS, Utils::Error::crash_printer);
+
+    ModemSimulator::Options options;
+    std::vector<std::string> preloaded;
+    for (int idx = 1; idx < argc; idx++)
+    {
+        const std::string arg = argv[idx];
+        const bool has_value = idx + 1 < argc;
+        if (arg == "--link" && has_value) options.link = argv[++idx];
+        else if (arg == "--latency" && has_value) options.latency = std::chrono::milliseconds(std::atoi(argv[++idx]));
+        else if (arg == "--latency-for" && has_value)
+        {
+            const std::string spec = argv[++idx];
+            const auto equal = spec.find('=');
+            if (equal == std::string::npos)
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            options.command_latency[spec.substr(0, equal)] = std::chrono::milliseconds(std::atoi(spec.c_str() + equal + 1));
+        }
+        else if (arg == "--rssi" && has_value) options.rssi = std::atoi(argv[++idx]);
+        else if (arg == "--capacity" && has_value) options.capacity = std::atoi(argv[++idx]);
+        else if (arg == "--no-sim") options.sim_ready = false;
+        else if (arg == "--baud" && has_value) options.baud = std::atoi(argv[++idx]);
+        else if (arg == "--link-limit" && has_value) options.link_limit = std::atoi(argv[++idx]);
+        else if (arg == "--ri" && has_value) options.ring_indicator = argv[++idx];
+        else if (arg == "--link-setup" && has_value) options.link_setup = std::chrono::milliseconds(std::atoi(argv[++idx]));
+        else if (arg == "--sms" && has_value) preloaded.emplace_back(argv[++idx]);
+        else
+        {
+            usage(argv[0]);
+            return arg == "-h" || arg == "--help" ? 0 : 1;
+        }
+    }
+
+    ModemSimulator sim(options);
+    simulator = &sim;
+    std::signal(SIGINT, sig_int_handler);
+    std::signal(SIGTERM, sig_int_handler);
+    for (auto &each : preloaded) sim.store_sms(std::move(each));
+
+    std::cout << "Simulated SIM7600 at " << sim.device();
+    if (!options.link.empty()) std::cout << " (" << options.link << ")";
+    std::cout << std::endl;
+
+    std::thread(console, std::ref(sim)).detach();
+    sim.run();
+    std::cout << "Simulator served " << sim.commands() << " commands" << std::endl;
+    simulator = nullptr;
+    return 0;
+}
@@ -0,0 +1,831 @@
+#include "modem_sim.hpp"
+#include "error.hpp"
+#include "baud_rate.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <sstream>
+#include <utility>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <linux/gpio.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+
+ModemSimulator::ModemSimulator(Options options) : m_options(std::move(options)), m_baud(m_options.baud)
+{
+    m_master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (m_master < 0 || grantpt(m_master) != 0 || unlockpt(m_master) != 0)
+    {
+        throw Utils::Error::SystemError("posix_openpt", errno);
+    }
+    m_device = ptsname(m_master);
+
+    m_slave = open(m_device.c_str(), O_RDWR | O_NOCTTY);
+    if (m_slave < 0)
+    {
+        throw Utils::Error::SystemError("open(" + m_device + ")", errno);
+    }
+    struct termios line_settings;
+    tcgetattr(m_slave, &line_settings);
+    cfmakeraw(&line_settings);
+    tcsetattr(m_slave, TCSANOW, &line_settings);
+
+    m_wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wake < 0)
+    {
+        throw Utils::Error::SystemError("eventfd", errno);
+    }
+
+    if (!m_options.link.empty())
+    {
+        unlink(m_options.link.c_str());
+        if (symlink(m_device.c_str(), m_options.link.c_str()) != 0)
+        {
+            throw Utils::Error::SystemError("symlink(" + m_options.link + ")", errno);
+        }
+    }
+
+    if (!m_options.ring_indicator.empty())
+    {
+        if (mkfifo(m_options.ring_indicator.c_str(), 0600) != 0 && errno != EEXIST)
+        {
+            throw Utils::Error::SystemError("mkfifo(" + m_options.ring_indicator + ")", errno);
+        }
+        // read-write, so opening does not wait for the service and pulses queue while it is away
+        m_ring_indicator = open(m_options.ring_indicator.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (m_ring_indicator < 0)
+        {
+            throw Utils::Error::SystemError("open(" + m_options.ring_indicator + ")", errno);
+        }
+    }
+}
+
+ModemSimulator::~ModemSimulator()
+{
+    if (!m_options.link.empty())
+    {
+        unlink(m_options.link.c_str());
+    }
+    if (m_ring_indicator >= 0)
+    {
+        close(m_ring_indicator);
+    }
+    close(m_wake);
+    close(m_slave);
+    close(m_master);
+}
+
+const std::string &ModemSimulator::device() const
+{
+    return m_device;
+}
+
+void ModemSimulator::deliver_sms(std::string pdu)
+{
+    inject([this, pdu = std::move(pdu)]() mutable
+           { receive(std::move(pdu)); });
+}
+
+void ModemSimulator::store_sms(std::string pdu)
+{
+    inject([this, pdu = std::move(pdu)]() mutable
+           { store(std::move(pdu)); });
+}
+
+void ModemSimulator::ring(std::string number)
+{
+    inject([this, number = std::move(number)]()
+           {
+               unsolicited("RING");
+               if (m_clip) unsolicited("+CLIP: \"" + number + "\",145,,,,0"); });
+}
+
+void ModemSimulator::emit(std::string urc)
+{
+    inject([this, urc = std::move(urc)]()
+           { unsolicited(urc); });
+}
+
+void ModemSimulator::inject(std::function<void()> action)
+{
+    {
+        std::lock_guard lock(m_injected_mtx);
+        m_injected.push_back(std::move(action));
+    }
+    const uint64_t one = 1;
+    write(m_wake, &one, sizeof(one));
+}
+
+bool ModemSimulator::run_once(int timeout_ms)
+{
+    if (!m_output.empty())
+    {
+        const auto until_due = std::chrono::duration_cast<std::chrono::milliseconds>(m_output.front().due - Clock::now()).count() + 1;
+        timeout_ms = timeout_ms < 0 ? std::max(0L, until_due) : std::min<long>(timeout_ms, std::max(0L, until_due));
+    }
+
+    for (const auto due : {m_unacknowledged.empty() ? Clock::time_point::max() : m_ack_due,
+                           m_retries.empty() ? Clock::time_point::max() : m_retries.front().first})
+    {
+        if (due == Clock::time_point::max()) continue;
+        const auto until_due = std::chrono::duration_cast<std::chrono::milliseconds>(due - Clock::now()).count() + 1;
+        timeout_ms = timeout_ms < 0 ? std::max(0L, until_due) : std::min<long>(timeout_ms, std::max(0L, until_due));
+    }
+
+    struct pollfd fds[2]{{m_master, POLLIN, 0}, {m_wake, POLLIN, 0}};
+    poll(fds, 2, timeout_ms);
+
+    if (fds[1].revents & POLLIN)
+    {
+        uint64_t count;
+        read(m_wake, &count, sizeof(count));
+        std::vector<std::function<void()>> injected;
+        {
+            std::lock_guard lock(m_injected_mtx);
+            injected.swap(m_injected);
+        }
+        for (auto &each : injected) each();
+    }
+
+    if (fds[0].revents & POLLIN)
+    {
+        char buffer[1024];
+        ssize_t n;
+        while ((n = read(m_master, buffer, sizeof(buffer))) > 0)
+        {
+            if (!link_up()) continue;
+            if (m_multiplexed) demultiplex(buffer, n);
+            else m_input.append(buffer, n);
+        }
+        take_commands(m_input, 0);
+        if (m_multiplexed && !m_input.empty())
+        {
+            // frames right behind the AT+CMUX
+            demultiplex(m_input.data(), m_input.size());
+            m_input.clear();
+        }
+    }
+
+    network_due();
+    write_due();
+    return m_running;
+}
+
+void ModemSimulator::run()
+{
+    while (run_once(100))
+    {
+    }
+}
+
+void ModemSimulator::stop()
+{
+    m_running = false;
+}
+
+size_t ModemSimulator::stored() const
+{
+    return m_stored;
+}
+
+unsigned long ModemSimulator::commands() const
+{
+    return m_commands;
+}
+
+unsigned long ModemSimulator::submitted() const
+{
+    return m_submitted;
+}
+
+unsigned long ModemSimulator::link_setups() const
+{
+    return m_link_setups;
+}
+
+void ModemSimulator::take_commands(std::string &input, unsigned int dlci)
+{
+    // commands end with S3 (CR); the LF of println() is ignored. After the prompt of AT+CMGS a PDU ends with ^Z
+    size_t end;
+    while ((dlci != 0 || !m_multiplexed) &&
+           (end = input.find_first_of(m_pdu_length[dlci] != 0 ? "\x1A\x1B" : "\r")) != std::string::npos)
+    {
+        if (m_pdu_length[dlci] != 0)
+        {
+            const bool send = input[end] == '\x1A';
+            std::string pdu = input.substr(0, end);
+            input.erase(0, end + 1);
+            m_channel = dlci;
+            submit(std::move(pdu), send);
+            continue;
+        }
+        std::string command = input.substr(0, end);
+        input.erase(0, end + 1);
+        command.erase(std::remove(command.begin(), command.end(), '\n'), command.end());
+        m_channel = dlci;
+        if (!command.empty()) handle_command(command);
+    }
+    m_channel = 0;
+}
+
+void ModemSimulator::handle_command(const std::string &command)
+{
+    ++m_commands;
+    if (m_echo)
+    {
+        queue(m_channel, framed(m_channel, command + "\r"), Clock::now());
+    }
+
+    std::string upper = command;
+    std::transform(upper.begin(), upper.end(), upper.begin(), [](unsigned char ch)
+                   { return std::toupper(ch); });
+    if (upper.compare(0, 2, "AT") != 0)
+    {
+        reply("", "", "ERROR");
+        return;
+    }
+    const auto verb_end = upper.find_first_of("=?", 2);
+    const auto verb = upper.substr(2, verb_end == std::string::npos ? std::string::npos : verb_end - 2);
+    const auto argument = verb_end == std::string::npos ? std::string() : upper.substr(verb_end);
+    const auto number = [&argument](size_t skip = 1)
+    {
+        return argument.size() > skip ? std::atoi(argument.c_str() + skip) : 0;
+    };
+
+    if (verb.empty())
+    {
+        reply(verb, "");
+    }
+    else if (verb == "E0" || verb == "E1")
+    {
+        m_echo = verb == "E1";
+        reply(verb, "");
+    }
+    else if (verb == "+CPIN" && argument == "?")
+    {
+        if (m_options.sim_ready) reply(verb, "+CPIN: READY");
+        else reply(verb, "", "+CME ERROR: 10");
+    }
+    else if (verb == "+CREG" && argument == "?")
+    {
+        reply(verb, "+CREG: 0,1");
+    }
+    else if (verb == "+COPS" && argument == "?")
+    {
+        reply(verb, "+COPS: 0,0,\"SIMULATOR\",7");
+    }
+    else if (verb == "+CSQ")
+    {
+        reply(verb, "+CSQ: " + std::to_string(m_options.rssi) + ",99");
+    }
+    else if (verb == "+CMGF")
+    {
+        // PDU mode only
+        if (argument == "=0" || argument == "?") reply(verb, argument == "?" ? "+CMGF: 0" : "");
+        else reply(verb, "", "+CMS ERROR: 303");
+    }
+    else if (verb == "+CLIP" && !argument.empty() && argument[0] == '=')
+    {
+        m_clip = number() != 0;
+        reply(verb, "");
+    }
+    else if (verb == "+CNMI" && !argument.empty() && argument[0] == '=')
+    {
+        // AT+CNMI=<mode>,<mt>[,...]
+        const auto comma = argument.find(',');
+        const int mt = comma == std::string::npos ? 0 : std::atoi(argument.c_str() + comma + 1);
+        if (mt < 0 || mt > 2)
+        {
+            reply(verb, "", "+CMS ERROR: 303");
+            return;
+        }
+        m_routing = mt;
+        reply(verb, "");
+    }
+    else if (verb == "+CSMS")
+    {
+        if (argument == "=0" || argument == "=1") m_acknowledged_delivery = argument == "=1";
+        else if (argument != "?")
+        {
+            reply(verb, "", "+CMS ERROR: 303");
+            return;
+        }
+        reply(verb, argument == "?" ? "+CSMS: " + std::to_string(m_acknowledged_delivery) + ",1,1,1" : "+CSMS: 1,1,1");
+    }
+    else if (verb == "+CNMA")
+    {
+        // nothing to acknowledge, e.g. after ACK_TIMEOUT
+        if (!m_acknowledged_delivery || m_unacknowledged.empty())
+        {
+            reply(verb, "", "+CMS ERROR: 340");
+            return;
+        }
+        auto pdu = std::move(m_unacknowledged.front());
+        m_unacknowledged.pop_front();
+        reply(verb, "");
+        if (number() == 2)
+        {
+            m_retries.emplace_back(Clock::now() + NETWORK_RETRY, std::move(pdu));
+        }
+        if (!m_unacknowledged.empty()) send_unacknowledged();
+    }
+    else if (verb == "+CGATT")
+    {
+        reply(verb, "");
+    }
+    else if (verb == "+CMGR" && !argument.empty() && argument[0] == '=')
+    {
+        auto message = m_storage.find(number());
+        if (message == m_storage.end())
+        {
+            reply(verb, "", "+CMS ERROR: 321");
+            return;
+        }
+        const auto &pdu = message->second.pdu;
+        const auto tpdu_length = pdu.size() / 2 - 1 - std::strtol(pdu.substr(0, 2).c_str(), nullptr, 16);
+        reply(verb, "+CMGR: " + std::to_string(message->second.stat) + ",," + std::to_string(tpdu_length) + "\r\n" + pdu);
+        message->second.stat = 1;
+    }
+    else if (verb == "+CMGD" && !argument.empty() && argument[0] == '=')
+    {
+        // AT+CMGD=<index>[,<delflag>]: 0 that one, 1 read ones, 2..4 everything (no sent/unsent storage here)
+        const auto comma = argument.find(',');
+        const int flag = comma == std::string::npos ? 0 : std::atoi(argument.c_str() + comma + 1);
+        if (flag == 0)
+        {
+            m_storage.erase(number());
+        }
+        else
+        {
+            for (auto each = m_storage.begin(); each != m_storage.end();)
+            {
+                each = (flag >= 2 || each->second.stat == 1) ? m_storage.erase(each) : std::next(each);
+            }
+        }
+        m_stored = m_storage.size();
+        reply(verb, "");
+    }
+    else if (verb == "+IFC")
+    {
+        // flow control has no meaning on a pty; remember the setting for AT+IFC?
+        if (argument == "=0,0" || argument == "=2,2")
+        {
+            m_flow_control = argument.substr(1);
+            reply(verb, "");
+        }
+        else if (argument == "?") reply(verb, "+IFC: " + m_flow_control);
+        else reply(verb, "", "ERROR");
+    }
+    else if (verb == "+IPR")
+    {
+        static const int rates[] = {300, 600, 1200, 2400, 4800, 9600, 19200, 38400, 57600, 115200,
+                                    230400, 460800, 921600, 3000000, 3200000, 3686400};
+        if (argument == "?")
+        {
+            reply(verb, "+IPR: " + std::to_string(m_baud));
+        }
+        else if (argument == "=?")
+        {
+            std::string list;
+            for (const int each : rates) list += (list.empty() ? "" : ",") + std::to_string(each);
+            reply(verb, "+IPR: (),(" + list + ")");
+        }
+        else if (const int rate = number(); std::find(std::begin(rates), std::end(rates), rate) != std::end(rates))
+        {
+            // the OK still goes out at the old rate
+            reply(verb, "");
+            m_output.push_back({m_output.back().due, "", rate});
+        }
+        else
+        {
+            reply(verb, "", "ERROR");
+        }
+    }
+    else if (verb == "+CMUX")
+    {
+        // AT+CMUX=<mode>[,<subset>[,<port_speed>[,<N1>...]]]: the basic option (0) with UIH frames (0) only
+        const auto parameter = [&argument](int which)
+        {
+            size_t begin = 1;
+            for (; which > 0 && begin != std::string::npos; --which)
+            {
+                begin = argument.find(',', begin);
+                if (begin != std::string::npos) ++begin;
+            }
+            return begin == std::string::npos ? std::string() : argument.substr(begin, argument.find(',', begin) - begin);
+        };
+        if (argument == "=?")
+        {
+            reply(verb, "+CMUX: (0),(0),(1-8),(1-32767)");
+        }
+        else if (!argument.empty() && argument[0] == '=' && parameter(0) == "0" &&
+                 (parameter(1).empty() || parameter(1) == "0"))
+        {
+            const auto n1 = parameter(3);
+            const long frame_size = n1.empty() ? 31 : std::atol(n1.c_str());
+            if (m_channel != 0 || frame_size < 1 || frame_size > static_cast<long>(Cmux::MAX_INFO))
+            {
+                reply(verb, "", "ERROR");
+                return;
+            }
+            // the OK goes out as plain text, what follows in frames
+            reply(verb, "");
+            m_frame_size = frame_size;
+            m_multiplexed = true;
+            std::cout << "Simulator: multiplexing in frames of up to " << m_frame_size << " bytes" << std::endl;
+        }
+        else
+        {
+            reply(verb, "", "ERROR");
+        }
+    }
+    else if (verb == "+CMGS" && !argument.empty() && argument[0] == '=' && argument != "=?")
+    {
+        // AT+CMGS=<length>: the TPDU's octets, the SMSC's not counted
+        const int length = number();
+        if (length < 7 || length > 164)
+        {
+            reply(verb, "", "+CMS ERROR: 304");
+            return;
+        }
+        m_pdu_length[m_channel] = length;
+        queue(m_channel, framed(m_channel, "\r\n> "), Clock::now());
+    }
+    else if (verb == "+CMMS")
+    {
+        // AT+CMMS=<n>: 0 the link goes down after each message, 1 stays up until LINK_HOLD passes, 2 likewise
+        // but <n> stays
+        if (argument == "?") reply(verb, "+CMMS: " + std::to_string(m_more_messages));
+        else if (argument == "=?") reply(verb, "+CMMS: (0-2)");
+        else if (argument == "=0" || argument == "=1" || argument == "=2")
+        {
+            m_more_messages = number();
+            m_link_kept = false;
+            reply(verb, "");
+        }
+        else reply(verb, "", "+CMS ERROR: 303");
+    }
+    else if (verb == "+CMGL" && !argument.empty() && argument[0] == '=')
+    {
+        std::string body;
+        list_messages(number(), body);
+        reply(verb, body);
+    }
+    else
+    {
+        reply(verb, "", "ERROR");
+    }
+}
+
+void ModemSimulator::list_messages(int stat, std::string &body)
+{
+    // <stat> 4 is "ALL"
+    for (auto &[index, message] : m_storage)
+    {
+        if (stat != 4 && message.stat != stat) continue;
+        const auto tpdu_length = message.pdu.size() / 2 - 1 - std::strtol(message.pdu.substr(0, 2).c_str(), nullptr, 16);
+        if (!body.empty()) body += "\r\n";
+        body += "+CMGL: " + std::to_string(index) + "," + std::to_string(message.stat) + ",," + std::to_string(tpdu_length) + "\r\n" + message.pdu;
+        message.stat = 1;
+    }
+}
+
+void ModemSimulator::submit(std::string pdu, bool send)
+{
+    const auto length = std::exchange(m_pdu_length[m_channel], 0);
+    pdu.erase(std::remove_if(pdu.begin(), pdu.end(), [](char each)
+                             { return each == '\r' || each == '\n'; }),
+              pdu.end());
+    if (m_echo)
+    {
+        queue(m_channel, framed(m_channel, pdu + (send ? "\x1A" : "\x1B")), Clock::now());
+    }
+    if (!send)
+    {
+        reply("+CMGS", "");
+        return;
+    }
+    // hex, an SMSC and the TPDU of the length AT+CMGS announced, which is an SMS-SUBMIT
+    const bool hex = std::all_of(pdu.begin(), pdu.end(), [](unsigned char each)
+                                 { return std::isxdigit(each); });
+    const size_t smsc_length = hex && pdu.size() >= 2 ? std::strtoul(pdu.substr(0, 2).c_str(), nullptr, 16) : 0;
+    if (!hex || pdu.size() % 2 != 0 || pdu.size() / 2 != 1 + smsc_length + length ||
+        (std::strtoul(pdu.substr(2 + 2 * smsc_length, 2).c_str(), nullptr, 16) & 0x03) != 0x01)
+    {
+        std::cerr << "Simulator: AT+CMGS=" << length << " of " << pdu << " is no SMS-SUBMIT of that length" << std::endl;
+        reply("+CMGS", "", "+CMS ERROR: 304");
+        return;
+    }
+
+    const auto now = Clock::now();
+    const bool link_up = m_more_messages != 0 && now < m_link_until;
+    if (!link_up)
+    {
+        ++m_link_setups;
+        // 1 lasts until the link it kept up goes down
+        if (m_more_messages == 1 && m_link_kept) m_more_messages = 0;
+    }
+    m_link_kept = m_more_messages != 0;
+    const auto due = now + latency_of("+CMGS") + (link_up ? std::chrono::milliseconds::zero() : m_options.link_setup);
+    m_link_until = due + LINK_HOLD;
+    ++m_submitted;
+    queue(m_channel, framed(m_channel, "\r\n+CMGS: " + std::to_string(m_message_reference++) + "\r\n\r\nOK\r\n"), due);
+}
+
+void ModemSimulator::reply(const std::string &verb, const std::string &body, const std::string &final_result)
+{
+    std::string text;
+    if (!body.empty()) text += "\r\n" + body + "\r\n";
+    text += "\r\n" + final_result + "\r\n";
+
+    queue(m_channel, framed(m_channel, text), Clock::now() + latency_of(verb));
+}
+
+void ModemSimulator::unsolicited(const std::string &line)
+{
+    if (line == "RING" || line.rfind("+CMTI:", 0) == 0 || line.rfind("+CMT:", 0) == 0)
+    {
+        pulse_ring_indicator();
+    }
+    const unsigned int dlci = m_multiplexed ? 1 : 0;
+    queue(dlci, framed(dlci, "\r\n" + line + "\r\n"), Clock::now());
+}
+
+std::string ModemSimulator::framed(unsigned int dlci, std::string_view text) const
+{
+    if (dlci == 0)
+    {
+        return std::string(text);
+    }
+    // UIH frames from the modem's side: C/R clear
+    std::string frames;
+    do
+    {
+        frames += Cmux::frame(dlci, Cmux::UIH, false, text.substr(0, m_frame_size));
+        text.remove_prefix(std::min(text.size(), m_frame_size));
+    } while (!text.empty());
+    return frames;
+}
+
+void ModemSimulator::queue(unsigned int dlci, std::string bytes, Clock::time_point due)
+{
+    // one UART, or one DLC of it: keep the order within, while other DLCs may overtake
+    for (const auto &each : m_output)
+    {
+        if (each.dlci == dlci && each.due > due) due = each.due;
+    }
+    const auto at = std::upper_bound(m_output.begin(), m_output.end(), due, [](Clock::time_point due, const Output &each)
+                                     { return due < each.due; });
+    m_output.insert(at, Output{due, std::move(bytes), 0, dlci});
+}
+
+void ModemSimulator::demultiplex(const char *data, size_t length)
+{
+    m_decoder.feed(data, length);
+    for (Cmux::Frame frame; m_decoder.next(frame) && m_multiplexed;)
+    {
+        const auto now = Clock::now();
+        switch (frame.control)
+        {
+        case Cmux::SABM:
+            m_open[frame.dlci] = true;
+            queue(0, Cmux::frame(frame.dlci, Cmux::UA, true, {}, true), now);
+            break;
+        case Cmux::DISC:
+            queue(0, Cmux::frame(frame.dlci, Cmux::UA, true, {}, true), now);
+            if (frame.dlci == 0) leave_multiplexing();
+            else m_open[frame.dlci] = false;
+            break;
+        case Cmux::UIH:
+        case Cmux::UI:
+            if (!m_open[frame.dlci])
+            {
+                queue(0, Cmux::frame(frame.dlci, Cmux::DM, true, {}, true), now);
+            }
+            else if (frame.dlci == 0)
+            {
+                control_message(frame.info);
+            }
+            else
+            {
+                auto &input = m_channel_input[frame.dlci];
+                input.append(frame.info);
+                take_commands(input, frame.dlci);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    if (m_decoder.bad_fcs() > 0 && m_decoder.bad_fcs() != m_garbled_frames)
+    {
+        m_garbled_frames = m_decoder.bad_fcs();
+        std::cerr << "Simulator: " << m_garbled_frames << " frames with a bad FCS so far" << std::endl;
+    }
+}
+
+void ModemSimulator::control_message(std::string_view info)
+{
+    if (info.size() < 2)
+    {
+        return;
+    }
+    const auto type = static_cast<uint8_t>(info[0]);
+    const auto value = info.substr(2, static_cast<uint8_t>(info[1]) >> 1);
+    if ((type & Cmux::MESSAGE_COMMAND) == 0)
+    {
+        return; // the service's answer to one of ours
+    }
+    const uint8_t response = type & ~Cmux::MESSAGE_COMMAND;
+    switch (type)
+    {
+    case Cmux::CLD:
+        queue(0, Cmux::frame(0, Cmux::UIH, false, Cmux::message(response)), Clock::now());
+        leave_multiplexing();
+        break;
+    case Cmux::MSC:
+    case Cmux::TEST:
+        queue(0, Cmux::frame(0, Cmux::UIH, false, Cmux::message(response, value)), Clock::now());
+        break;
+    default:
+        queue(0, Cmux::frame(0, Cmux::UIH, false, Cmux::message(Cmux::NSC, info.substr(0, 1))), Clock::now());
+        break;
+    }
+}
+
+void ModemSimulator::leave_multiplexing()
+{
+    std::cout << "Simulator: multiplexing closed down, back to AT commands" << std::endl;
+    m_multiplexed = false;
+    m_decoder.clear();
+    for (unsigned int dlci = 0; dlci <= Cmux::MAX_DLCI; dlci++)
+    {
+        m_open[dlci] = false;
+        m_channel_input[dlci].clear();
+    }
+}
+
+void ModemSimulator::pulse_ring_indicator()
+{
+    if (m_ring_indicator < 0)
+    {
+        return;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    struct gpio_v2_line_event event;
+    std::memset(&event, 0, sizeof(event));
+    event.timestamp_ns = static_cast<uint64_t>(now.tv_sec) * 1000000000u + now.tv_nsec;
+    event.id = GPIO_V2_LINE_EVENT_FALLING_EDGE;
+    event.seqno = event.line_seqno = ++m_ring_pulses;
+    if (write(m_ring_indicator, &event, sizeof(event)) != sizeof(event))
+    {
+        std::cerr << "Simulator: ring indicator pulse lost (" << strerror(errno) << ")" << std::endl;
+    }
+}
+
+std::chrono::milliseconds ModemSimulator::latency_of(const std::string &verb) const
+{
+    if (auto specific = m_options.command_latency.find(verb); specific != m_options.command_latency.end())
+    {
+        return specific->second;
+    }
+    return m_options.latency;
+}
+
+bool ModemSimulator::well_formed(const std::string &pdu)
+{
+    if (pdu.size() < 4 || pdu.size() % 2 != 0 || pdu.find_first_not_of("0123456789ABCDEFabcdef") != std::string::npos)
+    {
+        std::cerr << "Simulator: {" << pdu << "} is not a hex PDU, ignored" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void ModemSimulator::receive(std::string pdu)
+{
+    if (m_routing == 2)
+    {
+        if (!well_formed(pdu)) return;
+        if (!m_acknowledged_delivery)
+        {
+            unsolicited(delivery_urc(pdu));
+            return;
+        }
+        m_unacknowledged.push_back(std::move(pdu));
+        if (m_unacknowledged.size() == 1) send_unacknowledged();
+        return;
+    }
+    const int index = store(std::move(pdu));
+    if (index < 0)
+    {
+        std::cerr << "Simulator: message not stored, no +CMTI" << std::endl;
+        return;
+    }
+    if (m_routing == 1) unsolicited("+CMTI: \"SM\"," + std::to_string(index));
+}
+
+std::string ModemSimulator::delivery_urc(const std::string &pdu)
+{
+    const auto tpdu_length = pdu.size() / 2 - 1 - std::strtol(pdu.substr(0, 2).c_str(), nullptr, 16);
+    return "+CMT: ," + std::to_string(tpdu_length) + "\r\n" + pdu;
+}
+
+void ModemSimulator::send_unacknowledged()
+{
+    m_ack_due = Clock::now() + ACK_TIMEOUT;
+    unsolicited(delivery_urc(m_unacknowledged.front()));
+}
+
+void ModemSimulator::network_due()
+{
+    const auto now = Clock::now();
+    if (!m_unacknowledged.empty() && now >= m_ack_due)
+    {
+        std::cerr << "Simulator: +CMT not acknowledged in time, no more routing to the TE" << std::endl;
+        m_routing = 0;
+        for (auto &each : m_unacknowledged) m_retries.emplace_back(now + NETWORK_RETRY, std::move(each));
+        m_unacknowledged.clear();
+    }
+    while (!m_retries.empty() && m_retries.front().first <= now)
+    {
+        auto pdu = std::move(m_retries.front().second);
+        m_retries.pop_front();
+        receive(std::move(pdu));
+    }
+}
+
+int ModemSimulator::store(std::string pdu)
+{
+    if (!well_formed(pdu))
+    {
+        return -1;
+    }
+    for (unsigned int index = 0; index < m_options.capacity; index++)
+    {
+        if (m_storage.count(index) == 0)
+        {
+            m_storage[index] = Message{0, std::move(pdu)};
+            m_stored = m_storage.size();
+            return index;
+        }
+    }
+    std::cerr << "Simulator: SM storage is full" << std::endl;
+    return -1;
+}
+
+void ModemSimulator::write_due()
+{
+    const auto now = Clock::now();
+    while (!m_output.empty() && m_output.front().due <= now)
+    {
+        auto &output = m_output.front();
+        if (output.switch_to != 0)
+        {
+            std::cout << "Simulator: now at " << output.switch_to << " baud" << std::endl;
+            m_baud = output.switch_to;
+        }
+        else if (link_up())
+        {
+            const auto n = write(m_master, output.text.data(), output.text.size());
+            if (n < 0)
+            {
+                return; // EAGAIN: the service is not reading, retry on the next round
+            }
+            if (static_cast<size_t>(n) < output.text.size())
+            {
+                output.text.erase(0, n);
+                return;
+            }
+        }
+        m_output.pop_front();
+    }
+}
+
+bool ModemSimulator::link_up()
+{
+    const int host = getBaudRate(m_slave);
+    const bool up = host == m_baud && (m_options.link_limit == 0 || m_baud <= m_options.link_limit);
+    if (!up && host != m_garbled_rate)
+    {
+        std::cerr << "Simulator: service at " << host << " baud, modem at " << m_baud
+                  << (m_options.link_limit != 0 && m_baud > m_options.link_limit ? " beyond what the link carries" : "")
+                  << ": the bytes are garbage" << std::endl;
+    }
+    m_garbled_rate = up ? 0 : host;
+    return up;
+}
+
+int ModemSimulator::baud() const
+{
+    return m_baud;
+}
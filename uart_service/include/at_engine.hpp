@@ -0,0 +1,305 @@
+#ifndef AT_ENGINE_HPP
+#define AT_ENGINE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "serial.hpp"
+#include "reactor.hpp"
+#include "latency_histogram.hpp"
+
+/**
+ * Where an ATEngine writes its commands: the serial port itself, or one channel of a multiplexer on it.
+ * Output that cannot go out at once stays queued until descriptor() is writable and flush() is called.
+ */
+class ATPort
+{
+public:
+    virtual ~ATPort() = default;
+
+    // Write a command with its line end; false if none of it could be written or queued
+    virtual bool write_line(const std::string &line) = 0;
+
+    // Write data as it is, e.g. the PDU and ^Z after the prompt of AT+CMGS
+    virtual bool write(std::string_view data) = 0;
+
+    // Push on what is queued
+    virtual void flush() = 0;
+
+    // Bytes still queued
+    virtual int queued() const = 0;
+
+    // What to watch for EPOLLOUT while something is queued
+    virtual int descriptor() const = 0;
+};
+
+// The serial port as an ATPort: commands end with CR LF
+class SerialATPort : public ATPort
+{
+public:
+    explicit SerialATPort(SerialPi &serial);
+
+    bool write_line(const std::string &line) override;
+
+    bool write(std::string_view data) override;
+
+    void flush() override;
+
+    int queued() const override;
+
+    int descriptor() const override;
+
+private:
+    SerialPi &m_serial;
+};
+
+/**
+ * AT command transactions over one serial port or channel. Every line the service does not recognise as unsolicited
+ * is handed to consume() and collected for the oldest command in flight until its final result code (OK,
+ * ERROR, +CME ERROR, ...) or its deadline, which is a timerfd on the reactor. Completion is reported through
+ * a callback on the reactor thread.
+ *
+ * The modem answers in the order it was asked, so up to a pipeline depth of commands can be written ahead
+ * and their replies still be told apart by position. Only pipelinable() ones are written behind another;
+ * the rest (dialling, prompts, anything changing the line or the reply format) wait for an idle modem and
+ * nothing is written behind them. A command that timed out or was cancelled keeps its place until its late
+ * reply arrives or LATE_REPLY_GRACE passes, so that reply is not taken for the next command's.
+ *
+ * A prompted command (AT+CMGS) has its text written once the modem prompts for it with "> ", which ends no
+ * line and so is not for consume(): whoever reads the port sees it left over in its framer and calls prompt().
+ */
+class ATEngine
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using Id = unsigned long;
+
+    enum class Status
+    {
+        OK = 0,
+        ERROR = 1,
+        TIMEOUT = 2,
+        CANCELLED = 3,
+        CLOSED = 4
+    };
+
+    struct Result
+    {
+        Status status = Status::CLOSED;
+        std::string response;     // intermediate lines (without the echo), each ended by '\n'
+        std::string final_result; // the final result code line, empty on timeout
+        Clock::duration elapsed{};
+        std::chrono::nanoseconds cpu_time{}; // CPU time of the loop thread while the command was in flight
+
+        bool ok() const;
+    };
+
+    using Callback = std::function<void(const Result &)>;
+
+    // An intermediate line of the reply, as it is read
+    using LineCallback = std::function<void(std::string_view line)>;
+
+    // How one verb ("AT+CMGR", "AT+CREG?", "ATE") fared since start-up
+    struct VerbStatistics
+    {
+        std::string verb;
+        unsigned long ok = 0;
+        unsigned long errors = 0;
+        unsigned long timeouts = 0;
+        unsigned long cancelled = 0;
+        LatencyHistogram::Snapshot latency; // from written to the final result code, timeouts included
+    };
+
+    // Verbs counted apart; the last entry collects every further one as "other"
+    static constexpr std::size_t MAX_VERBS = 32;
+
+    // How long a command that timed out holds its place for the reply that may still come
+    static constexpr std::chrono::milliseconds LATE_REPLY_GRACE{1000};
+
+    // depth: commands written to the modem before the oldest one completes, 1 writes them one at a time
+    ATEngine(SerialPi &serial, Reactor &reactor, unsigned int depth = 1);
+
+    ATEngine(ATPort &port, Reactor &reactor, unsigned int depth = 1);
+
+    ATEngine(const ATEngine &) = delete;
+
+    ATEngine &operator=(const ATEngine &) = delete;
+
+    // Queue a command; callback (may be empty) runs on the reactor thread once it completes
+    Id submit(std::string command, std::chrono::milliseconds timeout, Callback callback);
+
+    /**
+     * Likewise, with the intermediate lines handed to on_line as they are read instead of being collected
+     * in Result::response, for replies too long to keep whole (AT+CMGL). Not called once the command timed
+     * out or was cancelled.
+     */
+    Id submit(std::string command, std::chrono::milliseconds timeout, Callback callback, LineCallback on_line);
+
+    /**
+     * Likewise, for a command the modem answers with the "> " prompt: text follows it, ended by ^Z. Should the
+     * command time out still waiting for the prompt, ESC takes the modem out of it again.
+     */
+    Id submit_prompted(std::string command, std::string text, std::chrono::milliseconds timeout, Callback callback);
+
+    /**
+     * Submit and run the reactor until the command completes. Only for code outside reactor handlers,
+     * e.g. the start-up sequence before the loop runs.
+     */
+    Result execute(std::string command, std::chrono::milliseconds timeout);
+
+    /**
+     * Complete a queued or in-flight command with CANCELLED. The modem still answers an in-flight one;
+     * its reply is swallowed. Returns false if the id is unknown.
+     */
+    bool cancel(Id id);
+
+    // Offer a line read from the modem. Returns false if no command is in flight to take it
+    bool consume(std::string_view line);
+
+    // Whether the oldest command in flight waits for the "> " prompt
+    bool awaiting_prompt() const;
+
+    // The modem prompted: write the text of the oldest command in flight and ^Z
+    void prompt();
+
+    /**
+     * Whether a line named like an unsolicited result code belongs to the oldest command in flight: its
+     * final result code ("NO CARRIER" after ATD or ATA, and only then) or its information response
+     * ("+CREG: 0,1" after AT+CREG?).
+     */
+    bool claims(std::string_view name) const;
+
+    // The serial port became writable (EPOLLOUT) while output was queued
+    void output_ready();
+
+    /**
+     * Write through port from now on, e.g. a multiplexer channel once the modem left plain AT commands
+     * behind. Only while nothing is in flight, which is when such a switch can happen anyway.
+     */
+    void switch_port(ATPort &port);
+
+    // The port went away: complete everything with CLOSED and refuse new commands
+    void close();
+
+    bool busy() const;
+
+    void dump_metrics(std::ostream &os) const;
+
+    // Per verb counters and latency; unlike the rest, may be called from any thread
+    std::vector<VerbStatistics> statistics() const;
+
+    static void dump_statistics(std::ostream &os, const std::vector<VerbStatistics> &statistics);
+
+    // The part of command its statistics are kept under: "AT+CMGR=3" is "AT+CMGR", "ATE0" is "ATE"
+    static std::string_view verb_of(std::string_view command);
+
+    static const char *to_string(Status status);
+
+    /**
+     * Whether command may be written while others are in flight: queries, tests and the commands that
+     * read, list or delete stored messages. Their replies neither need a prompt nor change how the modem
+     * parses or answers what follows.
+     */
+    static bool pipelinable(std::string_view command);
+
+private:
+    // Written by the loop thread only, read by statistics() from any
+    struct VerbCounters
+    {
+        std::string verb; // set before the entry is published through m_verb_count
+        std::atomic<unsigned long> ok{0};
+        std::atomic<unsigned long> errors{0};
+        std::atomic<unsigned long> timeouts{0};
+        std::atomic<unsigned long> cancelled{0};
+        LatencyHistogram latency;
+    };
+
+    struct Transaction
+    {
+        Id id = 0;
+        std::string command;
+        std::chrono::milliseconds timeout{};
+        Callback callback;
+        LineCallback on_line;
+        std::string text;        // what a prompted command writes at the prompt
+        bool prompt_due = false; // the prompt has not come yet
+        Result result;
+        Clock::time_point started;
+        std::chrono::nanoseconds cpu_started{};
+        bool pipelinable = false;
+        bool abandoned = false; // timed out or cancelled: the callback has run, the reply is swallowed
+        VerbCounters *counters = nullptr;
+    };
+
+    VerbCounters &counters_of(std::string_view command);
+
+    static void tally(std::atomic<unsigned long> &counter);
+
+    Id enqueue(Transaction transaction);
+
+    // Write queued commands while the pipeline depth and exclusivity allow
+    void start_next();
+
+    bool can_write(const Transaction &transaction) const;
+
+    // The oldest command in flight is answered (or has to be given up): arm the deadline of the next
+    void arm_deadline();
+
+    void deadline_expired();
+
+    void watch_output();
+
+    // Complete the oldest command in flight
+    void complete(Status status, std::string final_result);
+
+    static bool is_final_result(std::string_view line, Status &status);
+
+    static std::chrono::nanoseconds thread_cpu_time();
+
+    // when constructed on the serial port
+    std::unique_ptr<SerialATPort> m_serial_port;
+
+    ATPort *m_port;
+
+    Reactor &m_reactor;
+
+    int m_deadline_timer = -1;
+
+    bool m_closed = false;
+
+    bool m_watching_output = false;
+
+    const unsigned int m_depth;
+
+    Id m_next_id = 1;
+
+    // written and not yet answered, oldest first
+    std::deque<Transaction> m_in_flight;
+
+    std::deque<Transaction> m_queue;
+
+    // completed commands, those that timed out, and their summed wall / CPU time
+    unsigned long m_completed = 0;
+    unsigned long m_timeouts = 0;
+    // commands written behind another, the most in flight at once, late replies swallowed
+    unsigned long m_pipelined = 0;
+    std::size_t m_deepest = 0;
+    unsigned long m_late_replies = 0;
+    // prompts answered with the text, and prompted commands given up before the prompt came
+    unsigned long m_prompts = 0;
+    unsigned long m_prompts_missed = 0;
+    Clock::duration m_total_elapsed{};
+    std::chrono::nanoseconds m_total_cpu{};
+
+    std::unique_ptr<VerbCounters[]> m_verbs{new VerbCounters[MAX_VERBS]};
+    std::atomic<std::size_t> m_verb_count{0};
+};
+
+#endif // AT_ENGINE_HPP
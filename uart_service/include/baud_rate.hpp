@@ -0,0 +1,15 @@
+#ifndef BAUD_RATE_HPP
+#define BAUD_RATE_HPP
+
+/* Line rates through termios2, which takes any rate in bits per second (BOTHER)
+ * instead of one of the Bxxx constants. Kept apart from serial.hpp because
+ * <asm/termbits.h> redefines the struct termios of <termios.h>. */
+
+/* Sets input and output rate of the open tty fd to baud
+ * Returns: 0, or -1 with errno set */
+int setArbitraryBaudRate(int fd, int baud);
+
+/* Returns: the output rate of the open tty fd in bits per second, or -1 with errno set */
+int getBaudRate(int fd);
+
+#endif // BAUD_RATE_HPP
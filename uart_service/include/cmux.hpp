@@ -0,0 +1,123 @@
+#ifndef CMUX_HPP
+#define CMUX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/**
+ * The basic option of 3GPP TS 27.010, the multiplexer the SIM7600 switches to on AT+CMUX=0. Every frame
+ * is F9 | address | control | length | information | FCS | F9 and belongs to one DLC (data link
+ * connection): DLC 0 carries the multiplexer's own control messages, each further one is a virtual
+ * serial port with an AT interpreter of its own. Only framing and the FCS live here, so the service and
+ * the simulator share them; which DLCs are opened and what runs on them is up to the two ends.
+ */
+class Cmux
+{
+public:
+    static constexpr uint8_t FLAG = 0xF9;
+
+    // Frame types in the control field, without the P/F bit
+    enum Control : uint8_t
+    {
+        SABM = 0x2F, // open a DLC
+        UA = 0x63,   // acknowledges SABM and DISC
+        DM = 0x0F,   // the DLC is not open, e.g. refused SABM
+        DISC = 0x43, // close a DLC
+        UIH = 0xEF,  // data, the FCS covers the header only
+        UI = 0x03    // data, the FCS covers the information too
+    };
+
+    static constexpr uint8_t POLL_FINAL = 0x10;
+
+    // Control messages in UIH frames on DLC 0, the command form: the response has C/R (0x02) cleared
+    enum Message : uint8_t
+    {
+        CLD = 0xC3,   // close down: leave multiplexing, back to AT commands
+        TEST = 0x23,  // echoed by the other end
+        MSC = 0xE3,   // modem status: the V.24 signals of a DLC
+        FCON = 0xA3,  // the other end may send again
+        FCOFF = 0x63, // the other end is to stop sending
+        NSC = 0x11    // response to a message type the other end does not support
+    };
+
+    static constexpr uint8_t MESSAGE_COMMAND = 0x02;
+
+    // Flag, address, control, two length bytes, FCS and flag
+    static constexpr std::size_t OVERHEAD = 7;
+
+    // What the two length bytes can express
+    static constexpr std::size_t MAX_INFO = 0x7FFF;
+
+    static constexpr unsigned int MAX_DLCI = 63;
+
+    struct Frame
+    {
+        unsigned int dlci = 0;
+        uint8_t control = 0;  // the frame type, P/F masked off
+        bool command = false; // the C/R bit of the address
+        bool poll_final = false;
+        std::string_view info;
+    };
+
+    /**
+     * The frame check sequence over data: CRC-8 with the reflected polynomial x^8 + x^2 + x + 1, from 0xFF,
+     * sent inverted. Running a received header and its FCS through crc() leaves GOOD_CRC.
+     */
+    static uint8_t fcs(const uint8_t *data, std::size_t length);
+
+    static uint8_t crc(uint8_t crc, const uint8_t *data, std::size_t length);
+
+    static constexpr uint8_t GOOD_CRC = 0xCF;
+
+    /**
+     * Write a frame to out, which has room for info.size() + OVERHEAD bytes, and return its length. The
+     * initiator (the host) sets command on its commands and data, the modem on its responses.
+     */
+    static std::size_t encode(uint8_t *out, unsigned int dlci, uint8_t control, bool command, std::string_view info = {},
+                              bool poll_final = false);
+
+    static std::string frame(unsigned int dlci, uint8_t control, bool command, std::string_view info = {},
+                             bool poll_final = false);
+
+    // A control message for DLC 0: its type, one length byte (values stay below 128 bytes) and its value
+    static std::string message(uint8_t type, std::string_view value = {});
+};
+
+/**
+ * Cuts the byte stream after AT+CMUX into frames. Bytes are copied in with feed() and next() hands out
+ * each frame that checks out, with info viewing the buffer, which stays valid until the next feed(). A
+ * frame with a bad FCS is dropped and counted. Bytes that do not start a frame, and a frame whose
+ * closing flag is missing, are skipped up to the next flag, which is how a receiver finds the frames
+ * again after noise or a lost byte.
+ */
+class CmuxDecoder
+{
+public:
+    void feed(const char *data, std::size_t length);
+
+    bool next(Cmux::Frame &frame);
+
+    void clear();
+
+    unsigned long frames() const;
+
+    unsigned long bad_fcs() const;
+
+    // bytes skipped while looking for the start of a frame
+    unsigned long discarded() const;
+
+private:
+    std::string m_buffer;
+
+    std::size_t m_begin = 0;
+
+    unsigned long m_frames = 0;
+
+    unsigned long m_bad_fcs = 0;
+
+    unsigned long m_discarded = 0;
+};
+
+#endif // CMUX_HPP
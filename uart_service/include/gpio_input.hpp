@@ -0,0 +1,58 @@
+#ifndef GPIO_INPUT_HPP
+#define GPIO_INPUT_HPP
+
+#include <chrono>
+#include <functional>
+#include <string>
+
+/**
+ * One GPIO line watched for edges through the Linux GPIO character device (uAPI v2). The kernel
+ * timestamps every edge when it happens (CLOCK_MONOTONIC) and queues it on fd(), which the reactor waits
+ * on, so nothing polls the pin.
+ *
+ * For tests, chip may be a FIFO instead of /dev/gpiochipN. Whoever writes to it plays the chip by writing
+ * struct gpio_v2_line_event records, as cellular_modem_sim --ri does, and the events are read the same way.
+ */
+class GpioInput
+{
+public:
+    enum class Edge
+    {
+        RISING = 0,
+        FALLING = 1,
+        BOTH = 2
+    };
+
+    struct Event
+    {
+        std::chrono::nanoseconds timestamp; // CLOCK_MONOTONIC, comparable with now()
+        bool rising = false;
+        unsigned int sequence = 0;
+    };
+
+    // Request line of chip as an input reporting edge; throws Utils::Error::SystemError
+    GpioInput(const std::string &chip, unsigned int line, Edge edge, const std::string &consumer);
+
+    ~GpioInput();
+
+    GpioInput(const GpioInput &) = delete;
+
+    GpioInput &operator=(const GpioInput &) = delete;
+
+    int fd() const;
+
+    // Hand the queued edges to handler; returns the number read
+    unsigned int read_events(const std::function<void(const Event &)> &handler);
+
+    bool is_mock() const;
+
+    // The clock of Event::timestamp
+    static std::chrono::nanoseconds now();
+
+private:
+    int m_fd = -1;
+
+    bool m_mock = false;
+};
+
+#endif // GPIO_INPUT_HPP
@@ -0,0 +1,58 @@
+#ifndef GSM7_HPP
+#define GSM7_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * The GSM 7-bit default alphabet of 3GPP 23.038: septets packed LSB first, 8 into every 7 octets, and the
+ * default and extension tables they map through. Unpacking takes 16 septets at a time out of 14 octets with
+ * SSSE3 on x86 (chosen at run time) or, built with -DSMS_NEON=ON, NEON on AArch64, and goes septet by
+ * septet elsewhere and for the tail; mapping copies runs of 16 septets that are their own ASCII code in one
+ * go. Both write into buffers of the caller and allocate nothing. The way back, characters to septets and
+ * septets packed, is for the few messages sent and goes septet by septet.
+ */
+class Gsm7
+{
+public:
+    // Escape to the extension table: the septet after it selects the character
+    static constexpr uint8_t ESCAPE = 0x1B;
+
+    // The longest UTF-8 a septet maps to (€ of the extension table, in 2 septets, is 3 bytes)
+    static constexpr std::size_t MAX_UTF8 = 3;
+
+    // Unpack the first count septets of the length octets at packed into out, one septet per byte
+    static std::size_t unpack(const uint8_t *packed, std::size_t length, std::size_t count, uint8_t *out);
+
+    // The same, septet by septet
+    static std::size_t unpack_scalar(const uint8_t *packed, std::size_t length, std::size_t count, uint8_t *out);
+
+    // Map count unpacked septets to UTF-8 in out, which takes MAX_UTF8 bytes per septet; returns the bytes written
+    static std::size_t to_utf8(const uint8_t *septets, std::size_t count, char *out);
+
+    // The same, septet by septet
+    static std::size_t to_utf8_scalar(const uint8_t *septets, std::size_t count, char *out);
+
+    /**
+     * The septets code_point is sent as into out: 1 of the default alphabet, or 2 for ESCAPE and a character
+     * of the extension table; 0 if the alphabet has no such character
+     */
+    static std::size_t from_code_point(char32_t code_point, uint8_t out[2]);
+
+    /**
+     * Pack count septets LSB first into out after fill_bits zero bits, the padding of a user data header to
+     * a septet boundary; returns the octets written
+     */
+    static std::size_t pack(const uint8_t *septets, std::size_t count, unsigned int fill_bits, uint8_t *out);
+
+    // The vector unit unpack() and to_utf8() use on this CPU: "SSSE3", "SSE2", "NEON" or "none"
+    static const char *vector_unit();
+
+    // The septet a header of udh_octets (UDHL included) is padded to: the text starts there, after the fill bits
+    static constexpr std::size_t first_septet(std::size_t udh_octets)
+    {
+        return (udh_octets * 8 + 6) / 7;
+    }
+};
+
+#endif // GSM7_HPP
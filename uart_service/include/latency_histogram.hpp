@@ -0,0 +1,58 @@
+#ifndef LATENCY_HISTOGRAM_HPP
+#define LATENCY_HISTOGRAM_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Latency histogram in the HDR style: microsecond values are counted in buckets that are linear within
+ * each power of two, 16 to a power, so any percentile is read back within 1/16 (6.25 %) from 1 us to
+ * 70 minutes in a few KiB. One thread records, with relaxed atomic loads and stores and no locked
+ * instruction, while any other may take a snapshot(), consistent per bucket but not across them.
+ */
+class LatencyHistogram
+{
+public:
+    static constexpr unsigned int SUB_BUCKET_BITS = 4;
+    static constexpr unsigned int SUB_BUCKETS = 1u << SUB_BUCKET_BITS;
+    // the largest value kept apart, 2^32 - 1 us; longer ones land in the last bucket
+    static constexpr unsigned int MAGNITUDES = 32;
+    static constexpr std::size_t BUCKETS = (MAGNITUDES - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    struct Snapshot
+    {
+        std::array<std::uint64_t, BUCKETS> counts{};
+        std::uint64_t count = 0;
+        std::uint64_t total_us = 0;
+        std::uint64_t min_us = 0;
+        std::uint64_t max_us = 0;
+
+        // The value below which fraction (0..1) of the recorded ones lie, to the bucket's precision
+        std::uint64_t percentile(double fraction) const;
+
+        std::uint64_t mean_us() const;
+
+        // Add other, as when summing the histograms of several verbs
+        void merge(const Snapshot &other);
+    };
+
+    void record(std::chrono::nanoseconds latency);
+
+    Snapshot snapshot() const;
+
+    static std::size_t bucket_of(std::uint64_t us);
+
+    // The smallest value counted in bucket
+    static std::uint64_t lowest_in(std::size_t bucket);
+
+private:
+    std::array<std::atomic<std::uint64_t>, BUCKETS> m_counts{};
+    std::atomic<std::uint64_t> m_total_us{0};
+    std::atomic<std::uint64_t> m_min_us{UINT64_MAX};
+    std::atomic<std::uint64_t> m_max_us{0};
+};
+
+#endif // LATENCY_HISTOGRAM_HPP
@@ -0,0 +1,58 @@
+#ifndef LINE_FRAMER_HPP
+#define LINE_FRAMER_HPP
+
+#include <array>
+#include <cstddef>
+#include <string_view>
+
+/**
+ * Splits the byte stream of the modem into lines without copying them out. Reads land directly in
+ * the framer (space() / commit()), next() hands out each complete line as a std::string_view into
+ * the buffer with its CR/LF stripped, and an unterminated tail waits for the next read.
+ *
+ * The scan for '\n' is a memchr(), which glibc vectorizes (SSE2/AVX2 on x86, NEON on aarch64), and
+ * resumes where the previous scan stopped, so a PDU arriving in 16-byte bursts is scanned once.
+ * A view stays valid until next() returns false.
+ */
+class LineFramer
+{
+public:
+    static constexpr std::size_t CAPACITY = 4096;
+
+    // Where the next read should go, space_size() bytes long
+    char *space();
+
+    std::size_t space_size() const;
+
+    // length bytes were read into space()
+    void commit(std::size_t length);
+
+    // Copy data in, for callers that do not read into space(). Returns the number of bytes taken
+    std::size_t feed(const char *data, std::size_t length);
+
+    /**
+     * The next non-empty line, without its trailing CR/LF. A line that does not fit into CAPACITY
+     * is handed out in pieces. Returns false once only an unterminated tail is left, which is then
+     * moved to the front if the room behind it runs low.
+     */
+    bool next(std::string_view &line);
+
+    // The bytes after the last complete line, e.g. the "> " prompt of AT+CMGS
+    std::string_view partial() const;
+
+    void clear();
+
+private:
+    void compact();
+
+    std::array<char, CAPACITY> m_buffer;
+
+    // [m_begin, m_end) is pending; [m_begin, m_scanned) is known to contain no '\n'
+    std::size_t m_begin = 0;
+
+    std::size_t m_scanned = 0;
+
+    std::size_t m_end = 0;
+};
+
+#endif // LINE_FRAMER_HPP
@@ -0,0 +1,55 @@
+#ifndef LINE_HEALTH_HPP
+#define LINE_HEALTH_HPP
+
+#include <iostream>
+
+#include "serial.hpp"
+
+/**
+ * Watches the error counters of the UART driver and decides how to react to new errors. Overruns mean
+ * the host did not empty the FIFO in time, which RTS/CTS flow control prevents; framing and parity
+ * errors mean the line does not carry the rate, so only a lower one helps. After an action one check is
+ * skipped, since the counters may still move while the link settles.
+ */
+class LineHealth
+{
+public:
+    enum class Action
+    {
+        NONE = 0,
+        ENABLE_FLOW_CONTROL = 1,
+        STEP_DOWN = 2
+    };
+
+    // auto_flow_control: whether overruns may turn RTS/CTS on
+    explicit LineHealth(bool auto_flow_control);
+
+    /**
+     * Take the counters of a periodic check. flow_control: whether RTS/CTS is on already;
+     * can_step_down: whether a lower rate is left to go to.
+     */
+    Action assess(const LineErrors &counters, bool flow_control, bool can_step_down);
+
+    // Whether any counter moved between two readings
+    static bool changed(const LineErrors &before, const LineErrors &after);
+
+    void dump(std::ostream &os) const;
+
+    static const char *to_string(Action action);
+
+private:
+    bool m_auto_flow_control;
+
+    bool m_started = false;
+
+    bool m_settling = false;
+
+    LineErrors m_last{};
+
+    // errors counted since the service started
+    LineErrors m_total{};
+
+    unsigned long m_actions = 0;
+};
+
+#endif // LINE_HEALTH_HPP
@@ -0,0 +1,366 @@
+#ifndef MODEM_HPP
+#define MODEM_HPP
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "serial.hpp"
+#include "options.hpp"
+#include "serial_interface.hpp"
+#include "reactor.hpp"
+#include "at_engine.hpp"
+#include "line_framer.hpp"
+#include "line_health.hpp"
+#include "gpio_input.hpp"
+#include "multiplexer.hpp"
+#include "pdu_encoder.hpp"
+#include "traffic_capture.hpp"
+
+/**
+ * One SIM7600 on one AT port: its serial port, reader, AT engine and line health, all on a reactor of its
+ * own that run() drives on the calling thread. Several modems therefore run side by side on their own
+ * threads and cores. What they share, handing the messages on and the front-end, stays with the service:
+ * a stored or delivered PDU goes to the deliver callback on the modem's thread, and the front-end reaches
+ * the modem through the thread-safe request(), stop() and report().
+ *
+ * With cmux set the port is multiplexed after start-up: URCs, SMS transactions and front-end commands each
+ * get a DLC and an AT engine of their own, so a long AT+CMGL no longer holds a front-end command up.
+ *
+ * Messages to send queue up as AT+CMGS on the SMS engine, each part one prompt and PDU. While more than one
+ * is on its way, AT+CMMS=1 keeps the radio link up between them rather than have the network bring it up
+ * for each; their results go back in the order the messages were queued.
+ */
+class Modem
+{
+public:
+    // Hand a PDU on; false if it does not parse. Called on the modem's thread, so it must be thread-safe
+    using Deliver = std::function<bool(const std::string &pdu)>;
+
+    /**
+     * Make what was handed on durable, before the modem is told to delete or acknowledge it; false if it could
+     * not be, and the messages stay with the modem. Called on the modem's thread, so it must be thread-safe
+     */
+    using Persist = std::function<bool()>;
+
+    // The front-end's reply, called on the modem's thread
+    using Reply = std::function<void(const std::string &content)>;
+
+    Modem(std::string name, std::string device, const Utils::Options::Serial &serial_config, Deliver deliver,
+          Persist persist);
+
+    ~Modem();
+
+    Modem(const Modem &) = delete;
+
+    Modem &operator=(const Modem &) = delete;
+
+    /**
+     * Bring the modem up and serve it until stop() or until the port closes. Throws
+     * Utils::Error::UnexpectedATResponse if it cannot be brought up.
+     */
+    void run();
+
+    // The following may be called from any thread; they take effect on the modem's thread
+
+    // Send an AT command from the front-end; reply gets what it answered if that was as expected
+    void request(std::shared_ptr<Utils::Interface::Command> command, Reply reply);
+
+    /**
+     * Send text to recipient as an SMS, in as many parts as it takes. reply gets "+CMGS: <mr>[,<mr>...]", the
+     * message reference of each part, or "ERROR" and why it was not sent
+     */
+    void send(std::string recipient, std::string text, Reply reply);
+
+    void stop();
+
+    // Print everything measured so far
+    void report();
+
+    const std::string &name() const;
+
+    const std::string &device() const;
+
+private:
+    // The start-up sequence; false if stop() came first
+    bool start();
+
+    void loop();
+
+    static void throw_if_closed(const std::string &command, const ATEngine::Result &result);
+
+    /**
+     * Move modem and host to target together. The modem answers AT+IPR at the old rate and then switches;
+     * an AT at the new rate confirms. If that stays unanswered the host goes back, and if the modem did
+     * switch it is asked, at the new rate, to return.
+     */
+    void renegotiate_baud(int target);
+
+    // Whether the modem answers AT at the current rate
+    bool answers();
+
+    // answers() for the running loop, which must not block on execute(): then(answered) once it is known
+    void answers(std::function<void(bool)> then, int attempts = 3);
+
+    /**
+     * AT+CMUX=0 and open the channels. If the modem refuses or leaves a channel unopened, it is asked to
+     * leave multiplexing again and everything stays on the one AT engine.
+     */
+    void multiplex();
+
+    // The engine for the lines of a channel, and those for SMS and front-end commands (m_at when not multiplexed)
+    ATEngine &engine_of(const CmuxChannel &channel);
+
+    ATEngine &sms_at();
+
+    ATEngine &frontend_at();
+
+    void output_ready();
+
+    void line_check();
+
+    // The next AT+IPR rate below the current one, not below the configured baud; 0 if there is none
+    int lower_baud() const;
+
+    // renegotiate_baud() for the running loop, where nothing may block: AT+IPR, then answers() to confirm, and
+    // if the modem is silent at the lower rate it is asked back there and the host follows
+    void step_down_baud();
+
+    void serial_handler();
+
+    // The "> " of AT+CMGS ends no line: it is what the framer is left with once engine waits for it
+    void offer_prompt(ATEngine &engine, LineFramer &framer);
+
+    using UrcHandler = void (Modem::*)(std::string_view line, std::string_view body);
+
+    // Adding an unsolicited result code is an entry here and its handler
+    static constexpr auto unsolicited_results();
+
+    void line_handler(ATEngine &engine, std::string_view content);
+
+    /**
+     * RI goes low for a URC (about 120 ms for an SMS, for as long as a call rings) before the URC is sent.
+     * The edge carries the kernel's timestamp of when it happened, so the latency from the modem signalling
+     * to the message being handed on is measured from the pin rather than from when the line was read.
+     */
+    void ring_indicator_handler();
+
+    // When RI announced the URC being handled, if it did; URCs claim the pulses in order, each once
+    std::optional<std::chrono::nanoseconds> take_ring_indication(std::string_view what);
+
+    void new_message_handler(std::string_view line, std::string_view);
+
+    /**
+     * AT+CMGR the stored message, hand it on, persist it and AT+CMGD it. A PDU that does not parse while the UART
+     * counted errors was most likely garbled on the wire rather than by the sender: it is read once more
+     * before it is deleted.
+     */
+    void read_message(long index, bool may_retry, std::optional<std::chrono::nanoseconds> rung_at);
+
+    /**
+     * AT+CMGL=4 everything stored, handing each received PDU on as its line is read, then persist and delete
+     * what was handed on, by index: nothing else stored is touched. Messages stored to be sent, or anything
+     * else that is no SMS-DELIVER, are skipped and stay. What was not handed on stays stored for the next
+     * drain, except that PDUs the UART may have garbled are read once more with read_message(). Runs at
+     * start-up, and instead of one read per +CMTI when they arrive faster than the reads complete.
+     */
+    void drain_backlog();
+
+    // A line of the AT+CMGL=4 reply: "+CMGL: <index>,<stat>,[<alpha>],<length>", then the PDU
+    void listed_line(std::string_view line);
+
+    // A read or the drain completed: drain what +CMTI announced meanwhile
+    void sms_idle();
+
+    // "+CMT: [<alpha>],<length>" and the PDU: routed to the service instead of being stored
+    void delivered_message_handler(std::string_view line, std::string_view pdu);
+
+    /**
+     * Answer a +CMT under AT+CSMS=1: AT+CNMA once it was handed on, otherwise AT+CNMA=2 (RP-ERROR), which
+     * has the network send it again later, and messages go through storage for DIRECT_DELIVERY_RETRY.
+     */
+    void acknowledge(bool handed_on);
+
+    // AT+CNMI=2,2, and drain what was stored meanwhile
+    void deliver_directly();
+
+    void ring_handler(std::string_view, std::string_view);
+
+    // "+CLIP: \"<number>\",<type>,..." follows every RING once AT+CLIP=1 is set
+    void caller_handler(std::string_view line, std::string_view);
+
+    // "+CREG: <stat>[,<lac>,<ci>]", likewise +CGREG (GPRS) and +CEREG (LTE)
+    void registration_handler(std::string_view line, std::string_view);
+
+    void notice_handler(std::string_view line, std::string_view body);
+
+    /**
+     * Everything measured so far, on report(), every stats_interval and at exit. Rates are over the time
+     * since the previous dump, counts since start-up.
+     */
+    void dump_metrics();
+
+    void frontend_response_handler(const std::shared_ptr<Utils::Interface::Command> &command, const Reply &reply,
+                                   const ATEngine::Result &result);
+
+    // A message to send, from encoding it until its result goes back
+    struct Outgoing
+    {
+        std::string recipient;
+        Reply reply;
+        std::vector<ATEngine::Id> parts;
+        std::size_t sent = 0;
+        std::string references; // the TP-MR of each part sent
+        std::string result;     // set once every part was sent or one failed
+    };
+
+    // send() on the modem's thread: encode and queue the parts
+    void queue_message(const std::string &recipient, const std::string &text, const Reply &reply);
+
+    void part_sent(Outgoing &message, const ATEngine::Result &result);
+
+    // Reply for the messages at the front of the outbox that have their result
+    void flush_outbox();
+
+    /**
+     * The integer in the given comma-separated field after prefix, e.g. field 1 of
+     * "+CMTI: \"SM\",3" is 3; std::nullopt if the line has no such number
+     */
+    static std::optional<long> int_field(std::string_view line, std::string_view prefix, unsigned int field);
+
+    static void trim(std::string &s);
+
+    // s without the white space around it
+    static std::string_view trimmed(std::string_view s);
+
+    // Whether the hex of a stored PDU is other than an SMS-DELIVER, e.g. an SMS-SUBMIT stored to be sent
+    static bool not_received(std::string_view pdu);
+
+    // Returns false if the reply holds no PDU that parses
+    bool sms_handler(std::string_view raw_msg);
+
+    const std::string m_name;
+
+    const std::string m_device; // SerialPi keeps the pointer
+
+    const Utils::Options::Serial m_config;
+
+    const Deliver m_deliver;
+
+    const Persist m_persist;
+
+    std::atomic<bool> m_stopping{false};
+
+    SerialPi m_serial{m_device.c_str()};
+
+    // what the serial port reads and writes, when a capture file is configured
+    std::unique_ptr<TrafficCapture::Recorder> m_recorder;
+
+    LineFramer m_framer;
+
+    Reactor m_reactor;
+
+    ATEngine m_at;
+
+    // set once the modem multiplexes; m_at then runs on the URC channel
+    std::unique_ptr<Multiplexer> m_mux;
+
+    std::unique_ptr<ATEngine> m_sms_at;
+
+    std::unique_ptr<ATEngine> m_frontend_at;
+
+    LineHealth m_line_health;
+
+    const int m_lowest_baud;
+
+    std::unique_ptr<GpioInput> m_ring_indicator;
+
+    // falling edges of RI not yet matched to a URC, oldest first
+    std::deque<std::chrono::nanoseconds> m_ring_indicated_at;
+
+    unsigned long m_ring_indications = 0;
+
+    const std::chrono::seconds m_stats_interval;
+
+    unsigned long m_lines = 0;
+
+    SerialStatistics m_last_io{};
+
+    std::chrono::steady_clock::time_point m_last_dump = std::chrono::steady_clock::now();
+
+    // a URC whose second line is still to come on the channel of engine m_urc_source, and its first line
+    UrcHandler m_urc_waiting_for_body = nullptr;
+
+    const ATEngine *m_urc_source = nullptr;
+
+    std::string m_urc_header;
+
+    // The AT+CMGL=4 being answered: the UART's error counters before, the index of the PDU to come, the
+    // indices handed on and not, how many were no SMS-DELIVER, and whether a line fit neither (its message
+    // cannot be told apart)
+    struct Drain
+    {
+        LineErrors before{};
+        bool counted = false;
+        std::optional<long> listed;
+        std::vector<long> handed_on;
+        std::vector<long> kept;
+        unsigned int skipped = 0;
+        bool stray = false;
+    };
+
+    std::optional<Drain> m_drain;
+
+    // AT+CMGR of single messages not yet answered, and whether +CMTI came in meanwhile
+    unsigned int m_reads_in_flight = 0;
+
+    bool m_drain_wanted = false;
+
+    // drains run, messages they handed on, and +CMTI left to one
+    unsigned long m_drains = 0;
+
+    unsigned long m_drained = 0;
+
+    unsigned long m_coalesced = 0;
+
+    // +CMT under AT+CSMS=1 are being routed to the service and have to be acknowledged
+    bool m_direct_delivery = false;
+
+    // back to direct delivery after falling back to storage
+    int m_direct_delivery_timer = -1;
+
+    // +CMT acknowledged, refused, and acknowledgements the modem no longer expected
+    unsigned long m_acknowledged = 0;
+
+    unsigned long m_refused = 0;
+
+    unsigned long m_late_acknowledgements = 0;
+
+    PduEncoder m_encoder;
+
+    // the concatenation reference of the next message
+    uint8_t m_next_reference = 0;
+
+    // messages queued to send, oldest first, and their parts not yet answered
+    std::deque<std::unique_ptr<Outgoing>> m_outbox;
+
+    std::size_t m_parts_pending = 0;
+
+    // AT+CMMS=1 went out for the parts pending
+    bool m_link_kept = false;
+
+    // messages sent, the parts they took, and messages not sent
+    unsigned long m_messages_sent = 0;
+
+    unsigned long m_parts_sent = 0;
+
+    unsigned long m_messages_failed = 0;
+};
+
+#endif // MODEM_HPP
@@ -0,0 +1,140 @@
+#ifndef MULTIPLEXER_HPP
+#define MULTIPLEXER_HPP
+
+#include <array>
+#include <functional>
+#include <initializer_list>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "serial.hpp"
+#include "cmux.hpp"
+#include "at_engine.hpp"
+#include "line_framer.hpp"
+
+class Multiplexer;
+
+/**
+ * One DLC of a Multiplexer as an ATPort, so an ATEngine runs on it as on a serial port of its own.
+ * Commands go out as UIH frames ending in CR; what the modem sends on the DLC is cut into lines by
+ * the channel's framer.
+ */
+class CmuxChannel : public ATPort
+{
+public:
+    CmuxChannel(Multiplexer &mux, unsigned int dlci);
+
+    bool write_line(const std::string &line) override;
+
+    bool write(std::string_view data) override;
+
+    void flush() override;
+
+    int queued() const override;
+
+    int descriptor() const override;
+
+    unsigned int dlci() const;
+
+    // The modem acknowledged the SABM
+    bool is_open() const;
+
+    LineFramer &framer();
+
+private:
+    friend class Multiplexer;
+
+    Multiplexer &m_mux;
+
+    const unsigned int m_dlci;
+
+    bool m_open = false;
+
+    LineFramer m_framer;
+
+    unsigned long m_frames_in = 0;
+
+    unsigned long m_frames_out = 0;
+
+    unsigned long m_bytes_in = 0;
+
+    unsigned long m_bytes_out = 0;
+};
+
+/**
+ * The host's end of 27.010 multiplexing on a serial port, after AT+CMUX=0 was answered with OK. It opens
+ * DLC 0 and the channels asked for with SABM, answers the modem's control messages (MSC, TEST, flow
+ * control) on DLC 0 and hands what arrives on a channel to it, line by line. Everything runs on the
+ * reactor thread that reads the serial port.
+ */
+class Multiplexer
+{
+public:
+    // The highest DLC a channel can be opened on; the SIM7600 offers four
+    static constexpr unsigned int MAX_CHANNEL = 4;
+
+    // A line the modem sent on a channel
+    using LineHandler = std::function<void(CmuxChannel &channel, std::string_view line)>;
+
+    // frame_size: N1, the most information bytes per frame the modem accepts
+    Multiplexer(SerialPi &serial, std::size_t frame_size = 31);
+
+    Multiplexer(const Multiplexer &) = delete;
+
+    Multiplexer &operator=(const Multiplexer &) = delete;
+
+    // Send SABM on DLC 0 and on each channel; opened() tells once every UA arrived
+    void open(std::initializer_list<unsigned int> dlcis);
+
+    bool opened() const;
+
+    CmuxChannel &channel(unsigned int dlci);
+
+    // Decode what was read from the serial port; each line a channel completes goes to handler
+    void receive(const char *data, std::size_t length, const LineHandler &handler);
+
+    // data in UIH frames on dlci; false if the serial port refused it
+    bool send(unsigned int dlci, std::string_view data);
+
+    void flush();
+
+    int queued() const;
+
+    int descriptor() const;
+
+    // Ask the modem to leave multiplexing (CLD); it takes AT commands on the port again afterwards
+    void close();
+
+    // The frames of close(), for a modem a previous run may have left multiplexing
+    static std::string close_down();
+
+    void dump(std::ostream &os) const;
+
+private:
+    void control_message(std::string_view info);
+
+    bool send_frame(unsigned int dlci, uint8_t control, bool command, std::string_view info = {}, bool poll_final = false);
+
+    SerialPi &m_serial;
+
+    const std::size_t m_frame_size;
+
+    CmuxDecoder m_decoder;
+
+    bool m_control_open = false;
+
+    std::array<std::unique_ptr<CmuxChannel>, MAX_CHANNEL + 1> m_channels;
+
+    // frames for DLCs that are not open, or of a type the host does not expect
+    unsigned long m_stray_frames = 0;
+
+    // MSC, TEST, flow control, ... on DLC 0
+    unsigned long m_control_messages = 0;
+
+    // a frame is encoded here before it is written
+    std::string m_frame;
+};
+
+#endif // MULTIPLEXER_HPP
@@ -0,0 +1,100 @@
+#ifndef PDU_DECODER_HPP
+#define PDU_DECODER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "gsm7.hpp"
+
+/**
+ * SMS-DELIVER TPDUs (3GPP 23.040) in the hex that AT+CMGR, AT+CMGL and +CMT carry, SMSC in front, decoded
+ * without allocating. The hex goes through a lookup table into the decoder's octet buffer once; the numbers,
+ * the timestamp and the text are written into buffers of the decoder, which the views of a Message point
+ * into until the next decode(). Errors are returned rather than thrown, so a garbled line costs no more
+ * than a good one. A decoder is the storage of one message at a time: one per thread.
+ */
+class PduDecoder
+{
+public:
+    // The SMSC (up to 12 octets) and the longest TPDU (176), with room to spare
+    static constexpr std::size_t MAX_OCTETS = 200;
+
+    static constexpr std::size_t MAX_DIGITS = 20;
+
+    // An alphanumeric sender: the septets MAX_DIGITS semi-octets hold, in UTF-8
+    static constexpr std::size_t MAX_SENDER = MAX_DIGITS * 4 / 7 * Gsm7::MAX_UTF8;
+
+    // 255 septets, or 127 UTF-16 units, of up to 3 bytes in UTF-8
+    static constexpr std::size_t MAX_TEXT = 255 * Gsm7::MAX_UTF8;
+
+    enum class Error : uint8_t
+    {
+        NONE = 0,
+        NOT_HEX,          // a character that is no hex digit, or an odd count of them
+        TOO_LONG,         // more than MAX_OCTETS
+        TRUNCATED,        // ends before a field the lengths before it announce
+        NOT_DELIVER,      // the message type indicator is not SMS-DELIVER
+        ADDRESS_TOO_LONG, // an SMSC or sender of more than MAX_DIGITS
+        BAD_UDH,          // a header longer than the user data, or a concatenation IE out of range
+        UNSUPPORTED_DCS   // 8-bit data, or compressed text
+    };
+
+    struct Message
+    {
+        std::string_view smsc;
+        std::string_view sender;    // digits, or the name of an alphanumeric sender in UTF-8
+        uint8_t sender_type = 0;    // its type of address
+        std::string_view timestamp; // "yy/MM/dd,hh:mm:ss+zz", the zone in quarter hours
+        uint8_t pid = 0;
+        uint8_t dcs = 0;
+        // a concatenation IE: the message is part index (from 1) of count
+        bool segment = false;
+        uint16_t reference = 0;
+        uint8_t count = 0;
+        uint8_t index = 0;
+        // UTF-8, but for a surrogate whose other half is in the previous or next segment (see Utf16::finish)
+        std::string_view text;
+    };
+
+    // Decode pdu into message; on an error, message is left empty and error_offset() tells where
+    Error decode(std::string_view pdu, Message &message);
+
+    // The position in the hex of the last decode() where its error was found
+    std::size_t error_offset() const;
+
+    static const char *to_string(Error error);
+
+private:
+    // Fail at octet at of the TPDU, which is at twice that in the hex
+    Error fail(Error error, std::size_t at, Message &message);
+
+    // Semi-octets of the count octets, low nibble first, an F nibble filling; at most digits of them
+    static std::string_view semi_octets(const uint8_t *octets, std::size_t count, std::size_t digits, char *out);
+
+    // The 7 octets of TP-SCTS
+    std::string_view timestamp(const uint8_t *octets);
+
+    // Septets first..count of the packed octets, through the default alphabet into out
+    std::size_t septets_text(const uint8_t *packed, std::size_t length, std::size_t first, std::size_t count,
+                             char *out);
+
+    // The UTF-16BE from octet skip of the user data ud
+    std::string_view ucs2_text(const uint8_t *ud, std::size_t length, std::size_t skip);
+
+    uint8_t m_octets[MAX_OCTETS];
+
+    char m_smsc[MAX_DIGITS];
+
+    char m_sender[MAX_SENDER];
+
+    char m_timestamp[20];
+
+    char m_text[MAX_TEXT];
+
+    uint8_t m_septets[255];
+
+    std::size_t m_error_offset = 0;
+};
+
+#endif // PDU_DECODER_HPP
@@ -0,0 +1,96 @@
+#ifndef PDU_ENCODER_HPP
+#define PDU_ENCODER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * SMS-SUBMIT TPDUs (3GPP 23.040) for AT+CMGS in PDU mode, the way back of PduDecoder. Text that the GSM 7-bit
+ * default alphabet and its extension table can carry goes as septets, anything else as UCS-2 (UTF-16BE,
+ * surrogate pairs for what is beyond the BMP). Text too long for one message is cut into the parts of a
+ * concatenated one, each with an 8-bit concatenation IE in its user data header; an escape and its
+ * character, and the two halves of a surrogate pair, stay in one part. The SMSC is left to the SIM (a
+ * zero-length address) and the message reference to the modem.
+ *
+ * Errors are returned rather than thrown, as by the decoder. An encoder keeps its buffers between messages:
+ * one per thread.
+ */
+class PduEncoder
+{
+public:
+    // Septets and UCS-2 octets of a message on its own, and of a part after its 6-octet header
+    static constexpr std::size_t MAX_SEPTETS = 160;
+
+    static constexpr std::size_t MAX_PART_SEPTETS = 153;
+
+    static constexpr std::size_t MAX_OCTETS = 140;
+
+    static constexpr std::size_t MAX_PART_OCTETS = 134;
+
+    static constexpr std::size_t MAX_DIGITS = 20;
+
+    // The concatenation IE numbers parts in one octet
+    static constexpr std::size_t MAX_PARTS = 255;
+
+    enum class Error : uint8_t
+    {
+        NONE = 0,
+        BAD_NUMBER, // not an optional '+' and 1 to MAX_DIGITS digits
+        NOT_UTF8,   // the text is not well-formed UTF-8
+        EMPTY,      // no text
+        TOO_LONG    // more than MAX_PARTS parts
+    };
+
+    struct Pdu
+    {
+        std::string hex;         // SMSC and TPDU, as AT+CMGS takes it after the prompt
+        std::size_t tpdu_length; // octets of the TPDU, the <length> of AT+CMGS
+    };
+
+    /**
+     * Encode text (UTF-8) to recipient, an international number with '+' or a national one, into parts: one,
+     * or those of a concatenated message with reference. On an error, parts is left empty
+     */
+    Error encode(std::string_view recipient, std::string_view text, uint8_t reference, std::vector<Pdu> &parts);
+
+    static const char *to_string(Error error);
+
+private:
+    // The address, the units and the ends of the parts of text in the members
+    Error prepare(std::string_view recipient, std::string_view text);
+
+    // The next code point of text from at, moving at past it; false if the bytes there are not one
+    static bool next_code_point(std::string_view text, std::size_t &at, char32_t &code_point);
+
+    // Text to septets (false if the alphabet misses a character) or to UTF-16BE in m_units
+    bool to_septets(std::string_view text);
+
+    void to_ucs2(std::string_view text);
+
+    // The ends of the parts in m_units, in octets or septets as the alphabet counts them
+    void cut(bool septets, std::size_t single, std::size_t per_part);
+
+    // One SMS-SUBMIT of the units [begin, end), with a concatenation IE if index is not 0
+    void submit(bool septets, std::size_t begin, std::size_t end, uint8_t reference, std::size_t index,
+                std::size_t count, Pdu &pdu);
+
+    // The TP-DA fields of the last encode()
+    uint8_t m_address[2 + MAX_DIGITS / 2];
+
+    std::size_t m_address_length = 0;
+
+    // Septets, one per byte, or UTF-16BE octets of the text
+    bool m_septets = true;
+
+    std::vector<uint8_t> m_units;
+
+    // Where each part ends in m_units
+    std::vector<std::size_t> m_ends;
+
+    std::vector<uint8_t> m_octets;
+};
+
+#endif // PDU_ENCODER_HPP
@@ -0,0 +1,111 @@
+#ifndef REACTOR_HPP
+#define REACTOR_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Single-threaded epoll event loop of the service. The serial port, the command pipe, timers (timerfd)
+ * and signals (signalfd) are all registered here and their handlers run one at a time on the loop thread,
+ * so the handlers never need locks but must not block. The one exception is post(), through which other
+ * threads hand work to the loop thread.
+ */
+class Reactor
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using IOHandler = std::function<void(uint32_t events)>;
+    using TimerHandler = std::function<void()>;
+    using SignalHandler = std::function<void(int signal_number)>;
+    using Task = std::function<void()>;
+
+    struct Latency
+    {
+        unsigned long count = 0;
+        Clock::duration total{};
+        Clock::duration max{};
+
+        void record(Clock::duration sample);
+    };
+
+    Reactor();
+
+    ~Reactor();
+
+    Reactor(const Reactor &) = delete;
+
+    Reactor &operator=(const Reactor &) = delete;
+
+    // Watch a descriptor owned by the caller; events are EPOLLIN / EPOLLOUT / EPOLLET ...
+    void add(int fd, uint32_t events, std::string name, IOHandler handler);
+
+    void modify(int fd, uint32_t events);
+
+    void remove(int fd);
+
+    /**
+     * Create a timer firing after delay, then every interval (zero interval: one-shot).
+     * A zero delay leaves it disarmed until rearm_timer(). Returns the timer id.
+     */
+    int add_timer(std::string name, std::chrono::milliseconds delay, std::chrono::milliseconds interval, TimerHandler handler);
+
+    void rearm_timer(int timer, std::chrono::milliseconds delay, std::chrono::milliseconds interval = std::chrono::milliseconds::zero());
+
+    void disarm_timer(int timer);
+
+    void cancel_timer(int timer);
+
+    // Block the signals for the calling thread and deliver them through a signalfd instead
+    void watch_signals(std::initializer_list<int> signals, SignalHandler handler);
+
+    // Run task on the loop thread; safe to call from any thread
+    void post(Task task);
+
+    // Wait up to timeout_ms (-1: forever) and dispatch one batch of events. Returns false if none arrived
+    bool run_once(int timeout_ms);
+
+    void run();
+
+    void stop();
+
+    bool is_running() const;
+
+    /**
+     * Per source: how long a ready event waited in its epoll batch before its handler started,
+     * and how long the handler kept the loop busy.
+     */
+    void dump_latency(std::ostream &os) const;
+
+private:
+    struct Source
+    {
+        std::string name;
+        IOHandler handler;
+        bool owned = false; // timerfd / signalfd created by the reactor itself
+        Latency wait;
+        Latency busy;
+    };
+
+    int m_epoll_fd = -1;
+
+    int m_signal_fd = -1;
+
+    int m_post_fd = -1; // eventfd that wakes the loop for posted tasks
+
+    std::mutex m_posted_mtx;
+
+    std::vector<Task> m_posted;
+
+    bool m_running = false;
+
+    std::unordered_map<int, Source> m_sources;
+};
+
+#endif // REACTOR_HPP
@@ -0,0 +1,118 @@
+#ifndef REASSEMBLER_HPP
+#define REASSEMBLER_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "sms.hpp"
+
+/**
+ * The parts of concatenated messages (23.040 9.2.3.24.1), kept until the last one arrives. A message is
+ * told apart by its sender, reference and part count, since phones pick references on their own and 0 is
+ * as good a reference as any. Each message has a deadline, its first part's arrival plus the timeout: past
+ * it, or when the parts waiting take more than the limit, the oldest message is handed on with
+ * MISSING where its absent parts would be, rather than dropped.
+ *
+ * The messages are spread over shards by a hash of their key, each with a lock, its own share of the limit
+ * and its messages in order of arrival, so modems adding parts on their threads seldom wait for each
+ * other and the part that completes a message hands it on without looking at any other.
+ */
+class Reassembler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr std::string_view MISSING = "[segment missing]";
+
+    static constexpr std::size_t SHARDS = 16;
+
+    struct Stats
+    {
+        unsigned long completed = 0; // messages whose parts all arrived
+        unsigned long expired = 0;   // handed on incomplete when their deadline passed
+        unsigned long evicted = 0;   // handed on incomplete to stay within the limit
+        unsigned long duplicates = 0;
+        std::size_t waiting = 0;     // messages with parts still to come
+        std::size_t bytes = 0;       // what their parts take
+    };
+
+    Reassembler(std::chrono::milliseconds timeout, std::size_t limit_bytes, std::size_t shards = SHARDS);
+
+    Reassembler(const Reassembler &) = delete;
+
+    Reassembler &operator=(const Reassembler &) = delete;
+
+    /**
+     * Keep part, a part of a concatenated message. Appends to ready the whole message if part was its last
+     * one, and any message handed on incomplete to make room for it. Safe to call from any thread.
+     */
+    void add(SMS part, std::vector<SMS> &ready, Clock::time_point now = Clock::now());
+
+    // Appends to ready every message whose deadline is past now, incomplete
+    void expire(std::vector<SMS> &ready, Clock::time_point now = Clock::now());
+
+    // The earliest deadline of the messages waiting, none if there are none
+    std::optional<Clock::time_point> next_deadline() const;
+
+    Stats stats() const;
+
+    void report(std::ostream &os) const;
+
+private:
+    struct Key
+    {
+        std::string sender;
+        uint16_t reference = 0;
+        uint8_t count = 0;
+
+        bool operator==(const Key &other) const;
+    };
+
+    struct KeyHash
+    {
+        std::size_t operator()(const Key &key) const;
+    };
+
+    struct Entry
+    {
+        SMS first;                      // the first part to arrive, for the sender, SMSC and timestamp
+        std::vector<std::string> texts; // by part index
+        std::vector<bool> arrived;
+        unsigned int received = 0;
+        std::size_t bytes = 0;
+        Clock::time_point deadline;
+        std::list<const Key *>::iterator order;
+    };
+
+    struct Shard
+    {
+        mutable std::mutex mtx;
+        std::unordered_map<Key, Entry, KeyHash> entries;
+        std::list<const Key *> order; // oldest first, which is also the order of the deadlines
+        std::size_t bytes = 0;
+        Stats stats;
+    };
+
+    using Entries = std::unordered_map<Key, Entry, KeyHash>;
+
+    // Hand the message of entry on as it is, parts missing or not; the shard is locked
+    static SMS take(Shard &shard, Entries::iterator entry);
+
+    const std::chrono::milliseconds m_timeout;
+
+    const std::size_t m_shard_limit;
+
+    std::vector<std::unique_ptr<Shard>> m_shards;
+};
+
+#endif // REASSEMBLER_HPP
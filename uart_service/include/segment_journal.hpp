@@ -0,0 +1,142 @@
+#ifndef SEGMENT_JOURNAL_HPP
+#define SEGMENT_JOURNAL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * The PDUs of the parts of long messages still waiting for the rest, kept in a file so that they survive a
+ * restart once the modem deleted them. The file is mapped into memory and only appended to: a header, "SMSJRNL"
+ * and a version byte and the generation (u32), then records of a length (u32), the generation they belong to
+ * (u32), a checksum (u32) of the rest, the kind (u8), a padding byte and the key length (u16), followed by the
+ * key and, for a part, its PDU. A part record adds a PDU under its message's key, a release record drops
+ * those of the key. Integers are in host order; the file does not move between machines.
+ *
+ * The file is read up to the first record that is not whole or not of the header's generation, so a crash
+ * while appending loses only what was not yet synced. When no part is left the header moves to the next
+ * generation, which drops every record at once; when released records take most of the file, the parts
+ * still waiting are written to a new file that replaces it. A message released but not yet dropped comes
+ * back after a crash, so it may be relayed twice, but never not at all.
+ */
+class SegmentJournal
+{
+public:
+    struct Segment
+    {
+        std::string key;
+        std::string pdu;
+    };
+
+    struct Stats
+    {
+        unsigned long appended = 0;
+        unsigned long syncs = 0;
+        unsigned long compactions = 0;
+        std::size_t waiting = 0; // part records not released
+        std::size_t size = 0;    // bytes in use in the file
+    };
+
+    // Opens or creates path and maps it; throws Utils::Error::SystemError if it cannot, ParserError if it is
+    // something else than a journal
+    explicit SegmentJournal(const std::string &path);
+
+    ~SegmentJournal();
+
+    SegmentJournal(const SegmentJournal &) = delete;
+
+    SegmentJournal &operator=(const SegmentJournal &) = delete;
+
+    // The parts not released, in the order they were appended
+    std::vector<Segment> segments() const;
+
+    // Record pdu as a part of the message key; throws Utils::Error::SystemError if the file cannot grow
+    void append(std::string_view key, std::string_view pdu);
+
+    // The message key was handed on: drop its parts
+    void release(std::string_view key);
+
+    // Write what was appended or released out to the disk; false if it could not be
+    bool sync();
+
+    Stats stats() const;
+
+    void report(std::ostream &os) const;
+
+private:
+    enum class Kind : uint8_t
+    {
+        PART = 1,
+        RELEASE = 2
+    };
+
+    static constexpr std::size_t HEADER = 12;
+
+    static constexpr std::size_t RECORD = 16;
+
+    // The file grows and is mapped in steps of this
+    static constexpr std::size_t CHUNK = 64 * 1024;
+
+    // Read the records of the current generation from the start, calling each(kind, key, pdu); returns where they end
+    template <typename Each>
+    std::size_t scan(Each &&each) const;
+
+    // segments(), the lock held
+    std::vector<Segment> waiting() const;
+
+    void put(Kind kind, std::string_view key, std::string_view pdu);
+
+    // Make room for bytes more at the end of the records
+    void reserve(std::size_t bytes);
+
+    // Map size bytes of m_fd
+    void map(std::size_t size);
+
+    // Drop every record by moving the header on to the next generation
+    void reset();
+
+    // Replace the file by one holding only the parts not released
+    void compact();
+
+    void dirty(std::size_t from);
+
+    const std::string m_path;
+
+    mutable std::mutex m_mtx;
+
+    int m_fd = -1;
+
+    char *m_map = nullptr;
+
+    std::size_t m_mapped = 0;
+
+    uint32_t m_generation = 1;
+
+    // where the next record goes
+    std::size_t m_end = HEADER;
+
+    // the first byte written since the last sync, m_end if none
+    std::size_t m_dirty = HEADER;
+
+    struct Waiting
+    {
+        std::size_t records = 0;
+        std::size_t bytes = 0;
+    };
+
+    // the part records of the messages not released, by key
+    std::unordered_map<std::string, Waiting> m_waiting;
+
+    std::size_t m_waiting_records = 0;
+
+    std::size_t m_waiting_bytes = 0;
+
+    Stats m_stats;
+};
+
+#endif // SEGMENT_JOURNAL_HPP
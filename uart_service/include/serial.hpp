@@ -40,14 +40,17 @@
 #include <termios.h>
 #include <ctype.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <limits.h>
 #include <algorithm>
+#include <atomic>
 #include <limits.h>
 #include <pthread.h>
 #include <poll.h>
 #include <unistd.h>
 // #include <bcm2835.h>
 #include <stdarg.h> //Include forva_start, va_arg and va_end strings functions
+#include "traffic_capture.hpp"
 
 #define IOBASE 0x3f000000
 
@@ -261,6 +264,47 @@ typedef enum
     BOTH = 4
 } Digivalue;
 
+/* Status codes returned by the buffered readers (readChunk, readLine)
+ * when no data could be handed out */
+typedef enum
+{
+    READ_TIMEOUT = 0,
+    READ_ERROR = -1,
+    READ_EOF = -2
+} ReadStatus;
+
+/* Outcome of the lookahead parsers (parseInt, parseFloat) */
+typedef enum
+{
+    PARSE_OK = 0,
+    PARSE_TIMEOUT = 1,   // nothing (more) arrived in time
+    PARSE_NO_NUMBER = 2, // the line ended before a number started
+    PARSE_OVERFLOW = 3   // the digits did not fit; they are consumed nevertheless
+} ParseStatus;
+
+/* Receive errors the UART driver counted since it was loaded (TIOCGICOUNT) */
+typedef struct
+{
+    unsigned long overrun;       // the FIFO overflowed before the driver emptied it
+    unsigned long bufferOverrun; // the tty layer had no room left
+    unsigned long frame;         // no stop bit where expected: noise or a rate mismatch
+    unsigned long parity;
+    unsigned long brk;
+} LineErrors;
+
+/* Transfers on a serial port since it was opened */
+typedef struct
+{
+    unsigned long bytesIn;
+    unsigned long bytesOut;
+    unsigned long reads;        // readv() calls
+    unsigned long writes;       // writev() calls
+    unsigned long waits;        // poll() and FIONREAD calls
+    unsigned long wouldBlock;   // writev() calls the UART took only part of, or nothing
+    unsigned long readTimeouts; // waits for input that ran out
+    unsigned long errors;       // failed reads and writes, and a transmit queue that stayed full
+} SerialStatistics;
+
 typedef bool boolean;
 typedef unsigned char byte;
 
@@ -289,22 +333,79 @@ private:
     const char *serialPort;
     unsigned char c;
     struct termios options;
-    int speed;
+    int baud;
     long timeOut;
 
+    // Receive ring: bytes [rxHead, rxHead + rxCount) modulo RX_BUFFER_SIZE
+    static const unsigned int RX_BUFFER_SIZE = 4096;
+    unsigned char rxBuffer[RX_BUFFER_SIZE];
+    unsigned int rxHead;
+    unsigned int rxCount;
+    unsigned long rxSyscalls;
+
+    int fillBuffer(int timeoutInMs);
+    int findInBuffer(unsigned char value, unsigned int limit) const;
+    void copyFromBuffer(char *buffer, unsigned int length);
+    static int remainingTime(const struct timespec &start, int timeoutInMs);
+
+    // Transmit queue: output the UART could not take yet, [txHead, txHead + txCount) modulo TX_BUFFER_SIZE
+    static const unsigned int TX_BUFFER_SIZE = 4096;
+    static const int MAX_WRITE_PARTS = 4;
+    unsigned char txBuffer[TX_BUFFER_SIZE];
+    unsigned int txHead;
+    unsigned int txCount;
+    unsigned long txSyscalls;
+
+    int writeVector(const struct iovec *data, int count);
+    void queueOutput(const struct iovec *data, int count, size_t skip);
+
+    // SerialStatistics as relaxed atomics: only the thread using the port writes them, any may read
+    struct
+    {
+        std::atomic<unsigned long> bytesIn{0}, bytesOut{0}, reads{0}, writes{0}, waits{0}, wouldBlock{0},
+            readTimeouts{0}, errors{0};
+    } counters;
+    static void tally(std::atomic<unsigned long> &counter, unsigned long amount = 1);
+
+    // Gets every chunk read or written when set
+    TrafficCapture::Recorder *recorder;
 
 public:
     SerialPi();
+    explicit SerialPi(const char *port);
     void begin(int serialSpeed); //yes
+    int setBaudRate(int serialSpeed);
+    int baudRate() const;
+    static speed_t standardSpeed(int serialSpeed);
+    int setFlowControl(bool enabled);
+    bool flowControl() const;
+    int lineErrors(LineErrors &errors) const;
     int available(); // yes
     char receive(int timeoutInMs = -1); // yes
 
+    int readChunk(char *buffer, int length, int timeoutInMs = -1);
+    int readLine(char *buffer, int length, int timeoutInMs = -1);
+    void setReadThreshold(unsigned char minBytes, unsigned char interByteDeciseconds);
+    unsigned long readSyscallCount() const;
+    int fileDescriptor() const;
+
     long parseInt();
     float parseFloat();
     char peek();
 
-    void println(const char *message); // yes
+    ParseStatus parseInt(long &value, int timeoutInMs);
+    ParseStatus parseFloat(float &value, int timeoutInMs);
+    int peek(int timeoutInMs);
+    bool find(const char *target, int timeoutInMs);
+
+    int println(const char *message); // yes
     int send(unsigned char message); // yes
+    int send(const char *data, int length);
+    int writePending();
+    int pendingOutput() const;
+    unsigned long writeSyscallCount() const;
+    SerialStatistics statistics() const;
+    void setRecorder(TrafficCapture::Recorder *capture);
 
     void flush();
     void setTimeout(long millis);
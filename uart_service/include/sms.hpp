@@ -2,7 +2,9 @@
 #define SMS_HPP
 
 #include <iostream>
+#include <ctime>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <sstream>
 #include <iomanip>
@@ -30,19 +32,32 @@ public:
 
     void send_email() const;
 
-    typedef std::tuple<unsigned short, std::vector<std::string>> SegmentCountAndContents;
+    // The email send_email() relays text from sender in: headers To, From, dated when, and the text with bare
+    // LFs made CRLF, as SMTP wants them
+    static std::string format_email(std::string_view to, std::string_view from, std::string_view sender,
+                                    std::string_view text, std::time_t when);
 
+    // Part of a concatenated message: its reference, which part it is (from 0) and of how many
+    bool is_part() const;
+    unsigned short get_reference() const;
+    unsigned int get_index() const;
+    unsigned int get_count() const;
+
+    const std::string& get_sender() const;
+    const std::string& get_content() const;
+
+    // The whole message this is a part of, with content for its text; it keeps the reference and count
+    SMS whole(std::string content) const;
 
 private:
     std::string smsc;
     std::string sender;
     std::string timestamp;
     std::string content;
-    bool is_segment;
+    bool is_segment = false;
     unsigned short reference = 0;
-
-    // for long SMS lookup
-    static std::unordered_map<unsigned short, SegmentCountAndContents> ref_to_segments; 
+    unsigned int index = 0;
+    unsigned int count = 0;
 
     static std::once_flag config_init;
     
@@ -0,0 +1,120 @@
+#ifndef TRAFFIC_CAPTURE_HPP
+#define TRAFFIC_CAPTURE_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <sys/uio.h>
+
+/**
+ * Captures of the bytes a SerialPi reads and writes, for replaying a modem's traffic after the fact. A
+ * capture is a header, "CELLCAP" and a version byte, the wall-clock start in ns since the epoch (u64), the
+ * baud rate (u32) and the device (u16 length and its bytes), followed by one record per read() or
+ * write(): the microseconds since the previous record (u32), the length with the direction in its top bit
+ * (u32, set for bytes written) and the bytes themselves. Integers are little-endian.
+ */
+namespace TrafficCapture
+{
+    enum class Direction : uint8_t
+    {
+        IN = 0, // read from the modem
+        OUT = 1 // written to it
+    };
+
+    constexpr std::string_view MAGIC{"CELLCAP\x01", 8};
+
+    struct Record
+    {
+        std::chrono::microseconds at{}; // since the capture started
+        Direction direction = Direction::IN;
+        std::string_view data;
+        std::size_t offset = 0; // of the record in the file, to point at it in a bug report
+    };
+
+    /**
+     * Appends records to a memory buffer and writes it out when it fills up, on flush() and when destroyed,
+     * so recording costs a copy per read or write. Once limit bytes are in the file it stops recording.
+     * Not thread-safe: one recorder belongs to the thread serving its port.
+     */
+    class Recorder
+    {
+    public:
+        // Creates or truncates path; throws Utils::Error::SystemError if it cannot
+        Recorder(const std::string &path, const std::string &device, int baud, std::size_t limit);
+
+        ~Recorder();
+
+        Recorder(const Recorder &) = delete;
+
+        Recorder &operator=(const Recorder &) = delete;
+
+        // The first length bytes of the count parts of data went over the wire in direction
+        void record(Direction direction, const struct iovec *data, int count, std::size_t length);
+
+        void flush();
+
+        unsigned long records() const;
+
+        // bytes in the file and the buffer
+        std::size_t size() const;
+
+        bool full() const;
+
+    private:
+        void put32(uint32_t value);
+
+        static constexpr std::size_t BUFFER_SIZE = 64 * 1024;
+
+        const std::string m_path;
+
+        int m_fd = -1;
+
+        const std::size_t m_limit;
+
+        std::string m_buffer;
+
+        std::size_t m_written = 0;
+
+        unsigned long m_records = 0;
+
+        bool m_full = false;
+
+        std::chrono::steady_clock::time_point m_last;
+    };
+
+    // Reads a capture back, record by record
+    class Reader
+    {
+    public:
+        // Loads path; throws Utils::Error::SystemError if it cannot be read, ParserError if it is no capture
+        explicit Reader(const std::string &path);
+
+        // The next record; false at the end. A record cut short by a crash ends the capture
+        bool next(Record &record);
+
+        std::chrono::system_clock::time_point started() const;
+
+        int baud() const;
+
+        const std::string &device() const;
+
+    private:
+        uint32_t get32(std::size_t at) const;
+
+        std::string m_content;
+
+        std::size_t m_at = 0;
+
+        std::chrono::microseconds m_clock{};
+
+        std::chrono::system_clock::time_point m_started;
+
+        int m_baud = 0;
+
+        std::string m_device;
+    };
+} // namespace TrafficCapture
+
+#endif // TRAFFIC_CAPTURE_HPP
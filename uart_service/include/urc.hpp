@@ -0,0 +1,200 @@
+#ifndef URC_HPP
+#define URC_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+
+/**
+ * One unsolicited result code: its name is the line up to the ':' ("+CMTI" of "+CMTI: \"SM\",3"),
+ * or the whole line for those without parameters ("RING", "NO CARRIER").
+ */
+template <typename Handler>
+struct UrcEntry
+{
+    std::string_view name;
+    Handler handler{};
+    bool has_body = false; // the next line belongs to it, like the PDU after "+CMT: ,<length>"
+};
+
+/**
+ * Compile-time table of unsolicited result codes. The names are placed in a perfect hash whose seed is
+ * searched by the constexpr constructor, so classifying a line costs one hash over its name and one
+ * comparison however many codes there are. Build it with make_urc_table().
+ */
+template <typename Handler, std::size_t N>
+class UrcTable
+{
+public:
+    using Entry = UrcEntry<Handler>;
+
+    constexpr explicit UrcTable(const Entry (&entries)[N])
+    {
+        for (std::size_t idx = 0; idx < N; idx++)
+        {
+            m_entries[idx] = entries[idx];
+            if (entries[idx].name.size() > m_longest)
+            {
+                m_longest = entries[idx].name.size();
+            }
+        }
+        for (m_seed = 0; m_seed < MAX_SEED; m_seed++)
+        {
+            if (place())
+            {
+                return;
+            }
+        }
+        throw std::logic_error("no perfect hash for the URC names, is one of them listed twice?");
+    }
+
+    // The entry of the unsolicited result code line starts with, nullptr for anything else
+    constexpr const Entry *find(std::string_view line) const
+    {
+        const auto name = name_of(line, m_longest);
+        if (name.empty() || name.size() > m_longest)
+        {
+            return nullptr;
+        }
+        const auto slot = m_slots[hash(name, m_seed) & (SLOTS - 1)];
+        if (slot == 0 || m_entries[slot - 1].name != name)
+        {
+            return nullptr;
+        }
+        return &m_entries[slot - 1];
+    }
+
+    // What follows "<name>:", without leading spaces; empty for codes without parameters
+    static constexpr std::string_view parameters_of(std::string_view line)
+    {
+        const auto colon = line.find(':');
+        if (colon == std::string_view::npos)
+        {
+            return {};
+        }
+        line.remove_prefix(colon + 1);
+        while (!line.empty() && line.front() == ' ')
+        {
+            line.remove_prefix(1);
+        }
+        return line;
+    }
+
+private:
+    static constexpr std::size_t slot_count()
+    {
+        std::size_t slots = 1;
+        while (slots < 2 * N)
+        {
+            slots <<= 1;
+        }
+        return slots;
+    }
+
+    static constexpr std::size_t SLOTS = slot_count();
+
+    static constexpr std::uint32_t MAX_SEED = 4096;
+
+    // The name of the code a line may carry: up to ':' within the longest name, else the whole line
+    static constexpr std::string_view name_of(std::string_view line, std::size_t longest)
+    {
+        const auto colon = line.substr(0, longest + 1).find(':');
+        auto name = colon == std::string_view::npos ? line : line.substr(0, colon);
+        while (!name.empty() && name.back() == ' ')
+        {
+            name.remove_suffix(1);
+        }
+        return name;
+    }
+
+    // FNV-1a, with the seed folded into the offset basis
+    static constexpr std::uint32_t hash(std::string_view name, std::uint32_t seed)
+    {
+        std::uint32_t value = 2166136261u ^ (seed * 0x9E3779B9u);
+        for (const char each : name)
+        {
+            value = (value ^ static_cast<unsigned char>(each)) * 16777619u;
+        }
+        return value ^ (value >> 15);
+    }
+
+    constexpr bool place()
+    {
+        for (auto &slot : m_slots)
+        {
+            slot = 0;
+        }
+        for (std::size_t idx = 0; idx < N; idx++)
+        {
+            auto &slot = m_slots[hash(m_entries[idx].name, m_seed) & (SLOTS - 1)];
+            if (slot != 0)
+            {
+                return false;
+            }
+            slot = static_cast<std::uint8_t>(idx + 1);
+        }
+        return true;
+    }
+
+    static_assert(N > 0 && N < 255, "a URC table holds 1 to 254 entries");
+
+    std::array<Entry, N> m_entries{};
+
+    std::array<std::uint8_t, SLOTS> m_slots{}; // index into m_entries + 1, 0 when empty
+
+    std::uint32_t m_seed = 0;
+
+    std::size_t m_longest = 0;
+};
+
+template <typename Handler, std::size_t N>
+constexpr UrcTable<Handler, N> make_urc_table(const UrcEntry<Handler> (&entries)[N])
+{
+    return UrcTable<Handler, N>(entries);
+}
+
+// An unsolicited result code by name, before a handler is given to it
+struct UrcName
+{
+    std::string_view name;
+    bool has_body = false;
+};
+
+// The table of names, each with the handler handler_of(name) gives it
+template <typename Handler, std::size_t N, typename HandlerOf>
+constexpr UrcTable<Handler, N> make_urc_table(const UrcName (&names)[N], HandlerOf handler_of)
+{
+    UrcEntry<Handler> entries[N]{};
+    for (std::size_t idx = 0; idx < N; idx++)
+    {
+        entries[idx] = {names[idx].name, handler_of(names[idx].name), names[idx].has_body};
+    }
+    return UrcTable<Handler, N>(entries);
+}
+
+/**
+ * The unsolicited result codes the service handles. Modem::unsolicited_results() dispatches them and
+ * cellular_replay recognises them from this one list, so that a replay passes what the service takes.
+ */
+inline constexpr UrcName SERVICE_URCS[] = {
+    {"+CMTI"},
+    {"+CMT", true},
+    {"+CDSI"},
+    {"+CDS", true},
+    {"+CBM", true},
+    {"RING"},
+    {"+CLIP"},
+    {"NO CARRIER"},
+    {"+CREG"},
+    {"+CGREG"},
+    {"+CEREG"},
+    {"+CPIN"},
+    {"RDY"},
+    {"SMS DONE"},
+    {"PB DONE"},
+    {"NORMAL POWER DOWN"},
+};
+
+#endif // URC_HPP
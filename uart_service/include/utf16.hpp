@@ -0,0 +1,42 @@
+#ifndef UTF16_HPP
+#define UTF16_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * UCS-2 user data, which phones send as UTF-16BE (3GPP 23.038 and 23.040 leave that to them), to UTF-8.
+ * A surrogate pair becomes the 4-byte sequence of its code point. A surrogate without its other half is
+ * written on its own as a 3-byte sequence, as the half may be at the end of the previous or the start of
+ * the next segment of a concatenated message. finish() joins such halves once the segments are put
+ * together, and replaces anything else that is not UTF-8.
+ *
+ * Runs of units that take 1, 2 or 3 bytes each, and of units taking 1 or 2 bytes mixed as in accented
+ * Latin text, are transcoded 8 at a time with SSSE3 on x86 (chosen at run time) or, built with
+ * -DSMS_NEON=ON, NEON on AArch64; everything else unit by unit.
+ */
+class Utf16
+{
+public:
+    // The most UTF-8 per unit: 3 for a unit of the BMP, 4 for the 2 units of a surrogate pair
+    static constexpr std::size_t MAX_UTF8 = 3;
+
+    // Transcode units of the UTF-16BE at be into out, which takes MAX_UTF8 bytes per unit; returns the bytes written
+    static std::size_t to_utf8(const uint8_t *be, std::size_t units, char *out);
+
+    // The same, unit by unit
+    static std::size_t to_utf8_scalar(const uint8_t *be, std::size_t units, char *out);
+
+    /**
+     * Make text valid UTF-8: a high surrogate followed by a low one, each encoded on its own, becomes the code
+     * point they stand for; any other surrogate, and every byte that starts no well-formed sequence, becomes
+     * U+FFFD. Text that is valid UTF-8 is left alone without being copied. Returns the characters replaced.
+     */
+    static std::size_t finish(std::string &text);
+
+    // The vector unit to_utf8() uses on this CPU: "SSSE3", "NEON" or "none"
+    static const char *vector_unit();
+};
+
+#endif // UTF16_HPP
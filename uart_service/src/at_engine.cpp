@@ -0,0 +1,555 @@
+#include "at_engine.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <ctime>
+#include <optional>
+#include <sys/epoll.h>
+
+using namespace std::literals::chrono_literals;
+
+bool ATEngine::Result::ok() const
+{
+    return status == Status::OK;
+}
+
+SerialATPort::SerialATPort(SerialPi &serial) : m_serial(serial)
+{
+}
+
+bool SerialATPort::write_line(const std::string &line)
+{
+    return m_serial.println(line.c_str()) >= 0;
+}
+
+bool SerialATPort::write(std::string_view data)
+{
+    return m_serial.send(data.data(), static_cast<int>(data.size())) >= 0;
+}
+
+void SerialATPort::flush()
+{
+    m_serial.writePending();
+}
+
+int SerialATPort::queued() const
+{
+    return m_serial.pendingOutput();
+}
+
+int SerialATPort::descriptor() const
+{
+    return m_serial.fileDescriptor();
+}
+
+ATEngine::ATEngine(SerialPi &serial, Reactor &reactor, unsigned int depth)
+    : m_serial_port(std::make_unique<SerialATPort>(serial)), m_port(m_serial_port.get()), m_reactor(reactor),
+      m_depth(std::max(depth, 1u))
+{
+    m_deadline_timer = m_reactor.add_timer("AT deadline", 0ms, 0ms, [this]()
+                                           { deadline_expired(); });
+}
+
+ATEngine::ATEngine(ATPort &port, Reactor &reactor, unsigned int depth)
+    : m_port(&port), m_reactor(reactor), m_depth(std::max(depth, 1u))
+{
+    m_deadline_timer = m_reactor.add_timer("AT deadline", 0ms, 0ms, [this]()
+                                           { deadline_expired(); });
+}
+
+ATEngine::Id ATEngine::submit(std::string command, std::chrono::milliseconds timeout, Callback callback)
+{
+    return submit(std::move(command), timeout, std::move(callback), nullptr);
+}
+
+ATEngine::Id ATEngine::submit(std::string command, std::chrono::milliseconds timeout, Callback callback,
+                              LineCallback on_line)
+{
+    Transaction transaction;
+    transaction.id = m_next_id++;
+    transaction.command = std::move(command);
+    transaction.timeout = timeout;
+    transaction.callback = std::move(callback);
+    transaction.on_line = std::move(on_line);
+    return enqueue(std::move(transaction));
+}
+
+ATEngine::Id ATEngine::submit_prompted(std::string command, std::string text, std::chrono::milliseconds timeout,
+                                       Callback callback)
+{
+    Transaction transaction;
+    transaction.id = m_next_id++;
+    transaction.command = std::move(command);
+    transaction.timeout = timeout;
+    transaction.callback = std::move(callback);
+    transaction.text = std::move(text);
+    transaction.prompt_due = true;
+    return enqueue(std::move(transaction));
+}
+
+ATEngine::Id ATEngine::enqueue(Transaction transaction)
+{
+    // a prompt leaves the modem taking text rather than commands, so nothing may follow before it is answered
+    transaction.pipelinable = !transaction.prompt_due && pipelinable(transaction.command);
+    transaction.counters = &counters_of(transaction.command);
+    const auto id = transaction.id;
+
+    if (m_closed)
+    {
+        std::cout << "Sent " << transaction.command << ", but the serial port is closed" << std::endl;
+        transaction.result.status = Status::CLOSED;
+        if (transaction.callback) transaction.callback(transaction.result);
+        return id;
+    }
+    m_queue.push_back(std::move(transaction));
+    start_next();
+    return id;
+}
+
+ATEngine::Result ATEngine::execute(std::string command, std::chrono::milliseconds timeout)
+{
+    std::optional<Result> outcome;
+    submit(std::move(command), timeout, [&outcome](const Result &result)
+           { outcome = result; });
+    while (!outcome)
+    {
+        m_reactor.run_once(-1);
+    }
+    return *outcome;
+}
+
+bool ATEngine::cancel(Id id)
+{
+    auto in_flight = std::find_if(m_in_flight.begin(), m_in_flight.end(), [id](const Transaction &each)
+                                  { return each.id == id && !each.abandoned; });
+    if (in_flight != m_in_flight.end())
+    {
+        auto callback = std::move(in_flight->callback);
+        in_flight->callback = nullptr;
+        in_flight->abandoned = true;
+        tally(in_flight->counters->cancelled);
+        Result cancelled;
+        cancelled.status = Status::CANCELLED;
+        if (callback) callback(cancelled);
+        return true;
+    }
+    auto queued = std::find_if(m_queue.begin(), m_queue.end(), [id](const Transaction &each)
+                               { return each.id == id; });
+    if (queued == m_queue.end())
+    {
+        return false;
+    }
+    auto transaction = std::move(*queued);
+    m_queue.erase(queued);
+    tally(transaction.counters->cancelled);
+    transaction.result.status = Status::CANCELLED;
+    if (transaction.callback) transaction.callback(transaction.result);
+    return true;
+}
+
+bool ATEngine::consume(std::string_view line)
+{
+    if (m_in_flight.empty())
+    {
+        return false;
+    }
+    if (Status status; is_final_result(line, status))
+    {
+        complete(status, std::string(line));
+    }
+    else if (std::none_of(m_in_flight.begin(), m_in_flight.end(), [line](const Transaction &each)
+                          { return line == each.command; }) && // not the echo of a command (ATE1)
+             (m_in_flight.front().text.empty() || line.find('\x1A') == std::string_view::npos)) // nor of its text
+    {
+        auto &oldest = m_in_flight.front();
+        if (!oldest.on_line)
+        {
+            oldest.result.response.append(line).push_back('\n');
+        }
+        else if (!oldest.abandoned)
+        {
+            oldest.on_line(line);
+        }
+    }
+    return true;
+}
+
+bool ATEngine::awaiting_prompt() const
+{
+    return !m_in_flight.empty() && m_in_flight.front().prompt_due && !m_in_flight.front().abandoned;
+}
+
+void ATEngine::prompt()
+{
+    if (!awaiting_prompt())
+    {
+        return;
+    }
+    auto &oldest = m_in_flight.front();
+    oldest.prompt_due = false;
+    ++m_prompts;
+    oldest.text.push_back('\x1A');
+    if (!m_port->write(oldest.text))
+    {
+        std::cerr << "Sent " << oldest.command << ", but the serial port refused its text" << std::endl;
+    }
+    oldest.text.pop_back();
+    watch_output();
+}
+
+bool ATEngine::claims(std::string_view name) const
+{
+    if (m_in_flight.empty())
+    {
+        return false;
+    }
+    const std::string_view command = m_in_flight.front().command;
+    if (Status status; is_final_result(name, status))
+    {
+        // only a call ends with NO CARRIER, BUSY or NO ANSWER; otherwise it is a dropped call's, not ours
+        const auto upper = [command](std::size_t at)
+        { return at < command.size() ? std::toupper(static_cast<unsigned char>(command[at])) : 0; };
+        return upper(0) == 'A' && upper(1) == 'T' && (upper(2) == 'D' || upper(2) == 'A');
+    }
+    // "AT" + name, then the end of the command, '=' or '?'
+    if (command.size() < 2 + name.size() || command.compare(2, name.size(), name) != 0)
+    {
+        return false;
+    }
+    return command.size() == 2 + name.size() || command[2 + name.size()] == '=' || command[2 + name.size()] == '?';
+}
+
+void ATEngine::close()
+{
+    m_closed = true;
+    while (!m_in_flight.empty())
+    {
+        complete(Status::CLOSED, "");
+    }
+    while (!m_queue.empty())
+    {
+        auto transaction = std::move(m_queue.front());
+        m_queue.pop_front();
+        transaction.result.status = Status::CLOSED;
+        if (transaction.callback) transaction.callback(transaction.result);
+    }
+}
+
+bool ATEngine::busy() const
+{
+    return !m_in_flight.empty();
+}
+
+void ATEngine::start_next()
+{
+    while (!m_queue.empty() && !m_closed && can_write(m_queue.front()))
+    {
+        if (!m_in_flight.empty()) ++m_pipelined;
+        m_in_flight.push_back(std::move(m_queue.front()));
+        m_queue.pop_front();
+        m_deepest = std::max(m_deepest, m_in_flight.size());
+
+        auto &transaction = m_in_flight.back();
+        transaction.started = Clock::now();
+        transaction.cpu_started = thread_cpu_time();
+        if (!m_port->write_line(transaction.command))
+        {
+            // nothing was written: it cannot be answered, whatever its place
+            auto failed = std::move(transaction);
+            m_in_flight.pop_back();
+            failed.result.status = Status::ERROR;
+            std::cerr << "Sent " << failed.command << ", but the serial port refused it" << std::endl;
+            if (failed.callback) failed.callback(failed.result);
+            continue;
+        }
+        if (m_in_flight.size() == 1) arm_deadline();
+    }
+    watch_output();
+}
+
+bool ATEngine::can_write(const Transaction &transaction) const
+{
+    if (m_in_flight.empty())
+    {
+        return true;
+    }
+    return m_in_flight.size() < m_depth && transaction.pipelinable && m_in_flight.back().pipelinable;
+}
+
+void ATEngine::arm_deadline()
+{
+    if (m_in_flight.empty())
+    {
+        m_reactor.disarm_timer(m_deadline_timer);
+        return;
+    }
+    // the modem starts on a command once it answered the one before, so its time runs from now
+    const auto &oldest = m_in_flight.front();
+    m_reactor.rearm_timer(m_deadline_timer, oldest.abandoned ? LATE_REPLY_GRACE : oldest.timeout);
+}
+
+void ATEngine::deadline_expired()
+{
+    if (m_in_flight.empty())
+    {
+        return; // a deadline racing with the final result of the same command
+    }
+    if (m_in_flight.front().abandoned)
+    {
+        // no late reply either; give its place up
+        std::cerr << "Sent " << m_in_flight.front().command << ", no late reply came" << std::endl;
+        m_in_flight.pop_front();
+        arm_deadline();
+        start_next();
+        return;
+    }
+    complete(Status::TIMEOUT, "");
+}
+
+void ATEngine::output_ready()
+{
+    m_port->flush();
+    watch_output();
+}
+
+void ATEngine::switch_port(ATPort &port)
+{
+    m_port = &port;
+}
+
+// Only ask for EPOLLOUT while the UART left part of a command in the transmit queue
+void ATEngine::watch_output()
+{
+    const bool queued = m_port->queued() > 0;
+    if (queued != m_watching_output)
+    {
+        m_reactor.modify(m_port->descriptor(), queued ? EPOLLIN | EPOLLOUT : EPOLLIN);
+        m_watching_output = queued;
+    }
+}
+
+void ATEngine::complete(Status status, std::string final_result)
+{
+    if (m_in_flight.empty())
+    {
+        return;
+    }
+    auto &oldest = m_in_flight.front();
+    if (oldest.abandoned)
+    {
+        if (status != Status::CLOSED)
+        {
+            ++m_late_replies;
+            std::cerr << "Sent " << oldest.command << ", its late reply " << oldest.result.response << final_result
+                      << " is dropped" << std::endl;
+        }
+        m_in_flight.pop_front();
+        arm_deadline();
+        start_next();
+        return;
+    }
+
+    if (status == Status::TIMEOUT && oldest.prompt_due && !m_closed)
+    {
+        // the modem may still be taking text: ESC ends that without sending anything
+        ++m_prompts_missed;
+        m_port->write("\x1B");
+        watch_output();
+    }
+    auto transaction = std::move(oldest);
+    if (status == Status::TIMEOUT && !m_closed)
+    {
+        // keep the place for the reply that may still come, so it is not taken for the next command's
+        oldest = Transaction{};
+        oldest.id = transaction.id;
+        oldest.command = transaction.command;
+        oldest.timeout = transaction.timeout;
+        oldest.text = transaction.text;
+        oldest.pipelinable = transaction.pipelinable;
+        oldest.abandoned = true;
+    }
+    else
+    {
+        m_in_flight.pop_front();
+    }
+    arm_deadline();
+
+    auto &result = transaction.result;
+    result.status = status;
+    result.final_result = std::move(final_result);
+    result.elapsed = Clock::now() - transaction.started;
+    result.cpu_time = thread_cpu_time() - transaction.cpu_started;
+
+    ++m_completed;
+    if (status == Status::TIMEOUT) ++m_timeouts;
+    m_total_elapsed += result.elapsed;
+    m_total_cpu += result.cpu_time;
+    if (status == Status::OK || status == Status::ERROR || status == Status::TIMEOUT)
+    {
+        auto &counters = *transaction.counters;
+        tally(status == Status::OK ? counters.ok : (status == Status::ERROR ? counters.errors : counters.timeouts));
+        counters.latency.record(result.elapsed);
+    }
+
+    auto &log = status == Status::OK ? std::cout : std::cerr;
+    log << "Sent " << transaction.command << ", got " << result.response << result.final_result
+        << " (" << to_string(status) << " in " << std::chrono::duration_cast<std::chrono::milliseconds>(result.elapsed).count()
+        << " ms, cpu " << std::chrono::duration_cast<std::chrono::microseconds>(result.cpu_time).count() << " us)" << std::endl;
+
+    if (transaction.callback) transaction.callback(result);
+    start_next();
+}
+
+bool ATEngine::is_final_result(std::string_view line, Status &status)
+{
+    static const char *const errors[] = {"ERROR", "+CME ERROR", "+CMS ERROR", "NO CARRIER", "BUSY", "NO ANSWER", "NO DIALTONE"};
+    if (line == "OK")
+    {
+        status = Status::OK;
+        return true;
+    }
+    for (const auto *each : errors)
+    {
+        if (line.compare(0, std::char_traits<char>::length(each), each) == 0)
+        {
+            status = Status::ERROR;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::chrono::nanoseconds ATEngine::thread_cpu_time()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return std::chrono::seconds(now.tv_sec) + std::chrono::nanoseconds(now.tv_nsec);
+}
+
+void ATEngine::dump_metrics(std::ostream &os) const
+{
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    os << "AT commands: " << m_completed << " completed, " << m_timeouts << " timed out";
+    if (m_completed > 0)
+    {
+        os << ", mean wall " << duration_cast<microseconds>(m_total_elapsed).count() / m_completed
+           << " us, mean cpu " << duration_cast<microseconds>(m_total_cpu).count() / m_completed << " us per command";
+    }
+    os << "; pipeline depth " << m_depth << ": " << m_pipelined << " written behind another, at most " << m_deepest
+       << " in flight, " << m_late_replies << " late replies dropped; " << m_prompts << " prompts answered, "
+       << m_prompts_missed << " missed" << std::endl;
+}
+
+std::vector<ATEngine::VerbStatistics> ATEngine::statistics() const
+{
+    std::vector<VerbStatistics> snapshot(m_verb_count.load(std::memory_order_acquire));
+    for (std::size_t idx = 0; idx < snapshot.size(); idx++)
+    {
+        const auto &counters = m_verbs[idx];
+        auto &each = snapshot[idx];
+        each.verb = counters.verb;
+        each.ok = counters.ok.load(std::memory_order_relaxed);
+        each.errors = counters.errors.load(std::memory_order_relaxed);
+        each.timeouts = counters.timeouts.load(std::memory_order_relaxed);
+        each.cancelled = counters.cancelled.load(std::memory_order_relaxed);
+        each.latency = counters.latency.snapshot();
+    }
+    return snapshot;
+}
+
+void ATEngine::dump_statistics(std::ostream &os, const std::vector<VerbStatistics> &statistics)
+{
+    os << "AT commands by verb: ok, error, timeout, cancelled; latency (us) p50/p90/p99/max" << std::endl;
+    for (const auto &each : statistics)
+    {
+        os << '\t' << each.verb << ": " << each.ok << ", " << each.errors << ", " << each.timeouts << ", " << each.cancelled;
+        if (each.latency.count > 0)
+        {
+            os << "; " << each.latency.percentile(0.5) << '/' << each.latency.percentile(0.9) << '/'
+               << each.latency.percentile(0.99) << '/' << each.latency.max_us;
+        }
+        os << std::endl;
+    }
+}
+
+std::string_view ATEngine::verb_of(std::string_view command)
+{
+    if (command.size() <= 2)
+    {
+        return command;
+    }
+    if (std::string_view("+^$#%*").find(command[2]) == std::string_view::npos)
+    {
+        // basic commands are a letter, or '&' and a letter, and their number: "ATE0", "ATD+1234;", "AT&W"
+        return command.substr(0, command[2] == '&' ? 4 : 3);
+    }
+    const auto end = command.find_first_of("=?", 2);
+    if (end == std::string_view::npos || command.substr(end) == "=?")
+    {
+        return command; // execution "AT+CSQ" and test "AT+CMGS=?" carry nothing else
+    }
+    return command.substr(0, command[end] == '?' ? end + 1 : end);
+}
+
+ATEngine::VerbCounters &ATEngine::counters_of(std::string_view command)
+{
+    const auto verb = verb_of(command);
+    const auto count = m_verb_count.load(std::memory_order_relaxed);
+    for (std::size_t idx = 0; idx < count; idx++)
+    {
+        if (m_verbs[idx].verb == verb)
+        {
+            return m_verbs[idx];
+        }
+    }
+    if (count == MAX_VERBS)
+    {
+        return m_verbs[MAX_VERBS - 1];
+    }
+    m_verbs[count].verb = count == MAX_VERBS - 1 ? "other" : std::string(verb);
+    m_verb_count.store(count + 1, std::memory_order_release);
+    return m_verbs[count];
+}
+
+// Only the loop thread counts, so a relaxed load and store does without the locked add
+void ATEngine::tally(std::atomic<unsigned long> &counter)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+bool ATEngine::pipelinable(std::string_view command)
+{
+    static constexpr std::string_view safe_verbs[] = {"+CSQ", "+CMGR", "+CMGL", "+CMGD", "+CPMS", "+CNUM",
+                                                      "+CIMI", "+CGSN", "+GSN", "+CICCID", "I"};
+    if (command.size() < 3 || std::toupper(static_cast<unsigned char>(command[0])) != 'A' ||
+        std::toupper(static_cast<unsigned char>(command[1])) != 'T')
+    {
+        return false;
+    }
+    if (command.back() == '?')
+    {
+        return true; // read "AT+CREG?" and test "AT+CMGS=?" commands
+    }
+    const auto equals = command.find('=');
+    const auto verb = command.substr(2, equals == std::string_view::npos ? std::string_view::npos : equals - 2);
+    return std::find(std::begin(safe_verbs), std::end(safe_verbs), verb) != std::end(safe_verbs);
+}
+
+const char *ATEngine::to_string(Status status)
+{
+    switch (status)
+    {
+    case Status::OK:
+        return "OK";
+    case Status::ERROR:
+        return "ERROR";
+    case Status::TIMEOUT:
+        return "TIMEOUT";
+    case Status::CANCELLED:
+        return "CANCELLED";
+    case Status::CLOSED:
+        return "CLOSED";
+    }
+    return "UNKNOWN";
+}
@@ -0,0 +1,27 @@
+#include "baud_rate.hpp"
+
+#include <asm/ioctls.h>
+#include <asm/termbits.h>
+
+// <sys/ioctl.h> would bring the struct termios of glibc back in
+extern "C" int ioctl(int fd, unsigned long request, ...);
+
+int setArbitraryBaudRate(int fd, int baud)
+{
+    struct termios2 settings;
+    if (ioctl(fd, TCGETS2, &settings) != 0)
+        return -1;
+    settings.c_cflag &= ~(CBAUD | (CBAUD << IBSHIFT));
+    settings.c_cflag |= BOTHER | (BOTHER << IBSHIFT);
+    settings.c_ispeed = baud;
+    settings.c_ospeed = baud;
+    return ioctl(fd, TCSETS2, &settings);
+}
+
+int getBaudRate(int fd)
+{
+    struct termios2 settings;
+    if (ioctl(fd, TCGETS2, &settings) != 0)
+        return -1;
+    return settings.c_ospeed;
+}
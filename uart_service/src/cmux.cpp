@@ -0,0 +1,185 @@
+#include "cmux.hpp"
+
+#include <array>
+#include <cstring>
+
+namespace
+{
+    constexpr std::array<uint8_t, 256> crc_table()
+    {
+        std::array<uint8_t, 256> table{};
+        for (unsigned int byte = 0; byte < 256; byte++)
+        {
+            uint8_t crc = static_cast<uint8_t>(byte);
+            for (int bit = 0; bit < 8; bit++)
+            {
+                crc = (crc & 1) ? static_cast<uint8_t>((crc >> 1) ^ 0xE0) : static_cast<uint8_t>(crc >> 1);
+            }
+            table[byte] = crc;
+        }
+        return table;
+    }
+
+    constexpr auto CRC_TABLE = crc_table();
+} // namespace
+
+uint8_t Cmux::crc(uint8_t crc, const uint8_t *data, std::size_t length)
+{
+    for (std::size_t idx = 0; idx < length; idx++)
+    {
+        crc = CRC_TABLE[crc ^ data[idx]];
+    }
+    return crc;
+}
+
+uint8_t Cmux::fcs(const uint8_t *data, std::size_t length)
+{
+    return 0xFF - crc(0xFF, data, length);
+}
+
+std::size_t Cmux::encode(uint8_t *out, unsigned int dlci, uint8_t control, bool command, std::string_view info,
+                         bool poll_final)
+{
+    std::size_t at = 0;
+    out[at++] = FLAG;
+    out[at++] = static_cast<uint8_t>((dlci << 2) | (command ? 0x02 : 0x00) | 0x01);
+    out[at++] = static_cast<uint8_t>(control | (poll_final ? POLL_FINAL : 0));
+    if (info.size() < 0x80)
+    {
+        out[at++] = static_cast<uint8_t>((info.size() << 1) | 0x01);
+    }
+    else
+    {
+        out[at++] = static_cast<uint8_t>((info.size() & 0x7F) << 1);
+        out[at++] = static_cast<uint8_t>(info.size() >> 7);
+    }
+    const std::size_t header = at - 1;
+    std::memcpy(out + at, info.data(), info.size());
+    at += info.size();
+    // UI frames check their information as well, everything else the address, control and length
+    out[at] = control == UI ? fcs(out + 1, at - 1) : fcs(out + 1, header);
+    out[++at] = FLAG;
+    return at + 1;
+}
+
+std::string Cmux::frame(unsigned int dlci, uint8_t control, bool command, std::string_view info, bool poll_final)
+{
+    std::string out(info.size() + OVERHEAD, '\0');
+    out.resize(encode(reinterpret_cast<uint8_t *>(out.data()), dlci, control, command, info, poll_final));
+    return out;
+}
+
+std::string Cmux::message(uint8_t type, std::string_view value)
+{
+    std::string out;
+    out += static_cast<char>(type);
+    out += static_cast<char>((value.size() << 1) | 0x01);
+    out.append(value);
+    return out;
+}
+
+void CmuxDecoder::feed(const char *data, std::size_t length)
+{
+    if (m_begin > 0)
+    {
+        m_buffer.erase(0, m_begin);
+        m_begin = 0;
+    }
+    m_buffer.append(data, length);
+}
+
+bool CmuxDecoder::next(Cmux::Frame &frame)
+{
+    const auto *bytes = reinterpret_cast<const uint8_t *>(m_buffer.data());
+    const std::size_t end = m_buffer.size();
+    while (m_begin < end)
+    {
+        if (bytes[m_begin] != Cmux::FLAG)
+        {
+            const auto *flag = static_cast<const uint8_t *>(std::memchr(bytes + m_begin, Cmux::FLAG, end - m_begin));
+            const std::size_t found = flag == nullptr ? end : flag - bytes;
+            m_discarded += found - m_begin;
+            m_begin = found;
+            continue;
+        }
+        // the closing flag of one frame may be followed by the opening flag of the next, or be it
+        std::size_t at = m_begin + 1;
+        while (at < end && bytes[at] == Cmux::FLAG)
+        {
+            at++;
+        }
+        m_begin = at - 1;
+        if (end - at < 3)
+        {
+            return false;
+        }
+        const uint8_t address = bytes[at];
+        const uint8_t control = bytes[at + 1];
+        if ((address & 0x01) == 0)
+        {
+            // not an address: this flag was a closing one, or noise; look for the next
+            m_begin = at;
+            continue;
+        }
+        std::size_t header = 3;
+        std::size_t length = bytes[at + 2] >> 1;
+        if ((bytes[at + 2] & 0x01) == 0)
+        {
+            if (end - at < 4)
+            {
+                return false;
+            }
+            length |= static_cast<std::size_t>(bytes[at + 3]) << 7;
+            header = 4;
+        }
+        const std::size_t closing = at + header + length + 1;
+        if (closing >= end)
+        {
+            return false;
+        }
+        if (bytes[closing] != Cmux::FLAG)
+        {
+            m_discarded++;
+            m_begin = at;
+            continue;
+        }
+        const uint8_t type = control & ~Cmux::POLL_FINAL;
+        const std::size_t checked = type == Cmux::UI ? header + length : header;
+        if (Cmux::crc(Cmux::crc(0xFF, bytes + at, checked), bytes + at + header + length, 1) != Cmux::GOOD_CRC)
+        {
+            m_bad_fcs++;
+            m_begin = closing;
+            continue;
+        }
+        frame.dlci = address >> 2;
+        frame.control = type;
+        frame.command = (address & 0x02) != 0;
+        frame.poll_final = (control & Cmux::POLL_FINAL) != 0;
+        frame.info = std::string_view(m_buffer.data() + at + header, length);
+        m_frames++;
+        m_begin = closing;
+        return true;
+    }
+    return false;
+}
+
+void CmuxDecoder::clear()
+{
+    m_buffer.clear();
+    m_begin = 0;
+}
+
+unsigned long CmuxDecoder::frames() const
+{
+    return m_frames;
+}
+
+unsigned long CmuxDecoder::bad_fcs() const
+{
+    return m_bad_fcs;
+}
+
+unsigned long CmuxDecoder::discarded() const
+{
+    return m_discarded;
+}
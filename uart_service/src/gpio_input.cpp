@@ -0,0 +1,104 @@
+#include "gpio_input.hpp"
+#include "error.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// RI pulses last about 120 ms; contact bounce of the level shifter is far shorter
+constexpr unsigned int DEBOUNCE_US = 1000;
+
+GpioInput::GpioInput(const std::string &chip, unsigned int line, Edge edge, const std::string &consumer)
+{
+    struct stat info;
+    if (stat(chip.c_str(), &info) != 0)
+    {
+        throw Utils::Error::SystemError("stat(" + chip + ")", errno);
+    }
+    if (S_ISFIFO(info.st_mode))
+    {
+        // read-write, so the FIFO never reports a hang-up between writers
+        m_mock = true;
+        if ((m_fd = open(chip.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC)) < 0)
+        {
+            throw Utils::Error::SystemError("open(" + chip + ")", errno);
+        }
+        return;
+    }
+
+    const int chip_fd = open(chip.c_str(), O_RDONLY | O_CLOEXEC);
+    if (chip_fd < 0)
+    {
+        throw Utils::Error::SystemError("open(" + chip + ")", errno);
+    }
+    struct gpio_v2_line_request request;
+    std::memset(&request, 0, sizeof(request));
+    request.offsets[0] = line;
+    request.num_lines = 1;
+    std::strncpy(request.consumer, consumer.c_str(), sizeof(request.consumer) - 1);
+    request.config.flags = GPIO_V2_LINE_FLAG_INPUT;
+    if (edge != Edge::FALLING) request.config.flags |= GPIO_V2_LINE_FLAG_EDGE_RISING;
+    if (edge != Edge::RISING) request.config.flags |= GPIO_V2_LINE_FLAG_EDGE_FALLING;
+    request.config.num_attrs = 1;
+    request.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_DEBOUNCE;
+    request.config.attrs[0].attr.debounce_period_us = DEBOUNCE_US;
+    request.config.attrs[0].mask = 1;
+    const int result = ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &request);
+    const int error_number = errno;
+    close(chip_fd);
+    if (result != 0)
+    {
+        throw Utils::Error::SystemError("GPIO_V2_GET_LINE_IOCTL(" + chip + ", line " + std::to_string(line) + ")", error_number);
+    }
+    m_fd = request.fd;
+    fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) | O_NONBLOCK);
+}
+
+GpioInput::~GpioInput()
+{
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+    }
+}
+
+int GpioInput::fd() const
+{
+    return m_fd;
+}
+
+unsigned int GpioInput::read_events(const std::function<void(const Event &)> &handler)
+{
+    struct gpio_v2_line_event events[16];
+    unsigned int count = 0;
+    ssize_t n;
+    while ((n = read(m_fd, events, sizeof(events))) > 0)
+    {
+        for (size_t idx = 0; idx < static_cast<size_t>(n) / sizeof(events[0]); idx++, count++)
+        {
+            Event event;
+            event.timestamp = std::chrono::nanoseconds(events[idx].timestamp_ns);
+            event.rising = events[idx].id == GPIO_V2_LINE_EVENT_RISING_EDGE;
+            event.sequence = events[idx].line_seqno;
+            handler(event);
+        }
+    }
+    return count;
+}
+
+bool GpioInput::is_mock() const
+{
+    return m_mock;
+}
+
+std::chrono::nanoseconds GpioInput::now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return std::chrono::seconds(now.tv_sec) + std::chrono::nanoseconds(now.tv_nsec);
+}
@@ -0,0 +1,370 @@
+#include "gsm7.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define GSM7_X86 1
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#elif defined(SMS_NEON) && defined(__ARM_NEON) && defined(__aarch64__)
+#define GSM7_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+    // A character of the alphabet in UTF-8, copied as MAX_UTF8 bytes whatever its length
+    struct Utf8
+    {
+        char bytes[4];
+        uint8_t length;
+    };
+
+    constexpr Utf8 utf8(char16_t code_point)
+    {
+        Utf8 encoded{};
+        if (code_point < 0x80)
+        {
+            encoded.bytes[0] = static_cast<char>(code_point);
+            encoded.length = 1;
+        }
+        else if (code_point < 0x800)
+        {
+            encoded.bytes[0] = static_cast<char>(0xC0 | code_point >> 6);
+            encoded.bytes[1] = static_cast<char>(0x80 | (code_point & 0x3F));
+            encoded.length = 2;
+        }
+        else
+        {
+            encoded.bytes[0] = static_cast<char>(0xE0 | code_point >> 12);
+            encoded.bytes[1] = static_cast<char>(0x80 | (code_point >> 6 & 0x3F));
+            encoded.bytes[2] = static_cast<char>(0x80 | (code_point & 0x3F));
+            encoded.length = 3;
+        }
+        return encoded;
+    }
+
+    // 23.038 6.2.1; the escape shows as a no-break space where it is not followed by an extension character
+    constexpr char16_t DEFAULT_ALPHABET[128] = {
+        u'@', u'£', u'$', u'¥', u'è', u'é', u'ù', u'ì', u'ò', u'Ç', u'\n', u'Ø', u'ø', u'\r', u'Å', u'å',
+        u'Δ', u'_', u'Φ', u'Γ', u'Λ', u'Ω', u'Π', u'Ψ', u'Σ', u'Θ', u'Ξ', u'\u00A0', u'Æ', u'æ', u'ß', u'É',
+        u' ', u'!', u'"', u'#', u'¤', u'%', u'&', u'\'', u'(', u')', u'*', u'+', u',', u'-', u'.', u'/',
+        u'0', u'1', u'2', u'3', u'4', u'5', u'6', u'7', u'8', u'9', u':', u';', u'<', u'=', u'>', u'?',
+        u'¡', u'A', u'B', u'C', u'D', u'E', u'F', u'G', u'H', u'I', u'J', u'K', u'L', u'M', u'N', u'O',
+        u'P', u'Q', u'R', u'S', u'T', u'U', u'V', u'W', u'X', u'Y', u'Z', u'Ä', u'Ö', u'Ñ', u'Ü', u'§',
+        u'¿', u'a', u'b', u'c', u'd', u'e', u'f', u'g', u'h', u'i', u'j', u'k', u'l', u'm', u'n', u'o',
+        u'p', u'q', u'r', u's', u't', u'u', u'v', u'w', u'x', u'y', u'z', u'ä', u'ö', u'ñ', u'ü', u'à',
+    };
+
+    constexpr std::array<Utf8, 128> DEFAULT_TABLE = []()
+    {
+        std::array<Utf8, 128> table{};
+        for (std::size_t septet = 0; septet < table.size(); septet++) table[septet] = utf8(DEFAULT_ALPHABET[septet]);
+        return table;
+    }();
+
+    // 23.038 6.2.1.1; a septet the extension table leaves undefined shows as its default character
+    constexpr std::array<Utf8, 128> EXTENSION_TABLE = []()
+    {
+        std::array<Utf8, 128> table = DEFAULT_TABLE;
+        table[0x0A] = utf8(u'\f');
+        table[0x14] = utf8(u'^');
+        table[0x28] = utf8(u'{');
+        table[0x29] = utf8(u'}');
+        table[0x2F] = utf8(u'\\');
+        table[0x3C] = utf8(u'[');
+        table[0x3D] = utf8(u'~');
+        table[0x3E] = utf8(u']');
+        table[0x40] = utf8(u'|');
+        table[0x65] = utf8(u'€');
+        return table;
+    }();
+
+    // The septet of each code point below 0x80 (ESCAPE << 8 and the septet of the extension table, or 0xFFFF
+    // if there is none), and the characters above it, which are few enough to be looked up one by one
+    struct Septets
+    {
+        char16_t code_point;
+        uint16_t septets;
+    };
+
+    constexpr uint16_t NO_SEPTET = 0xFFFF;
+
+    constexpr uint16_t EXTENDED = Gsm7::ESCAPE << 8;
+
+    constexpr std::array<uint16_t, 128> ASCII_SEPTETS = []()
+    {
+        std::array<uint16_t, 128> table{};
+        for (auto &each : table) each = NO_SEPTET;
+        for (std::size_t septet = 0; septet < 128; septet++)
+        {
+            if (DEFAULT_ALPHABET[septet] < 0x80 && septet != Gsm7::ESCAPE) table[DEFAULT_ALPHABET[septet]] = septet;
+        }
+        table['\f'] = EXTENDED | 0x0A;
+        table['^'] = EXTENDED | 0x14;
+        table['{'] = EXTENDED | 0x28;
+        table['}'] = EXTENDED | 0x29;
+        table['\\'] = EXTENDED | 0x2F;
+        table['['] = EXTENDED | 0x3C;
+        table['~'] = EXTENDED | 0x3D;
+        table[']'] = EXTENDED | 0x3E;
+        table['|'] = EXTENDED | 0x40;
+        return table;
+    }();
+
+    constexpr std::size_t OTHER_COUNT = []()
+    {
+        std::size_t count = 1; // €
+        for (std::size_t septet = 0; septet < 128; septet++)
+        {
+            count += DEFAULT_ALPHABET[septet] >= 0x80 && septet != Gsm7::ESCAPE;
+        }
+        return count;
+    }();
+
+    constexpr std::array<Septets, OTHER_COUNT> OTHER_SEPTETS = []()
+    {
+        std::array<Septets, OTHER_COUNT> table{};
+        std::size_t count = 0;
+        for (std::size_t septet = 0; septet < 128; septet++)
+        {
+            if (DEFAULT_ALPHABET[septet] >= 0x80 && septet != Gsm7::ESCAPE)
+            {
+                table[count++] = {DEFAULT_ALPHABET[septet], static_cast<uint16_t>(septet)};
+            }
+        }
+        table[count] = {u'€', EXTENDED | 0x65};
+        return table;
+    }();
+
+    // Septets from..to, each out of the octet it starts in and, past bit 1, the one after
+    void unpack_septets(const uint8_t *packed, std::size_t from, std::size_t to, uint8_t *out)
+    {
+        for (std::size_t idx = from; idx < to; idx++)
+        {
+            const std::size_t octet = idx * 7 / 8;
+            const unsigned int shift = idx * 7 % 8;
+            unsigned int septet = packed[octet] >> shift;
+            if (shift > 1)
+            {
+                septet |= packed[octet + 1] << (8 - shift);
+            }
+            out[idx] = static_cast<uint8_t>(septet & 0x7F);
+        }
+    }
+
+#if defined(GSM7_X86)
+    // Septets 0..15 of 14 octets: each as the 16-bit word of the two octets it spans, multiplied by
+    // 2^(8 - shift) so that it ends up in the high byte, which a shift by 8 and a mask leave
+    __attribute__((target("ssse3"))) std::size_t unpack_ssse3(const uint8_t *packed, std::size_t length,
+                                                              std::size_t count, uint8_t *out)
+    {
+        const __m128i low_words = _mm_setr_epi8(0, 1, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7);
+        const __m128i high_words = _mm_setr_epi8(7, 8, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, 14);
+        const __m128i multipliers = _mm_setr_epi16(256, 2, 4, 8, 16, 32, 64, 128);
+        const __m128i mask = _mm_set1_epi16(0x7F);
+        std::size_t done = 0;
+        // a load takes 16 octets, of which the 14 of a group are used
+        for (std::size_t octet = 0; done + 16 <= count && octet + 16 <= length; done += 16, octet += 14)
+        {
+            const __m128i octets = _mm_loadu_si128(reinterpret_cast<const __m128i *>(packed + octet));
+            const __m128i low = _mm_and_si128(
+                _mm_srli_epi16(_mm_mullo_epi16(_mm_shuffle_epi8(octets, low_words), multipliers), 8), mask);
+            const __m128i high = _mm_and_si128(
+                _mm_srli_epi16(_mm_mullo_epi16(_mm_shuffle_epi8(octets, high_words), multipliers), 8), mask);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + done), _mm_packus_epi16(low, high));
+        }
+        return done;
+    }
+
+    bool has_ssse3()
+    {
+        static const bool supported = __builtin_cpu_supports("ssse3");
+        return supported;
+    }
+
+    // How many of the 16 septets, from the first, are their own ASCII code: space to Z but ¤ and ¡, and a to z
+    std::size_t plain_run(const uint8_t *septets)
+    {
+        const __m128i each = _mm_loadu_si128(reinterpret_cast<const __m128i *>(septets));
+        const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(each, _mm_set1_epi8(0x1F)),
+                                            _mm_cmplt_epi8(each, _mm_set1_epi8(0x5B)));
+        const __m128i other = _mm_or_si128(_mm_cmpeq_epi8(each, _mm_set1_epi8(0x24)),
+                                           _mm_cmpeq_epi8(each, _mm_set1_epi8(0x40)));
+        const __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(each, _mm_set1_epi8(0x60)),
+                                            _mm_cmplt_epi8(each, _mm_set1_epi8(0x7B)));
+        const unsigned int plain = _mm_movemask_epi8(_mm_or_si128(_mm_andnot_si128(other, upper), lower));
+        return __builtin_ctz(~plain);
+    }
+#elif defined(GSM7_NEON)
+    // Septets 0..15 of 14 octets: each as the 16-bit word of the two octets it spans, shifted right by
+    // where it starts and masked
+    std::size_t unpack_neon(const uint8_t *packed, std::size_t length, std::size_t count, uint8_t *out)
+    {
+        static constexpr uint8_t LOW_WORDS[16] = {0, 1, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7};
+        static constexpr uint8_t HIGH_WORDS[16] = {7, 8, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, 14};
+        static constexpr int16_t SHIFTS[8] = {0, -7, -6, -5, -4, -3, -2, -1};
+        const uint8x16_t low_words = vld1q_u8(LOW_WORDS);
+        const uint8x16_t high_words = vld1q_u8(HIGH_WORDS);
+        const int16x8_t shifts = vld1q_s16(SHIFTS);
+        const uint16x8_t mask = vdupq_n_u16(0x7F);
+        std::size_t done = 0;
+        for (std::size_t octet = 0; done + 16 <= count && octet + 16 <= length; done += 16, octet += 14)
+        {
+            const uint8x16_t octets = vld1q_u8(packed + octet);
+            const uint16x8_t low = vandq_u16(vshlq_u16(vreinterpretq_u16_u8(vqtbl1q_u8(octets, low_words)), shifts), mask);
+            const uint16x8_t high =
+                vandq_u16(vshlq_u16(vreinterpretq_u16_u8(vqtbl1q_u8(octets, high_words)), shifts), mask);
+            vst1q_u8(out + done, vcombine_u8(vmovn_u16(low), vmovn_u16(high)));
+        }
+        return done;
+    }
+
+    std::size_t plain_run(const uint8_t *septets)
+    {
+        const uint8x16_t each = vld1q_u8(septets);
+        const uint8x16_t upper = vandq_u8(vcgtq_u8(each, vdupq_n_u8(0x1F)), vcltq_u8(each, vdupq_n_u8(0x5B)));
+        const uint8x16_t other = vorrq_u8(vceqq_u8(each, vdupq_n_u8(0x24)), vceqq_u8(each, vdupq_n_u8(0x40)));
+        const uint8x16_t lower = vandq_u8(vcgtq_u8(each, vdupq_n_u8(0x60)), vcltq_u8(each, vdupq_n_u8(0x7B)));
+        const uint8x16_t plain = vorrq_u8(vbicq_u8(upper, other), lower);
+        // a nibble per septet, as there is no movemask
+        const uint64_t nibbles = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(plain), 4)), 0);
+        return nibbles == ~uint64_t{0} ? 16 : __builtin_ctzll(~nibbles) / 4;
+    }
+#endif
+
+    template <bool VECTOR> std::size_t map(const uint8_t *septets, std::size_t count, char *out)
+    {
+        std::size_t written = 0;
+        for (std::size_t idx = 0; idx < count;)
+        {
+            std::size_t end = std::min(count, idx + 16);
+#if defined(GSM7_X86) || defined(GSM7_NEON)
+            if (VECTOR && count - idx >= 16)
+            {
+                // all 16 are copied, those up to the first that is not plain count; that one is mapped below
+                const std::size_t run = plain_run(septets + idx);
+                std::memcpy(out + written, septets + idx, 16);
+                written += run;
+                idx += run;
+                if (run == 16)
+                {
+                    continue;
+                }
+                end = idx + 1;
+            }
+#endif
+            // character by character; an escape takes the septet after it, which may be past end
+            while (idx < end)
+            {
+                const uint8_t septet = septets[idx++] & 0x7F;
+                const Utf8 *character = &DEFAULT_TABLE[septet];
+                if (septet == Gsm7::ESCAPE && idx < count)
+                {
+                    character = &EXTENSION_TABLE[septets[idx++] & 0x7F];
+                }
+                // every septet has MAX_UTF8 bytes of out, so the whole table entry fits
+                std::memcpy(out + written, character->bytes, Gsm7::MAX_UTF8);
+                written += character->length;
+            }
+        }
+        return written;
+    }
+} // namespace
+
+std::size_t Gsm7::unpack(const uint8_t *packed, std::size_t length, std::size_t count, uint8_t *out)
+{
+    count = std::min(count, length * 8 / 7);
+    std::size_t done = 0;
+#if defined(GSM7_X86)
+    if (has_ssse3())
+    {
+        done = unpack_ssse3(packed, length, count, out);
+    }
+#elif defined(GSM7_NEON)
+    done = unpack_neon(packed, length, count, out);
+#endif
+    unpack_septets(packed, done, count, out);
+    return count;
+}
+
+std::size_t Gsm7::unpack_scalar(const uint8_t *packed, std::size_t length, std::size_t count, uint8_t *out)
+{
+    count = std::min(count, length * 8 / 7);
+    unpack_septets(packed, 0, count, out);
+    return count;
+}
+
+std::size_t Gsm7::to_utf8(const uint8_t *septets, std::size_t count, char *out)
+{
+    return map<true>(septets, count, out);
+}
+
+std::size_t Gsm7::to_utf8_scalar(const uint8_t *septets, std::size_t count, char *out)
+{
+    return map<false>(septets, count, out);
+}
+
+std::size_t Gsm7::from_code_point(char32_t code_point, uint8_t out[2])
+{
+    uint16_t septets = NO_SEPTET;
+    if (code_point < 0x80)
+    {
+        septets = ASCII_SEPTETS[code_point];
+    }
+    else
+    {
+        for (const auto &each : OTHER_SEPTETS)
+        {
+            if (each.code_point == code_point) septets = each.septets;
+        }
+    }
+    if (septets == NO_SEPTET)
+    {
+        return 0;
+    }
+    if (septets < 0x80)
+    {
+        out[0] = static_cast<uint8_t>(septets);
+        return 1;
+    }
+    out[0] = ESCAPE;
+    out[1] = static_cast<uint8_t>(septets & 0x7F);
+    return 2;
+}
+
+std::size_t Gsm7::pack(const uint8_t *septets, std::size_t count, unsigned int fill_bits, uint8_t *out)
+{
+    std::size_t written = 0;
+    unsigned int bits = fill_bits % 7;
+    unsigned int pending = 0;
+    for (std::size_t idx = 0; idx < count; idx++)
+    {
+        pending |= static_cast<unsigned int>(septets[idx] & 0x7F) << bits;
+        bits += 7;
+        if (bits >= 8)
+        {
+            out[written++] = static_cast<uint8_t>(pending);
+            pending >>= 8;
+            bits -= 8;
+        }
+    }
+    if (bits > 0)
+    {
+        out[written++] = static_cast<uint8_t>(pending);
+    }
+    return written;
+}
+
+const char *Gsm7::vector_unit()
+{
+#if defined(GSM7_X86)
+    return has_ssse3() ? "SSSE3" : "SSE2";
+#elif defined(GSM7_NEON)
+    return "NEON";
+#else
+    return "none";
+#endif
+}
@@ -0,0 +1,107 @@
+#include "latency_histogram.hpp"
+
+#include <cmath>
+
+namespace
+{
+    unsigned int most_significant_bit(std::uint64_t value)
+    {
+        return 63 - __builtin_clzll(value);
+    }
+
+    // Only the recording thread writes, so a plain add cannot lose a count and needs no lock prefix
+    void add(std::atomic<std::uint64_t> &counter, std::uint64_t value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+}
+
+std::size_t LatencyHistogram::bucket_of(std::uint64_t us)
+{
+    if (us < 2 * SUB_BUCKETS)
+    {
+        return us;
+    }
+    if (us >> MAGNITUDES)
+    {
+        return BUCKETS - 1;
+    }
+    // the top SUB_BUCKET_BITS + 1 bits select the bucket within the value's power of two
+    const unsigned int shift = most_significant_bit(us) - SUB_BUCKET_BITS;
+    return (shift + 1) * SUB_BUCKETS + (us >> shift) - SUB_BUCKETS;
+}
+
+std::uint64_t LatencyHistogram::lowest_in(std::size_t bucket)
+{
+    if (bucket < 2 * SUB_BUCKETS)
+    {
+        return bucket;
+    }
+    const unsigned int shift = bucket / SUB_BUCKETS - 1;
+    return static_cast<std::uint64_t>(bucket % SUB_BUCKETS + SUB_BUCKETS) << shift;
+}
+
+void LatencyHistogram::record(std::chrono::nanoseconds latency)
+{
+    const std::uint64_t us = latency.count() > 0 ? static_cast<std::uint64_t>(latency.count()) / 1000 : 0;
+    add(m_counts[bucket_of(us)], 1);
+    add(m_total_us, us);
+    if (us < m_min_us.load(std::memory_order_relaxed)) m_min_us.store(us, std::memory_order_relaxed);
+    if (us > m_max_us.load(std::memory_order_relaxed)) m_max_us.store(us, std::memory_order_relaxed);
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const
+{
+    Snapshot copy;
+    for (std::size_t idx = 0; idx < BUCKETS; idx++)
+    {
+        copy.counts[idx] = m_counts[idx].load(std::memory_order_relaxed);
+        copy.count += copy.counts[idx];
+    }
+    copy.total_us = m_total_us.load(std::memory_order_relaxed);
+    copy.max_us = m_max_us.load(std::memory_order_relaxed);
+    copy.min_us = copy.count == 0 ? 0 : m_min_us.load(std::memory_order_relaxed);
+    return copy;
+}
+
+std::uint64_t LatencyHistogram::Snapshot::percentile(double fraction) const
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+    const auto rank = static_cast<std::uint64_t>(std::ceil(fraction * count));
+    std::uint64_t seen = 0;
+    for (std::size_t idx = 0; idx < BUCKETS; idx++)
+    {
+        seen += counts[idx];
+        if (seen >= rank && seen > 0)
+        {
+            // the bucket's lower bound, clamped to what was actually recorded
+            const auto value = lowest_in(idx);
+            return value < min_us ? min_us : (value > max_us ? max_us : value);
+        }
+    }
+    return max_us;
+}
+
+std::uint64_t LatencyHistogram::Snapshot::mean_us() const
+{
+    return count == 0 ? 0 : total_us / count;
+}
+
+void LatencyHistogram::Snapshot::merge(const Snapshot &other)
+{
+    if (other.count == 0)
+    {
+        return;
+    }
+    for (std::size_t idx = 0; idx < BUCKETS; idx++)
+    {
+        counts[idx] += other.counts[idx];
+    }
+    min_us = count == 0 || other.min_us < min_us ? other.min_us : min_us;
+    max_us = other.max_us > max_us ? other.max_us : max_us;
+    count += other.count;
+    total_us += other.total_us;
+}
@@ -0,0 +1,87 @@
+#include "line_framer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+char *LineFramer::space()
+{
+    return m_buffer.data() + m_end;
+}
+
+std::size_t LineFramer::space_size() const
+{
+    return CAPACITY - m_end;
+}
+
+void LineFramer::commit(std::size_t length)
+{
+    m_end = std::min(m_end + length, CAPACITY);
+}
+
+std::size_t LineFramer::feed(const char *data, std::size_t length)
+{
+    length = std::min(length, space_size());
+    std::memcpy(space(), data, length);
+    commit(length);
+    return length;
+}
+
+bool LineFramer::next(std::string_view &line)
+{
+    while (m_begin < m_end)
+    {
+        const char *base = m_buffer.data();
+        const auto *newline = static_cast<const char *>(std::memchr(base + m_scanned, '\n', m_end - m_scanned));
+        if (newline != nullptr)
+        {
+            const std::size_t stop = newline - base;
+            line = std::string_view(base + m_begin, stop - m_begin);
+            m_begin = m_scanned = stop + 1;
+        }
+        else if (m_end - m_begin == CAPACITY)
+        {
+            // no line ending in a full buffer, hand it out as it is rather than stall
+            line = std::string_view(base + m_begin, CAPACITY);
+            m_begin = m_scanned = m_end;
+        }
+        else
+        {
+            m_scanned = m_end;
+            compact();
+            return false;
+        }
+        while (!line.empty() && line.back() == '\r')
+        {
+            line.remove_suffix(1);
+        }
+        if (!line.empty())
+        {
+            return true;
+        }
+    }
+    clear();
+    return false;
+}
+
+std::string_view LineFramer::partial() const
+{
+    return std::string_view(m_buffer.data() + m_begin, m_end - m_begin);
+}
+
+void LineFramer::compact()
+{
+    // moving a long tail after every short read would cost more than the scan itself
+    if (m_begin == 0 || CAPACITY - m_end >= CAPACITY / 4)
+    {
+        return;
+    }
+    std::memmove(m_buffer.data(), m_buffer.data() + m_begin, m_end - m_begin);
+    m_scanned -= m_begin;
+    m_end -= m_begin;
+    m_begin = 0;
+}
+
+void LineFramer::clear()
+{
+    m_begin = m_scanned = m_end = 0;
+}
@@ -0,0 +1,79 @@
+#include "line_health.hpp"
+
+LineHealth::LineHealth(bool auto_flow_control) : m_auto_flow_control(auto_flow_control)
+{
+}
+
+LineHealth::Action LineHealth::assess(const LineErrors &counters, bool flow_control, bool can_step_down)
+{
+    if (!m_started)
+    {
+        // the driver counts since it was loaded; only what happens from now on matters
+        m_started = true;
+        m_last = counters;
+        return Action::NONE;
+    }
+    const unsigned long overruns = (counters.overrun - m_last.overrun) + (counters.bufferOverrun - m_last.bufferOverrun);
+    const unsigned long garbled = (counters.frame - m_last.frame) + (counters.parity - m_last.parity);
+    m_total.overrun += counters.overrun - m_last.overrun;
+    m_total.bufferOverrun += counters.bufferOverrun - m_last.bufferOverrun;
+    m_total.frame += counters.frame - m_last.frame;
+    m_total.parity += counters.parity - m_last.parity;
+    m_total.brk += counters.brk - m_last.brk;
+    m_last = counters;
+
+    if (m_settling || (overruns == 0 && garbled == 0))
+    {
+        m_settling = false;
+        return Action::NONE;
+    }
+    std::cerr << "UART lost data: " << overruns << " overruns, " << garbled << " framing/parity errors" << std::endl;
+
+    Action action = Action::NONE;
+    if (overruns > 0 && garbled == 0 && !flow_control && m_auto_flow_control)
+    {
+        action = Action::ENABLE_FLOW_CONTROL;
+    }
+    else if (can_step_down)
+    {
+        action = Action::STEP_DOWN;
+    }
+    if (action != Action::NONE)
+    {
+        ++m_actions;
+        m_settling = true;
+    }
+    return action;
+}
+
+bool LineHealth::changed(const LineErrors &before, const LineErrors &after)
+{
+    return before.overrun != after.overrun || before.bufferOverrun != after.bufferOverrun ||
+           before.frame != after.frame || before.parity != after.parity;
+}
+
+void LineHealth::dump(std::ostream &os) const
+{
+    if (!m_started)
+    {
+        os << "UART line errors: not counted on this port" << std::endl;
+        return;
+    }
+    os << "UART line errors: " << m_total.overrun << " overruns, " << m_total.bufferOverrun << " buffer overruns, "
+       << m_total.frame << " framing, " << m_total.parity << " parity, " << m_total.brk << " breaks; "
+       << m_actions << " corrective actions" << std::endl;
+}
+
+const char *LineHealth::to_string(Action action)
+{
+    switch (action)
+    {
+    case Action::NONE:
+        return "NONE";
+    case Action::ENABLE_FLOW_CONTROL:
+        return "ENABLE_FLOW_CONTROL";
+    case Action::STEP_DOWN:
+        return "STEP_DOWN";
+    }
+    return "UNKNOWN";
+}
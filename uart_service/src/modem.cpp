@@ -0,0 +1,1129 @@
+#include "modem.hpp"
+#include "error.hpp"
+#include "urc.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <sys/epoll.h>
+
+using namespace std::literals::chrono_literals;
+
+// A front-end command without its final result code by then completes as a timeout
+constexpr auto FRONTEND_COMMAND_TIMEOUT = 5000ms;
+
+// AT+CMGS from the prompt to the network's answer, which 27.005 lets take long
+constexpr auto SEND_TIMEOUT = 60000ms;
+
+// How often the error counters of the UART are read
+constexpr auto LINE_CHECK_INTERVAL = 5000ms;
+
+// A +CMTI or RING this soon after RI went low is what the pulse announced
+constexpr auto RING_INDICATOR_WINDOW = 1000ms;
+
+// How often the recorded traffic is written out, which is what a crash loses at most
+constexpr auto CAPTURE_FLUSH_INTERVAL = 1000ms;
+
+// The DLCs of a multiplexed modem: URCs and everything else, SMS transactions, front-end commands
+constexpr unsigned int URC_CHANNEL = 1;
+constexpr unsigned int SMS_CHANNEL = 2;
+constexpr unsigned int FRONTEND_CHANNEL = 3;
+
+// How long the modem may take to acknowledge the SABMs after AT+CMUX
+constexpr auto CMUX_OPEN_TIMEOUT = 2000ms;
+
+// AT+CMGL=4 of a full storage: a few hundred PDUs of up to 176 bytes in hex at the slowest rate
+constexpr auto BACKLOG_LIST_TIMEOUT = 30000ms;
+
+// How long messages go through storage after the service refused one delivered directly
+constexpr auto DIRECT_DELIVERY_RETRY = 60000ms;
+
+// The fixed rates of AT+IPR on the SIM7600 from 115200 up, for stepping down
+constexpr int MODEM_RATES[] = {115200, 230400, 460800, 921600, 3000000, 3200000, 3686400};
+
+Modem::Modem(std::string name, std::string device, const Utils::Options::Serial &serial_config, Deliver deliver,
+             Persist persist)
+    : m_name(std::move(name)), m_device(std::move(device)), m_config(serial_config), m_deliver(std::move(deliver)),
+      m_persist(std::move(persist)),
+      m_at(m_serial, m_reactor, serial_config.get_pipeline_depth()),
+      m_line_health(serial_config.get_flow_control() == "auto"), m_lowest_baud(serial_config.get_baud()),
+      m_stats_interval(serial_config.get_stats_interval())
+{
+    if (const auto chip = serial_config.get_ring_indicator_chip(); !chip.empty())
+    {
+        try
+        {
+            m_ring_indicator = std::make_unique<GpioInput>(chip, serial_config.get_ring_indicator_line(),
+                                                           GpioInput::Edge::FALLING, "cellular RI");
+        }
+        catch (const Utils::Error::SystemError &e)
+        {
+            std::cerr << m_name << ": no ring indicator, URCs are only seen on the UART: " << e.what() << std::endl;
+        }
+    }
+}
+
+Modem::~Modem()
+{
+    m_serial.end();
+}
+
+void Modem::run()
+{
+    if (start())
+    {
+        loop();
+    }
+}
+
+void Modem::request(std::shared_ptr<Utils::Interface::Command> command, Reply reply)
+{
+    m_reactor.post([this, command = std::move(command), reply = std::move(reply)]()
+                   { frontend_at().submit(command->message(), FRONTEND_COMMAND_TIMEOUT, [this, command, reply](const ATEngine::Result &result)
+                                          { frontend_response_handler(command, reply, result); }); });
+}
+
+void Modem::send(std::string recipient, std::string text, Reply reply)
+{
+    m_reactor.post([this, recipient = std::move(recipient), text = std::move(text), reply = std::move(reply)]()
+                   { queue_message(recipient, text, reply); });
+}
+
+void Modem::stop()
+{
+    m_stopping = true;
+    m_reactor.post([this]()
+                   { m_reactor.stop(); });
+}
+
+void Modem::report()
+{
+    m_reactor.post([this]()
+                   { dump_metrics(); });
+}
+
+const std::string &Modem::name() const
+{
+    return m_name;
+}
+
+const std::string &Modem::device() const
+{
+    return m_device;
+}
+
+bool Modem::start()
+{
+    m_serial.begin(m_config.get_baud());
+    std::cout << m_name << ": starting serial at " << m_device << std::endl;
+    if (const auto capture = m_config.get_capture_file(); !capture.empty())
+    {
+        try
+        {
+            m_recorder = std::make_unique<TrafficCapture::Recorder>(capture, m_device, m_serial.baudRate(),
+                                                                     std::size_t(m_config.get_capture_limit_mb()) << 20);
+            m_serial.setRecorder(m_recorder.get());
+            m_reactor.add_timer("capture flush", CAPTURE_FLUSH_INTERVAL, CAPTURE_FLUSH_INTERVAL, [this]()
+                                { m_recorder->flush(); });
+        }
+        catch (const Utils::Error::SystemError &e)
+        {
+            std::cerr << m_name << ": the traffic is not recorded: " << e.what() << std::endl;
+        }
+    }
+    m_reactor.add(m_serial.fileDescriptor(), EPOLLIN, "serial", [this](uint32_t events)
+                  {
+                      if (events & EPOLLOUT) output_ready();
+                      if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) serial_handler(); });
+    // SerialPi::pinMode(powerkey, OUTPUT);
+    // std::cout << "\tPin mode set" << std::endl;
+    // SerialPi::digitalWrite(powerkey, HIGH);
+    // std::cout << "\tDigital write set to HIGH" << std::endl;
+    // std::this_thread::sleep_for(600ms);
+    // SerialPi::digitalWrite(powerkey, LOW);
+    // std::cout << "\tDigital write set to LOW" << std::endl;
+    // AT+IPR sticks in the modem, so after a restart it may still run at the rate negotiated last time
+    std::vector<int> rates{m_serial.baudRate()};
+    if (const int target = m_config.get_target_baud(); target > 0 && target != rates.front())
+    {
+        rates.push_back(target);
+    }
+    unsigned int attempt = 0;
+    for (auto hi = m_at.execute("AT", 2000ms); !hi.ok(); hi = m_at.execute("AT", 2000ms))
+    {
+        if (m_stopping) return false;
+        throw_if_closed("AT", hi);
+        if (attempt == 0 && m_config.get_cmux())
+        {
+            // a previous run may have left it multiplexed, where a bare AT goes unanswered
+            const auto close_down = Multiplexer::close_down();
+            m_serial.send(close_down.data(), static_cast<int>(close_down.size()));
+        }
+        if (rates.size() > 1)
+        {
+            const int next = rates[++attempt % rates.size()];
+            std::cout << "No answer at " << m_serial.baudRate() << " baud, trying " << next << std::endl;
+            m_serial.setBaudRate(next);
+        }
+    }
+
+    std::this_thread::sleep_for(500ms);
+
+    for (auto ready_or_not = m_at.execute("AT+CPIN?", 500ms);
+         !ready_or_not.ok() || ready_or_not.response.find("CPIN: READY") == std::string::npos;
+         ready_or_not = m_at.execute("AT+CPIN?", 500ms))
+    {
+        throw_if_closed("AT+CPIN?", ready_or_not);
+        if (m_stopping) return false;
+        std::this_thread::sleep_for(500ms);
+    }
+    // query signal connection
+    m_at.execute("AT+CREG?", 500ms);
+    // query carrier
+    m_at.execute("AT+COPS?", 1500ms);
+    // force disable internet
+    m_at.execute("AT+CGATT=0", 1500ms);
+    // enable the phone call number
+    m_at.execute("AT+CLIP=1", 1500ms);
+    // query signal
+    const auto signal = m_at.execute("AT+CSQ", 1500ms);
+    if (const auto rssi = int_field(signal.response, "+CSQ:", 0); rssi && *rssi != 99)
+    {
+        std::cout << m_name << ": signal strength " << -113 + 2 * *rssi << " dBm" << std::endl;
+    }
+    if (m_config.get_flow_control() == "on")
+    {
+        const auto flow = m_at.execute("AT+IFC=2,2", 1000ms);
+        throw_if_closed("AT+IFC=2,2", flow);
+        if (!flow.ok() || m_serial.setFlowControl(true) != 0)
+        {
+            std::cerr << "RTS/CTS flow control could not be turned on" << std::endl;
+        }
+    }
+    renegotiate_baud(m_config.get_target_baud());
+    if (m_config.get_cmux())
+    {
+        multiplex();
+    }
+    return !m_stopping;
+}
+
+void Modem::loop()
+{
+    m_at.execute("AT+CMGF=0", 1000ms); // PDU mode
+    if (m_config.get_direct_delivery())
+    {
+        // +CMT to be acknowledged needs phase 2+ (AT+CSMS=1); without it the modem acknowledges on its own
+        if (m_at.execute("AT+CSMS=1", 1000ms).ok() && m_at.execute("AT+CNMI=2,2", 1000ms).ok())
+        {
+            m_direct_delivery = true;
+            m_direct_delivery_timer = m_reactor.add_timer("direct delivery", 0ms, 0ms, [this]()
+                                                          { deliver_directly(); });
+        }
+        else
+        {
+            std::cerr << m_name << ": no direct delivery with acknowledgements, messages are stored" << std::endl;
+        }
+    }
+    if (!m_direct_delivery)
+    {
+        m_at.execute("AT+CNMI=2,1", 1000ms);
+    }
+    // what arrived while the service was not running
+    drain_backlog();
+
+    if (m_ring_indicator)
+    {
+        m_reactor.add(m_ring_indicator->fd(), EPOLLIN, "ring indicator", [this](uint32_t)
+                      { ring_indicator_handler(); });
+    }
+    if (LineErrors counters; m_serial.lineErrors(counters) == 0)
+    {
+        m_line_health.assess(counters, m_serial.flowControl(), lower_baud() != 0);
+        m_reactor.add_timer("line check", LINE_CHECK_INTERVAL, LINE_CHECK_INTERVAL, [this]()
+                            { line_check(); });
+    }
+    else
+    {
+        std::cout << "No UART error counters on " << m_device << " (" << strerror(errno) << "), overruns go unnoticed" << std::endl;
+    }
+    if (m_stats_interval.count() > 0)
+    {
+        m_reactor.add_timer("statistics", m_stats_interval, m_stats_interval, [this]()
+                            { dump_metrics(); });
+    }
+    std::cout << m_name << ": listening to " << m_device << std::endl;
+
+    if (!m_stopping)
+    {
+        m_reactor.run();
+    }
+
+    dump_metrics();
+    if (m_mux)
+    {
+        // so that the next start finds it taking AT commands
+        m_mux->close();
+    }
+    std::cout << m_name << ": loop ends" << std::endl;
+}
+
+void Modem::frontend_response_handler(const std::shared_ptr<Utils::Interface::Command> &command, const Reply &reply,
+                                      const ATEngine::Result &result)
+{
+    if (result.status == ATEngine::Status::TIMEOUT || result.status == ATEngine::Status::CLOSED)
+    {
+        std::cerr << "Command from front-end: " << command->message() << " gets no result from " << m_name << " ("
+                  << ATEngine::to_string(result.status) << ")" << std::endl;
+        return;
+    }
+    // the intermediate lines if there are any, otherwise the final result code itself
+    auto content = result.response.empty() ? result.final_result : result.response;
+    trim(content);
+    try
+    {
+        command->verify(content);
+        std::cout << "Command from front-end: " << command->message() << " gets expected result " << content
+                  << " from " << m_name << std::endl;
+        reply(content);
+    }
+    catch (const std::exception &error)
+    {
+        std::cerr << error.what() << std::endl;
+    }
+}
+
+void Modem::queue_message(const std::string &recipient, const std::string &text, const Reply &reply)
+{
+    auto &message = *m_outbox.emplace_back(std::make_unique<Outgoing>());
+    message.recipient = recipient;
+    message.reply = reply;
+    std::vector<PduEncoder::Pdu> parts;
+    if (const auto error = m_encoder.encode(recipient, text, m_next_reference++, parts); error != PduEncoder::Error::NONE)
+    {
+        message.result = std::string("ERROR ") + PduEncoder::to_string(error);
+        flush_outbox();
+        return;
+    }
+
+    auto &engine = sms_at();
+    if (!m_link_kept && m_parts_pending + parts.size() > 1)
+    {
+        // the link stays up from one message to the next until none follows for a few seconds
+        m_link_kept = true;
+        engine.submit("AT+CMMS=1", 1000ms, nullptr);
+    }
+    m_parts_pending += parts.size();
+    for (auto &part : parts)
+    {
+        message.parts.push_back(engine.submit_prompted("AT+CMGS=" + std::to_string(part.tpdu_length), std::move(part.hex),
+                                                       SEND_TIMEOUT, [this, &message](const ATEngine::Result &result)
+                                                       { part_sent(message, result); }));
+    }
+}
+
+void Modem::part_sent(Outgoing &message, const ATEngine::Result &result)
+{
+    if (--m_parts_pending == 0)
+    {
+        m_link_kept = false;
+    }
+    if (!message.result.empty())
+    {
+        return; // cancelled, as a part before it failed
+    }
+    if (!result.ok())
+    {
+        message.result = "ERROR " + (result.final_result.empty() ? std::string(ATEngine::to_string(result.status))
+                                                                 : result.final_result);
+        // the rest would arrive without it
+        for (std::size_t idx = message.sent + 1; idx < message.parts.size(); idx++)
+        {
+            sms_at().cancel(message.parts[idx]);
+        }
+        flush_outbox();
+        return;
+    }
+    m_parts_sent++;
+    const auto reference = int_field(result.response, "+CMGS:", 0);
+    message.references += (message.sent == 0 ? "" : ",") + (reference ? std::to_string(*reference) : std::string("?"));
+    if (++message.sent == message.parts.size())
+    {
+        message.result = "+CMGS: " + message.references;
+        flush_outbox();
+    }
+}
+
+void Modem::flush_outbox()
+{
+    while (!m_outbox.empty() && !m_outbox.front()->result.empty())
+    {
+        const auto message = std::move(m_outbox.front());
+        m_outbox.pop_front();
+        const bool sent = message->result.compare(0, 5, "ERROR") != 0;
+        (sent ? m_messages_sent : m_messages_failed)++;
+        (sent ? std::cout : std::cerr) << m_name << ": SMS to " << message->recipient << " in " << message->parts.size()
+                                       << " part(s): " << message->result << std::endl;
+        message->reply(message->recipient + ' ' + message->result);
+    }
+}
+
+void Modem::throw_if_closed(const std::string &command, const ATEngine::Result &result)
+{
+    if (result.status == ATEngine::Status::CLOSED)
+    {
+        throw Utils::Error::UnexpectedATResponse(command, "OK", "a closed serial port");
+    }
+}
+
+void Modem::renegotiate_baud(int target)
+{
+    const int current = m_serial.baudRate();
+    if (target <= 0 || target == current)
+    {
+        return;
+    }
+    // make sure the UART can run at target before the modem leaves the rate we can reach it at
+    if (m_serial.setBaudRate(target) != 0)
+    {
+        std::cerr << "The UART cannot run at " << target << " baud (" << strerror(errno) << "), staying at "
+                  << current << std::endl;
+        m_serial.setBaudRate(current);
+        return;
+    }
+    m_serial.setBaudRate(current);
+
+    const auto request = "AT+IPR=" + std::to_string(target);
+    const auto accepted = m_at.execute(request, 1000ms);
+    throw_if_closed(request, accepted);
+    if (!accepted.ok())
+    {
+        std::cerr << "The modem refused " << target << " baud, staying at " << current << std::endl;
+        return;
+    }
+    m_serial.setBaudRate(target);
+    if (answers())
+    {
+        std::cout << "Serial link now at " << target << " baud" << std::endl;
+        return;
+    }
+
+    std::cerr << "No answer at " << target << " baud, falling back to " << current << std::endl;
+    m_serial.setBaudRate(current);
+    if (!answers())
+    {
+        m_serial.setBaudRate(target);
+        m_at.execute("AT+IPR=" + std::to_string(current), 1000ms);
+        m_serial.setBaudRate(current);
+        if (!answers())
+        {
+            throw Utils::Error::UnexpectedATResponse(request, "OK", "no answer at " + std::to_string(target) +
+                                                                         " or " + std::to_string(current) + " baud");
+        }
+    }
+}
+
+bool Modem::answers()
+{
+    for (int attempt = 0; attempt < 3; attempt++)
+    {
+        const auto hi = m_at.execute("AT", 300ms);
+        throw_if_closed("AT", hi);
+        if (hi.ok())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Modem::answers(std::function<void(bool)> then, int attempts)
+{
+    m_at.submit("AT", 300ms, [this, then = std::move(then), attempts](const ATEngine::Result &hi) mutable
+                {
+                    if (hi.ok() || attempts <= 1 || hi.status == ATEngine::Status::CLOSED)
+                    {
+                        then(hi.ok());
+                        return;
+                    }
+                    answers(std::move(then), attempts - 1); });
+}
+
+void Modem::multiplex()
+{
+    const auto frame_size = m_config.get_cmux_frame_size();
+    // N1 is the fourth parameter; the ones left out keep their defaults
+    const std::string request = frame_size == 31 ? "AT+CMUX=0" : "AT+CMUX=0,0,," + std::to_string(frame_size);
+    const auto accepted = m_at.execute(request, 1000ms);
+    throw_if_closed(request, accepted);
+    if (!accepted.ok())
+    {
+        std::cerr << m_name << ": the modem refused " << request << ", staying on a single channel" << std::endl;
+        return;
+    }
+    m_mux = std::make_unique<Multiplexer>(m_serial, frame_size);
+    m_mux->open({URC_CHANNEL, SMS_CHANNEL, FRONTEND_CHANNEL});
+    const auto deadline = std::chrono::steady_clock::now() + CMUX_OPEN_TIMEOUT;
+    while (!m_mux->opened() && !m_stopping && std::chrono::steady_clock::now() < deadline)
+    {
+        const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        m_reactor.run_once(static_cast<int>(std::max(left.count(), 1L)));
+    }
+    if (!m_mux->opened())
+    {
+        std::cerr << m_name << ": the modem did not open every channel, leaving multiplexing" << std::endl;
+        const auto close_down = Multiplexer::close_down();
+        m_serial.send(close_down.data(), static_cast<int>(close_down.size()));
+        m_mux.reset();
+        return;
+    }
+    const auto depth = m_config.get_pipeline_depth();
+    m_at.switch_port(m_mux->channel(URC_CHANNEL));
+    m_sms_at = std::make_unique<ATEngine>(m_mux->channel(SMS_CHANNEL), m_reactor, depth);
+    m_frontend_at = std::make_unique<ATEngine>(m_mux->channel(FRONTEND_CHANNEL), m_reactor, depth);
+    std::cout << m_name << ": multiplexed, URCs on DLC " << URC_CHANNEL << ", SMS on DLC " << SMS_CHANNEL
+              << ", front-end on DLC " << FRONTEND_CHANNEL << std::endl;
+}
+
+ATEngine &Modem::engine_of(const CmuxChannel &channel)
+{
+    switch (channel.dlci())
+    {
+    case SMS_CHANNEL:
+        return sms_at();
+    case FRONTEND_CHANNEL:
+        return frontend_at();
+    default:
+        return m_at;
+    }
+}
+
+ATEngine &Modem::sms_at()
+{
+    return m_sms_at ? *m_sms_at : m_at;
+}
+
+ATEngine &Modem::frontend_at()
+{
+    return m_frontend_at ? *m_frontend_at : m_at;
+}
+
+void Modem::output_ready()
+{
+    // the engines share the UART's transmit queue; whichever flushes it, each re-evaluates EPOLLOUT
+    m_at.output_ready();
+    if (m_sms_at) m_sms_at->output_ready();
+    if (m_frontend_at) m_frontend_at->output_ready();
+}
+
+void Modem::line_check()
+{
+    LineErrors counters;
+    if (m_serial.lineErrors(counters) != 0)
+    {
+        return;
+    }
+    switch (m_line_health.assess(counters, m_serial.flowControl(), lower_baud() != 0))
+    {
+    case LineHealth::Action::ENABLE_FLOW_CONTROL:
+        std::cerr << "Turning RTS/CTS flow control on" << std::endl;
+        m_at.submit("AT+IFC=2,2", 1000ms, [this](const ATEngine::Result &result)
+                    {
+                        if (!result.ok() || m_serial.setFlowControl(true) != 0)
+                        {
+                            std::cerr << "RTS/CTS flow control could not be turned on" << std::endl;
+                        } });
+        break;
+    case LineHealth::Action::STEP_DOWN:
+        step_down_baud();
+        break;
+    case LineHealth::Action::NONE:
+        break;
+    }
+}
+
+int Modem::lower_baud() const
+{
+    if (m_mux)
+    {
+        return 0; // AT+IPR on a DLC would change the rate under the multiplexer
+    }
+    int lower = 0;
+    for (const int rate : MODEM_RATES)
+    {
+        if (rate < m_serial.baudRate() && rate >= m_lowest_baud)
+        {
+            lower = rate;
+        }
+    }
+    return lower;
+}
+
+void Modem::step_down_baud()
+{
+    const int current = m_serial.baudRate();
+    const int lower = lower_baud();
+    std::cerr << "Stepping the serial link down from " << current << " to " << lower << " baud" << std::endl;
+    m_at.submit("AT+IPR=" + std::to_string(lower), 1000ms, [this, current, lower](const ATEngine::Result &result)
+                {
+                    if (!result.ok() || m_serial.setBaudRate(lower) != 0)
+                    {
+                        std::cerr << "The serial link stays at " << current << " baud" << std::endl;
+                        return;
+                    }
+                    answers([this, current, lower](bool answered)
+                            {
+                                if (answered)
+                                {
+                                    std::cout << "Serial link now at " << lower << " baud" << std::endl;
+                                    return;
+                                }
+                                // the modem took AT+IPR and is at the lower rate, where it is asked back
+                                std::cerr << "No answer at " << lower << " baud, back to " << current << std::endl;
+                                m_at.submit("AT+IPR=" + std::to_string(current), 1000ms, [this, current, lower](const ATEngine::Result &)
+                                            {
+                                                m_serial.setBaudRate(current);
+                                                answers([current, lower](bool back)
+                                                        {
+                                                            if (!back)
+                                                            {
+                                                                std::cerr << "No answer at " << lower << " or " << current
+                                                                          << " baud" << std::endl;
+                                                            } }); }); }); });
+}
+
+void Modem::serial_handler()
+{
+    int length;
+    if (m_mux)
+    {
+        char chunk[LineFramer::CAPACITY];
+        while ((length = m_serial.readChunk(chunk, sizeof(chunk), 0)) > 0)
+        {
+            m_mux->receive(chunk, length, [this](CmuxChannel &channel, std::string_view line)
+                           {
+                               m_lines++;
+                               line_handler(engine_of(channel), line); });
+        }
+        for (const unsigned int dlci : {URC_CHANNEL, SMS_CHANNEL, FRONTEND_CHANNEL})
+        {
+            auto &channel = m_mux->channel(dlci);
+            offer_prompt(engine_of(channel), channel.framer());
+        }
+    }
+    else
+    {
+        while ((length = m_serial.readChunk(m_framer.space(), m_framer.space_size(), 0)) > 0)
+        {
+            m_framer.commit(length);
+            for (std::string_view line; m_framer.next(line);)
+            {
+                m_lines++;
+                line_handler(m_at, line);
+            }
+        }
+        offer_prompt(m_at, m_framer);
+    }
+    if (length == READ_ERROR || length == READ_EOF)
+    {
+        std::cout << "serial port is closed or gets EOF (the other end is off-line)" << std::endl;
+        m_reactor.remove(m_serial.fileDescriptor());
+        m_at.close();
+        if (m_sms_at) m_sms_at->close();
+        if (m_frontend_at) m_frontend_at->close();
+        m_reactor.stop();
+    }
+}
+
+void Modem::offer_prompt(ATEngine &engine, LineFramer &framer)
+{
+    if (const auto partial = framer.partial(); engine.awaiting_prompt() && !partial.empty() && partial.front() == '>')
+    {
+        framer.clear();
+        engine.prompt();
+    }
+}
+
+constexpr auto Modem::unsolicited_results()
+{
+    return make_urc_table<UrcHandler>(SERVICE_URCS, [](std::string_view name) -> UrcHandler
+                                      {
+                                          if (name == "+CMTI") return &Modem::new_message_handler;
+                                          if (name == "+CMT") return &Modem::delivered_message_handler;
+                                          if (name == "RING") return &Modem::ring_handler;
+                                          if (name == "+CLIP") return &Modem::caller_handler;
+                                          if (name == "+CREG" || name == "+CGREG" || name == "+CEREG") return &Modem::registration_handler;
+                                          return &Modem::notice_handler; });
+}
+
+void Modem::line_handler(ATEngine &engine, std::string_view content)
+{
+    static constexpr auto urc_table = unsolicited_results();
+    if (m_urc_waiting_for_body != nullptr && m_urc_source == &engine)
+    {
+        // the PDU line of +CMT / +CDS / +CBM
+        const auto handler = std::exchange(m_urc_waiting_for_body, nullptr);
+        (this->*handler)(m_urc_header, content);
+    }
+    else if (const auto *urc = urc_table.find(content); urc != nullptr && !engine.claims(urc->name))
+    {
+        if (urc->has_body)
+        {
+            m_urc_header.assign(content);
+            m_urc_waiting_for_body = urc->handler;
+            m_urc_source = &engine;
+        }
+        else
+        {
+            (this->*urc->handler)(content, {});
+        }
+    }
+    else if (!engine.consume(content))
+    {
+        std::cerr << "Unparsable content from serial port: " << content << std::endl;
+    }
+}
+
+void Modem::ring_indicator_handler()
+{
+    m_ring_indicator->read_events([this](const GpioInput::Event &event)
+                                  {
+                                      if (event.rising) return;
+                                      m_ring_indicated_at.push_back(event.timestamp);
+                                      m_ring_indications++;
+                                      std::cout << "Ring indicator pulled low, "
+                                                << std::chrono::duration_cast<std::chrono::microseconds>(GpioInput::now() - event.timestamp).count()
+                                                << " us ago" << std::endl; });
+    // the URC the pulse announces may already be waiting
+    serial_handler();
+}
+
+std::optional<std::chrono::nanoseconds> Modem::take_ring_indication(std::string_view what)
+{
+    const auto now = GpioInput::now();
+    while (!m_ring_indicated_at.empty() && now - m_ring_indicated_at.front() > RING_INDICATOR_WINDOW)
+    {
+        m_ring_indicated_at.pop_front();
+    }
+    if (m_ring_indicated_at.empty())
+    {
+        return std::nullopt;
+    }
+    const auto at = m_ring_indicated_at.front();
+    m_ring_indicated_at.pop_front();
+    const auto elapsed = now - at;
+    std::cout << what << " " << std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()
+              << " us after the ring indicator" << std::endl;
+    return at;
+}
+
+void Modem::new_message_handler(std::string_view line, std::string_view)
+{
+    std::cout << m_name << ": new SMS: " << line;
+    if (const auto smsNo = int_field(line, "+CMTI:", 1))
+    {
+        if (m_drain || m_reads_in_flight > 0)
+        {
+            // a burst: one AT+CMGL picks up this one and those still to come
+            std::cout << " -> No. " << *smsNo << ", left to a drain of the backlog" << std::endl;
+            take_ring_indication("+CMTI");
+            m_drain_wanted = true;
+            m_coalesced++;
+            return;
+        }
+        std::cout << " -> No. " << *smsNo << std::endl;
+        read_message(*smsNo, true, take_ring_indication("+CMTI"));
+    }
+    else
+    {
+        std::cout << " -> Unparsable number" << std::endl;
+    }
+}
+
+void Modem::read_message(long index, bool may_retry, std::optional<std::chrono::nanoseconds> rung_at)
+{
+    std::ostringstream query_formatter;
+    std::ostringstream delete_formatter;
+    query_formatter << "AT+CMGR=" << index;
+    delete_formatter << "AT+CMGD=" << index;
+    LineErrors before{};
+    const bool counted = m_serial.lineErrors(before) == 0;
+    m_reads_in_flight++;
+    sms_at().submit(query_formatter.str(), 2000ms, [this, index, may_retry, rung_at, counted, before, query = query_formatter.str(), remove = delete_formatter.str()](const ATEngine::Result &smsContent)
+                {
+                    m_reads_in_flight--;
+                    if (!smsContent.ok())
+                    {
+                        // left stored, for the next drain to list
+                        std::cerr << query << " => no message returned" << std::endl;
+                        sms_idle();
+                        return;
+                    }
+                    LineErrors after{};
+                    const bool handled = sms_handler(smsContent.response);
+                    if (!handled && may_retry && counted &&
+                        m_serial.lineErrors(after) == 0 && LineHealth::changed(before, after))
+                    {
+                        std::cerr << "The UART counted errors while message " << index << " was read, reading it again" << std::endl;
+                        read_message(index, false, rung_at);
+                        return;
+                    }
+                    if (handled && rung_at)
+                    {
+                        std::cout << "Message " << index << " handed on "
+                                  << std::chrono::duration_cast<std::chrono::microseconds>(GpioInput::now() - *rung_at).count()
+                                  << " us after the ring indicator" << std::endl;
+                    }
+                    if (!handled)
+                    {
+                        std::cerr << "Message " << index << " stays stored, it was not handed on" << std::endl;
+                        sms_idle();
+                        return;
+                    }
+                    if (!m_persist())
+                    {
+                        std::cerr << "Message " << index << " stays stored, what was handed on is not on the disk" << std::endl;
+                        sms_idle();
+                        return;
+                    }
+                    sms_at().submit(remove, 1000ms, nullptr);
+                    sms_idle(); });
+}
+
+void Modem::drain_backlog()
+{
+    m_drain_wanted = false;
+    m_drain.emplace();
+    m_drain->counted = m_serial.lineErrors(m_drain->before) == 0;
+    m_drains++;
+    const auto started = std::chrono::steady_clock::now();
+    sms_at().submit(
+        "AT+CMGL=4", BACKLOG_LIST_TIMEOUT, [this, started](const ATEngine::Result &listing)
+        {
+            auto drain = std::move(*m_drain);
+            m_drain.reset();
+            if (!drain.handed_on.empty() && !m_persist())
+            {
+                std::cerr << "What was handed on is not on the disk, the " << drain.handed_on.size()
+                          << " messages stay stored" << std::endl;
+                drain.kept.insert(drain.kept.end(), drain.handed_on.begin(), drain.handed_on.end());
+                drain.handed_on.clear();
+            }
+            m_drained += drain.handed_on.size();
+            if (!listing.ok())
+            {
+                std::cerr << "AT+CMGL=4 => " << ATEngine::to_string(listing.status) << " after "
+                          << drain.handed_on.size() << " messages" << std::endl;
+            }
+            else if (!drain.handed_on.empty() || !drain.kept.empty())
+            {
+                std::cout << m_name << ": drained " << drain.handed_on.size() << " stored messages in "
+                          << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count()
+                          << " ms, " << drain.kept.size() << " not handed on, " << drain.skipped
+                          << " not SMS-DELIVER left stored" << std::endl;
+            }
+            // one by one: AT+CMGD=0,1 would take read messages this drain did not hand on as well
+            for (const auto index : drain.handed_on)
+            {
+                sms_at().submit("AT+CMGD=" + std::to_string(index), 1000ms, nullptr);
+            }
+            LineErrors after{};
+            const bool garbled = drain.counted && m_serial.lineErrors(after) == 0 && LineHealth::changed(drain.before, after);
+            for (const auto index : drain.kept)
+            {
+                if (garbled)
+                {
+                    std::cerr << "The UART counted errors while message " << index << " was listed, reading it again" << std::endl;
+                    read_message(index, false, std::nullopt);
+                }
+                else
+                {
+                    std::cerr << "Message " << index << " stays stored for the next drain" << std::endl;
+                }
+            }
+            sms_idle(); },
+        [this](std::string_view line)
+        { listed_line(line); });
+}
+
+void Modem::listed_line(std::string_view line)
+{
+    if (!m_drain)
+    {
+        return;
+    }
+    if (const auto index = std::exchange(m_drain->listed, std::nullopt))
+    {
+        const auto pdu = trimmed(line);
+        if (not_received(pdu))
+        {
+            m_drain->skipped++;
+            return;
+        }
+        (m_deliver(std::string(pdu)) ? m_drain->handed_on : m_drain->kept).push_back(*index);
+    }
+    else if (const auto next = int_field(line, "+CMGL:", 0); next && line.rfind("+CMGL:", 0) == 0)
+    {
+        m_drain->listed = next;
+    }
+    else
+    {
+        std::cerr << "Unexpected line in the list of stored messages: " << line << std::endl;
+        m_drain->stray = true;
+    }
+}
+
+void Modem::sms_idle()
+{
+    if (m_drain_wanted && !m_drain && m_reads_in_flight == 0)
+    {
+        drain_backlog();
+    }
+}
+
+void Modem::delivered_message_handler(std::string_view line, std::string_view pdu)
+{
+    std::cout << m_name << ": new SMS delivered directly: " << line << std::endl;
+    const auto rung_at = take_ring_indication("+CMT");
+    const bool handed_on = m_deliver(std::string(pdu));
+    if (handed_on && rung_at)
+    {
+        std::cout << "Message handed on " << std::chrono::duration_cast<std::chrono::microseconds>(GpioInput::now() - *rung_at).count()
+                  << " us after the ring indicator" << std::endl;
+    }
+    if (m_direct_delivery)
+    {
+        acknowledge(handed_on && m_persist());
+    }
+}
+
+void Modem::acknowledge(bool handed_on)
+{
+    if (handed_on)
+    {
+        m_acknowledged++;
+        m_at.submit("AT+CNMA", 1000ms, [this](const ATEngine::Result &result)
+                    {
+                        if (result.ok() || result.status == ATEngine::Status::CLOSED) return;
+                        // too late: the modem answered the network with an error and stopped routing messages
+                        m_late_acknowledgements++;
+                        std::cerr << m_name << ": AT+CNMA => " << (result.final_result.empty() ? ATEngine::to_string(result.status) : result.final_result)
+                                  << ", turning direct delivery on again" << std::endl;
+                        deliver_directly(); });
+        return;
+    }
+    m_refused++;
+    std::cerr << m_name << ": the message could not be handed on, refusing it; messages are stored for the next "
+              << std::chrono::duration_cast<std::chrono::seconds>(DIRECT_DELIVERY_RETRY).count() << " s" << std::endl;
+    m_at.submit("AT+CNMA=2", 1000ms, nullptr);
+    // a +CMT may still come before this, and is answered as well
+    m_at.submit("AT+CNMI=2,1", 1000ms, [this](const ATEngine::Result &result)
+                {
+                    if (!result.ok()) return;
+                    m_direct_delivery = false;
+                    m_reactor.rearm_timer(m_direct_delivery_timer, DIRECT_DELIVERY_RETRY); });
+}
+
+void Modem::deliver_directly()
+{
+    m_at.submit("AT+CNMI=2,2", 1000ms, [this](const ATEngine::Result &result)
+                {
+                    if (result.status == ATEngine::Status::CLOSED) return;
+                    m_direct_delivery = result.ok();
+                    if (!m_direct_delivery)
+                    {
+                        std::cerr << m_name << ": AT+CNMI=2,2 refused, messages stay stored" << std::endl;
+                        m_at.submit("AT+CNMI=2,1", 1000ms, nullptr);
+                    }
+                    m_drain_wanted = true;
+                    sms_idle(); });
+}
+
+void Modem::ring_handler(std::string_view, std::string_view)
+{
+    std::cout << m_name << ": new incoming phone call is ringing" << std::endl;
+    take_ring_indication("RING");
+}
+
+void Modem::caller_handler(std::string_view line, std::string_view)
+{
+    const auto number_begin = line.find('"');
+    const auto number_end = number_begin == line.npos ? line.npos : line.find('"', number_begin + 1);
+    if (number_end != line.npos && number_end > number_begin + 1)
+    {
+        std::cout << m_name << ": new incoming phone call from " << line.substr(number_begin + 1, number_end - number_begin - 1) << std::endl;
+    }
+    else
+    {
+        std::cout << m_name << ": new incoming phone call from unknown caller (NO CLIP entry"
+                  << ", raw content: {" << line << "})" << std::endl;
+    }
+}
+
+void Modem::registration_handler(std::string_view line, std::string_view)
+{
+    static const char *const states[] = {"not registered", "registered, home network", "searching",
+                                         "registration denied", "unknown", "registered, roaming"};
+    const auto name = line.substr(0, line.find(':'));
+    const auto stat = int_field(line, ":", 0);
+    std::cout << m_name << ": network registration (" << name << "): "
+              << (stat && *stat >= 0 && *stat < 6 ? states[*stat] : "unexpected state") << std::endl;
+}
+
+void Modem::notice_handler(std::string_view line, std::string_view body)
+{
+    std::cout << m_name << " reports: " << line;
+    if (!body.empty())
+    {
+        std::cout << " {" << body << "}";
+    }
+    std::cout << std::endl;
+}
+
+void Modem::dump_metrics()
+{
+    const auto now = std::chrono::steady_clock::now();
+    const auto io = m_serial.statistics();
+    const double seconds = std::chrono::duration<double>(now - m_last_dump).count();
+    const unsigned long syscalls = io.reads + io.writes + io.waits;
+    // one write, so the reports of modems on other threads do not interleave with it
+    std::ostringstream report;
+    report << "Metrics of " << m_name << " on " << m_device << '\n';
+    report << "Serial I/O: " << io.bytesIn << " bytes in, " << io.bytesOut << " out ("
+           << static_cast<unsigned long>((io.bytesIn - m_last_io.bytesIn) / seconds) << '/'
+           << static_cast<unsigned long>((io.bytesOut - m_last_io.bytesOut) / seconds) << " B/s lately), "
+           << io.reads << " reads, " << io.writes << " writes, " << io.waits << " waits, " << io.wouldBlock
+           << " short writes, " << io.readTimeouts << " read timeouts, " << io.errors << " errors";
+    if (m_lines > 0)
+    {
+        report << "; " << m_lines << " lines, " << static_cast<double>(syscalls) / m_lines << " syscalls per line";
+    }
+    report << '\n';
+    m_last_io = io;
+    m_last_dump = now;
+
+    m_reactor.dump_latency(report);
+    m_at.dump_metrics(report);
+    ATEngine::dump_statistics(report, m_at.statistics());
+    if (m_mux)
+    {
+        m_mux->dump(report);
+        report << "SMS channel: ";
+        m_sms_at->dump_metrics(report);
+        ATEngine::dump_statistics(report, m_sms_at->statistics());
+        report << "Front-end channel: ";
+        m_frontend_at->dump_metrics(report);
+        ATEngine::dump_statistics(report, m_frontend_at->statistics());
+    }
+    m_line_health.dump(report);
+    if (m_config.get_direct_delivery())
+    {
+        report << "Direct delivery: " << (m_direct_delivery ? "on" : "off") << ", " << m_acknowledged << " acknowledged, "
+               << m_refused << " refused, " << m_late_acknowledgements << " acknowledgements too late\n";
+    }
+    report << "SMS sent: " << m_messages_sent << " messages in " << m_parts_sent << " parts, " << m_messages_failed
+           << " not sent, " << m_outbox.size() << " queued\n";
+    report << "SMS backlog: " << m_drains << " drains, " << m_drained << " messages drained, " << m_coalesced
+           << " +CMTI left to a drain\n";
+    if (m_recorder)
+    {
+        report << "Capture: " << m_recorder->records() << " chunks, " << m_recorder->size() << " bytes"
+               << (m_recorder->full() ? " (full)" : "") << '\n';
+    }
+    if (m_ring_indicator) report << "Ring indicator: " << m_ring_indications << " pulses" << (m_ring_indicator->is_mock() ? " (mock chip)" : "") << '\n';
+    std::cout << report.str() << std::flush;
+}
+
+std::optional<long> Modem::int_field(std::string_view line, std::string_view prefix, unsigned int field)
+{
+    auto pos = line.find(prefix);
+    if (pos == std::string_view::npos)
+    {
+        return std::nullopt;
+    }
+    pos += prefix.size();
+    for (; field > 0; --field)
+    {
+        if (pos = line.find(',', pos); pos == std::string_view::npos)
+        {
+            return std::nullopt;
+        }
+        ++pos;
+    }
+    while (pos < line.size() && line[pos] == ' ')
+    {
+        ++pos;
+    }
+    long value = 0;
+    const auto [end, error] = std::from_chars(line.data() + pos, line.data() + line.size(), value);
+    if (error != std::errc())
+    {
+        return std::nullopt;
+    }
+    return value;
+}
+
+void Modem::trim(std::string &s)
+{
+    s.erase(s.begin(), std::find_if(s.begin(), s.end(),
+                                    [](unsigned char ch)
+                                    { return !std::isspace(ch); }));
+    s.erase(std::find_if(s.rbegin(), s.rend(),
+                         [](unsigned char ch)
+                         { return !std::isspace(ch); })
+                .base(),
+            s.end());
+}
+
+std::string_view Modem::trimmed(std::string_view s)
+{
+    const auto begin = std::find_if(s.begin(), s.end(), [](unsigned char ch)
+                                    { return !std::isspace(ch); });
+    const auto end = std::find_if(s.rbegin(), s.rend(), [](unsigned char ch)
+                                  { return !std::isspace(ch); })
+                         .base();
+    return begin < end ? s.substr(begin - s.begin(), end - begin) : std::string_view();
+}
+
+bool Modem::not_received(std::string_view pdu)
+{
+    // past the SMSC, its length in octets first, TP-MTI is the low 2 bits of the first octet: 00 SMS-DELIVER
+    const auto octet = [pdu](std::size_t at) -> std::optional<unsigned int>
+    {
+        unsigned int value = 0;
+        if (2 * at + 2 > pdu.size() || std::from_chars(pdu.data() + 2 * at, pdu.data() + 2 * at + 2, value, 16).ptr != pdu.data() + 2 * at + 2)
+        {
+            return std::nullopt;
+        }
+        return value;
+    };
+    const auto smsc_length = octet(0);
+    const auto first = smsc_length ? octet(1 + *smsc_length) : std::nullopt;
+    // what does not parse this far is left to the decoder to refuse, and perhaps to be read again
+    return first && (*first & 0x03) != 0x00;
+}
+
+bool Modem::sms_handler(std::string_view raw_msg)
+{
+    // "+CMGR: <stat>,[<alpha>],<length>" and the PDU on the next line
+    size_t pos = raw_msg.find("+CMGR:");
+    if (pos != std::string_view::npos)
+    {
+        pos = raw_msg.find('\n', pos);
+    }
+    if (pos == std::string_view::npos)
+    {
+        std::cerr << "cannot handle the received SMS raw string: " << raw_msg
+                  << "; no +CMGR header line is presented. No PDU line" << std::endl;
+        return false;
+    }
+
+    // Everything after that line is the PDU
+    return m_deliver(std::string(trimmed(raw_msg.substr(pos + 1))));
+}
@@ -0,0 +1,256 @@
+#include "multiplexer.hpp"
+
+#include <algorithm>
+
+CmuxChannel::CmuxChannel(Multiplexer &mux, unsigned int dlci) : m_mux(mux), m_dlci(dlci)
+{
+}
+
+bool CmuxChannel::write_line(const std::string &line)
+{
+    // an AT interpreter on a DLC ends the command at S3 like on the UART
+    return m_mux.send(m_dlci, line + '\r');
+}
+
+bool CmuxChannel::write(std::string_view data)
+{
+    return m_mux.send(m_dlci, data);
+}
+
+void CmuxChannel::flush()
+{
+    m_mux.flush();
+}
+
+int CmuxChannel::queued() const
+{
+    return m_mux.queued();
+}
+
+int CmuxChannel::descriptor() const
+{
+    return m_mux.descriptor();
+}
+
+unsigned int CmuxChannel::dlci() const
+{
+    return m_dlci;
+}
+
+bool CmuxChannel::is_open() const
+{
+    return m_open;
+}
+
+LineFramer &CmuxChannel::framer()
+{
+    return m_framer;
+}
+
+Multiplexer::Multiplexer(SerialPi &serial, std::size_t frame_size)
+    : m_serial(serial), m_frame_size(std::clamp<std::size_t>(frame_size, 1, Cmux::MAX_INFO))
+{
+}
+
+void Multiplexer::open(std::initializer_list<unsigned int> dlcis)
+{
+    // DLC 0 first: the modem refuses every other SABM until it is open
+    send_frame(0, Cmux::SABM, true, {}, true);
+    for (const unsigned int dlci : dlcis)
+    {
+        if (dlci == 0 || dlci > MAX_CHANNEL)
+        {
+            std::cerr << "CMUX: no channel on DLC " << dlci << std::endl;
+            continue;
+        }
+        if (!m_channels[dlci])
+        {
+            m_channels[dlci] = std::make_unique<CmuxChannel>(*this, dlci);
+        }
+        send_frame(dlci, Cmux::SABM, true, {}, true);
+    }
+}
+
+bool Multiplexer::opened() const
+{
+    return m_control_open && std::all_of(m_channels.begin(), m_channels.end(), [](const auto &each)
+                                         { return !each || each->m_open; });
+}
+
+CmuxChannel &Multiplexer::channel(unsigned int dlci)
+{
+    return *m_channels.at(dlci);
+}
+
+void Multiplexer::receive(const char *data, std::size_t length, const LineHandler &handler)
+{
+    m_decoder.feed(data, length);
+    for (Cmux::Frame frame; m_decoder.next(frame);)
+    {
+        CmuxChannel *channel = frame.dlci <= MAX_CHANNEL ? m_channels[frame.dlci].get() : nullptr;
+        switch (frame.control)
+        {
+        case Cmux::UA:
+            if (frame.dlci == 0)
+            {
+                m_control_open = true;
+            }
+            else if (channel != nullptr && !channel->m_open)
+            {
+                channel->m_open = true;
+                std::cout << "CMUX: channel " << frame.dlci << " is open" << std::endl;
+            }
+            break;
+        case Cmux::DM:
+            std::cerr << "CMUX: the modem refused DLC " << frame.dlci << std::endl;
+            if (channel != nullptr) channel->m_open = false;
+            break;
+        case Cmux::DISC:
+            // the modem closes a DLC (or, on DLC 0, multiplexing altogether)
+            send_frame(frame.dlci, Cmux::UA, false, {}, true);
+            if (frame.dlci == 0) m_control_open = false;
+            if (channel != nullptr) channel->m_open = false;
+            break;
+        case Cmux::UIH:
+        case Cmux::UI:
+            if (frame.dlci == 0)
+            {
+                control_message(frame.info);
+            }
+            else if (channel != nullptr && channel->m_open)
+            {
+                channel->m_frames_in++;
+                channel->m_bytes_in += frame.info.size();
+                for (auto info = frame.info; !info.empty();)
+                {
+                    const auto taken = channel->m_framer.feed(info.data(), info.size());
+                    info.remove_prefix(taken);
+                    for (std::string_view line; channel->m_framer.next(line);)
+                    {
+                        handler(*channel, line);
+                    }
+                }
+            }
+            else
+            {
+                m_stray_frames++;
+            }
+            break;
+        default:
+            m_stray_frames++;
+            break;
+        }
+    }
+}
+
+void Multiplexer::control_message(std::string_view info)
+{
+    if (info.size() < 2)
+    {
+        m_stray_frames++;
+        return;
+    }
+    m_control_messages++;
+    const auto type = static_cast<uint8_t>(info[0]);
+    const std::size_t length = static_cast<uint8_t>(info[1]) >> 1;
+    const auto value = info.substr(2, length);
+    if ((type & Cmux::MESSAGE_COMMAND) == 0)
+    {
+        // a response to one of ours; only CLD needs acting on
+        if ((type | Cmux::MESSAGE_COMMAND) == Cmux::CLD)
+        {
+            std::cout << "CMUX: the modem left multiplexing" << std::endl;
+            m_control_open = false;
+        }
+        return;
+    }
+    const uint8_t response = type & ~Cmux::MESSAGE_COMMAND;
+    switch (type)
+    {
+    case Cmux::MSC:
+    case Cmux::TEST:
+        send_frame(0, Cmux::UIH, true, Cmux::message(response, value));
+        break;
+    case Cmux::FCON:
+    case Cmux::FCOFF:
+        std::cerr << "CMUX: the modem " << (type == Cmux::FCOFF ? "stops" : "resumes") << " taking frames" << std::endl;
+        send_frame(0, Cmux::UIH, true, Cmux::message(response));
+        break;
+    case Cmux::CLD:
+        send_frame(0, Cmux::UIH, true, Cmux::message(response));
+        m_control_open = false;
+        break;
+    default:
+        send_frame(0, Cmux::UIH, true, Cmux::message(Cmux::NSC, std::string_view(info.data(), 1)));
+        break;
+    }
+}
+
+bool Multiplexer::send(unsigned int dlci, std::string_view data)
+{
+    // the whole of data in one write, cut into frames of at most m_frame_size
+    const std::size_t frames = std::max<std::size_t>(1, (data.size() + m_frame_size - 1) / m_frame_size);
+    m_frame.resize(data.size() + frames * Cmux::OVERHEAD);
+    auto *out = reinterpret_cast<uint8_t *>(m_frame.data());
+    std::size_t length = 0;
+    do
+    {
+        const auto part = data.substr(0, m_frame_size);
+        length += Cmux::encode(out + length, dlci, Cmux::UIH, true, part);
+        data.remove_prefix(part.size());
+    } while (!data.empty());
+    if (auto *channel = dlci <= MAX_CHANNEL ? m_channels[dlci].get() : nullptr)
+    {
+        channel->m_frames_out += frames;
+        channel->m_bytes_out += length;
+    }
+    return m_serial.send(m_frame.data(), static_cast<int>(length)) >= 0;
+}
+
+bool Multiplexer::send_frame(unsigned int dlci, uint8_t control, bool command, std::string_view info, bool poll_final)
+{
+    const auto frame = Cmux::frame(dlci, control, command, info, poll_final);
+    return m_serial.send(frame.data(), static_cast<int>(frame.size())) >= 0;
+}
+
+void Multiplexer::flush()
+{
+    m_serial.writePending();
+}
+
+int Multiplexer::queued() const
+{
+    return m_serial.pendingOutput();
+}
+
+int Multiplexer::descriptor() const
+{
+    return m_serial.fileDescriptor();
+}
+
+void Multiplexer::close()
+{
+    if (m_control_open)
+    {
+        send_frame(0, Cmux::UIH, true, Cmux::message(Cmux::CLD));
+    }
+}
+
+std::string Multiplexer::close_down()
+{
+    return Cmux::frame(0, Cmux::UIH, true, Cmux::message(Cmux::CLD));
+}
+
+void Multiplexer::dump(std::ostream &os) const
+{
+    os << "CMUX: " << m_decoder.frames() << " frames in, " << m_decoder.bad_fcs() << " with a bad FCS, "
+       << m_decoder.discarded() << " bytes outside frames, " << m_stray_frames << " stray frames, "
+       << m_control_messages << " control messages\n";
+    for (const auto &channel : m_channels)
+    {
+        if (!channel) continue;
+        os << "  DLC " << channel->m_dlci << (channel->m_open ? "" : " (closed)") << ": " << channel->m_frames_in
+           << " frames / " << channel->m_bytes_in << " bytes in, " << channel->m_frames_out << " frames / "
+           << channel->m_bytes_out << " bytes out\n";
+    }
+}
@@ -0,0 +1,291 @@
+#include "pdu_decoder.hpp"
+#include "utf16.hpp"
+
+#include <array>
+
+namespace
+{
+    // The value of each hex digit, -1 for every other character
+    constexpr std::array<int8_t, 256> HEX_VALUES = []()
+    {
+        std::array<int8_t, 256> values{};
+        for (auto &each : values) each = -1;
+        for (int digit = 0; digit < 10; digit++) values['0' + digit] = static_cast<int8_t>(digit);
+        for (int digit = 0; digit < 6; digit++)
+        {
+            values['A' + digit] = static_cast<int8_t>(10 + digit);
+            values['a' + digit] = static_cast<int8_t>(10 + digit);
+        }
+        return values;
+    }();
+
+    constexpr char DIGITS[] = "0123456789ABCDEF";
+
+    // TP-MTI in the MS direction, and TP-UDHI
+    constexpr uint8_t MTI_MASK = 0x03;
+    constexpr uint8_t MTI_DELIVER = 0x00;
+    constexpr uint8_t UDHI = 0x40;
+
+    // The type of number of an address whose semi-octets are septets of the default alphabet
+    constexpr uint8_t TON_MASK = 0x70;
+    constexpr uint8_t TON_ALPHANUMERIC = 0x50;
+
+    // Concatenated short messages with an 8-bit and a 16-bit reference
+    constexpr uint8_t IEI_CONCATENATED_8 = 0x00;
+    constexpr uint8_t IEI_CONCATENATED_16 = 0x08;
+
+    enum class Alphabet : uint8_t
+    {
+        GSM7,
+        UCS2,
+        OTHER, // 8-bit data, or compressed text
+    };
+
+    // The alphabet of TP-DCS by its coding group (23.038 §4); reserved codings are read as the default alphabet
+    constexpr Alphabet alphabet_of(uint8_t dcs)
+    {
+        const uint8_t group = dcs >> 4;
+        if (group < 0x8)
+        {
+            // general data coding, marked for automatic deletion or not: bit 5 compressed, bits 3-2 the alphabet
+            if (dcs & 0x20) return Alphabet::OTHER;
+            if ((dcs & 0x0C) == 0x04) return Alphabet::OTHER;
+            return (dcs & 0x0C) == 0x08 ? Alphabet::UCS2 : Alphabet::GSM7;
+        }
+        if (group == 0xE)
+        {
+            // message waiting indication, store the message, in UCS-2; 1100 and 1101 are in the default alphabet
+            return Alphabet::UCS2;
+        }
+        if (group == 0xF)
+        {
+            // data coding and message class: bit 2 8-bit data
+            return dcs & 0x04 ? Alphabet::OTHER : Alphabet::GSM7;
+        }
+        return Alphabet::GSM7;
+    }
+}
+
+PduDecoder::Error PduDecoder::decode(std::string_view pdu, Message &message)
+{
+    message = Message{};
+    m_error_offset = 0;
+    if (pdu.size() % 2 != 0)
+    {
+        return fail(Error::NOT_HEX, pdu.size() / 2, message);
+    }
+    const std::size_t length = pdu.size() / 2;
+    if (length > MAX_OCTETS)
+    {
+        return fail(Error::TOO_LONG, MAX_OCTETS, message);
+    }
+    const auto *hex = reinterpret_cast<const uint8_t *>(pdu.data());
+    for (std::size_t idx = 0; idx < length; idx++)
+    {
+        const int high = HEX_VALUES[hex[2 * idx]];
+        const int low = HEX_VALUES[hex[2 * idx + 1]];
+        if ((high | low) < 0)
+        {
+            return fail(Error::NOT_HEX, idx, message);
+        }
+        m_octets[idx] = static_cast<uint8_t>(high << 4 | low);
+    }
+
+    // SMSC: its length in octets, the type of address and the semi-octets
+    if (length < 1)
+    {
+        return fail(Error::TRUNCATED, 0, message);
+    }
+    const std::size_t smsc_length = m_octets[0];
+    if (smsc_length > 1 + MAX_DIGITS / 2)
+    {
+        return fail(Error::ADDRESS_TOO_LONG, 0, message);
+    }
+    std::size_t at = 1;
+    if (at + smsc_length > length)
+    {
+        return fail(Error::TRUNCATED, at, message);
+    }
+    Message decoded;
+    if (smsc_length > 0)
+    {
+        decoded.smsc = semi_octets(m_octets + at + 1, smsc_length - 1, (smsc_length - 1) * 2, m_smsc);
+    }
+    at += smsc_length;
+
+    // First octet, then TP-OA: its length in digits, the type of address and the semi-octets
+    if (at + 3 > length)
+    {
+        return fail(Error::TRUNCATED, at, message);
+    }
+    const uint8_t first = m_octets[at];
+    if ((first & MTI_MASK) != MTI_DELIVER)
+    {
+        return fail(Error::NOT_DELIVER, at, message);
+    }
+    const std::size_t sender_digits = m_octets[at + 1];
+    if (sender_digits > MAX_DIGITS)
+    {
+        return fail(Error::ADDRESS_TOO_LONG, at + 1, message);
+    }
+    decoded.sender_type = m_octets[at + 2];
+    at += 3;
+    const std::size_t sender_octets = (sender_digits + 1) / 2;
+    // the address, TP-PID, TP-DCS, TP-SCTS and TP-UDL
+    if (at + sender_octets + 10 > length)
+    {
+        return fail(Error::TRUNCATED, at, message);
+    }
+    if ((decoded.sender_type & TON_MASK) == TON_ALPHANUMERIC)
+    {
+        decoded.sender = {m_sender, septets_text(m_octets + at, sender_octets, 0, sender_digits * 4 / 7, m_sender)};
+    }
+    else
+    {
+        decoded.sender = semi_octets(m_octets + at, sender_octets, sender_digits, m_sender);
+    }
+    at += sender_octets;
+    decoded.pid = m_octets[at++];
+    decoded.dcs = m_octets[at++];
+    decoded.timestamp = timestamp(m_octets + at);
+    at += 7;
+    const std::size_t udl = m_octets[at++];
+
+    // TP-UD: udl septets of the default alphabet, or udl octets of UCS-2
+    const auto alphabet = alphabet_of(decoded.dcs);
+    const bool ucs2 = alphabet == Alphabet::UCS2;
+    if (alphabet == Alphabet::OTHER)
+    {
+        return fail(Error::UNSUPPORTED_DCS, at - 9, message);
+    }
+    const std::size_t ud_length = ucs2 ? udl : (udl * 7 + 7) / 8;
+    if (at + ud_length > length)
+    {
+        return fail(Error::TRUNCATED, at, message);
+    }
+    const uint8_t *ud = m_octets + at;
+    std::size_t skip = 0;
+    if (first & UDHI)
+    {
+        if (ud_length == 0 || ud[0] + 1u > ud_length)
+        {
+            return fail(Error::BAD_UDH, at, message);
+        }
+        skip = ud[0] + 1u;
+        for (std::size_t ie = 1; ie + 2 <= skip;)
+        {
+            const uint8_t iei = ud[ie];
+            const std::size_t iedl = ud[ie + 1];
+            const uint8_t *data = ud + ie + 2;
+            if (ie + 2 + iedl > skip)
+            {
+                return fail(Error::BAD_UDH, at + ie, message);
+            }
+            if ((iei == IEI_CONCATENATED_8 && iedl == 3) || (iei == IEI_CONCATENATED_16 && iedl == 4))
+            {
+                const std::size_t wide = iei == IEI_CONCATENATED_16;
+                decoded.reference = wide ? static_cast<uint16_t>(data[0] << 8 | data[1]) : data[0];
+                decoded.count = data[1 + wide];
+                decoded.index = data[2 + wide];
+                if (decoded.count == 0 || decoded.index == 0 || decoded.index > decoded.count)
+                {
+                    return fail(Error::BAD_UDH, at + ie, message);
+                }
+                decoded.segment = true;
+            }
+            ie += 2 + iedl;
+        }
+    }
+    if (ucs2)
+    {
+        decoded.text = ucs2_text(ud, ud_length, skip);
+    }
+    else
+    {
+        // the header is padded with fill bits to a whole septet, where the text starts
+        decoded.text = {m_text, septets_text(ud, ud_length, Gsm7::first_septet(skip), udl, m_text)};
+    }
+    message = decoded;
+    return Error::NONE;
+}
+
+std::size_t PduDecoder::error_offset() const
+{
+    return m_error_offset;
+}
+
+const char *PduDecoder::to_string(Error error)
+{
+    switch (error)
+    {
+    case Error::NONE:
+        return "no error";
+    case Error::NOT_HEX:
+        return "not hex";
+    case Error::TOO_LONG:
+        return "longer than any SMS-DELIVER";
+    case Error::TRUNCATED:
+        return "truncated";
+    case Error::NOT_DELIVER:
+        return "not an SMS-DELIVER";
+    case Error::ADDRESS_TOO_LONG:
+        return "address too long";
+    case Error::BAD_UDH:
+        return "malformed user data header";
+    case Error::UNSUPPORTED_DCS:
+        return "unsupported data coding scheme";
+    }
+    return "unknown error";
+}
+
+PduDecoder::Error PduDecoder::fail(Error error, std::size_t at, Message &message)
+{
+    message = Message{};
+    m_error_offset = 2 * at;
+    return error;
+}
+
+std::string_view PduDecoder::semi_octets(const uint8_t *octets, std::size_t count, std::size_t digits, char *out)
+{
+    std::size_t written = 0;
+    for (std::size_t idx = 0; idx < count && written < digits; idx++)
+    {
+        out[written++] = DIGITS[octets[idx] & 0x0F];
+        if ((octets[idx] >> 4) != 0x0F && written < digits)
+        {
+            out[written++] = DIGITS[octets[idx] >> 4];
+        }
+    }
+    return {out, written};
+}
+
+std::string_view PduDecoder::timestamp(const uint8_t *octets)
+{
+    // yy MM dd hh mm ss as swapped BCD digits, then the zone: quarter hours with the sign in bit 3
+    static constexpr char SEPARATORS[] = "//,::";
+    char *out = m_timestamp;
+    for (int field = 0; field < 6; field++)
+    {
+        *out++ = DIGITS[octets[field] & 0x0F];
+        *out++ = DIGITS[octets[field] >> 4];
+        if (field < 5) *out++ = SEPARATORS[field];
+    }
+    const uint8_t zone = octets[6];
+    const unsigned int quarters = (zone & 0x07) * 10 + (zone >> 4);
+    *out++ = (zone & 0x08) ? '-' : '+';
+    *out++ = DIGITS[quarters / 10 % 10];
+    *out++ = DIGITS[quarters % 10];
+    return {m_timestamp, static_cast<std::size_t>(out - m_timestamp)};
+}
+
+std::size_t PduDecoder::septets_text(const uint8_t *packed, std::size_t length, std::size_t first, std::size_t count,
+                                     char *out)
+{
+    count = Gsm7::unpack(packed, length, count, m_septets);
+    return first < count ? Gsm7::to_utf8(m_septets + first, count - first, out) : 0;
+}
+
+std::string_view PduDecoder::ucs2_text(const uint8_t *ud, std::size_t length, std::size_t skip)
+{
+    return {m_text, skip < length ? Utf16::to_utf8(ud + skip, (length - skip) / 2, m_text) : 0};
+}
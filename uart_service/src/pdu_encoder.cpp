@@ -0,0 +1,284 @@
+#include "pdu_encoder.hpp"
+#include "gsm7.hpp"
+
+#include <algorithm>
+
+namespace
+{
+    constexpr char DIGITS[] = "0123456789ABCDEF";
+
+    // TP-MTI SMS-SUBMIT with a relative TP-VP, and TP-UDHI
+    constexpr uint8_t MTI_SUBMIT = 0x01;
+    constexpr uint8_t VPF_RELATIVE = 0x10;
+    constexpr uint8_t UDHI = 0x40;
+
+    // International and unknown type of number, ISDN numbering plan
+    constexpr uint8_t TYPE_INTERNATIONAL = 0x91;
+    constexpr uint8_t TYPE_UNKNOWN = 0x81;
+
+    constexpr uint8_t DCS_GSM7 = 0x00;
+    constexpr uint8_t DCS_UCS2 = 0x08;
+
+    // TP-VP in relative format: 24 hours
+    constexpr uint8_t VALIDITY_DAY = 0xA7;
+
+    // UDHL and the concatenation IE with an 8-bit reference: 05 00 03 <reference> <count> <index>
+    constexpr uint8_t IEI_CONCATENATED_8 = 0x00;
+    constexpr std::size_t UDH_OCTETS = 6;
+
+    // SMSC, first octet, TP-MR, TP-DA, TP-PID, TP-DCS, TP-VP, TP-UDL and 140 octets of user data
+    constexpr std::size_t MAX_PDU = 1 + 2 + 2 + PduEncoder::MAX_DIGITS / 2 + 4 + PduEncoder::MAX_OCTETS;
+
+    bool is_high_surrogate(const uint8_t *be)
+    {
+        return (be[0] & 0xFC) == 0xD8;
+    }
+}
+
+PduEncoder::Error PduEncoder::encode(std::string_view recipient, std::string_view text, uint8_t reference,
+                                     std::vector<Pdu> &parts)
+{
+    // parts keeps its strings from the last message unless an error empties it
+    const auto error = prepare(recipient, text);
+    if (error != Error::NONE)
+    {
+        parts.clear();
+        return error;
+    }
+    const bool septets = m_septets;
+    parts.resize(m_ends.size());
+    const std::size_t count = m_ends.size();
+    for (std::size_t idx = 0, begin = 0; idx < count; begin = m_ends[idx++])
+    {
+        submit(septets, begin, m_ends[idx], reference, count > 1 ? idx + 1 : 0, count, parts[idx]);
+    }
+    return Error::NONE;
+}
+
+PduEncoder::Error PduEncoder::prepare(std::string_view recipient, std::string_view text)
+{
+    // TP-DA: its length in digits, the type of address and the semi-octets, an F nibble filling
+    const bool international = !recipient.empty() && recipient[0] == '+';
+    const auto digits = recipient.substr(international ? 1 : 0);
+    if (digits.empty() || digits.size() > MAX_DIGITS ||
+        !std::all_of(digits.begin(), digits.end(), [](char each)
+                     { return each >= '0' && each <= '9'; }))
+    {
+        return Error::BAD_NUMBER;
+    }
+    m_address[0] = static_cast<uint8_t>(digits.size());
+    m_address[1] = international ? TYPE_INTERNATIONAL : TYPE_UNKNOWN;
+    for (std::size_t idx = 0; idx < digits.size(); idx += 2)
+    {
+        const unsigned int high = idx + 1 < digits.size() ? digits[idx + 1] - '0' : 0xF;
+        m_address[2 + idx / 2] = static_cast<uint8_t>(high << 4 | (digits[idx] - '0'));
+    }
+    m_address_length = 2 + (digits.size() + 1) / 2;
+
+    if (text.empty())
+    {
+        return Error::EMPTY;
+    }
+    for (std::size_t at = 0; at < text.size();)
+    {
+        if (char32_t code_point; !next_code_point(text, at, code_point))
+        {
+            return Error::NOT_UTF8;
+        }
+    }
+
+    m_septets = to_septets(text);
+    if (m_septets)
+    {
+        cut(true, MAX_SEPTETS, MAX_PART_SEPTETS);
+    }
+    else
+    {
+        to_ucs2(text);
+        cut(false, MAX_OCTETS, MAX_PART_OCTETS);
+    }
+    return m_ends.size() > MAX_PARTS ? Error::TOO_LONG : Error::NONE;
+}
+
+bool PduEncoder::next_code_point(std::string_view text, std::size_t &at, char32_t &code_point)
+{
+    const auto lead = static_cast<uint8_t>(text[at]);
+    std::size_t length;
+    char32_t least;
+    if (lead < 0x80)
+    {
+        code_point = lead;
+        at++;
+        return true;
+    }
+    else if ((lead & 0xE0) == 0xC0)
+    {
+        length = 2;
+        least = 0x80;
+        code_point = lead & 0x1F;
+    }
+    else if ((lead & 0xF0) == 0xE0)
+    {
+        length = 3;
+        least = 0x800;
+        code_point = lead & 0x0F;
+    }
+    else if ((lead & 0xF8) == 0xF0)
+    {
+        length = 4;
+        least = 0x10000;
+        code_point = lead & 0x07;
+    }
+    else
+    {
+        return false;
+    }
+    if (at + length > text.size())
+    {
+        return false;
+    }
+    for (std::size_t idx = 1; idx < length; idx++)
+    {
+        const auto continuation = static_cast<uint8_t>(text[at + idx]);
+        if ((continuation & 0xC0) != 0x80)
+        {
+            return false;
+        }
+        code_point = code_point << 6 | (continuation & 0x3F);
+    }
+    // neither overlong, nor a surrogate, nor beyond Unicode
+    if (code_point < least || (code_point >= 0xD800 && code_point < 0xE000) || code_point > 0x10FFFF)
+    {
+        return false;
+    }
+    at += length;
+    return true;
+}
+
+bool PduEncoder::to_septets(std::string_view text)
+{
+    m_units.clear();
+    for (std::size_t at = 0; at < text.size();)
+    {
+        char32_t code_point;
+        next_code_point(text, at, code_point);
+        uint8_t septets[2];
+        const std::size_t count = Gsm7::from_code_point(code_point, septets);
+        if (count == 0)
+        {
+            return false;
+        }
+        m_units.insert(m_units.end(), septets, septets + count);
+    }
+    return true;
+}
+
+void PduEncoder::to_ucs2(std::string_view text)
+{
+    m_units.clear();
+    for (std::size_t at = 0; at < text.size();)
+    {
+        char32_t code_point;
+        next_code_point(text, at, code_point);
+        if (code_point >= 0x10000)
+        {
+            const char32_t offset = code_point - 0x10000;
+            const char32_t high = 0xD800 | offset >> 10;
+            const char32_t low = 0xDC00 | (offset & 0x3FF);
+            m_units.insert(m_units.end(), {static_cast<uint8_t>(high >> 8), static_cast<uint8_t>(high),
+                                           static_cast<uint8_t>(low >> 8), static_cast<uint8_t>(low)});
+        }
+        else
+        {
+            m_units.insert(m_units.end(), {static_cast<uint8_t>(code_point >> 8), static_cast<uint8_t>(code_point)});
+        }
+    }
+}
+
+void PduEncoder::cut(bool septets, std::size_t single, std::size_t per_part)
+{
+    m_ends.clear();
+    const std::size_t size = m_units.size();
+    if (size <= single)
+    {
+        m_ends.push_back(size);
+        return;
+    }
+    for (std::size_t begin = 0; begin < size;)
+    {
+        std::size_t end = std::min(begin + per_part, size);
+        if (end < size)
+        {
+            // an escape goes with its character, a high surrogate with its low one
+            if (septets && m_units[end - 1] == Gsm7::ESCAPE) end--;
+            if (!septets && is_high_surrogate(&m_units[end - 2])) end -= 2;
+        }
+        m_ends.push_back(end);
+        begin = end;
+    }
+}
+
+void PduEncoder::submit(bool septets, std::size_t begin, std::size_t end, uint8_t reference, std::size_t index,
+                        std::size_t count, Pdu &pdu)
+{
+    m_octets.resize(MAX_PDU);
+    std::size_t at = 0;
+    m_octets[at++] = 0; // the SMSC of the SIM
+    m_octets[at++] = MTI_SUBMIT | VPF_RELATIVE | (index != 0 ? UDHI : 0);
+    m_octets[at++] = 0; // TP-MR, set by the modem
+    std::copy(m_address, m_address + m_address_length, m_octets.begin() + at);
+    at += m_address_length;
+    m_octets[at++] = 0; // TP-PID
+    m_octets[at++] = septets ? DCS_GSM7 : DCS_UCS2;
+    m_octets[at++] = VALIDITY_DAY;
+
+    const std::size_t udl_at = at++;
+    const std::size_t header = index != 0 ? UDH_OCTETS : 0;
+    if (index != 0)
+    {
+        const uint8_t udh[UDH_OCTETS] = {UDH_OCTETS - 1, IEI_CONCATENATED_8, 3, reference, static_cast<uint8_t>(count),
+                                         static_cast<uint8_t>(index)};
+        std::copy(udh, udh + UDH_OCTETS, m_octets.begin() + at);
+        at += UDH_OCTETS;
+    }
+    if (septets)
+    {
+        // TP-UDL counts septets, the header and its fill bits included
+        const std::size_t first = header != 0 ? Gsm7::first_septet(header) : 0;
+        m_octets[udl_at] = static_cast<uint8_t>(first + end - begin);
+        at += Gsm7::pack(m_units.data() + begin, end - begin, static_cast<unsigned int>(first * 7 - header * 8),
+                         m_octets.data() + at);
+    }
+    else
+    {
+        m_octets[udl_at] = static_cast<uint8_t>(header + end - begin);
+        std::copy(m_units.begin() + begin, m_units.begin() + end, m_octets.begin() + at);
+        at += end - begin;
+    }
+
+    pdu.tpdu_length = at - 1;
+    pdu.hex.resize(2 * at);
+    for (std::size_t idx = 0; idx < at; idx++)
+    {
+        pdu.hex[2 * idx] = DIGITS[m_octets[idx] >> 4];
+        pdu.hex[2 * idx + 1] = DIGITS[m_octets[idx] & 0x0F];
+    }
+}
+
+const char *PduEncoder::to_string(Error error)
+{
+    switch (error)
+    {
+    case Error::NONE:
+        return "no error";
+    case Error::BAD_NUMBER:
+        return "not a phone number";
+    case Error::NOT_UTF8:
+        return "not UTF-8";
+    case Error::EMPTY:
+        return "no text";
+    case Error::TOO_LONG:
+        return "more parts than a concatenated message takes";
+    }
+    return "unknown error";
+}
@@ -0,0 +1,245 @@
+#include "reactor.hpp"
+#include "error.hpp"
+
+#include <csignal>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+namespace
+{
+    constexpr int MAX_EVENTS = 16;
+
+    struct itimerspec to_itimerspec(std::chrono::milliseconds delay, std::chrono::milliseconds interval)
+    {
+        struct itimerspec spec{};
+        spec.it_value.tv_sec = delay.count() / 1000;
+        spec.it_value.tv_nsec = (delay.count() % 1000) * 1000000;
+        spec.it_interval.tv_sec = interval.count() / 1000;
+        spec.it_interval.tv_nsec = (interval.count() % 1000) * 1000000;
+        return spec;
+    }
+}
+
+void Reactor::Latency::record(Clock::duration sample)
+{
+    ++count;
+    total += sample;
+    if (sample > max) max = sample;
+}
+
+Reactor::Reactor()
+{
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll_fd < 0)
+    {
+        throw Utils::Error::SystemError("epoll_create1", errno);
+    }
+    m_post_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_post_fd < 0)
+    {
+        throw Utils::Error::SystemError("eventfd", errno);
+    }
+    add(m_post_fd, EPOLLIN, "posted", [this](uint32_t)
+        {
+            uint64_t count = 0;
+            if (read(m_post_fd, &count, sizeof(count)) != sizeof(count)) return;
+            std::vector<Task> tasks;
+            {
+                std::lock_guard lock(m_posted_mtx);
+                tasks.swap(m_posted);
+            }
+            for (auto &task : tasks) task();
+        });
+    m_sources[m_post_fd].owned = true;
+}
+
+Reactor::~Reactor()
+{
+    for (const auto &[fd, source] : m_sources)
+    {
+        if (source.owned) ::close(fd);
+    }
+    ::close(m_epoll_fd);
+}
+
+void Reactor::add(int fd, uint32_t events, std::string name, IOHandler handler)
+{
+    struct epoll_event event{};
+    event.events = events;
+    event.data.fd = fd;
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+    {
+        throw Utils::Error::SystemError("epoll_ctl(ADD, " + name + ")", errno);
+    }
+    auto &source = m_sources[fd];
+    source.name = std::move(name);
+    source.handler = std::move(handler);
+}
+
+void Reactor::modify(int fd, uint32_t events)
+{
+    struct epoll_event event{};
+    event.events = events;
+    event.data.fd = fd;
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, fd, &event) != 0)
+    {
+        throw Utils::Error::SystemError("epoll_ctl(MOD)", errno);
+    }
+}
+
+void Reactor::remove(int fd)
+{
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    if (auto source = m_sources.find(fd); source != m_sources.end())
+    {
+        if (source->second.owned) ::close(fd);
+        m_sources.erase(source);
+    }
+}
+
+int Reactor::add_timer(std::string name, std::chrono::milliseconds delay, std::chrono::milliseconds interval, TimerHandler handler)
+{
+    int timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer < 0)
+    {
+        throw Utils::Error::SystemError("timerfd_create", errno);
+    }
+    add(timer, EPOLLIN, std::move(name), [timer, handler = std::move(handler)](uint32_t)
+        {
+            uint64_t expirations = 0;
+            if (read(timer, &expirations, sizeof(expirations)) == sizeof(expirations)) handler();
+        });
+    m_sources[timer].owned = true;
+    if (delay.count() > 0) rearm_timer(timer, delay, interval);
+    return timer;
+}
+
+void Reactor::rearm_timer(int timer, std::chrono::milliseconds delay, std::chrono::milliseconds interval)
+{
+    // a zero it_value would disarm the timer: fire "now" instead
+    auto spec = to_itimerspec(delay.count() > 0 ? delay : std::chrono::milliseconds(1), interval);
+    if (timerfd_settime(timer, 0, &spec, nullptr) != 0)
+    {
+        throw Utils::Error::SystemError("timerfd_settime", errno);
+    }
+}
+
+void Reactor::disarm_timer(int timer)
+{
+    auto spec = to_itimerspec(std::chrono::milliseconds::zero(), std::chrono::milliseconds::zero());
+    timerfd_settime(timer, 0, &spec, nullptr);
+}
+
+void Reactor::cancel_timer(int timer)
+{
+    remove(timer);
+}
+
+void Reactor::watch_signals(std::initializer_list<int> signals, SignalHandler handler)
+{
+    sigset_t mask;
+    sigemptyset(&mask);
+    for (const auto each : signals) sigaddset(&mask, each);
+    if (pthread_sigmask(SIG_BLOCK, &mask, nullptr) != 0)
+    {
+        throw Utils::Error::SystemError("pthread_sigmask", errno);
+    }
+
+    if (m_signal_fd >= 0) remove(m_signal_fd);
+    m_signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (m_signal_fd < 0)
+    {
+        throw Utils::Error::SystemError("signalfd", errno);
+    }
+    const int fd = m_signal_fd;
+    add(fd, EPOLLIN, "signal", [fd, handler = std::move(handler)](uint32_t)
+        {
+            struct signalfd_siginfo info;
+            while (read(fd, &info, sizeof(info)) == sizeof(info)) handler(static_cast<int>(info.ssi_signo));
+        });
+    m_sources[fd].owned = true;
+}
+
+void Reactor::post(Task task)
+{
+    {
+        std::lock_guard lock(m_posted_mtx);
+        m_posted.push_back(std::move(task));
+    }
+    const uint64_t one = 1;
+    if (write(m_post_fd, &one, sizeof(one)) != sizeof(one))
+    {
+        throw Utils::Error::SystemError("write(eventfd)", errno);
+    }
+}
+
+bool Reactor::run_once(int timeout_ms)
+{
+    struct epoll_event events[MAX_EVENTS];
+    int ready = epoll_wait(m_epoll_fd, events, MAX_EVENTS, timeout_ms);
+    if (ready < 0)
+    {
+        if (errno == EINTR) return false;
+        throw Utils::Error::SystemError("epoll_wait", errno);
+    }
+    const auto woken = Clock::now();
+    for (int idx = 0; idx < ready; idx++)
+    {
+        const int fd = events[idx].data.fd;
+        auto source = m_sources.find(fd);
+        if (source == m_sources.end()) continue; // removed by an earlier handler of this batch
+
+        // the handler may remove (or replace) its own source: keep it alive outside the map while it runs
+        auto handler = std::move(source->second.handler);
+        const auto started = Clock::now();
+        handler(events[idx].events);
+        const auto finished = Clock::now();
+
+        if (source = m_sources.find(fd); source != m_sources.end())
+        {
+            if (!source->second.handler) source->second.handler = std::move(handler);
+            source->second.wait.record(started - woken);
+            source->second.busy.record(finished - started);
+        }
+    }
+    return ready > 0;
+}
+
+void Reactor::run()
+{
+    m_running = true;
+    while (m_running)
+    {
+        run_once(-1);
+    }
+}
+
+void Reactor::stop()
+{
+    m_running = false;
+}
+
+bool Reactor::is_running() const
+{
+    return m_running;
+}
+
+void Reactor::dump_latency(std::ostream &os) const
+{
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    os << "Event loop latency (us): source, events, wait mean/max, handler mean/max" << std::endl;
+    for (const auto &[fd, source] : m_sources)
+    {
+        if (source.busy.count == 0) continue;
+        os << '\t' << source.name << ", " << source.busy.count
+           << ", " << duration_cast<microseconds>(source.wait.total).count() / source.wait.count
+           << '/' << duration_cast<microseconds>(source.wait.max).count()
+           << ", " << duration_cast<microseconds>(source.busy.total).count() / source.busy.count
+           << '/' << duration_cast<microseconds>(source.busy.max).count() << std::endl;
+    }
+}
@@ -0,0 +1,162 @@
+#include "reassembler.hpp"
+
+#include <algorithm>
+#include <functional>
+
+namespace
+{
+    // What an entry takes besides the text of its parts
+    std::size_t overhead(std::size_t count, std::size_t sender)
+    {
+        return 128 + sender + count * (sizeof(std::string) + 1);
+    }
+}
+
+bool Reassembler::Key::operator==(const Key &other) const
+{
+    return reference == other.reference && count == other.count && sender == other.sender;
+}
+
+std::size_t Reassembler::KeyHash::operator()(const Key &key) const
+{
+    return std::hash<std::string>{}(key.sender) ^ ((std::size_t{key.reference} << 8 | key.count) * 0x9E3779B97F4A7C15ull);
+}
+
+Reassembler::Reassembler(std::chrono::milliseconds timeout, std::size_t limit_bytes, std::size_t shards)
+    : m_timeout(timeout), m_shard_limit(std::max<std::size_t>(1, limit_bytes / std::max<std::size_t>(1, shards)))
+{
+    for (std::size_t idx = 0; idx < std::max<std::size_t>(1, shards); idx++)
+    {
+        m_shards.push_back(std::make_unique<Shard>());
+    }
+}
+
+void Reassembler::add(SMS part, std::vector<SMS> &ready, Clock::time_point now)
+{
+    Key key{part.get_sender(), part.get_reference(), static_cast<uint8_t>(part.get_count())};
+    auto &shard = *m_shards[KeyHash{}(key) % m_shards.size()];
+    const unsigned int index = part.get_index();
+    std::lock_guard lock(shard.mtx);
+
+    auto entry = shard.entries.find(key);
+    if (entry == shard.entries.end())
+    {
+        const std::size_t count = key.count;
+        entry = shard.entries.emplace(std::move(key), Entry{part.whole({}), {}, {}, 0, 0, now + m_timeout, {}}).first;
+        entry->second.texts.resize(count);
+        entry->second.arrived.resize(count);
+        entry->second.bytes = overhead(count, entry->first.sender.size());
+        entry->second.order = shard.order.insert(shard.order.end(), &entry->first);
+        shard.bytes += entry->second.bytes;
+    }
+    auto &waiting = entry->second;
+    if (waiting.arrived[index])
+    {
+        // the modem handed the same part on twice, e.g. read again after a failed delete
+        shard.stats.duplicates++;
+        return;
+    }
+    waiting.arrived[index] = true;
+    waiting.bytes += part.get_content().size();
+    shard.bytes += part.get_content().size();
+    waiting.texts[index] = part.get_content();
+    if (++waiting.received == waiting.texts.size())
+    {
+        shard.stats.completed++;
+        ready.push_back(take(shard, entry));
+        return;
+    }
+
+    // the oldest first, but never the message the part just went to
+    while (shard.bytes > m_shard_limit && shard.order.front() != &entry->first)
+    {
+        shard.stats.evicted++;
+        ready.push_back(take(shard, shard.entries.find(*shard.order.front())));
+    }
+}
+
+void Reassembler::expire(std::vector<SMS> &ready, Clock::time_point now)
+{
+    for (auto &each : m_shards)
+    {
+        auto &shard = *each;
+        std::lock_guard lock(shard.mtx);
+        while (!shard.order.empty())
+        {
+            const auto entry = shard.entries.find(*shard.order.front());
+            if (entry->second.deadline > now)
+            {
+                break;
+            }
+            shard.stats.expired++;
+            ready.push_back(take(shard, entry));
+        }
+    }
+}
+
+std::optional<Reassembler::Clock::time_point> Reassembler::next_deadline() const
+{
+    std::optional<Clock::time_point> next;
+    for (const auto &each : m_shards)
+    {
+        std::lock_guard lock(each->mtx);
+        if (!each->order.empty())
+        {
+            const auto deadline = each->entries.find(*each->order.front())->second.deadline;
+            if (!next || deadline < *next) next = deadline;
+        }
+    }
+    return next;
+}
+
+Reassembler::Stats Reassembler::stats() const
+{
+    Stats total;
+    for (const auto &each : m_shards)
+    {
+        std::lock_guard lock(each->mtx);
+        total.completed += each->stats.completed;
+        total.expired += each->stats.expired;
+        total.evicted += each->stats.evicted;
+        total.duplicates += each->stats.duplicates;
+        total.waiting += each->entries.size();
+        total.bytes += each->bytes;
+    }
+    return total;
+}
+
+void Reassembler::report(std::ostream &os) const
+{
+    const auto total = stats();
+    os << "Long SMS: " << total.completed << " joined, " << total.expired << " relayed incomplete after the timeout, "
+       << total.evicted << " to stay within the limit, " << total.duplicates << " parts received twice; "
+       << total.waiting << " waiting for parts in " << total.bytes << " bytes" << std::endl;
+}
+
+SMS Reassembler::take(Shard &shard, Entries::iterator entry)
+{
+    auto &waiting = entry->second;
+    std::size_t size = 0;
+    for (std::size_t idx = 0; idx < waiting.texts.size(); idx++)
+    {
+        size += waiting.arrived[idx] ? waiting.texts[idx].size() : MISSING.size();
+    }
+    std::string text;
+    text.reserve(size);
+    for (std::size_t idx = 0; idx < waiting.texts.size(); idx++)
+    {
+        if (waiting.arrived[idx])
+        {
+            text += waiting.texts[idx];
+        }
+        else
+        {
+            text += MISSING;
+        }
+    }
+    SMS message = waiting.first.whole(std::move(text));
+    shard.bytes -= waiting.bytes;
+    shard.order.erase(waiting.order);
+    shard.entries.erase(entry);
+    return message;
+}
@@ -0,0 +1,338 @@
+#include "traffic_capture.hpp"
+#include "line_framer.hpp"
+#include "cmux.hpp"
+#include "urc.hpp"
+#include "sms.hpp"
+#include "error.hpp"
+
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+
+namespace
+{
+    // The unsolicited results the service handles, from its own list, whether or not a PDU follows
+    constexpr auto RECOGNISED = make_urc_table<bool>(SERVICE_URCS, [](std::string_view)
+                                                     { return true; });
+
+    // The information responses that carry PDUs on the next line
+    constexpr auto PDU_RESPONSES = make_urc_table<bool>({
+        {"+CMGR", true, true},
+        {"+CMGL", true, true},
+    });
+
+    /**
+     * What the modem sent in a capture, through the service's line framing, the recognition of unsolicited
+     * results and the SMS decoder; the service's own writes only tell which command a reply answers and
+     * when the port is multiplexed. Every PDU that does not decode is reported with where it is in the file.
+     */
+    class Replay
+    {
+    public:
+        explicit Replay(bool verbose) : m_verbose(verbose)
+        {
+        }
+
+        void play(const TrafficCapture::Record &record)
+        {
+            m_record = &record;
+            if (record.direction == TrafficCapture::Direction::OUT)
+            {
+                m_bytes_out += record.data.size();
+                sent(record.data);
+                return;
+            }
+            m_bytes_in += record.data.size();
+            if (m_multiplexed)
+            {
+                demultiplex(record.data);
+                return;
+            }
+            for (auto data = record.data; !data.empty();)
+            {
+                const auto taken = m_framer.feed(data.data(), data.size());
+                data.remove_prefix(taken);
+                for (std::string_view line; m_framer.next(line);)
+                {
+                    received(0, line);
+                    if (m_multiplexed)
+                    {
+                        // what follows the OK of AT+CMUX is frames
+                        const std::string rest = std::string(m_framer.partial()) + std::string(data);
+                        m_framer.clear();
+                        demultiplex(rest);
+                        return;
+                    }
+                }
+            }
+        }
+
+        void summary(std::ostream &os, double seconds, std::chrono::microseconds recorded) const
+        {
+            const double recorded_seconds = recorded.count() / 1e6;
+            os << m_bytes_in << " bytes in, " << m_bytes_out << " out; " << m_lines << " lines, " << m_pdus_ok
+               << " PDUs decoded, " << m_pdus_failed << " failed";
+            if (m_decoder.frames() > 0)
+            {
+                os << "; " << m_decoder.frames() << " CMUX frames, " << m_decoder.bad_fcs() << " with a bad FCS";
+            }
+            os << '\n';
+            for (const auto &[name, count] : m_urcs)
+            {
+                os << '\t' << name << ": " << count << '\n';
+            }
+            os << "Replayed " << recorded_seconds << " s of traffic in " << seconds << " s";
+            if (seconds > 0)
+            {
+                os << ": " << m_lines / seconds << " lines/s, " << m_bytes_in / seconds / 1e6 << " MB/s";
+            }
+            os << std::endl;
+        }
+
+        unsigned long failures() const
+        {
+            return m_pdus_failed;
+        }
+
+    private:
+        // The command lines the service wrote, to name what the replies that follow answer
+        void sent(std::string_view data)
+        {
+            if (m_multiplexed)
+            {
+                m_out_decoder.feed(data.data(), data.size());
+                for (Cmux::Frame frame; m_out_decoder.next(frame);)
+                {
+                    if (frame.dlci == 0 && !frame.info.empty() && static_cast<uint8_t>(frame.info[0]) == Cmux::CLD)
+                    {
+                        m_closing = true;
+                    }
+                    else if (frame.dlci != 0 && frame.control == Cmux::UIH)
+                    {
+                        remember_command(frame.dlci, frame.info);
+                    }
+                }
+                return;
+            }
+            remember_command(0, data);
+        }
+
+        void remember_command(unsigned int dlci, std::string_view data)
+        {
+            auto &command = m_commands[dlci];
+            auto &pending = m_pending_commands[dlci];
+            for (const char each : data)
+            {
+                if (each == '\r' || each == '\n')
+                {
+                    if (pending.empty()) continue;
+                    command = std::exchange(pending, {});
+                    if (dlci == 0 && command.rfind("AT+CMUX=0", 0) == 0) m_cmux_requested = true;
+                    if (m_verbose) std::cout << at() << " DLC " << dlci << " > " << command << std::endl;
+                    continue;
+                }
+                pending += each;
+            }
+        }
+
+        void demultiplex(std::string_view data)
+        {
+            m_decoder.feed(data.data(), data.size());
+            for (Cmux::Frame frame; m_decoder.next(frame);)
+            {
+                if (frame.dlci == 0)
+                {
+                    // the modem confirming the CLD of the service: plain AT from here on
+                    if (m_closing && frame.info.size() >= 1 &&
+                        static_cast<uint8_t>(frame.info[0]) == (Cmux::CLD & ~Cmux::MESSAGE_COMMAND))
+                    {
+                        m_multiplexed = m_closing = false;
+                        m_decoder.clear();
+                        return;
+                    }
+                    continue;
+                }
+                if (frame.dlci > Cmux::MAX_DLCI || (frame.control != Cmux::UIH && frame.control != Cmux::UI))
+                {
+                    continue;
+                }
+                auto &framer = m_channels[frame.dlci];
+                for (auto info = frame.info; !info.empty();)
+                {
+                    info.remove_prefix(framer.feed(info.data(), info.size()));
+                    for (std::string_view line; framer.next(line);)
+                    {
+                        received(frame.dlci, line);
+                    }
+                }
+            }
+        }
+
+        void received(unsigned int dlci, std::string_view line)
+        {
+            m_lines++;
+            if (m_verbose) std::cout << at() << " DLC " << dlci << " < " << line << std::endl;
+            if (auto &header = m_pdu_header[dlci]; !header.empty())
+            {
+                decode(dlci, header, line);
+                header.clear();
+                return;
+            }
+            const auto *entry = RECOGNISED.find(line);
+            if (entry == nullptr) entry = PDU_RESPONSES.find(line);
+            if (entry != nullptr)
+            {
+                m_urcs[std::string(entry->name)]++;
+                if (entry->has_body) m_pdu_header[dlci].assign(line);
+                return;
+            }
+            if (line == "OK" && m_cmux_requested && dlci == 0)
+            {
+                m_cmux_requested = false;
+                m_multiplexed = true;
+            }
+        }
+
+        void decode(unsigned int dlci, const std::string &header, std::string_view pdu)
+        {
+            try
+            {
+                SMS message{std::string(pdu)};
+                m_pdus_ok++;
+            }
+            catch (const std::exception &error)
+            {
+                m_pdus_failed++;
+                std::cerr << at() << " DLC " << dlci << ", record at byte " << m_record->offset << ": " << header
+                          << " after " << m_commands[dlci] << " carries a PDU that does not decode: " << error.what()
+                          << "\n\t" << pdu << std::endl;
+            }
+        }
+
+        std::string at() const
+        {
+            std::ostringstream os;
+            os << '[' << std::fixed << std::setprecision(6) << m_record->at.count() / 1e6 << ']';
+            return os.str();
+        }
+
+        const bool m_verbose;
+
+        const TrafficCapture::Record *m_record = nullptr;
+
+        LineFramer m_framer;
+
+        bool m_cmux_requested = false;
+
+        bool m_multiplexed = false;
+
+        bool m_closing = false;
+
+        CmuxDecoder m_decoder;
+
+        CmuxDecoder m_out_decoder;
+
+        std::map<unsigned int, LineFramer> m_channels;
+
+        // per DLC: the last command written, the one being written, the header line of a PDU to come
+        std::map<unsigned int, std::string> m_commands;
+
+        std::map<unsigned int, std::string> m_pending_commands;
+
+        std::map<unsigned int, std::string> m_pdu_header;
+
+        std::map<std::string, unsigned long> m_urcs;
+
+        unsigned long m_lines = 0;
+
+        unsigned long m_pdus_ok = 0;
+
+        unsigned long m_pdus_failed = 0;
+
+        std::size_t m_bytes_in = 0;
+
+        std::size_t m_bytes_out = 0;
+    };
+
+    void usage(const char *self)
+    {
+        std::cout << "Usage: " << self << " [--speed FACTOR] [--verbose] CAPTURE\n"
+                  << "Replays a capture recorded by cellular_uart_service (serial: capture: file:) through its line\n"
+                  << "framing, unsolicited result codes and SMS decoding, as fast as possible unless a speed is given\n"
+                  << "(1 for the pace it was recorded at). Exits with 2 if any PDU failed to decode." << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::signal(SIGABRT, Utils::Error::crash_printer);
+    std::signal(SIGSEGV, Utils::Error::crash_printer);
+
+    double speed = 0; // as fast as possible
+    bool verbose = false;
+    std::string path;
+    for (int idx = 1; idx < argc; idx++)
+    {
+        if (std::strcmp(argv[idx], "--speed") == 0 && idx + 1 < argc)
+        {
+            speed = std::atof(argv[++idx]);
+        }
+        else if (std::strcmp(argv[idx], "--verbose") == 0 || std::strcmp(argv[idx], "-v") == 0)
+        {
+            verbose = true;
+        }
+        else if (argv[idx][0] != '-' && path.empty())
+        {
+            path = argv[idx];
+        }
+        else
+        {
+            usage(argv[0]);
+            return std::strcmp(argv[idx], "-h") == 0 || std::strcmp(argv[idx], "--help") == 0 ? 0 : 1;
+        }
+    }
+    if (path.empty())
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    try
+    {
+        TrafficCapture::Reader capture(path);
+        const auto started = std::chrono::system_clock::to_time_t(capture.started());
+        std::cout << "Capture of " << capture.device() << " at " << capture.baud() << " baud, started "
+                  << std::put_time(std::localtime(&started), "%F %T") << std::endl;
+
+        Replay replay(verbose);
+        TrafficCapture::Record record;
+        const auto start = std::chrono::steady_clock::now();
+        while (capture.next(record))
+        {
+            if (speed > 0)
+            {
+                std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                          record.at / speed));
+            }
+            replay.play(record);
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        replay.summary(std::cout, seconds, record.at);
+        return replay.failures() == 0 ? 0 : 2;
+    }
+    catch (const std::exception &error)
+    {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+}
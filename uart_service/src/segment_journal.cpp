@@ -0,0 +1,375 @@
+#include "segment_journal.hpp"
+#include "error.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr std::string_view MAGIC{"SMSJRNL\x01", 8};
+
+    struct RecordHeader
+    {
+        uint32_t length; // of the key and the PDU
+        uint32_t generation;
+        uint32_t checksum;
+        uint8_t kind;
+        uint8_t padding;
+        uint16_t key_length;
+    };
+
+    static_assert(sizeof(RecordHeader) == 16, "records are laid out without holes");
+
+    // FNV-1a over the generation, kind, key length and body, which is what a torn write garbles
+    uint32_t checksum(const RecordHeader &record, std::string_view body)
+    {
+        uint32_t hash = 2166136261u;
+        const auto add = [&hash](const void *data, std::size_t size)
+        {
+            for (std::size_t idx = 0; idx < size; idx++)
+            {
+                hash = (hash ^ static_cast<const uint8_t *>(data)[idx]) * 16777619u;
+            }
+        };
+        add(&record.generation, sizeof(record.generation));
+        add(&record.kind, sizeof(record.kind));
+        add(&record.key_length, sizeof(record.key_length));
+        add(body.data(), body.size());
+        return hash;
+    }
+
+    // Lay a record out at out, which takes sizeof(RecordHeader) + key and pdu bytes
+    void encode(char *out, uint32_t generation, uint8_t kind, std::string_view key, std::string_view pdu)
+    {
+        RecordHeader record{static_cast<uint32_t>(key.size() + pdu.size()), generation, 0, kind, 0,
+                            static_cast<uint16_t>(key.size())};
+        std::memcpy(out + sizeof(record), key.data(), key.size());
+        std::memcpy(out + sizeof(record) + key.size(), pdu.data(), pdu.size());
+        record.checksum = checksum(record, {out + sizeof(record), record.length});
+        std::memcpy(out, &record, sizeof(record));
+    }
+
+    std::size_t page_size()
+    {
+        static const std::size_t size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        return size;
+    }
+}
+
+SegmentJournal::SegmentJournal(const std::string &path) : m_path(path)
+{
+    m_fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (m_fd < 0)
+    {
+        throw Utils::Error::SystemError("open(" + path + ")", errno);
+    }
+    try
+    {
+        struct stat file{};
+        if (fstat(m_fd, &file) != 0)
+        {
+            throw Utils::Error::SystemError("fstat(" + path + ")", errno);
+        }
+        if (file.st_size == 0)
+        {
+            if (const int error = posix_fallocate(m_fd, 0, CHUNK); error != 0)
+            {
+                throw Utils::Error::SystemError("posix_fallocate(" + path + ")", error);
+            }
+            map(CHUNK);
+            std::memcpy(m_map, MAGIC.data(), MAGIC.size());
+            std::memcpy(m_map + MAGIC.size(), &m_generation, sizeof(m_generation));
+            m_dirty = 0;
+        }
+        else
+        {
+            map(static_cast<std::size_t>(file.st_size));
+            if (m_mapped < HEADER || std::string_view(m_map, MAGIC.size()) != MAGIC)
+            {
+                throw Utils::Error::ParserError(path + " is not a segment journal of cellular_uart_service");
+            }
+            std::memcpy(&m_generation, m_map + MAGIC.size(), sizeof(m_generation));
+        }
+    }
+    catch (...)
+    {
+        if (m_map != nullptr) munmap(m_map, m_mapped);
+        close(m_fd);
+        throw;
+    }
+
+    m_end = scan([this](Kind kind, std::string_view key, std::string_view pdu)
+                 {
+                     if (kind == Kind::PART)
+                     {
+                         auto &waiting = m_waiting[std::string(key)];
+                         waiting.records++;
+                         waiting.bytes += RECORD + key.size() + pdu.size();
+                         m_waiting_records++;
+                         m_waiting_bytes += RECORD + key.size() + pdu.size();
+                     }
+                     else if (const auto released = m_waiting.find(std::string(key)); released != m_waiting.end())
+                     {
+                         m_waiting_records -= released->second.records;
+                         m_waiting_bytes -= released->second.bytes;
+                         m_waiting.erase(released);
+                     } });
+    // a new file's header is to be written out, an old one's records are there already
+    m_dirty = m_dirty == 0 ? 0 : m_end;
+    sync();
+}
+
+SegmentJournal::~SegmentJournal()
+{
+    sync();
+    munmap(m_map, m_mapped);
+    close(m_fd);
+}
+
+std::vector<SegmentJournal::Segment> SegmentJournal::segments() const
+{
+    std::lock_guard lock(m_mtx);
+    return waiting();
+}
+
+void SegmentJournal::append(std::string_view key, std::string_view pdu)
+{
+    std::lock_guard lock(m_mtx);
+    put(Kind::PART, key, pdu);
+    auto &waiting = m_waiting[std::string(key)];
+    waiting.records++;
+    waiting.bytes += RECORD + key.size() + pdu.size();
+    m_waiting_records++;
+    m_waiting_bytes += RECORD + key.size() + pdu.size();
+    m_stats.appended++;
+}
+
+void SegmentJournal::release(std::string_view key)
+{
+    std::lock_guard lock(m_mtx);
+    const auto released = m_waiting.find(std::string(key));
+    if (released == m_waiting.end())
+    {
+        return;
+    }
+    m_waiting_records -= released->second.records;
+    m_waiting_bytes -= released->second.bytes;
+    m_waiting.erase(released);
+    try
+    {
+        if (m_waiting.empty())
+        {
+            reset();
+            return;
+        }
+        put(Kind::RELEASE, key, {});
+        if (m_end > CHUNK && m_end - HEADER > 2 * m_waiting_bytes)
+        {
+            compact();
+        }
+    }
+    catch (const std::exception &error)
+    {
+        std::cerr << "Segment journal " << m_path << ": " << error.what() << "; the parts of " << key
+                  << " come back after a restart" << std::endl;
+    }
+}
+
+bool SegmentJournal::sync()
+{
+    std::lock_guard lock(m_mtx);
+    if (m_dirty >= m_end)
+    {
+        return true;
+    }
+    const std::size_t from = m_dirty / page_size() * page_size();
+    if (msync(m_map + from, m_end - from, MS_SYNC) != 0)
+    {
+        std::cerr << "Segment journal " << m_path << ": " << Utils::Error::SystemError("msync", errno).what() << std::endl;
+        return false;
+    }
+    m_dirty = m_end;
+    m_stats.syncs++;
+    return true;
+}
+
+SegmentJournal::Stats SegmentJournal::stats() const
+{
+    std::lock_guard lock(m_mtx);
+    Stats stats = m_stats;
+    stats.waiting = m_waiting_records;
+    stats.size = m_end;
+    return stats;
+}
+
+void SegmentJournal::report(std::ostream &os) const
+{
+    const auto total = stats();
+    os << "Segment journal " << m_path << ": " << total.waiting << " parts waiting in " << total.size << " bytes, "
+       << total.appended << " appended, " << total.syncs << " syncs, " << total.compactions << " compactions"
+       << std::endl;
+}
+
+template <typename Each>
+std::size_t SegmentJournal::scan(Each &&each) const
+{
+    std::size_t at = HEADER;
+    while (at + RECORD <= m_mapped)
+    {
+        RecordHeader record;
+        std::memcpy(&record, m_map + at, RECORD);
+        // zeroes, where nothing was written yet, are of no generation
+        if (record.generation != m_generation || record.length > m_mapped - at - RECORD ||
+            record.key_length > record.length)
+        {
+            break;
+        }
+        const std::string_view body(m_map + at + RECORD, record.length);
+        const auto kind = static_cast<Kind>(record.kind);
+        if (record.checksum != checksum(record, body) || (kind != Kind::PART && kind != Kind::RELEASE))
+        {
+            break;
+        }
+        each(kind, body.substr(0, record.key_length), body.substr(record.key_length));
+        at += RECORD + record.length;
+    }
+    return at;
+}
+
+std::vector<SegmentJournal::Segment> SegmentJournal::waiting() const
+{
+    std::vector<Segment> segments;
+    scan([&segments](Kind kind, std::string_view key, std::string_view pdu)
+         {
+             if (kind == Kind::PART)
+             {
+                 segments.push_back({std::string(key), std::string(pdu)});
+                 return;
+             }
+             segments.erase(std::remove_if(segments.begin(), segments.end(), [key](const Segment &segment)
+                                           { return segment.key == key; }),
+                            segments.end()); });
+    return segments;
+}
+
+void SegmentJournal::put(Kind kind, std::string_view key, std::string_view pdu)
+{
+    if (key.size() > UINT16_MAX)
+    {
+        throw Utils::Error::ParserError("a key of " + std::to_string(key.size()) + " bytes for the segment journal");
+    }
+    reserve(RECORD + key.size() + pdu.size());
+    encode(m_map + m_end, m_generation, static_cast<uint8_t>(kind), key, pdu);
+    dirty(m_end);
+    m_end += RECORD + key.size() + pdu.size();
+}
+
+void SegmentJournal::reserve(std::size_t bytes)
+{
+    if (m_end + bytes <= m_mapped)
+    {
+        return;
+    }
+    const std::size_t size = (std::max(m_mapped * 2, m_end + bytes) + CHUNK - 1) / CHUNK * CHUNK;
+    // allocated rather than a hole, so that running out of disk is an error here and not a SIGBUS later
+    if (const int error = posix_fallocate(m_fd, 0, static_cast<off_t>(size)); error != 0)
+    {
+        throw Utils::Error::SystemError("posix_fallocate(" + m_path + ")", error);
+    }
+    void *grown = mremap(m_map, m_mapped, size, MREMAP_MAYMOVE);
+    if (grown == MAP_FAILED)
+    {
+        throw Utils::Error::SystemError("mremap(" + m_path + ")", errno);
+    }
+    m_map = static_cast<char *>(grown);
+    m_mapped = size;
+}
+
+void SegmentJournal::map(std::size_t size)
+{
+    void *mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (mapped == MAP_FAILED)
+    {
+        throw Utils::Error::SystemError("mmap(" + m_path + ")", errno);
+    }
+    m_map = static_cast<char *>(mapped);
+    m_mapped = size;
+}
+
+void SegmentJournal::reset()
+{
+    m_generation = m_generation == UINT32_MAX ? 1 : m_generation + 1;
+    std::memcpy(m_map + MAGIC.size(), &m_generation, sizeof(m_generation));
+    m_end = HEADER;
+    // on the disk before any record of the new generation, or those would be read as of none
+    if (msync(m_map, page_size(), MS_SYNC) != 0)
+    {
+        m_dirty = 0;
+        throw Utils::Error::SystemError("msync(" + m_path + ")", errno);
+    }
+    m_dirty = m_end;
+    m_stats.compactions++;
+}
+
+void SegmentJournal::compact()
+{
+    const auto segments = waiting();
+    const uint32_t generation = m_generation == UINT32_MAX ? 1 : m_generation + 1;
+    std::string content(MAGIC);
+    content.append(reinterpret_cast<const char *>(&generation), sizeof(generation));
+    for (const auto &segment : segments)
+    {
+        const std::size_t at = content.size();
+        content.resize(at + RECORD + segment.key.size() + segment.pdu.size());
+        encode(content.data() + at, generation, static_cast<uint8_t>(Kind::PART), segment.key, segment.pdu);
+    }
+    const std::size_t size = (content.size() + CHUNK - 1) / CHUNK * CHUNK;
+
+    // written and synced aside, then renamed over the journal, so that a crash leaves one or the other
+    const std::string aside = m_path + ".tmp";
+    const int fd = open(aside.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0)
+    {
+        throw Utils::Error::SystemError("open(" + aside + ")", errno);
+    }
+    int error = posix_fallocate(fd, 0, static_cast<off_t>(size));
+    if (error == 0 && (pwrite(fd, content.data(), content.size(), 0) != static_cast<ssize_t>(content.size()) ||
+                       fsync(fd) != 0 || rename(aside.c_str(), m_path.c_str()) != 0))
+    {
+        error = errno;
+    }
+    if (error != 0)
+    {
+        close(fd);
+        unlink(aside.c_str());
+        throw Utils::Error::SystemError("writing " + aside, error);
+    }
+    const auto slash = m_path.rfind('/');
+    const std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : m_path.substr(0, slash);
+    if (const int dir = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC); dir >= 0)
+    {
+        fsync(dir);
+        close(dir);
+    }
+
+    munmap(m_map, m_mapped);
+    m_map = nullptr;
+    close(m_fd);
+    m_fd = fd;
+    map(size);
+    m_generation = generation;
+    m_end = content.size();
+    m_dirty = m_end;
+    m_stats.compactions++;
+}
+
+void SegmentJournal::dirty(std::size_t from)
+{
+    m_dirty = std::min(m_dirty, from);
+}
@@ -20,6 +20,9 @@
  */
 
 #include "serial.hpp"
+#include "baud_rate.hpp"
+
+#include <linux/serial.h>
 
 struct bcm2835_peripheral gpio = {GPIO_BASE2};
 struct bcm2835_peripheral bsc_rev1 = {IOBASE + 0X205000};
@@ -61,7 +64,7 @@ static int getBoardRev()
     FILE *cpu_info;
     char line[120];
     char *c, finalChar;
-    static int rev = 0;
+    bool found = false;
 
     if (REV != 0)
         return REV;
@@ -75,15 +78,19 @@ static int getBoardRev()
     while (fgets(line, 120, cpu_info) != NULL)
     {
         if (strncmp(line, "Revision", 8) == 0)
+        {
+            found = true;
             break;
+        }
     }
 
     fclose(cpu_info);
 
-    if (line == NULL)
+    // Not a Raspberry Pi (e.g. a pty on a development box): the UART path does not need the board revision
+    if (!found)
     {
-        fprintf(stderr, "Unable to determine board revision from /proc/cpuinfo.\n");
-        exit(1);
+        fprintf(stderr, "Unable to determine board revision from /proc/cpuinfo; GPIO/I2C helpers are unavailable.\n");
+        return 0;
     }
 
     for (c = line; *c; ++c)
@@ -112,85 +119,116 @@ static int getBoardRev()
 }
 
 // Constructor
-SerialPi::SerialPi()
+SerialPi::SerialPi() : SerialPi("/dev/ttyS0")
 {
-    REV = getBoardRev();
-    serialPort = "/dev/ttyS0";
     //    serialPort = "/dev/ttyAMA0";
-    timeOut = 1000;
 }
 
-// Sets the data rate in bits per second (baud) for serial data transmission
-void SerialPi::begin(int serialSpeed)
+// Constructor for any other tty, e.g. a USB AT port or the slave end of a pty
+SerialPi::SerialPi(const char *port)
 {
+    REV = getBoardRev();
+    serialPort = port;
+    timeOut = 1000;
+    baud = 0;
+    rxHead = 0;
+    rxCount = 0;
+    rxSyscalls = 0;
+    txHead = 0;
+    txCount = 0;
+    txSyscalls = 0;
+    recorder = NULL;
+}
 
+/* Returns: the Bxxx constant of a standard rate, or B0 for any other */
+speed_t SerialPi::standardSpeed(int serialSpeed)
+{
     switch (serialSpeed)
     {
     case 50:
-        speed = B50;
-        break;
+        return B50;
     case 75:
-        speed = B75;
-        break;
+        return B75;
     case 110:
-        speed = B110;
-        break;
+        return B110;
     case 134:
-        speed = B134;
-        break;
+        return B134;
     case 150:
-        speed = B150;
-        break;
+        return B150;
     case 200:
-        speed = B200;
-        break;
+        return B200;
     case 300:
-        speed = B300;
-        break;
+        return B300;
     case 600:
-        speed = B600;
-        break;
+        return B600;
     case 1200:
-        speed = B1200;
-        break;
+        return B1200;
     case 1800:
-        speed = B1800;
-        break;
+        return B1800;
     case 2400:
-        speed = B2400;
-        break;
+        return B2400;
+    case 4800:
+        return B4800;
     case 9600:
-        speed = B9600;
-        break;
+        return B9600;
     case 19200:
-        speed = B19200;
-        break;
+        return B19200;
     case 38400:
-        speed = B38400;
-        break;
+        return B38400;
     case 57600:
-        speed = B57600;
-        break;
+        return B57600;
     case 115200:
-        speed = B115200;
-        break;
+        return B115200;
+    case 230400:
+        return B230400;
+#ifdef B460800
+    case 460800:
+        return B460800;
+    case 500000:
+        return B500000;
+    case 576000:
+        return B576000;
+    case 921600:
+        return B921600;
+    case 1000000:
+        return B1000000;
+    case 1152000:
+        return B1152000;
+    case 1500000:
+        return B1500000;
+    case 2000000:
+        return B2000000;
+    case 2500000:
+        return B2500000;
+    case 3000000:
+        return B3000000;
+    case 3500000:
+        return B3500000;
+    case 4000000:
+        return B4000000;
+#endif
     default:
-        speed = B230400;
-        break;
+        return B0;
     }
+}
 
+// Sets the data rate in bits per second (baud) for serial data transmission
+void SerialPi::begin(int serialSpeed)
+{
     if ((sd = open(serialPort, O_RDWR | O_NOCTTY | O_NDELAY | O_NONBLOCK)) == -1)
     {
         fprintf(stderr, "Unable to open the serial port %s - \n", serialPort);
         exit(-1);
     }
 
-    fcntl(sd, F_SETFL, O_RDWR);
+    // keep O_NONBLOCK: a busy UART must not stall the event loop, output is queued instead
+    fcntl(sd, F_SETFL, O_NONBLOCK);
 
     tcgetattr(sd, &options);
     cfmakeraw(&options);
-    cfsetispeed(&options, speed);
-    cfsetospeed(&options, speed);
+    cfsetispeed(&options, B115200);
+    cfsetospeed(&options, B115200);
+    baud = 115200;
 
     options.c_cflag |= (CLOCAL | CREAD);
     options.c_cflag &= ~PARENB;
@@ -202,6 +240,11 @@ void SerialPi::begin(int serialSpeed)
 
     tcsetattr(sd, TCSANOW, &options);
 
+    if (serialSpeed != baud && setBaudRate(serialSpeed) != 0)
+    {
+        fprintf(stderr, "Unable to run %s at %d baud (%s), staying at %d\n", serialPort, serialSpeed, strerror(errno), baud);
+    }
+
     ioctl(sd, TIOCMGET, &status);
 
     status |= TIOCM_DTR;
@@ -212,163 +255,729 @@ void SerialPi::begin(int serialSpeed)
     usleep(10000);
 }
 
-void SerialPi::println(const char *message)
+/* Switches the open port to serialSpeed. Standard rates go through cfsetspeed(),
+ * any other (3000000 on a PL011 with a raised UART clock, say) through termios2.
+ * Queued output is sent at the old rate first and unread input is dropped, as it
+ * may be garbled by the switch. The rate is read back, since a driver can keep
+ * the old one or round to what its clock divides to.
+ * Returns: 0, or -1 with errno set (EINVAL if the driver did not take the rate) */
+int SerialPi::setBaudRate(int serialSpeed)
 {
-    const char *newline = "\r\n";
-    char *msg = NULL;
-    asprintf(&msg, "%s%s", message, newline);
-    write(sd, msg, strlen(msg));
+    if (serialSpeed <= 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    writePending();
+    tcdrain(sd);
+
+    const speed_t standard = standardSpeed(serialSpeed);
+    struct termios previous = options;
+    if (standard != B0)
+    {
+        cfsetispeed(&options, standard);
+        cfsetospeed(&options, standard);
+        if (tcsetattr(sd, TCSANOW, &options) != 0)
+        {
+            options = previous;
+            return -1;
+        }
+    }
+    else if (setArbitraryBaudRate(sd, serialSpeed) != 0)
+    {
+        return -1;
+    }
+
+    // accept what a divisor can get within 2%, the tolerance of an 8N1 frame is about 4%
+    const int actual = getBaudRate(sd);
+    if (actual < 0 || std::abs(actual - serialSpeed) > serialSpeed / 50)
+    {
+        options = previous;
+        tcsetattr(sd, TCSANOW, &options);
+        errno = EINVAL;
+        return -1;
+    }
+    tcgetattr(sd, &options);
+    baud = actual;
+    flush();
+    return 0;
+}
+
+// Returns: the current rate in bits per second
+int SerialPi::baudRate() const
+{
+    return baud;
+}
+
+/* Turns RTS/CTS hardware flow control on or off (CRTSCTS). The modem has to
+ * be switched as well (AT+IFC=2,2 on the SIM7600), or nothing flows once it
+ * is on. With it the UART lowers RTS while the kernel buffer is full instead
+ * of overrunning, and holds output while the modem lowers CTS.
+ * Returns: 0, or -1 with errno set */
+int SerialPi::setFlowControl(bool enabled)
+{
+    if (enabled)
+        options.c_cflag |= CRTSCTS;
+    else
+        options.c_cflag &= ~CRTSCTS;
+    if (tcsetattr(sd, TCSANOW, &options) != 0)
+    {
+        tcgetattr(sd, &options);
+        return -1;
+    }
+    return 0;
+}
+
+bool SerialPi::flowControl() const
+{
+    return (options.c_cflag & CRTSCTS) != 0;
+}
+
+/* Reads the error counters of the UART driver. Pseudo-terminals and most
+ * USB serial adapters have none.
+ * Returns: 0, or -1 with errno set */
+int SerialPi::lineErrors(LineErrors &errors) const
+{
+    struct serial_icounter_struct counters;
+    if (ioctl(sd, TIOCGICOUNT, &counters) != 0)
+        return -1;
+    errors.overrun = counters.overrun;
+    errors.bufferOverrun = counters.buf_overrun;
+    errors.frame = counters.frame;
+    errors.parity = counters.parity;
+    errors.brk = counters.brk;
+    return 0;
+}
+
+/* Writes message followed by CR LF with a single writev(), without copying it
+ * Returns: number of bytes written or queued, -1 on error */
+int SerialPi::println(const char *message)
+{
+    struct iovec data[2];
+    data[0].iov_base = (void *)message;
+    data[0].iov_len = strlen(message);
+    data[1].iov_base = (void *)"\r\n";
+    data[1].iov_len = 2;
+    return writeVector(data, 2);
 }
 
 /* Writes binary data to the serial port. This data is sent as a byte
  * Returns: number of bytes written */
 int SerialPi::send(unsigned char message)
 {
-    write(sd, &message, 1);
-    return 1;
+    struct iovec data;
+    data.iov_base = &message;
+    data.iov_len = 1;
+    return writeVector(&data, 1);
+}
+
+/* Writes length bytes of binary data, e.g. a PDU followed by ^Z, in one go
+ * Returns: number of bytes written or queued, -1 on error */
+int SerialPi::send(const char *data, int length)
+{
+    struct iovec part;
+    part.iov_base = (void *)data;
+    part.iov_len = length;
+    return writeVector(&part, 1);
+}
+
+/* Writes the queued output and then the count parts of data with as few writev()
+ * calls as the UART allows. Whatever the UART cannot take right now (short write or
+ * EAGAIN) is copied to the transmit queue, to be sent by writePending(); only when
+ * the queue is full as well does it wait up to the timeout for the UART to drain.
+ * Returns: number of bytes of data written or queued, -1 on error */
+int SerialPi::writeVector(const struct iovec *data, int count)
+{
+    size_t total = 0;
+    for (int idx = 0; idx < count; idx++)
+        total += data[idx].iov_len;
+
+    size_t written = 0; // bytes of data, not counting the queue
+    while (true)
+    {
+        struct iovec iov[2 + MAX_WRITE_PARTS];
+        int iovcnt = 0;
+        unsigned int firstSpan = TX_BUFFER_SIZE - txHead;
+        if (firstSpan > txCount)
+            firstSpan = txCount;
+        if (firstSpan > 0)
+        {
+            iov[iovcnt].iov_base = txBuffer + txHead;
+            iov[iovcnt++].iov_len = firstSpan;
+        }
+        if (txCount > firstSpan)
+        {
+            iov[iovcnt].iov_base = txBuffer;
+            iov[iovcnt++].iov_len = txCount - firstSpan;
+        }
+        size_t skip = written;
+        for (int idx = 0; idx < count && iovcnt < 2 + MAX_WRITE_PARTS; idx++)
+        {
+            if (skip >= data[idx].iov_len)
+            {
+                skip -= data[idx].iov_len;
+                continue;
+            }
+            iov[iovcnt].iov_base = (char *)data[idx].iov_base + skip;
+            iov[iovcnt++].iov_len = data[idx].iov_len - skip;
+            skip = 0;
+        }
+        if (iovcnt == 0)
+            return total;
+
+        ++txSyscalls;
+        tally(counters.writes);
+        ssize_t n = writev(sd, iov, iovcnt);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                tally(counters.errors);
+                fprintf(stderr, "Failed to write to the serial port %s: %s\n", serialPort, strerror(errno));
+                return -1;
+            }
+            n = 0;
+        }
+        tally(counters.bytesOut, n);
+        if (recorder != NULL)
+            recorder->record(TrafficCapture::Direction::OUT, iov, iovcnt, n);
+
+        unsigned int fromQueue = (size_t)n < txCount ? n : txCount;
+        txHead = (txHead + fromQueue) % TX_BUFFER_SIZE;
+        txCount -= fromQueue;
+        written += n - fromQueue;
+        if (txCount == 0 && written == total)
+            return total;
+
+        // the UART is busy: keep the rest for later if the queue has room for it
+        tally(counters.wouldBlock);
+        if (total - written <= TX_BUFFER_SIZE - txCount)
+        {
+            queueOutput(data, count, written);
+            return total;
+        }
+        struct pollfd pfd;
+        pfd.fd = sd;
+        pfd.events = POLLOUT;
+        ++txSyscalls;
+        tally(counters.waits);
+        if (poll(&pfd, 1, timeOut) <= 0)
+        {
+            tally(counters.errors);
+            fprintf(stderr, "The transmit queue of the serial port %s is full\n", serialPort);
+            return -1;
+        }
+    }
+}
+
+// Appends the parts of data after the first skip bytes to the transmit queue
+void SerialPi::queueOutput(const struct iovec *data, int count, size_t skip)
+{
+    for (int idx = 0; idx < count; idx++)
+    {
+        const unsigned char *part = (const unsigned char *)data[idx].iov_base;
+        size_t length = data[idx].iov_len;
+        if (skip >= length)
+        {
+            skip -= length;
+            continue;
+        }
+        part += skip;
+        length -= skip;
+        skip = 0;
+        while (length > 0)
+        {
+            unsigned int tail = (txHead + txCount) % TX_BUFFER_SIZE;
+            unsigned int span = TX_BUFFER_SIZE - tail;
+            if (span > length)
+                span = length;
+            memcpy(txBuffer + tail, part, span);
+            txCount += span;
+            part += span;
+            length -= span;
+        }
+    }
+}
+
+/* Sends as much of the transmit queue as the UART takes now; call it when the
+ * port becomes writable again
+ * Returns: number of bytes still queued, -1 on error */
+int SerialPi::writePending()
+{
+    if (txCount > 0 && writeVector(NULL, 0) < 0)
+        return -1;
+    return txCount;
+}
+
+// Returns: number of bytes waiting in the transmit queue
+int SerialPi::pendingOutput() const
+{
+    return txCount;
+}
+
+// Returns: number of writev/poll system calls issued on the transmit side
+unsigned long SerialPi::writeSyscallCount() const
+{
+    return txSyscalls;
+}
+
+/* Only the thread using the port counts, so a relaxed load and store is enough and
+ * spares the locked add of fetch_add on every read and write */
+void SerialPi::tally(std::atomic<unsigned long> &counter, unsigned long amount)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+/* Safe to call from any thread; the fields are read one by one, so they may be
+ * a read or write apart from each other
+ * Returns: the transfer counters since the port was opened */
+SerialStatistics SerialPi::statistics() const
+{
+    SerialStatistics snapshot;
+    snapshot.bytesIn = counters.bytesIn.load(std::memory_order_relaxed);
+    snapshot.bytesOut = counters.bytesOut.load(std::memory_order_relaxed);
+    snapshot.reads = counters.reads.load(std::memory_order_relaxed);
+    snapshot.writes = counters.writes.load(std::memory_order_relaxed);
+    snapshot.waits = counters.waits.load(std::memory_order_relaxed);
+    snapshot.wouldBlock = counters.wouldBlock.load(std::memory_order_relaxed);
+    snapshot.readTimeouts = counters.readTimeouts.load(std::memory_order_relaxed);
+    snapshot.errors = counters.errors.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+/* Records every chunk read or written from now on into capture, which stays
+ * owned by the caller and is used on the thread using the port; NULL stops */
+void SerialPi::setRecorder(TrafficCapture::Recorder *capture)
+{
+    recorder = capture;
 }
 
 /* Get the numberof bytes (characters) available for reading from
- * the serial port.
+ * the serial port, including the ones already held in the receive buffer.
  * Return: number of bytes avalable to read */
 int SerialPi::available()
 {
     int nbytes = 0;
+    ++rxSyscalls;
+    tally(counters.waits);
     if (ioctl(sd, FIONREAD, &nbytes) < 0)
     {
         fprintf(stderr, "Failed to get byte count on serial.\n");
         raise(SIGINT);
     }
-    return nbytes;
+    return rxCount + nbytes;
 }
 
-/* Reads 1 byte of incoming serial data
- * Returns: first byte of incoming serial data available */
-char SerialPi::receive(int timeoutInMs)
+/* Waits up to timeoutInMs for the port to become readable, then drains
+ * everything the kernel reports through FIONREAD into the receive ring with
+ * a single readv() (the free space may wrap around the end of the ring).
+ * Returns: number of bytes added, or one of READ_TIMEOUT, READ_ERROR, READ_EOF */
+int SerialPi::fillBuffer(int timeoutInMs)
 {
+    if (rxCount == RX_BUFFER_SIZE)
+        return RX_BUFFER_SIZE;
+    if (rxCount == 0)
+        rxHead = 0; // keep the free space contiguous when the ring is empty
+
     struct pollfd pfd;
     pfd.fd = sd;
     pfd.events = POLLIN;
+    ++rxSyscalls;
+    tally(counters.waits);
     int ret = poll(&pfd, 1, timeoutInMs);
     if (ret == -1)
     {
-        return 0;
+        tally(counters.errors);
+        return READ_ERROR;
     }
     else if (ret == 0)
     {
-        return 26; // ^Z --> timeout
+        if (timeoutInMs != 0) // a zero timeout only checks, as when draining the port
+            tally(counters.readTimeouts);
+        return READ_TIMEOUT;
+    }
+    if (!(pfd.revents & POLLIN))
+    {
+        return READ_EOF; // POLLHUP / POLLERR without data
     }
 
-    if (pfd.revents & POLLIN)
+    int pending = 0;
+    ++rxSyscalls;
+    tally(counters.waits);
+    if (ioctl(sd, FIONREAD, &pending) < 0 || pending <= 0)
     {
-        unsigned char c;
-        ssize_t n = read(sd, &c, 1);
-        if (n == 0) return 4; // EOT
-        return c;
+        pending = 1; // let read() report the EOF or the error
     }
-    return 4; // EOT
+
+    unsigned int space = RX_BUFFER_SIZE - rxCount;
+    unsigned int wanted = (unsigned int)pending < space ? (unsigned int)pending : space;
+    unsigned int tail = (rxHead + rxCount) % RX_BUFFER_SIZE;
+    unsigned int firstSpan = RX_BUFFER_SIZE - tail;
+
+    struct iovec iov[2];
+    int iovcnt = 1;
+    iov[0].iov_base = rxBuffer + tail;
+    iov[0].iov_len = wanted < firstSpan ? wanted : firstSpan;
+    if (wanted > firstSpan)
+    {
+        iov[1].iov_base = rxBuffer;
+        iov[1].iov_len = wanted - firstSpan;
+        iovcnt = 2;
+    }
+
+    ++rxSyscalls;
+    tally(counters.reads);
+    ssize_t n = readv(sd, iov, iovcnt);
+    if (n == 0 || (n < 0 && errno == EIO))
+    {
+        return READ_EOF; // EIO: the master side of a pty went away
+    }
+    if (n < 0)
+    {
+        if (errno == EAGAIN || errno == EINTR)
+            return READ_TIMEOUT;
+        tally(counters.errors);
+        return READ_ERROR;
+    }
+    tally(counters.bytesIn, n);
+    if (recorder != NULL)
+        recorder->record(TrafficCapture::Direction::IN, iov, iovcnt, n);
+    rxCount += n;
+    return n;
+}
+
+/* Returns: offset of the first occurrence of value among the first limit
+ * buffered bytes, or -1 if there is none */
+int SerialPi::findInBuffer(unsigned char value, unsigned int limit) const
+{
+    if (limit > rxCount)
+        limit = rxCount;
+    unsigned int firstSpan = RX_BUFFER_SIZE - rxHead;
+    if (firstSpan > limit)
+        firstSpan = limit;
+
+    const void *hit = memchr(rxBuffer + rxHead, value, firstSpan);
+    if (hit != NULL)
+        return (const unsigned char *)hit - (rxBuffer + rxHead);
+    if (limit > firstSpan)
+    {
+        hit = memchr(rxBuffer, value, limit - firstSpan);
+        if (hit != NULL)
+            return firstSpan + ((const unsigned char *)hit - rxBuffer);
+    }
+    return -1;
+}
+
+// Moves length buffered bytes (length <= rxCount) out of the ring
+void SerialPi::copyFromBuffer(char *buffer, unsigned int length)
+{
+    unsigned int firstSpan = RX_BUFFER_SIZE - rxHead;
+    if (firstSpan > length)
+        firstSpan = length;
+    if (buffer != NULL)
+    {
+        memcpy(buffer, rxBuffer + rxHead, firstSpan);
+        memcpy(buffer + firstSpan, rxBuffer, length - firstSpan);
+    }
+    rxHead = (rxHead + length) % RX_BUFFER_SIZE;
+    rxCount -= length;
+}
+
+/* Reads 1 byte of incoming serial data
+ * Returns: first byte of incoming serial data available */
+char SerialPi::receive(int timeoutInMs)
+{
+    if (rxCount == 0)
+    {
+        int ret = fillBuffer(timeoutInMs);
+        if (ret == READ_ERROR)
+            return 0;
+        if (ret == READ_TIMEOUT)
+            return 26; // ^Z --> timeout
+        if (ret == READ_EOF)
+            return 4; // EOT
+    }
+    unsigned char first = rxBuffer[rxHead];
+    copyFromBuffer(NULL, 1);
+    return first;
+}
+
+/* Copies up to length bytes of whatever has arrived, waiting up to
+ * timeoutInMs only if nothing is buffered yet.
+ * Returns: number of bytes copied, or one of READ_TIMEOUT, READ_ERROR, READ_EOF */
+int SerialPi::readChunk(char *buffer, int length, int timeoutInMs)
+{
+    if (length <= 0)
+        return 0;
+    if (rxCount == 0)
+    {
+        int ret = fillBuffer(timeoutInMs);
+        if (ret <= 0)
+            return ret;
+    }
+    unsigned int n = (unsigned int)length < rxCount ? (unsigned int)length : rxCount;
+    copyFromBuffer(buffer, n);
+    return n;
+}
+
+/* Copies the next non-empty line into buffer without its CR/LF and
+ * NUL-terminates it. A line longer than length - 1 is handed out in pieces.
+ * Bytes of an incomplete line stay buffered when the timeout expires.
+ * Returns: length of the line, or one of READ_TIMEOUT, READ_ERROR, READ_EOF */
+int SerialPi::readLine(char *buffer, int length, int timeoutInMs)
+{
+    if (length <= 1)
+        return READ_ERROR;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    unsigned int limit = length - 1;
+
+    while (true)
+    {
+        // drop the CR/LF left in front by the previous line or by "\r\nOK\r\n" framing
+        while (rxCount > 0 && (rxBuffer[rxHead] == '\r' || rxBuffer[rxHead] == '\n'))
+            copyFromBuffer(NULL, 1);
+
+        int newline = findInBuffer('\n', limit + 1);
+        if (newline >= 0 || rxCount >= limit || rxCount == RX_BUFFER_SIZE)
+        {
+            unsigned int lineLength = newline >= 0 ? newline : (rxCount < limit ? rxCount : limit);
+            copyFromBuffer(buffer, lineLength);
+            if (newline >= 0)
+                copyFromBuffer(NULL, 1);
+            while (lineLength > 0 && buffer[lineLength - 1] == '\r')
+                --lineLength;
+            buffer[lineLength] = '\0';
+            return lineLength;
+        }
+
+        int ret = fillBuffer(remainingTime(start, timeoutInMs));
+        if (ret <= 0)
+            return ret;
+    }
+}
+
+/* Tunes when a read on the port completes (termios VMIN / VTIME).
+ * Note that with interByteDeciseconds == 0 the kernel also holds back poll()
+ * readiness until minBytes have arrived, so short replies such as "OK" would
+ * only show up with the next burst; keep minBytes at 1 in that case. */
+void SerialPi::setReadThreshold(unsigned char minBytes, unsigned char interByteDeciseconds)
+{
+    options.c_cc[VMIN] = minBytes;
+    options.c_cc[VTIME] = interByteDeciseconds;
+    tcsetattr(sd, TCSANOW, &options);
+}
+
+// Returns: number of poll/ioctl/read system calls issued on the receive side
+unsigned long SerialPi::readSyscallCount() const
+{
+    return rxSyscalls;
+}
+
+// Returns: the descriptor of the open port, for event loops to watch
+int SerialPi::fileDescriptor() const
+{
+    return sd;
+}
+
+// Returns: what is left of timeoutInMs since start (monotonic), -1 if the timeout is infinite
+int SerialPi::remainingTime(const struct timespec &start, int timeoutInMs)
+{
+    if (timeoutInMs < 0)
+        return -1;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long elapsed = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+    return elapsed >= timeoutInMs ? 0 : timeoutInMs - elapsed;
 }
 
 /* returns the first valid (long) integer value from the current position.
  * initial characters that are not digits (or the minus sign) are skipped
- * function is terminated by the first character that is not a digit. */
+ * function is terminated by the first character that is not a digit.
+ * Returns 0 if there is no number on the rest of the line or none arrived within the timeout */
 long SerialPi::parseInt()
 {
-    bool isNegative = false;
     long value = 0;
-    char c;
+    parseInt(value, timeOut);
+    return value;
+}
+
+float SerialPi::parseFloat()
+{
+    float value = 0;
+    parseFloat(value, timeOut);
+    return value;
+}
+
+/* Reads the next integer straight out of the receive buffer, e.g. the 20 and the 99
+ * of "+CSQ: 20,99" in two calls. Characters that cannot start a number are skipped,
+ * but never past the end of the line: the '\n' is left unread. The character after
+ * the number is left unread as well. value is only set on PARSE_OK */
+ParseStatus SerialPi::parseInt(long &value, int timeoutInMs)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int next;
 
     // Skip characters until a number or - sign found
-    do
+    while (true)
     {
-        c = peek();
-        if (c == '-')
-            break;
-        if (c >= '0' && c <= '9')
-            break;
-        read(sd, &c, 1); // discard non-numeric
-    } while (1);
+        next = peek(remainingTime(start, timeoutInMs));
+        if (next < 0)
+            return PARSE_TIMEOUT;
+        if (next == '\n')
+            return PARSE_NO_NUMBER;
+        if (next == '-' || isdigit(next))
+            break;
+        copyFromBuffer(NULL, 1); // discard non-numeric
+    }
 
-    do
-    {
-        if (c == '-')
-            isNegative = true;
-        else if (c >= '0' && c <= '9') // is c a digit?
-            value = value * 10 + c - '0';
-        read(sd, &c, 1); // consume the character we got with peek
-        c = peek();
+    bool isNegative = next == '-';
+    if (isNegative)
+        copyFromBuffer(NULL, 1);
 
-    } while (c >= '0' && c <= '9');
+    bool hasDigits = false;
+    bool overflow = false;
+    long result = 0;
+    while (true)
+    {
+        next = peek(remainingTime(start, timeoutInMs));
+        if (next < 0)
+            return PARSE_TIMEOUT;
+        if (!isdigit(next))
+            break;
+        copyFromBuffer(NULL, 1); // consume the character we got with peek
+        hasDigits = true;
+        if (result > (LONG_MAX - (next - '0')) / 10)
+            overflow = true;
+        else
+            result = result * 10 + next - '0';
+    }
 
-    if (isNegative)
-        value = -value;
-    return value;
+    if (!hasDigits)
+        return PARSE_NO_NUMBER;
+    if (overflow)
+        return PARSE_OVERFLOW;
+    value = isNegative ? -result : result;
+    return PARSE_OK;
 }
 
-float SerialPi::parseFloat()
+/* Same as parseInt(), accepting one decimal point, e.g. "-3.5" */
+ParseStatus SerialPi::parseFloat(float &value, int timeoutInMs)
 {
-    boolean isNegative = false;
-    boolean isFraction = false;
-    long value = 0;
-    char c;
-    float fraction = 1.0;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int next;
 
     // Skip characters until a number or - sign found
-    do
+    while (true)
     {
-        c = peek();
-        if (c == '-')
-            break;
-        if (c >= '0' && c <= '9')
-            break;
-        read(sd, &c, 1); // discard non-numeric
-    } while (1);
+        next = peek(remainingTime(start, timeoutInMs));
+        if (next < 0)
+            return PARSE_TIMEOUT;
+        if (next == '\n')
+            return PARSE_NO_NUMBER;
+        if (next == '-' || isdigit(next))
+            break;
+        copyFromBuffer(NULL, 1); // discard non-numeric
+    }
 
-    do
+    bool isNegative = next == '-';
+    if (isNegative)
+        copyFromBuffer(NULL, 1);
+
+    bool hasDigits = false;
+    bool isFraction = false;
+    double result = 0;
+    double fraction = 1.0;
+    while (true)
     {
-        if (c == '-')
-            isNegative = true;
-        else if (c == '.')
+        next = peek(remainingTime(start, timeoutInMs));
+        if (next < 0)
+            return PARSE_TIMEOUT;
+        if (next == '.' && !isFraction)
+        {
             isFraction = true;
-        else if (c >= '0' && c <= '9')
-        { // is c a digit?
-            value = value * 10 + c - '0';
+        }
+        else if (isdigit(next))
+        {
+            hasDigits = true;
+            result = result * 10 + next - '0';
             if (isFraction)
                 fraction *= 0.1;
         }
-        read(sd, &c, 1); // consume the character we got with peek
-        c = peek();
-    } while ((c >= '0' && c <= '9') || (c == '.' && isFraction == false));
+        else
+        {
+            break;
+        }
+        copyFromBuffer(NULL, 1); // consume the character we got with peek
+    }
 
-    if (isNegative)
-        value = -value;
-    if (isFraction)
-        return value * fraction;
-    else
-        return value;
+    if (!hasDigits)
+        return PARSE_NO_NUMBER;
+    value = (isNegative ? -result : result) * fraction;
+    return PARSE_OK;
 }
 
-// Returns the next byte (character) of incoming serial data without removing it from the internal serial buffer.
+/* Returns the next byte (character) of incoming serial data without removing it from the receive buffer.
+ * Waits up to the timeout set by setTimeout(); returns -1 if nothing arrived */
 char SerialPi::peek()
 {
-    // We obtain a pointer to FILE structure from the file descriptor sd
-    FILE *f = fdopen(sd, "r+");
-    // With a pointer to FILE we can do getc and ungetc
-    c = getc(f);
-    ungetc(c, f);
-    return c;
+    return peek(timeOut);
 }
 
-// Remove any data remaining on the serial buffer
-void SerialPi::flush()
+/* Returns the next byte (0 - 255) without removing it from the receive buffer,
+ * or -1 if nothing arrived within timeoutInMs */
+int SerialPi::peek(int timeoutInMs)
 {
-    while (available())
+    if (rxCount == 0 && fillBuffer(timeoutInMs) <= 0)
+        return -1;
+    return rxBuffer[rxHead];
+}
+
+/* Consumes input up to and including target, e.g. find("+CSQ:") before parseInt()
+ * Returns: true if target was found within timeoutInMs */
+bool SerialPi::find(const char *target, int timeoutInMs)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    size_t length = strlen(target);
+    size_t matched = 0;
+    while (matched < length)
     {
-        read(sd, &c, 1);
+        int next = peek(remainingTime(start, timeoutInMs));
+        if (next < 0)
+            return false;
+        if (next == (unsigned char)target[matched])
+        {
+            ++matched;
+            copyFromBuffer(NULL, 1);
+        }
+        else if (matched > 0)
+        {
+            matched = 0; // test the same character against the start of target
+        }
+        else
+        {
+            copyFromBuffer(NULL, 1);
+        }
     }
+    return true;
+}
+
+// Remove any data remaining on the serial buffer
+void SerialPi::flush()
+{
+    rxHead = 0;
+    rxCount = 0;
+    ++rxSyscalls;
+    tcflush(sd, TCIFLUSH);
 }
 
-/* Sets the maximum milliseconds to wait for serial data when using SerialPi::readBytes()
+/* Sets the maximum milliseconds to wait for serial data when using SerialPi::peek() and the parse functions
  * The default value is set to 1000 */
 void SerialPi::setTimeout(long millis)
 {
@@ -1,297 +1,400 @@
-#include "serial.hpp"
 #include "sms.hpp"
 #include "cmd_pipe.hpp"
+#include "options.hpp"
 #include "error.hpp"
+#include "reactor.hpp"
+#include "modem.hpp"
+#include "reassembler.hpp"
+#include "segment_journal.hpp"
 
+#include <algorithm>
+#include <chrono>
 #include <memory>
+#include <mutex>
 #include <string>
-#include <chrono>
-#include <sstream>
 #include <iostream>
 #include <optional>
 #include <thread>
-#include <mutex>
-#include <condition_variable>
 #include <functional>
-#include <atomic>
 #include <csignal>
-
-using namespace std::literals::chrono_literals;
+#include <vector>
+#include <sys/epoll.h>
 
 constexpr int POWERKEY = 6;
 
+// How long a long message the email could not take waits before it is relayed again
+constexpr auto RETRY_INTERVAL = std::chrono::seconds(60);
+
+// A modem to serve: its name towards the front-end, its AT port and the rest of its serial block
+struct Port
+{
+    std::string name;
+    std::string device;
+    Utils::Options::Serial config;
+};
+
+/**
+ * The modems, each serving its port on a thread and reactor of its own, and what they share: the
+ * front-end's command pipe and the signals on the main thread's reactor, the parts of concatenated
+ * messages waiting for the rest, and handing the messages on, one email at a time (curl). The reassembly
+ * timer on the main reactor hands what has waited too long to the relay thread, so that a slow SMTP server
+ * holds up neither the timers nor the front-end. The parts are journaled as
+ * they arrive and the journal synced before a modem deletes or acknowledges them, so that a restart
+ * picks them up again from the journal rather than losing them. A long message that could not be handed on
+ * keeps its parts in the journal and is relayed again on the retry timer.
+ */
 class Service
 {
 public:
-    Service(unsigned int powerkey)
+    Service(unsigned int powerkey, const std::vector<Port> &ports)
+        : m_reassembler(std::chrono::seconds(m_reassembly.get_timeout()), m_reassembly.get_limit_kb() * 1024ul)
     {
-        m_serial.begin(115200);
-        std::cout << "starting serial at /dev/ttyS0" << std::endl;
-        // SerialPi::pinMode(powerkey, OUTPUT);
-        // std::cout << "\tPin mode set" << std::endl;
-        // SerialPi::digitalWrite(powerkey, HIGH);
-        // std::cout << "\tDigital write set to HIGH" << std::endl;
-        // std::this_thread::sleep_for(600ms);
-        // SerialPi::digitalWrite(powerkey, LOW);
-        // std::cout << "\tDigital write set to LOW" << std::endl;
-        for (std::optional<std::string> hi = std::nullopt; !hi; hi = send_command_get_respond("AT", 2000ms))
+        if (const auto path = m_reassembly.get_journal(); !path.empty())
         {
+            try
+            {
+                m_journal = std::make_unique<SegmentJournal>(path);
+                recover();
+            }
+            catch (const std::exception &error)
+            {
+                std::cerr << "No segment journal, the parts of long messages are lost on a restart: " << error.what() << std::endl;
+            }
         }
-
-        std::this_thread::sleep_for(500ms);
-
-        for (std::optional<std::string> ready_or_not = std::nullopt; 
-             ready_or_not == std::nullopt || ready_or_not->find("CPIN: READY") == std::string::npos;
-             ready_or_not = send_command_get_respond("AT+CPIN?", 500ms))
+        for (const auto &port : ports)
         {
-            std::this_thread::sleep_for(500ms);
+            m_modems.push_back(std::make_unique<Modem>(
+                port.name, port.device, port.config, [this](const std::string &pdu)
+                { return deliver(pdu); },
+                [this]()
+                { return m_journal == nullptr || m_journal->sync(); }));
         }
-        // query signal connection
-        send_command_get_respond("AT+CREG?", 500ms);
-        // query carrier
-        send_command_get_respond("AT+COPS?", 1500ms);
-        // force disable internet
-        send_command_get_respond("AT+CGATT=0", 1500ms);
-        // enable the phone call number
-        send_command_get_respond("AT+CLIP=1", 1500ms);
-        // query signal
-        send_command_get_respond("AT+CSQ", 1500ms);
     }
 
     ~Service()
     {
-        m_serial.end();
         m_pipe.close();
     }
 
     Service(const Service &) = delete;
 
-    Service(Service &&) = default;
-
     Service &operator=(const Service &) = delete;
 
-    Service &operator=(Service &&) = default;
-
     void loop()
     {
-        std::ostringstream incoming;
-        char last = 0;
-        send_command_get_respond("AT+CMGF=0", 1000ms); // PDU mode
-        send_command_get_respond("AT+CNMI=2,1", 1000ms);
-        while (true)
+        // before the modem threads start, so that they inherit the blocked signals and leave them to the signalfd
+        m_reactor.watch_signals({SIGINT, SIGTERM, SIGUSR1}, [this](int sig)
+                                { signal_handler(sig); });
+        m_reactor.add(m_pipe.listen_fd(), EPOLLIN | EPOLLET, "command pipe", [this](uint32_t)
+                      { m_pipe.drain([this](auto msg)
+                                     { frontend_request_handler(msg); }); });
+        m_expiry_timer = m_reactor.add_timer("reassembly", std::chrono::milliseconds::zero(), std::chrono::milliseconds::zero(),
+                                             [this]()
+                                             { expire(); });
+        schedule_expiry();
+        m_retry_timer = m_reactor.add_timer("relay retry", std::chrono::milliseconds::zero(), std::chrono::milliseconds::zero(),
+                                            [this]()
+                                            { retry(); });
+
+        std::thread relayer([this]()
+                            { m_relayer.run(); });
+        std::vector<std::thread> threads;
+        for (auto &each : m_modems)
         {
-            auto first = m_serial.receive();
-            if (first == 0 || first == 4)
-            {
-                std::cout << "serial port is closed or gets EOF (the other end is off-line)" << std::endl;
-                break;
-            }
-            if (first == '\n' && last == '\r')
-            {
-                auto content = incoming.str();
-                incoming.str("");
-                incoming.clear();
-                if (content.empty())
-                {
-                    last = 0;
-                    continue; // empty -> skip
-                }
-                if (const auto cmti = content.find("+CMTI:"); cmti != content.npos)
-                {
-                    std::cout << "New SMS: " << content; 
-                    if (const auto sm_cnt = content.find("\"SM\","); sm_cnt != content.npos)
-                    {
-                        std::ostringstream query_formatter;
-                        std::ostringstream delete_formatter;
-                        const auto smsNo = content.substr(sm_cnt + 5);
-                        query_formatter << "AT+CMGR=" << smsNo;
-                        delete_formatter << "AT+CMGD=" << smsNo;
-                        std::cout << " -> No. " << smsNo << std::endl;
-                        auto smsContent = send_command_get_respond(query_formatter.str(), 2000ms);
-                        send_command_get_respond(delete_formatter.str(), 1000ms);
-                        if (smsContent)
-                        {
-                            sms_handler(*smsContent);
-                        } 
-                        else
-                        {
-                            std::cerr << query_formatter.str() << " => no message returned" << std::endl; 
-                        }
-                    }
-                    else 
-                    {
-                        std::cout << " -> Unparsable number" << std::endl;
-                    }
-                }
-                else if (const auto ring = content.find("RING"); ring != content.npos)
-                {
-                    if (const auto phone = content.find("CLIP:"); phone != content.npos)
-                    {
-                        const auto phone_num = content.substr(phone, content.find(",", phone));
-                        std::cout << "New incoming phone call from " << phone_num << std::endl;
-                    }
-                    else
-                    {
-                        std::cout << "New incoming phone call from unknown caller (NO CLIP entry"
-                                  << ", raw content: {" << content << "})" << std::endl;
-                    }
-                }
-                else
-                {
-                    std::unique_lock lock(m_cmd_queue_mtx);
-                    if (!m_incoming_commands.empty())
-                    {
-                        try
-                        {
-                            auto latestCommand = m_incoming_commands.front();
-                            m_incoming_commands.pop();
-                            latestCommand->verify(content);
-                            std::cout << "Command from front-end: " << latestCommand->message() << " gets expected result " << content << std::endl;
-                            m_pipe.send(std::make_shared<Utils::Interface::Prompt>(content));
-                        }
-                        catch (const std::exception &error)
-                        {
-                            std::cerr << error.what() << std::endl;
-                        }
-                    }
-                    else
-                    {
-                        std::cerr << "Unparsable content from serial port: " << content;
-                    }
-                }
-            }
-            else if (first != '\r')
-            {
-                incoming << first;
-            }
-            last = first;
+            threads.emplace_back([this, modem = each.get()]()
+                                 {
+                                     try
+                                     {
+                                         modem->run();
+                                     }
+                                     catch (const std::exception &error)
+                                     {
+                                         std::cerr << modem->name() << " on " << modem->device() << " gave up: " << error.what() << std::endl;
+                                     }
+                                     m_reactor.post([this, modem]()
+                                                    { modem_ended(*modem); }); });
+        }
+        std::cout << "Daemon is listening to " << m_modems.size() << " modem(s) and the front-end" << std::endl;
+
+        m_reactor.run();
+
+        for (auto &each : m_modems)
+        {
+            each->stop();
         }
+        for (auto &each : threads)
+        {
+            each.join();
+        }
+        // what it has not relayed by now stays in the journal for the next start
+        m_relayer.post([this]()
+                       { m_relayer.stop(); });
+        relayer.join();
         std::cout << "loop ends" << std::endl;
     }
 
-    void begin_daemon_thread()
+protected:
+    void modem_ended(const Modem &modem)
     {
-        if (m_frontend_thread == nullptr)
+        std::cout << modem.name() << " is no longer served" << std::endl;
+        if (++m_ended == m_modems.size())
         {
-            m_frontend_thread = std::make_unique<std::thread>([this]()
-                                                              { m_pipe.listen([this](auto msg)
-                                                                              { frontend_request_handler(msg); }); });
-            std::cout << "Daemon is listening to front-end" << std::endl;
+            std::cout << "No modem left to serve" << std::endl;
+            m_reactor.stop();
         }
     }
 
-protected:
-    std::optional<std::string> send_command_get_respond(const std::string &command, std::chrono::milliseconds timeout)
+    void signal_handler(int sig)
     {
-        m_serial.flush();
-        m_serial.println(command.c_str());
-        auto start = std::chrono::steady_clock::now();
-
-        // spin for respond
-        while (!m_serial.available() && std::chrono::steady_clock::now() - start <= timeout)
+        if (sig == SIGUSR1)
         {
-        } // wait
+            m_reactor.dump_latency(std::cout);
+            m_reassembler.report(std::cout);
+            if (m_journal) m_journal->report(std::cout);
+            {
+                std::lock_guard lock(m_relay_mtx);
+                std::cout << m_unsent.size() << " long SMS waiting to be relayed again" << std::endl;
+            }
+            for (auto &each : m_modems)
+            {
+                each->report();
+            }
+            return;
+        }
+        std::cout << "Killed by ";
+        if (sig == SIGINT) std::cout << " Ctrl-C ";
+        if (sig == SIGTERM) std::cout << " KILL ";
+        std::cout << std::endl;
+        m_reactor.stop();
+    }
 
-        std::ostringstream oss;
-        bool oFound = false;
-        char c;
-        while (m_serial.available() || std::chrono::steady_clock::now() - start <= timeout)
+    void frontend_request_handler(std::shared_ptr<Utils::Interface::AMessage> incoming_request)
+    {
+        const auto command = std::dynamic_pointer_cast<Utils::Interface::Command>(incoming_request);
+        const auto sms = std::dynamic_pointer_cast<Utils::Interface::Sms>(incoming_request);
+        if (command == nullptr && sms == nullptr)
         {
-            int remainedTime = (timeout - (std::chrono::steady_clock::now() - start)).count();
+            std::cerr << "daemon thread receive non-command message, ignore" << std::endl;
+            return;
+        }
+        auto *modem = m_modems.front().get();
+        if (const auto &name = incoming_request->modem())
+        {
+            modem = nullptr;
+            for (auto &each : m_modems)
+            {
+                if (each->name() == *name) modem = each.get();
+            }
+            if (modem == nullptr)
+            {
+                std::cerr << "Command from front-end: " << incoming_request->message() << " is for " << *name
+                          << ", which is not configured" << std::endl;
+                return;
+            }
+        }
+        // name the modem in the reply only when there is more than one to tell apart
+        const auto from = m_modems.size() > 1 ? std::optional<std::string>(modem->name()) : std::nullopt;
+        auto reply = [this, from](const std::string &content)
+        {
+            m_reactor.post([this, from, content]()
+                           { m_pipe.send(std::make_shared<Utils::Interface::Prompt>(content, from)); });
+        };
+        if (sms != nullptr)
+        {
+            modem->send(sms->recipient(), sms->text(), std::move(reply));
+        }
+        else
+        {
+            modem->request(command, std::move(reply));
+        }
+    }
 
-            c = m_serial.receive(remainedTime >= 0 ? remainedTime : 0);
-            if (c == 26 || c == 0 || c == 4)
+    // Called on the modem threads
+    bool deliver(const std::string &pdu)
+    {
+        std::vector<SMS> ready;
+        try
+        {
+            SMS message(pdu);
+            std::cout << "Parsed to " << message << std::endl;
+            if (!message.is_part())
             {
-                // 26 --- ^Z timeout
-                // 0 --- error
-                // 4 --- EOF
-                break;
+                ready.push_back(std::move(message));
             }
-            if (!oFound && c == 'O')
+            else
+            {
+                // on the disk before the modem deletes it, by way of the Persist callback
+                if (m_journal) m_journal->append(journal_key(message), pdu);
+                m_reassembler.add(std::move(message), ready);
+                m_reactor.post([this]()
+                               { schedule_expiry(); });
+            }
+        }
+        catch (const std::exception &exp)
+        {
+            std::cerr << exp.what() << std::endl;
+            return false;
+        }
+        return relay(std::move(ready));
+    }
+
+    /**
+     * Hand the messages on, on a modem thread or the relay thread, never the main one. A long message's parts
+     * are released from the journal once it is; one that is not keeps them and waits for the retry timer, as
+     * the modem has deleted its parts. False if a message on its own was not handed on, which the modem then
+     * leaves stored
+     */
+    bool relay(std::vector<SMS> messages)
+    {
+        bool sent = true;
+        bool kept = false;
+        for (auto &each : messages)
+        {
+            try
             {
-                oFound = true;
+                std::lock_guard lock(m_email_mtx);
+                each.send_email();
             }
-            else if (oFound)
+            catch (const std::exception &exp)
             {
-                if (c == 'K')
+                std::cerr << exp.what() << std::endl;
+                if (each.get_count() > 0)
                 {
-                    std::cout << "Sent " << command << ", got " << oss.str() << std::endl;
-                    return oss.str();
+                    std::lock_guard lock(m_relay_mtx);
+                    m_unsent.push_back(std::move(each));
+                    kept = true;
                 }
-                oFound = false;
-                oss << 'O' << c;
-            }
-            else if (c != '\r')
-            {
-                oss << c;
+                else
+                {
+                    sent = false;
+                }
+                continue;
             }
+            if (m_journal && each.get_count() > 0) m_journal->release(journal_key(each));
         }
-        if (c == 0) std::cerr << "Sent " << command << ", error" << std::endl;
-        else if (c == 4) std::cout << "Sent " << command << ", but the serial port is closed" << std::endl;
-        else std::cerr << "Sent " << command << ", timeout" << std::endl;
-        return std::nullopt;
+        if (kept)
+        {
+            m_reactor.post([this]()
+                           { schedule_retry(); });
+        }
+        return sent;
     }
 
-    void frontend_request_handler(std::shared_ptr<Utils::Interface::AMessage> incoming_request)
+    // On the main reactor: the long messages not handed on so far, once more
+    void retry()
     {
-        const auto command = std::dynamic_pointer_cast<Utils::Interface::Command>(incoming_request);
-        if (command == nullptr)
+        m_retry_armed = false;
+        std::vector<SMS> unsent;
         {
-            std::cerr << "daemon thread receive non-command message, ignore" << std::endl;
-            return;
+            std::lock_guard lock(m_relay_mtx);
+            unsent.swap(m_unsent);
         }
-        m_serial.println(command->message().c_str());
-        std::unique_lock lock(m_cmd_queue_mtx);
-        m_incoming_commands.emplace(std::move(command));
+        std::cout << "Relaying " << unsent.size() << " long SMS again" << std::endl;
+        relay_later(std::move(unsent));
     }
 
-    static inline void trim(std::string &s)
+    // From the main reactor: relay on the relay thread
+    void relay_later(std::vector<SMS> messages)
     {
-        s.erase(s.begin(), std::find_if(s.begin(), s.end(),
-                                        [](unsigned char ch)
-                                        { return !std::isspace(ch); }));
-        s.erase(std::find_if(s.rbegin(), s.rend(),
-                             [](unsigned char ch)
-                             { return !std::isspace(ch); })
-                    .base(),
-                s.end());
+        m_relayer.post([this, messages = std::move(messages)]() mutable
+                       { relay(std::move(messages)); });
     }
 
-    void sms_handler(std::string raw_msg)
+    void schedule_retry()
     {
-        size_t pos = raw_msg.find("\n");
-        pos = raw_msg.find("\n", pos + 1);
-        if (pos == std::string::npos)
+        if (!m_retry_armed)
         {
-            std::cerr << "cannot handle the received SMS raw string: " << raw_msg
-                      << "; only one line is presented. No PDU line" << std::endl;
+            m_retry_armed = true;
+            m_reactor.rearm_timer(m_retry_timer, RETRY_INTERVAL);
         }
+    }
 
-        // Everything after that line is the PDU
-        auto pdu = raw_msg.substr(pos + 1);
-        trim(pdu);
-        try
+    // The journal's key of a long message, the same for its parts and the message they make
+    static std::string journal_key(const SMS &message)
+    {
+        return message.get_sender() + '/' + std::to_string(message.get_reference()) + '/' + std::to_string(message.get_count());
+    }
+
+    // Before the modems start: the parts a previous run journaled wait for the rest again, from now on
+    void recover()
+    {
+        const auto segments = m_journal->segments();
+        std::vector<SMS> ready;
+        for (const auto &segment : segments)
         {
-            SMS message(pdu);
-            std::cout << "Parsed to " << message << std::endl;
-            message.send_email();
+            try
+            {
+                m_reassembler.add(SMS(segment.pdu), ready);
+            }
+            catch (const std::exception &exp)
+            {
+                std::cerr << "Journaled part " << segment.pdu << ": " << exp.what() << std::endl;
+            }
         }
-        catch (const std::exception &exp)
+        if (!segments.empty())
         {
-            std::cerr << exp.what() << std::endl;
+            std::cout << segments.size() << " parts of long messages recovered from the segment journal" << std::endl;
+        }
+        relay(std::move(ready));
+    }
+
+    // On the main reactor: relay the messages past their deadline and wait for the next
+    void expire()
+    {
+        std::vector<SMS> ready;
+        m_reassembler.expire(ready);
+        if (!ready.empty())
+        {
+            std::cout << ready.size() << " long SMS relayed without all their parts" << std::endl;
+            relay_later(std::move(ready));
+        }
+        schedule_expiry();
+    }
+
+    void schedule_expiry()
+    {
+        const auto next = m_reassembler.next_deadline();
+        if (!next)
+        {
+            m_reactor.disarm_timer(m_expiry_timer);
+            return;
         }
+        // a zero delay would disarm the timer, so a deadline already past fires in a millisecond
+        const auto delay = std::chrono::ceil<std::chrono::milliseconds>(*next - Reassembler::Clock::now());
+        m_reactor.rearm_timer(m_expiry_timer, std::max(delay, std::chrono::milliseconds(1)));
     }
 
 private:
-    SerialPi m_serial;
+    Reactor m_reactor;
 
-    std::unique_ptr<std::thread> m_frontend_thread;
+    Utils::CommandPipe m_pipe{Utils::Role::SERVICE};
 
-    std::queue<std::shared_ptr<Utils::Interface::Command>> m_incoming_commands;
+    std::vector<std::unique_ptr<Modem>> m_modems;
 
-    std::mutex m_cmd_queue_mtx;
+    std::size_t m_ended = 0;
 
-    Utils::CommandPipe m_pipe{Utils::Role::SERVICE};
+    // Relays what the main reactor's timers hand on
+    Reactor m_relayer;
+
+    // One email at a time, whichever thread sends it
+    std::mutex m_email_mtx;
+
+    std::mutex m_relay_mtx;
+
+    // Long messages the email did not take, under m_relay_mtx, their parts still journaled
+    std::vector<SMS> m_unsent;
+
+    Utils::Options::Reassembly m_reassembly;
+
+    Reassembler m_reassembler;
+
+    std::unique_ptr<SegmentJournal> m_journal;
+
+    int m_expiry_timer = -1;
+
+    int m_retry_timer = -1;
+
+    bool m_retry_armed = false;
 };
 
 static std::unique_ptr<Service> ptr = nullptr;
@@ -302,22 +405,35 @@ void sig_int_handler(int sig)
     if (sig == SIGINT) std::cout << " Ctrl-C ";
     if (sig == SIGTERM) std::cout << " KILL ";
     std::cout << std::endl;
-    
-    ptr = nullptr;
+
+    exit(0);
 }
 
-int main()
+/**
+ * cellular_uart_service [DEVICE...]: one modem per DEVICE, e.g. the ptys of several cellular_modem_sim,
+ * set up like the first modem of the config; without any, the modems of the config
+ */
+int main(int argc, char **argv)
 {
-    std::signal(SIGINT, sig_int_handler);
-    std::signal(SIGTERM, sig_int_handler);
     std::signal(SIGABRT, Utils::Error::crash_printer);
     std::signal(SIGSEGV, Utils::Error::crash_printer);
     std::signal(SIGFPE, Utils::Error::crash_printer);
     std::signal(SIGILL, Utils::Error::crash_printer);
     std::signal(SIGBUS, Utils::Error::crash_printer);
 
-    ptr = std::make_unique<Service>(POWERKEY);
-    ptr->begin_daemon_thread();
+    // only until the event loop takes SIGINT/SIGTERM over through its signalfd
+    std::signal(SIGINT, sig_int_handler);
+    std::signal(SIGTERM, sig_int_handler);
+
+    // the devices on the command line, if any, instead of those of the config
+    const auto configs = Utils::Options::Serial::modems(std::vector<std::string>(argv + 1, argv + argc));
+    std::vector<Port> ports;
+    for (const auto &config : configs)
+    {
+        ports.push_back({config.get_name(), config.get_device(), config});
+    }
+    ptr = std::make_unique<Service>(POWERKEY, ports);
     ptr->loop();
+    ptr = nullptr;
     return 0;
 }
@@ -0,0 +1,183 @@
+#include "traffic_capture.hpp"
+#include "error.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace TrafficCapture
+{
+    constexpr uint32_t OUT_BIT = 0x80000000u;
+
+    constexpr std::size_t RECORD_HEADER = 8;
+
+    Recorder::Recorder(const std::string &path, const std::string &device, int baud, std::size_t limit)
+        : m_path(path), m_limit(limit), m_last(std::chrono::steady_clock::now())
+    {
+        m_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+        if (m_fd < 0)
+        {
+            throw Utils::Error::SystemError("open(" + path + ")", errno);
+        }
+        m_buffer.reserve(BUFFER_SIZE);
+        m_buffer.append(MAGIC);
+        const auto started = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 std::chrono::system_clock::now().time_since_epoch())
+                                 .count();
+        put32(static_cast<uint32_t>(started));
+        put32(static_cast<uint32_t>(static_cast<uint64_t>(started) >> 32));
+        put32(static_cast<uint32_t>(baud));
+        const auto name = device.substr(0, 0xFFFF);
+        m_buffer += static_cast<char>(name.size() & 0xFF);
+        m_buffer += static_cast<char>(name.size() >> 8);
+        m_buffer += name;
+    }
+
+    Recorder::~Recorder()
+    {
+        flush();
+        close(m_fd);
+    }
+
+    void Recorder::record(Direction direction, const struct iovec *data, int count, std::size_t length)
+    {
+        if (m_full || length == 0)
+        {
+            return;
+        }
+        if (size() + RECORD_HEADER + length > m_limit)
+        {
+            m_full = true;
+            std::cerr << "Capture " << m_path << " reached " << m_limit << " bytes, recording stops" << std::endl;
+            return;
+        }
+        const auto now = std::chrono::steady_clock::now();
+        const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - m_last).count();
+        m_last = now;
+        put32(static_cast<uint32_t>(std::min<long long>(elapsed, UINT32_MAX)));
+        put32(static_cast<uint32_t>(length) | (direction == Direction::OUT ? OUT_BIT : 0));
+        for (int idx = 0; idx < count && length > 0; idx++)
+        {
+            const auto part = std::min(length, data[idx].iov_len);
+            m_buffer.append(static_cast<const char *>(data[idx].iov_base), part);
+            length -= part;
+        }
+        m_records++;
+        if (m_buffer.size() >= BUFFER_SIZE)
+        {
+            flush();
+        }
+    }
+
+    void Recorder::flush()
+    {
+        std::size_t done = 0;
+        while (done < m_buffer.size())
+        {
+            const auto n = write(m_fd, m_buffer.data() + done, m_buffer.size() - done);
+            if (n < 0)
+            {
+                if (errno == EINTR) continue;
+                std::cerr << "Capture " << m_path << ": " << Utils::Error::SystemError("write", errno).what()
+                          << ", recording stops" << std::endl;
+                m_full = true;
+                break;
+            }
+            done += n;
+        }
+        m_written += done;
+        m_buffer.clear();
+    }
+
+    unsigned long Recorder::records() const
+    {
+        return m_records;
+    }
+
+    std::size_t Recorder::size() const
+    {
+        return m_written + m_buffer.size();
+    }
+
+    bool Recorder::full() const
+    {
+        return m_full;
+    }
+
+    void Recorder::put32(uint32_t value)
+    {
+        const char bytes[4] = {static_cast<char>(value), static_cast<char>(value >> 8), static_cast<char>(value >> 16),
+                               static_cast<char>(value >> 24)};
+        m_buffer.append(bytes, 4);
+    }
+
+    Reader::Reader(const std::string &path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            throw Utils::Error::SystemError("open(" + path + ")", errno);
+        }
+        m_content.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        constexpr std::size_t FIXED = MAGIC.size() + 8 + 4 + 2;
+        if (m_content.size() < FIXED || std::string_view(m_content).substr(0, MAGIC.size()) != MAGIC)
+        {
+            throw Utils::Error::ParserError(path + " is not a capture of cellular_uart_service");
+        }
+        const uint64_t started = get32(MAGIC.size()) | static_cast<uint64_t>(get32(MAGIC.size() + 4)) << 32;
+        m_started = std::chrono::system_clock::time_point(
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(started)));
+        m_baud = static_cast<int>(get32(MAGIC.size() + 8));
+        const std::size_t name_length = static_cast<uint8_t>(m_content[FIXED - 2]) |
+                                        static_cast<uint8_t>(m_content[FIXED - 1]) << 8;
+        m_device = m_content.substr(FIXED, name_length);
+        m_at = FIXED + name_length;
+    }
+
+    bool Reader::next(Record &record)
+    {
+        if (m_at + RECORD_HEADER > m_content.size())
+        {
+            return false;
+        }
+        const uint32_t delta = get32(m_at);
+        const uint32_t word = get32(m_at + 4);
+        const std::size_t length = word & ~OUT_BIT;
+        if (m_at + RECORD_HEADER + length > m_content.size())
+        {
+            return false;
+        }
+        m_clock += std::chrono::microseconds(delta);
+        record.at = m_clock;
+        record.direction = (word & OUT_BIT) ? Direction::OUT : Direction::IN;
+        record.data = std::string_view(m_content).substr(m_at + RECORD_HEADER, length);
+        record.offset = m_at;
+        m_at += RECORD_HEADER + length;
+        return true;
+    }
+
+    std::chrono::system_clock::time_point Reader::started() const
+    {
+        return m_started;
+    }
+
+    int Reader::baud() const
+    {
+        return m_baud;
+    }
+
+    const std::string &Reader::device() const
+    {
+        return m_device;
+    }
+
+    uint32_t Reader::get32(std::size_t at) const
+    {
+        const auto *bytes = reinterpret_cast<const uint8_t *>(m_content.data() + at);
+        return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | static_cast<uint32_t>(bytes[3]) << 24;
+    }
+} // namespace TrafficCapture
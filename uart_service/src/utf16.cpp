@@ -0,0 +1,412 @@
+#include "utf16.hpp"
+
+#include <array>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define UTF16_X86 1
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#elif defined(SMS_NEON) && defined(__ARM_NEON) && defined(__aarch64__)
+#define UTF16_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+    constexpr char REPLACEMENT[] = "\xEF\xBF\xBD";
+
+    unsigned int unit_at(const uint8_t *be, std::size_t idx)
+    {
+        return be[2 * idx] << 8 | be[2 * idx + 1];
+    }
+
+    // The code point at unit idx into out; returns the units it took, 2 for a surrogate pair
+    inline std::size_t put(const uint8_t *be, std::size_t idx, std::size_t units, char *out, std::size_t &written)
+    {
+        const unsigned int unit = unit_at(be, idx);
+        if (unit < 0x80)
+        {
+            out[written++] = static_cast<char>(unit);
+            return 1;
+        }
+        if (unit < 0x800)
+        {
+            out[written++] = static_cast<char>(0xC0 | unit >> 6);
+            out[written++] = static_cast<char>(0x80 | (unit & 0x3F));
+            return 1;
+        }
+        if ((unit & 0xFC00) == 0xD800 && idx + 1 < units)
+        {
+            if (const unsigned int low = unit_at(be, idx + 1); (low & 0xFC00) == 0xDC00)
+            {
+                const unsigned int code_point = 0x10000 + ((unit & 0x3FF) << 10 | (low & 0x3FF));
+                out[written++] = static_cast<char>(0xF0 | code_point >> 18);
+                out[written++] = static_cast<char>(0x80 | (code_point >> 12 & 0x3F));
+                out[written++] = static_cast<char>(0x80 | (code_point >> 6 & 0x3F));
+                out[written++] = static_cast<char>(0x80 | (code_point & 0x3F));
+                return 2;
+            }
+        }
+        // the rest of the BMP, and a surrogate on its own for finish() to join or replace
+        out[written++] = static_cast<char>(0xE0 | unit >> 12);
+        out[written++] = static_cast<char>(0x80 | (unit >> 6 & 0x3F));
+        out[written++] = static_cast<char>(0x80 | (unit & 0x3F));
+        return 1;
+    }
+
+    // The leading units of 8 whose lane of mask is set, from a movemask of 16-bit lanes. A full run is
+    // told by a branch, which is predicted, so the next load need not wait for the count
+    inline std::size_t leading(unsigned int mask)
+    {
+        if (mask == 0xFFFF)
+        {
+            return 8;
+        }
+        return __builtin_ctz(~mask) / 2;
+    }
+
+#if defined(UTF16_X86) || defined(UTF16_NEON)
+    // For 8 units as 2 bytes each, the shuffle that leaves out the second byte of the lanes set in an 8-bit
+    // mask of the ASCII ones, and the bytes left
+    struct Compaction
+    {
+        uint8_t shuffle[16];
+        uint8_t length;
+    };
+
+    constexpr std::array<Compaction, 256> compactions()
+    {
+        std::array<Compaction, 256> table{};
+        for (unsigned int mask = 0; mask < 256; mask++)
+        {
+            uint8_t at = 0;
+            for (unsigned int lane = 0; lane < 8; lane++)
+            {
+                table[mask].shuffle[at++] = static_cast<uint8_t>(2 * lane);
+                if ((mask >> lane & 1) == 0) table[mask].shuffle[at++] = static_cast<uint8_t>(2 * lane + 1);
+            }
+            table[mask].length = at;
+            while (at < 16) table[mask].shuffle[at++] = 0x80; // zero, for pshufb and tbl alike
+        }
+        return table;
+    }
+
+    constexpr auto COMPACTIONS = compactions();
+#endif
+
+#if defined(UTF16_X86)
+    /**
+     * The run of 8 units at be that take as many bytes as the first, up to 24 bytes into out; returns the
+     * units taken, none if the first is a surrogate. Units stay in 16-bit lanes: an ASCII run packs to
+     * bytes, two bytes per unit are built in their lane, and three are the lead byte of each unit with
+     * the two trailing ones of its lane, interleaved by shuffles. 8 units of 1 and 2 bytes mixed, as in
+     * accented Latin text, are taken together: each as 2 bytes, the second of the ASCII ones then left out.
+     */
+    __attribute__((target("ssse3"))) inline std::size_t run_ssse3(const uint8_t *be, char *out,
+                                                                  std::size_t &written)
+    {
+        const __m128i units = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(be)),
+                                               _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14));
+        // unsigned compares as signed ones, with the sign bit flipped
+        const __m128i biased = _mm_xor_si128(units, _mm_set1_epi16(-0x8000));
+        const __m128i is_one = _mm_cmplt_epi16(biased, _mm_set1_epi16(0x80 - 0x8000));
+        const unsigned int one = _mm_movemask_epi8(is_one);
+        const unsigned int two = _mm_movemask_epi8(_mm_cmplt_epi16(biased, _mm_set1_epi16(0x800 - 0x8000)));
+        auto *target = reinterpret_cast<__m128i *>(out + written);
+        const __m128i low_six = _mm_set1_epi16(0x3F);
+        const __m128i last = _mm_slli_epi16(_mm_or_si128(_mm_and_si128(units, low_six), _mm_set1_epi16(0x80)), 8);
+        const __m128i lead = _mm_or_si128(_mm_srli_epi16(units, 6), _mm_set1_epi16(0xC0));
+        if (two == 0xFFFF && one != 0xFFFF)
+        {
+            const __m128i pairs = _mm_or_si128(_mm_and_si128(is_one, units), _mm_andnot_si128(is_one, _mm_or_si128(lead, last)));
+            const auto &compaction = COMPACTIONS[_mm_movemask_epi8(_mm_packs_epi16(is_one, _mm_setzero_si128()))];
+            _mm_storeu_si128(target, _mm_shuffle_epi8(pairs, _mm_loadu_si128(reinterpret_cast<const __m128i *>(compaction.shuffle))));
+            written += compaction.length;
+            return 8;
+        }
+        if (one & 1)
+        {
+            _mm_storel_epi64(target, _mm_packus_epi16(units, units));
+            const std::size_t run = leading(one);
+            written += run;
+            return run;
+        }
+        if (two & 1)
+        {
+            _mm_storeu_si128(target, _mm_or_si128(lead, last));
+            const std::size_t run = leading(two & ~one);
+            written += 2 * run;
+            return run;
+        }
+        const unsigned int surrogate = _mm_movemask_epi8(
+            _mm_cmpeq_epi16(_mm_and_si128(units, _mm_set1_epi16(-0x800)), _mm_set1_epi16(-0x2800)));
+        const std::size_t run = leading(~two & ~surrogate & 0xFFFF);
+        if (run == 0)
+        {
+            return 0;
+        }
+        const __m128i leads = _mm_packus_epi16(_mm_or_si128(_mm_srli_epi16(units, 12), _mm_set1_epi16(0xE0)),
+                                               _mm_setzero_si128());
+        const __m128i trail = _mm_or_si128(
+            _mm_or_si128(_mm_and_si128(_mm_srli_epi16(units, 6), low_six), _mm_set1_epi16(0x80)), last);
+        // output byte 3i is lead byte i, 3i + 1 and 3i + 2 are bytes 2i and 2i + 1 of trail
+        const __m128i first = _mm_or_si128(
+            _mm_shuffle_epi8(leads, _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5)),
+            _mm_shuffle_epi8(trail, _mm_setr_epi8(-1, 0, 1, -1, 2, 3, -1, 4, 5, -1, 6, 7, -1, 8, 9, -1)));
+        const __m128i second = _mm_or_si128(
+            _mm_shuffle_epi8(leads, _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(trail, _mm_setr_epi8(10, 11, -1, 12, 13, -1, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1)));
+        _mm_storeu_si128(target, first);
+        _mm_storel_epi64(target + 1, second);
+        written += 3 * run;
+        return run;
+    }
+
+    __attribute__((target("ssse3"))) std::size_t transcode_ssse3(const uint8_t *be, std::size_t units, char *out)
+    {
+        std::size_t written = 0;
+        for (std::size_t idx = 0; idx < units;)
+        {
+            if (units - idx >= 8)
+            {
+                if (const std::size_t run = run_ssse3(be + 2 * idx, out, written); run > 0)
+                {
+                    idx += run;
+                    continue;
+                }
+            }
+            idx += put(be, idx, units, out, written);
+        }
+        return written;
+    }
+
+    bool has_ssse3()
+    {
+        static const bool supported = __builtin_cpu_supports("ssse3");
+        return supported;
+    }
+#elif defined(UTF16_NEON)
+    // The leading lanes of 8 that are set in a comparison result
+    inline std::size_t leading(uint16x8_t mask)
+    {
+        const uint64_t lanes = vget_lane_u64(vreinterpret_u64_u8(vmovn_u16(mask)), 0);
+        if (lanes == ~uint64_t{0})
+        {
+            return 8;
+        }
+        return __builtin_ctzll(~lanes) / 8;
+    }
+
+    // As run_ssse3, with NEON's interleaving stores
+    inline std::size_t run_neon(const uint8_t *be, char *out, std::size_t &written)
+    {
+        const uint16x8_t units = vreinterpretq_u16_u8(vrev16q_u8(vld1q_u8(be)));
+        auto *target = reinterpret_cast<uint8_t *>(out + written);
+        const uint16x8_t one = vcltq_u16(units, vdupq_n_u16(0x80));
+        const uint16x8_t two = vcltq_u16(units, vdupq_n_u16(0x800));
+        const uint16x8_t low_six = vdupq_n_u16(0x3F);
+        const uint8x8_t last = vmovn_u16(vorrq_u16(vandq_u16(units, low_six), vdupq_n_u16(0x80)));
+        if (vminvq_u16(two) != 0 && vminvq_u16(one) == 0)
+        {
+            // lead byte low in each lane, trailing byte high, as little-endian stores them
+            const uint16x8_t lead = vorrq_u16(vshrq_n_u16(units, 6), vdupq_n_u16(0xC0));
+            const uint16x8_t pairs = vbslq_u16(one, units, vorrq_u16(lead, vshlq_n_u16(vmovl_u8(last), 8)));
+            const auto mask = vaddv_u8(vand_u8(vmovn_u16(one), vcreate_u8(0x8040201008040201ull)));
+            const auto &compaction = COMPACTIONS[mask];
+            vst1q_u8(target, vqtbl1q_u8(vreinterpretq_u8_u16(pairs), vld1q_u8(compaction.shuffle)));
+            written += compaction.length;
+            return 8;
+        }
+        if (vgetq_lane_u16(one, 0))
+        {
+            vst1_u8(target, vmovn_u16(units));
+            const std::size_t run = leading(one);
+            written += run;
+            return run;
+        }
+        if (vgetq_lane_u16(two, 0))
+        {
+            const uint8x8x2_t bytes{{vmovn_u16(vorrq_u16(vshrq_n_u16(units, 6), vdupq_n_u16(0xC0))), last}};
+            vst2_u8(target, bytes);
+            const std::size_t run = leading(vbicq_u16(two, one));
+            written += 2 * run;
+            return run;
+        }
+        const uint16x8_t surrogate = vceqq_u16(vandq_u16(units, vdupq_n_u16(0xF800)), vdupq_n_u16(0xD800));
+        const std::size_t run = leading(vmvnq_u16(vorrq_u16(two, surrogate)));
+        if (run == 0)
+        {
+            return 0;
+        }
+        const uint8x8x3_t bytes{{vmovn_u16(vorrq_u16(vshrq_n_u16(units, 12), vdupq_n_u16(0xE0))),
+                                 vmovn_u16(vorrq_u16(vandq_u16(vshrq_n_u16(units, 6), low_six), vdupq_n_u16(0x80))),
+                                 last}};
+        vst3_u8(target, bytes);
+        written += 3 * run;
+        return run;
+    }
+#endif
+
+    std::size_t transcode(const uint8_t *be, std::size_t units, char *out)
+    {
+        std::size_t written = 0;
+        for (std::size_t idx = 0; idx < units;)
+        {
+#if defined(UTF16_NEON)
+            if (units - idx >= 8)
+            {
+                if (const std::size_t run = run_neon(be + 2 * idx, out, written); run > 0)
+                {
+                    idx += run;
+                    continue;
+                }
+            }
+#endif
+            idx += put(be, idx, units, out, written);
+        }
+        return written;
+    }
+
+    /**
+     * The length of the UTF-8 sequence at text[idx] and its code point, 0 if it is not well-formed: a lead
+     * byte, as many continuation bytes as it announces, and no overlong form or code point past U+10FFFF.
+     * Surrogates pass, for the caller to tell apart.
+     */
+    std::size_t sequence(const std::string &text, std::size_t idx, unsigned int &code_point)
+    {
+        const auto *bytes = reinterpret_cast<const unsigned char *>(text.data()) + idx;
+        const std::size_t left = text.size() - idx;
+        const unsigned int lead = bytes[0];
+        std::size_t length = 0;
+        unsigned int lowest = 0;
+        if (lead < 0x80)
+        {
+            code_point = lead;
+            return 1;
+        }
+        if (lead >= 0xC2 && lead <= 0xDF)
+        {
+            length = 2;
+            code_point = lead & 0x1F;
+            lowest = 0x80;
+        }
+        else if (lead >= 0xE0 && lead <= 0xEF)
+        {
+            length = 3;
+            code_point = lead & 0x0F;
+            lowest = 0x800;
+        }
+        else if (lead >= 0xF0 && lead <= 0xF4)
+        {
+            length = 4;
+            code_point = lead & 0x07;
+            lowest = 0x10000;
+        }
+        if (length == 0 || length > left)
+        {
+            return 0;
+        }
+        for (std::size_t each = 1; each < length; each++)
+        {
+            if ((bytes[each] & 0xC0) != 0x80)
+            {
+                return 0;
+            }
+            code_point = code_point << 6 | (bytes[each] & 0x3F);
+        }
+        return code_point >= lowest && code_point <= 0x10FFFF ? length : 0;
+    }
+} // namespace
+
+std::size_t Utf16::to_utf8(const uint8_t *be, std::size_t units, char *out)
+{
+#if defined(UTF16_X86)
+    if (has_ssse3())
+    {
+        return transcode_ssse3(be, units, out);
+    }
+#endif
+    return transcode(be, units, out);
+}
+
+std::size_t Utf16::to_utf8_scalar(const uint8_t *be, std::size_t units, char *out)
+{
+    std::size_t written = 0;
+    for (std::size_t idx = 0; idx < units;)
+    {
+        idx += put(be, idx, units, out, written);
+    }
+    return written;
+}
+
+std::size_t Utf16::finish(std::string &text)
+{
+    std::size_t replaced = 0;
+    std::string fixed;
+    bool changed = false;
+    // text[copied..idx) is fine but not in fixed yet
+    std::size_t copied = 0;
+    for (std::size_t idx = 0; idx < text.size();)
+    {
+        // ASCII 8 bytes at a time
+        if (idx + 8 <= text.size())
+        {
+            uint64_t eight;
+            std::memcpy(&eight, text.data() + idx, sizeof(eight));
+            if ((eight & 0x8080808080808080ull) == 0)
+            {
+                idx += 8;
+                continue;
+            }
+        }
+        unsigned int code_point = 0;
+        const std::size_t length = sequence(text, idx, code_point);
+        if (length != 0 && (code_point & 0xF800) != 0xD800)
+        {
+            idx += length;
+            continue;
+        }
+        if (!changed)
+        {
+            fixed.reserve(text.size() + 16);
+            changed = true;
+        }
+        fixed.append(text, copied, idx - copied);
+        unsigned int low = 0;
+        if (length != 0 && (code_point & 0xFC00) == 0xD800 && idx + 3 < text.size() &&
+            sequence(text, idx + 3, low) == 3 && (low & 0xFC00) == 0xDC00)
+        {
+            const unsigned int joined = 0x10000 + ((code_point & 0x3FF) << 10 | (low & 0x3FF));
+            fixed += static_cast<char>(0xF0 | joined >> 18);
+            fixed += static_cast<char>(0x80 | (joined >> 12 & 0x3F));
+            fixed += static_cast<char>(0x80 | (joined >> 6 & 0x3F));
+            fixed += static_cast<char>(0x80 | (joined & 0x3F));
+            idx += 6;
+        }
+        else
+        {
+            fixed += REPLACEMENT;
+            replaced++;
+            idx += length != 0 ? length : 1;
+        }
+        copied = idx;
+    }
+    if (changed)
+    {
+        fixed.append(text, copied, std::string::npos);
+        text.swap(fixed);
+    }
+    return replaced;
+}
+
+const char *Utf16::vector_unit()
+{
+#if defined(UTF16_X86)
+    return has_ssse3() ? "SSSE3" : "none";
+#elif defined(UTF16_NEON)
+    return "NEON";
+#else
+    return "none";
+#endif
+}
@@ -37,6 +37,15 @@ namespace Utils
 
         void listen(std::function<void(std::shared_ptr<Interface::AMessage>)> callback);
 
+        // Open the listening end without blocking, so that an event loop can watch it (edge-triggered)
+        int listen_fd();
+
+        /**
+         * Read whatever the writers have put into the pipe without blocking. A message is complete
+         * once it ends with a newline or its writer closes the pipe; each complete one goes to callback.
+         */
+        void drain(const std::function<void(std::shared_ptr<Interface::AMessage>)> &callback);
+
         // Send a string into the pipe.
         void send(const std::shared_ptr<Interface::AMessage>& message);
 
@@ -48,6 +57,9 @@ namespace Utils
         unsigned int listen_idx = 1;
 
         std::ifstream ifs;
+
+        int listen_fd_ = -1;
+        std::string pending_;
     };
 }
 
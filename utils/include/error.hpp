@@ -16,7 +16,8 @@ namespace Utils::Error
         PARSER_ERROR = 2,
         PIPE_ERROR = 3,
         SMS_PDU_ERROR = 4,
-        EMAIL_ERROR = 5
+        EMAIL_ERROR = 5,
+        SYSTEM_ERROR = 6
     };
 
     std::ostream &operator<<(std::ostream &os, const Type &type);
@@ -89,6 +90,12 @@ namespace Utils::Error
     public:
         EmailError(std::optional<CURLcode> curlErrorCode, std::string description);
     };
+
+    class SystemError : public BaseError<Type::SYSTEM_ERROR>
+    {
+    public:
+        SystemError(const std::string &call, int error_number);
+    };
 }
 
 #endif // LOGGER_HPP
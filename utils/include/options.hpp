@@ -5,6 +5,7 @@
 #include <memory>
 #include <mutex>
 #include <string>
+#include <vector>
 
 namespace Utils::Options
 {
@@ -65,6 +66,120 @@ private:
 
 };
 
+/**
+ * The "serial" block of the config:
+ *   serial:
+ *     device: /dev/ttyS0   # or a USB AT port, or the pty of cellular_modem_sim
+ *     baud: 115200
+ *     cmux: true           # optional, multiplex URCs, SMS and front-end commands (27.010)
+ *     direct_delivery: true # optional, messages inline with +CMT and acknowledged, not stored on the SIM
+ *     ring_indicator:      # optional, the RI pin of the modem on a GPIO
+ *       chip: /dev/gpiochip0
+ *       line: 27
+ *     capture:             # optional, record the traffic for cellular_replay
+ *       file: /var/log/cellular_modem0.cap
+ *       limit_mb: 64
+ *
+ * and, for several modems, a "modems" list of such blocks; what an entry leaves out comes from "serial":
+ *   modems:
+ *     - name: uart
+ *       device: /dev/ttyS0
+ *     - name: usb
+ *       device: /dev/ttyUSB2
+ */
+class Serial: public Base
+{
+public:
+
+    Serial();
+    Serial(const Serial& other) = default;
+    Serial(Serial&& other) = default;
+    Serial& operator=(const Serial& other) = default;
+    Serial& operator=(Serial&& other) = default;
+
+    /**
+     * Every modem of the "modems" list, or the one of the "serial" block if there is none; given devices (the
+     * service's command line), one modem per device instead, each with the rest of the first block. Modems
+     * that would record to the same capture file get one each, named after them ("cellular.modem1.cap").
+     */
+    static std::vector<Serial> modems(const std::vector<std::string>& devices = {});
+
+    std::string get_name() const;
+    std::string get_device() const;
+    int get_baud() const;
+    int get_target_baud() const;
+    std::string get_flow_control() const;
+    unsigned int get_pipeline_depth() const;
+    std::string get_ring_indicator_chip() const;
+    unsigned int get_ring_indicator_line() const;
+    unsigned int get_stats_interval() const;
+    bool get_cmux() const;
+    unsigned int get_cmux_frame_size() const;
+    bool get_direct_delivery() const;
+    std::string get_capture_file() const;
+    unsigned int get_capture_limit_mb() const;
+
+private:
+
+    Serial(const Serial& defaults, const YAML::Node& block, std::string default_name);
+
+    // The blocks of the "modems" list, or the "serial" block alone
+    static std::vector<Serial> configured();
+
+    // Read the keys present in block, keeping the current value of the others
+    void parse(const YAML::Node& block);
+
+    std::string name = "modem0";
+    std::string device = "/dev/ttyS0";
+    int baud = 115200;
+    // rate to move modem and host to with AT+IPR after start-up; 0 stays at baud
+    int target_baud = 0;
+    // RTS/CTS: "off", "on", or "auto" to turn it on once the UART overruns
+    std::string flow_control = "off";
+    // AT commands written before the previous one is answered; V.250 only promises 1
+    unsigned int pipeline_depth = 1;
+    // GPIO character device and line offset RI is wired to; empty when it is not
+    std::string ring_indicator_chip;
+    unsigned int ring_indicator_line = 0;
+    // seconds between dumps of the I/O and AT statistics to the log, 0 only on SIGUSR1 and at exit
+    unsigned int stats_interval = 0;
+    // 27.010 multiplexing (AT+CMUX): URCs, SMS and the front-end on channels of their own
+    bool cmux = false;
+    // the most information bytes in a frame, N1 of AT+CMUX; 31 is the default of the basic option
+    unsigned int cmux_frame_size = 31;
+    // AT+CNMI=2,2: the modem hands messages over with +CMT and the service acknowledges each with AT+CNMA
+    // once it took it, instead of the modem storing them for AT+CMGR
+    bool direct_delivery = false;
+    // where every byte read from and written to the modem is recorded, empty for nowhere
+    std::string capture_file;
+    // MiB after which recording stops
+    unsigned int capture_limit_mb = 64;
+};
+
+/**
+ * The "reassembly" block of the config, for the parts of concatenated messages:
+ *   reassembly:
+ *     timeout: 600   # seconds after its first part that a message is relayed with the parts it has
+ *     limit_kb: 256  # the most the waiting parts may take; beyond it the oldest message is relayed as it is
+ *     journal: /var/lib/cellular_uart_service/segments.journal  # where the parts are kept across restarts, "" for nowhere
+ */
+class Reassembly: public Base
+{
+public:
+
+    Reassembly();
+
+    unsigned int get_timeout() const;
+    unsigned int get_limit_kb() const;
+    std::string get_journal() const;
+
+private:
+
+    unsigned int timeout = 600;
+    unsigned int limit_kb = 256;
+    std::string journal = "/var/lib/cellular_uart_service/segments.journal";
+};
+
 } // namespace Utils::Options
 
 
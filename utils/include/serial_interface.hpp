@@ -1,3 +1,6 @@
+#ifndef SERIAL_INTERFACE_HPP
+#define SERIAL_INTERFACE_HPP
+
 
 #include <iostream>
 #include <string>
@@ -10,32 +13,43 @@ namespace Utils::Interface
     {
         UNKNOWN = 0,
         COMMAND = 1,
-        PROMPT = 2
+        PROMPT = 2,
+        SMS = 3
     };
 
+    /**
+     * A message between the front-end and the service, one per line: its type, then "@<modem> " when it
+     * concerns one modem of several, then its content, e.g. "1@usb AT+CSQ", "2@usb +CSQ: 20,99" or
+     * "3@usb +447700900123 Hello". Without a modem a command or SMS goes to the first one.
+     */
     class AMessage
     {
     public:
 
-        explicit AMessage(Type direction);
+        explicit AMessage(Type direction, std::optional<std::string> modem = std::nullopt);
     
         friend std::ostream& operator<<(std::ostream& os, const std::shared_ptr<AMessage>& cmd);
 
         virtual std::string message() const = 0;
 
+        // The name of the modem it is for or from, if it names one
+        const std::optional<std::string>& modem() const;
+
     protected:
         virtual std::string to_string() const = 0;
 
 
     private:
         Type type_;
+        std::optional<std::string> modem_;
     };
 
     class Command : public AMessage
     {
     public:
 
-        Command(std::string at_command, std::optional<std::string> expected_respond);
+        Command(std::string at_command, std::optional<std::string> expected_respond,
+                std::optional<std::string> modem = std::nullopt);
 
         Command(const Command&) = default;
 
@@ -61,7 +75,7 @@ namespace Utils::Interface
     {
     public:
 
-        explicit Prompt(std::string message);
+        explicit Prompt(std::string message, std::optional<std::string> modem = std::nullopt);
 
         Prompt(const Prompt&) = default;
 
@@ -80,5 +94,36 @@ namespace Utils::Interface
         const std::string message_;
     };
 
+    // An SMS for the modem to send: the recipient's number, then the text (UTF-8) to the end of the line
+    class Sms : public AMessage
+    {
+    public:
+
+        Sms(std::string recipient, std::string text, std::optional<std::string> modem = std::nullopt);
+
+        Sms(const Sms&) = default;
+
+        Sms(Sms&&) = default;
+
+        Sms& operator=(const Sms&) = delete;
+
+        Sms& operator=(Sms&&) = delete;
+
+        std::string message() const override;
+
+        const std::string& recipient() const;
+
+        const std::string& text() const;
+
+    protected:
+        std::string to_string() const override;
+
+    private:
+        const std::string recipient_;
+        const std::string text_;
+    };
+
     std::shared_ptr<AMessage> parse(std::istream& is);
 }
+
+#endif // SERIAL_INTERFACE_HPP
@@ -5,6 +5,7 @@
 #include <sys/types.h>
 #include <fcntl.h>
 #include <stdexcept>
+#include <sstream>
 
 using namespace Utils;
 
@@ -53,6 +54,11 @@ void CommandPipe::close()
     {
         ifs.close();
     }
+    if (listen_fd_ >= 0)
+    {
+        ::close(listen_fd_);
+        listen_fd_ = -1;
+    }
 }
 
 void CommandPipe::listen(std::function<void(std::shared_ptr<Interface::AMessage>)> callback)
@@ -74,6 +80,58 @@ void CommandPipe::listen(std::function<void(std::shared_ptr<Interface::AMessage>
     std::cout << "Pipe " << PIPE_PATH[listen_idx] << " is closed" << std::endl;
 }
 
+int CommandPipe::listen_fd()
+{
+    if (listen_fd_ < 0)
+    {
+        listen_fd_ = open(PIPE_PATH[listen_idx], O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (listen_fd_ < 0)
+        {
+            throw Error::PipeError(std::string("fail to open ") + PIPE_PATH[listen_idx] + " without blocking");
+        }
+        std::cout << "Pipe " << PIPE_PATH[listen_idx] << " is watched by the event loop" << std::endl;
+    }
+    return listen_fd_;
+}
+
+void CommandPipe::drain(const std::function<void(std::shared_ptr<Interface::AMessage>)> &callback)
+{
+    char buffer[512];
+    bool writer_closed = false;
+    while (true)
+    {
+        auto n = read(listen_fd_, buffer, sizeof(buffer));
+        if (n > 0)
+        {
+            pending_.append(buffer, n);
+            continue;
+        }
+        writer_closed = n == 0; // otherwise EAGAIN: the writer is still connected
+        break;
+    }
+
+    auto complete = writer_closed ? pending_.size() : pending_.rfind('\n');
+    if (complete == std::string::npos || complete == 0)
+    {
+        return;
+    }
+    std::istringstream messages(pending_.substr(0, complete));
+    pending_.erase(0, writer_closed ? complete : complete + 1);
+
+    while (!(messages >> std::ws).eof())
+    {
+        try
+        {
+            callback(Interface::parse(messages));
+        }
+        catch (const std::exception &error)
+        {
+            std::cerr << error.what() << std::endl;
+            return;
+        }
+    }
+}
+
 void CommandPipe::send(const std::shared_ptr<Interface::AMessage>& message)
 {
     switch (role_)
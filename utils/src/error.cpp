@@ -29,6 +29,9 @@ namespace Utils::Error
         case Type::EMAIL_ERROR:
             os << "EMAIL ERROR";
             break;
+        case Type::SYSTEM_ERROR:
+            os << "SYSTEM CALL ERROR";
+            break;
         }
         os << ")]";
         return os;
@@ -52,6 +55,8 @@ namespace Utils::Error
     EmailError::EmailError(std::optional<CURLcode> curlErrorCode, std::string description) :
         BaseError("CURL fail " + (curlErrorCode ? (EmailError_FailAtCall + curl_easy_strerror(*curlErrorCode) + ") ") : EmailError_FailAtInit) + description) {}
 
+    SystemError::SystemError(const std::string &call, int error_number) : BaseError(call + " failed: " + strerror(error_number)) {}
+
     void crash_printer(int sig)
     {
         void *buffer[64];
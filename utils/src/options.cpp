@@ -1,3 +1,4 @@
+#include <map>
 #include <sstream>
 #include <iostream>
 #include "options.hpp"
@@ -116,4 +117,175 @@ std::string Email::get_receiver_bracket() const { return receiver_bracket; }
 bool Email::is_valid() const { return m_valid; }
 
 
+Serial::Serial(): Base()
+{
+    if (all_configs == nullptr || !(*all_configs)["serial"] || !(*all_configs)["serial"].IsMap())
+    {
+        std::cout << "Config: no 'serial' block, using " << device << " at " << baud << " baud" << std::endl;
+        return;
+    }
+    parse((*all_configs)["serial"]);
+}
+
+Serial::Serial(const Serial& defaults, const YAML::Node& block, std::string default_name): Serial(defaults)
+{
+    name = std::move(default_name);
+    parse(block);
+}
+
+std::vector<Serial> Serial::modems(const std::vector<std::string>& devices)
+{
+    auto all = configured();
+    if (!devices.empty())
+    {
+        const Serial first = all.front();
+        all.clear();
+        for (std::size_t idx = 0; idx < devices.size(); idx++)
+        {
+            all.push_back(first);
+            all.back().name = "modem" + std::to_string(idx);
+            all.back().device = devices[idx];
+        }
+    }
+    // two recorders on one file would truncate and interleave it
+    std::map<std::string, unsigned int> sharing;
+    for (const auto& each : all)
+    {
+        if (!each.capture_file.empty()) sharing[each.capture_file]++;
+    }
+    for (auto& each : all)
+    {
+        if (each.capture_file.empty() || sharing[each.capture_file] < 2) continue;
+        const auto slash = each.capture_file.rfind('/');
+        const auto dot = each.capture_file.rfind('.');
+        const auto at = dot != std::string::npos && (slash == std::string::npos || dot > slash) ? dot : each.capture_file.size();
+        each.capture_file.insert(at, "." + each.name);
+        std::cout << "Config: " << each.name << " records its traffic to " << each.capture_file << std::endl;
+    }
+    return all;
+}
+
+std::vector<Serial> Serial::configured()
+{
+    const Serial defaults;
+    if (all_configs == nullptr || !(*all_configs)["modems"])
+    {
+        return {defaults};
+    }
+    const auto list = (*all_configs)["modems"];
+    if (!list.IsSequence() || list.size() == 0)
+    {
+        std::cerr << "The config yaml at " << CONFIG_PATH << " has a 'modems' entry that is not a list of serial blocks;"
+                     " using the 'serial' block alone" << std::endl;
+        return {defaults};
+    }
+    std::vector<Serial> all;
+    for (std::size_t idx = 0; idx < list.size(); idx++)
+    {
+        all.push_back(Serial(defaults, list[idx], "modem" + std::to_string(idx)));
+    }
+    return all;
+}
+
+void Serial::parse(const YAML::Node& block)
+{
+    try
+    {
+        name = block["name"].as<std::string>(name);
+        device = block["device"].as<std::string>(device);
+        baud = block["baud"].as<int>(baud);
+        target_baud = block["target_baud"].as<int>(target_baud);
+        flow_control = block["flow_control"].as<std::string>(flow_control);
+        if (flow_control != "off" && flow_control != "on" && flow_control != "auto")
+        {
+            std::cerr << "Config: flow_control is one of off, on, auto; not " << flow_control << ", using off" << std::endl;
+            flow_control = "off";
+        }
+        pipeline_depth = block["pipeline_depth"].as<unsigned int>(pipeline_depth);
+        stats_interval = block["stats_interval"].as<unsigned int>(stats_interval);
+        cmux = block["cmux"].as<bool>(cmux);
+        cmux_frame_size = block["cmux_frame_size"].as<unsigned int>(cmux_frame_size);
+        if (cmux_frame_size < 1 || cmux_frame_size > 32767)
+        {
+            std::cerr << "Config: cmux_frame_size is 1 to 32767, not " << cmux_frame_size << ", using 31" << std::endl;
+            cmux_frame_size = 31;
+        }
+        direct_delivery = block["direct_delivery"].as<bool>(direct_delivery);
+        if (auto ring_indicator = block["ring_indicator"]; ring_indicator && ring_indicator.IsMap())
+        {
+            ring_indicator_chip = ring_indicator["chip"].as<std::string>(ring_indicator_chip);
+            ring_indicator_line = ring_indicator["line"].as<unsigned int>(ring_indicator_line);
+        }
+        if (auto capture = block["capture"]; capture && capture.IsMap())
+        {
+            capture_file = capture["file"].as<std::string>(capture_file);
+            capture_limit_mb = capture["limit_mb"].as<unsigned int>(capture_limit_mb);
+        }
+        std::cout << "Config: " << name << " on serial port " << device << " at " << baud << " baud";
+        if (target_baud > 0) std::cout << ", then " << target_baud << " baud";
+        std::cout << ", flow control " << flow_control << ", up to " << pipeline_depth << " AT commands in flight";
+        if (stats_interval > 0) std::cout << ", statistics every " << stats_interval << " s";
+        if (cmux) std::cout << ", multiplexed in frames of up to " << cmux_frame_size << " bytes";
+        if (direct_delivery) std::cout << ", messages delivered directly";
+        if (!ring_indicator_chip.empty()) std::cout << ", ring indicator on line " << ring_indicator_line << " of " << ring_indicator_chip;
+        if (!capture_file.empty()) std::cout << ", traffic recorded to " << capture_file << " (up to " << capture_limit_mb << " MiB)";
+        std::cout << std::endl;
+    }
+    catch (const YAML::Exception& e)
+    {
+        std::cerr << "The config yaml at " << CONFIG_PATH << " has an invalid serial block for " << name << "; using "
+                  << device << " at " << baud << " baud. The error is: " << e.what() << std::endl;
+    }
+}
+
+std::string Serial::get_name() const { return name; }
+std::string Serial::get_device() const { return device; }
+int Serial::get_baud() const { return baud; }
+int Serial::get_target_baud() const { return target_baud; }
+std::string Serial::get_flow_control() const { return flow_control; }
+unsigned int Serial::get_pipeline_depth() const { return pipeline_depth; }
+std::string Serial::get_ring_indicator_chip() const { return ring_indicator_chip; }
+unsigned int Serial::get_ring_indicator_line() const { return ring_indicator_line; }
+unsigned int Serial::get_stats_interval() const { return stats_interval; }
+bool Serial::get_cmux() const { return cmux; }
+unsigned int Serial::get_cmux_frame_size() const { return cmux_frame_size; }
+bool Serial::get_direct_delivery() const { return direct_delivery; }
+std::string Serial::get_capture_file() const { return capture_file; }
+unsigned int Serial::get_capture_limit_mb() const { return capture_limit_mb; }
+
+
+Reassembly::Reassembly(): Base()
+{
+    if (all_configs == nullptr || !(*all_configs)["reassembly"] || !(*all_configs)["reassembly"].IsMap())
+    {
+        return;
+    }
+    const auto block = (*all_configs)["reassembly"];
+    try
+    {
+        timeout = block["timeout"].as<unsigned int>(timeout);
+        limit_kb = block["limit_kb"].as<unsigned int>(limit_kb);
+        journal = block["journal"].as<std::string>(journal);
+        if (timeout == 0 || limit_kb == 0)
+        {
+            std::cerr << "Config: reassembly timeout and limit_kb are at least 1, using 600 s and 256 KiB" << std::endl;
+            timeout = 600;
+            limit_kb = 256;
+        }
+        std::cout << "Config: long messages wait up to " << timeout << " s for their parts, which take up to "
+                  << limit_kb << " KiB, " << (journal.empty() ? "kept in memory only" : "journaled to " + journal)
+                  << std::endl;
+    }
+    catch (const YAML::Exception& e)
+    {
+        std::cerr << "The config yaml at " << CONFIG_PATH << " has an invalid reassembly block; using " << timeout
+                  << " s and " << limit_kb << " KiB. The error is: " << e.what() << std::endl;
+    }
+}
+
+unsigned int Reassembly::get_timeout() const { return timeout; }
+unsigned int Reassembly::get_limit_kb() const { return limit_kb; }
+std::string Reassembly::get_journal() const { return journal; }
+
+
 }// namespace Utils::Options
@@ -4,7 +4,13 @@
 
 namespace Utils::Interface
 {
-    AMessage::AMessage(Type direction) : type_(std::move(direction)) {}
+    AMessage::AMessage(Type direction, std::optional<std::string> modem) : type_(std::move(direction)),
+                                                                            modem_(std::move(modem)) {}
+
+    const std::optional<std::string> &AMessage::modem() const
+    {
+        return modem_;
+    }
 
     std::ostream &operator<<(std::ostream &os, const std::shared_ptr<AMessage> &cmd)
     {
@@ -15,12 +21,17 @@ namespace Utils::Interface
         }
 
         os << static_cast<unsigned int>(cmd->type_);
+        if (cmd->modem_)
+        {
+            os << '@' << *cmd->modem_ << ' ';
+        }
         os << cmd->to_string();
         return os;
     }
 
-    Command::Command(std::string at_command, std::optional<std::string> expected_respond) : AMessage(Type::COMMAND), at_command_(std::move(at_command)),
-                                                                                            expected_respond_(std::move(expected_respond)) {}
+    Command::Command(std::string at_command, std::optional<std::string> expected_respond, std::optional<std::string> modem)
+        : AMessage(Type::COMMAND, std::move(modem)), at_command_(std::move(at_command)),
+          expected_respond_(std::move(expected_respond)) {}
 
     std::string Command::to_string() const
     {
@@ -58,8 +69,8 @@ namespace Utils::Interface
         }
     }
 
-    Prompt::Prompt(std::string message) : AMessage(Type::PROMPT),
-                                          message_(std::move(message)) {}
+    Prompt::Prompt(std::string message, std::optional<std::string> modem) : AMessage(Type::PROMPT, std::move(modem)),
+                                                                            message_(std::move(message)) {}
 
                                           
     std::string Prompt::message() const 
@@ -72,6 +83,29 @@ namespace Utils::Interface
         return message_;
     }
 
+    Sms::Sms(std::string recipient, std::string text, std::optional<std::string> modem)
+        : AMessage(Type::SMS, std::move(modem)), recipient_(std::move(recipient)), text_(std::move(text)) {}
+
+    std::string Sms::message() const
+    {
+        return "SMS to " + recipient_;
+    }
+
+    const std::string &Sms::recipient() const
+    {
+        return recipient_;
+    }
+
+    const std::string &Sms::text() const
+    {
+        return text_;
+    }
+
+    std::string Sms::to_string() const
+    {
+        return recipient_ + ' ' + text_;
+    }
+
     std::shared_ptr<AMessage> parse(std::istream &is)
     {
         unsigned int type;
@@ -80,6 +114,15 @@ namespace Utils::Interface
         {
             throw Error::ParserError("fail to parse the message between client and service; got service type 0 (UNKNOWN)");
         }
+        std::optional<std::string> modem;
+        if (is.peek() == '@')
+        {
+            is.get();
+            std::string name;
+            is >> name;
+            is.get(); // the space after the name
+            modem = std::move(name);
+        }
 
         switch (static_cast<Type>(type))
         {
@@ -104,17 +147,30 @@ namespace Utils::Interface
                 }
                 std::cout << "Parse input stream to AT COMMAND: {" << content0 << ';' << content1
                           << '}' << std::endl;
-                return std::make_shared<Command>(content0, content1);
+                return std::make_shared<Command>(content0, content1, modem);
             }
             std::cout << "Parse input stream to AT COMMAND: {" << content0 << "} WITH NO expected respond"
                       << std::endl;
-            return std::make_shared<Command>(content0, std::nullopt);
+            return std::make_shared<Command>(content0, std::nullopt, modem);
         }
         case Type::PROMPT:
         {
             std::string content;
             std::getline(is, content);
-            return std::make_shared<Prompt>(content);
+            return std::make_shared<Prompt>(content, modem);
+        }
+        case Type::SMS:
+        {
+            std::string recipient;
+            is >> recipient;
+            is.get(); // the space after the number
+            std::string text;
+            std::getline(is, text);
+            if (recipient.empty())
+            {
+                throw Error::ParserError("fail to parse the message between client and service; an SMS without a recipient");
+            }
+            return std::make_shared<Sms>(recipient, text, modem);
         }
         default:
             throw Error::ParserError("fail to parse the message between client and service; got service type 0 (UNKNOWN)");